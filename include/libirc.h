@@ -5,11 +5,14 @@
 #include "libirc/connectivity.h"
 #include "libirc/constants.h"
 #include "libirc/conversion.h"
+#include "libirc/graph.h"
 #include "libirc/io.h"
 #include "libirc/irc.h"
 #include "libirc/linalg.h"
 #include "libirc/mathtools.h"
 #include "libirc/molecule.h"
+#include "libirc/neighbors.h"
+#include "libirc/periodic.h"
 #include "libirc/periodic_table.h"
 #include "libirc/transformation.h"
 #include "libirc/wilson.h"
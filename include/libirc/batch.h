@@ -0,0 +1,507 @@
+#ifndef IRC_BATCH_H
+#define IRC_BATCH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace irc {
+
+/// Batched kernels for primitive internal coordinates
+///
+/// The kernels compute the values and the Wilson gradients of \ref width
+/// primitive internal coordinates of the same type at once. The gradient
+/// kernels also return the values, which share most of the intermediate
+/// results; the value kernels compute the values only. Positions and
+/// gradients are stored as structures of arrays (one array per cartesian
+/// component, one element per primitive) and every kernel is a loop over the
+/// lanes without data-dependent branches. The compiler vectorizes these loops
+/// when SIMD instructions are enabled (e.g. with -mavx2 or -mavx512f; GCC also
+/// needs -fno-math-errno to vectorize square roots); otherwise they run as
+/// scalar code.
+///
+/// The gradients are computed from the cosines of the angles, without
+/// trigonometric functions.
+namespace batch {
+
+/// Number of primitives computed at once
+///
+/// Four lanes fill an AVX2 register and eight lanes an AVX-512 register. The
+/// width can be overridden by defining IRC_BATCH_WIDTH.
+#ifdef IRC_BATCH_WIDTH
+constexpr std::size_t width{IRC_BATCH_WIDTH};
+#elif defined(__AVX512F__)
+constexpr std::size_t width{8};
+#else
+constexpr std::size_t width{4};
+#endif
+
+/// One value per lane
+using Lanes = double[width];
+
+/// One point (or vector) per lane
+struct Points {
+  alignas(64) double x[width];
+  alignas(64) double y[width];
+  alignas(64) double z[width];
+
+  /// Set lane \param l to \param p
+  template<typename Vector3>
+  void set(std::size_t l, const Vector3& p) {
+    x[l] = p(0);
+    y[l] = p(1);
+    z[l] = p(2);
+  }
+
+  /// Point in lane \param l
+  template<typename Vector3>
+  Vector3 get(std::size_t l) const {
+    return {x[l], y[l], z[l]};
+  }
+};
+
+/// Number of primitives of the batch starting at \param start
+inline std::size_t batch_size(std::size_t start, std::size_t n_primitives) {
+  return std::min(width, n_primitives - start);
+}
+
+/// Bond lengths between \param p1 and \param p2
+inline void bond_values(const Points& p1, const Points& p2, Lanes& q) {
+  for (std::size_t l{0}; l < width; l++) {
+    const double dx{p1.x[l] - p2.x[l]};
+    const double dy{p1.y[l] - p2.y[l]};
+    const double dz{p1.z[l] - p2.z[l]};
+
+    q[l] = std::sqrt(dx * dx + dy * dy + dz * dz);
+  }
+}
+
+/// Cosines of the angles between \param p1, \param p2 and \param p3
+inline void
+angle_cosines(const Points& p1, const Points& p2, const Points& p3, Lanes& c) {
+  for (std::size_t l{0}; l < width; l++) {
+    const double r1x{p1.x[l] - p2.x[l]};
+    const double r1y{p1.y[l] - p2.y[l]};
+    const double r1z{p1.z[l] - p2.z[l]};
+
+    const double r2x{p3.x[l] - p2.x[l]};
+    const double r2y{p3.y[l] - p2.y[l]};
+    const double r2z{p3.z[l] - p2.z[l]};
+
+    const double N{std::sqrt(r1x * r1x + r1y * r1y + r1z * r1z) *
+                   std::sqrt(r2x * r2x + r2y * r2y + r2z * r2z)};
+
+    const double cos_angle{(r1x * r2x + r1y * r2y + r1z * r2z) / N};
+
+    c[l] = std::min(std::max(cos_angle, -1.), 1.);
+  }
+}
+
+/// Angles between \param p1, \param p2 and \param p3
+inline void angle_values(const Points& p1,
+                         const Points& p2,
+                         const Points& p3,
+                         Lanes& q) {
+  angle_cosines(p1, p2, p3, q);
+
+  for (std::size_t l{0}; l < width; l++) {
+    q[l] = std::acos(q[l]);
+  }
+}
+
+/// Dihedral angles between \param p1, \param p2, \param p3 and \param p4
+inline void dihedral_values(const Points& p1,
+                            const Points& p2,
+                            const Points& p3,
+                            const Points& p4,
+                            Lanes& q) {
+  for (std::size_t l{0}; l < width; l++) {
+    const double b1x{p1.x[l] - p2.x[l]};
+    const double b1y{p1.y[l] - p2.y[l]};
+    const double b1z{p1.z[l] - p2.z[l]};
+
+    const double b2x{p2.x[l] - p3.x[l]};
+    const double b2y{p2.y[l] - p3.y[l]};
+    const double b2z{p2.z[l] - p3.z[l]};
+
+    const double b3x{p3.x[l] - p4.x[l]};
+    const double b3y{p3.y[l] - p4.y[l]};
+    const double b3z{p3.z[l] - p4.z[l]};
+
+    // Normals to the planes (1,2,3) and (2,3,4)
+    double n1x{b1y * b2z - b1z * b2y};
+    double n1y{b1z * b2x - b1x * b2z};
+    double n1z{b1x * b2y - b1y * b2x};
+
+    double n2x{b2y * b3z - b2z * b3y};
+    double n2y{b2z * b3x - b2x * b3z};
+    double n2z{b2x * b3y - b2y * b3x};
+
+    const double in1{1. / std::sqrt(n1x * n1x + n1y * n1y + n1z * n1z)};
+    const double in2{1. / std::sqrt(n2x * n2x + n2y * n2y + n2z * n2z)};
+    n1x *= in1;
+    n1y *= in1;
+    n1z *= in1;
+    n2x *= in2;
+    n2y *= in2;
+    n2z *= in2;
+
+    const double ib2{1. / std::sqrt(b2x * b2x + b2y * b2y + b2z * b2z)};
+
+    const double mx{(n1y * b2z - n1z * b2y) * ib2};
+    const double my{(n1z * b2x - n1x * b2z) * ib2};
+    const double mz{(n1x * b2y - n1y * b2x) * ib2};
+
+    const double x{n1x * n2x + n1y * n2y + n1z * n2z};
+    const double y{mx * n2x + my * n2y + mz * n2z};
+
+    q[l] = std::atan2(y, x);
+  }
+}
+
+/// Sines of the out of plane angles of \param p1, \param p2 and \param p3
+/// around the central point \param pc
+///
+/// The sines are computed from the unit vectors from \param pc to the other
+/// points, which are stored in \param e1, \param e2 and \param e3.
+inline void out_of_plane_sines(const Points& pc,
+                               const Points& p1,
+                               const Points& p2,
+                               const Points& p3,
+                               Points& e1,
+                               Points& e2,
+                               Points& e3,
+                               Lanes& r1,
+                               Lanes& r2,
+                               Lanes& r3,
+                               Lanes& s) {
+  for (std::size_t l{0}; l < width; l++) {
+    double e1x{p1.x[l] - pc.x[l]};
+    double e1y{p1.y[l] - pc.y[l]};
+    double e1z{p1.z[l] - pc.z[l]};
+
+    double e2x{p2.x[l] - pc.x[l]};
+    double e2y{p2.y[l] - pc.y[l]};
+    double e2z{p2.z[l] - pc.z[l]};
+
+    double e3x{p3.x[l] - pc.x[l]};
+    double e3y{p3.y[l] - pc.y[l]};
+    double e3z{p3.z[l] - pc.z[l]};
+
+    r1[l] = std::sqrt(e1x * e1x + e1y * e1y + e1z * e1z);
+    r2[l] = std::sqrt(e2x * e2x + e2y * e2y + e2z * e2z);
+    r3[l] = std::sqrt(e3x * e3x + e3y * e3y + e3z * e3z);
+
+    e1x /= r1[l];
+    e1y /= r1[l];
+    e1z /= r1[l];
+    e2x /= r2[l];
+    e2y /= r2[l];
+    e2z /= r2[l];
+    e3x /= r3[l];
+    e3y /= r3[l];
+    e3z /= r3[l];
+
+    const double c1{
+        std::min(std::max(e2x * e3x + e2y * e3y + e2z * e3z, -1.), 1.)};
+    const double sin_a1{std::sqrt(1. - c1 * c1)};
+
+    // Unit normal to the plane (pc, p2, p3)
+    const double t1x{(e2y * e3z - e2z * e3y) / sin_a1};
+    const double t1y{(e2z * e3x - e2x * e3z) / sin_a1};
+    const double t1z{(e2x * e3y - e2y * e3x) / sin_a1};
+
+    s[l] = t1x * e1x + t1y * e1y + t1z * e1z;
+
+    e1.x[l] = e1x;
+    e1.y[l] = e1y;
+    e1.z[l] = e1z;
+    e2.x[l] = e2x;
+    e2.y[l] = e2y;
+    e2.z[l] = e2z;
+    e3.x[l] = e3x;
+    e3.y[l] = e3y;
+    e3.z[l] = e3z;
+  }
+}
+
+/// Out of plane angles of \param p1, \param p2 and \param p3 around the
+/// central point \param pc
+inline void out_of_plane_values(const Points& pc,
+                                const Points& p1,
+                                const Points& p2,
+                                const Points& p3,
+                                Lanes& q) {
+  Points e1, e2, e3;
+  Lanes r1, r2, r3;
+
+  out_of_plane_sines(pc, p1, p2, p3, e1, e2, e3, r1, r2, r3, q);
+
+  for (std::size_t l{0}; l < width; l++) {
+    q[l] = std::asin(q[l]);
+  }
+}
+
+/// Bond lengths \param q and gradients (see \function wilson::bond_gradient)
+inline void bond_gradients(const Points& p1,
+                           const Points& p2,
+                           Lanes& q,
+                           Points& g1,
+                           Points& g2) {
+  for (std::size_t l{0}; l < width; l++) {
+    const double dx{p1.x[l] - p2.x[l]};
+    const double dy{p1.y[l] - p2.y[l]};
+    const double dz{p1.z[l] - p2.z[l]};
+
+    q[l] = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+    const double id{1. / q[l]};
+
+    g1.x[l] = dx * id;
+    g1.y[l] = dy * id;
+    g1.z[l] = dz * id;
+
+    g2.x[l] = -g1.x[l];
+    g2.y[l] = -g1.y[l];
+    g2.z[l] = -g1.z[l];
+  }
+}
+
+/// Angles \param q and gradients (see \function wilson::angle_gradient)
+///
+/// \return Lanes (bit \f$l\f$ set for lane \f$l\f$) where the angle is linear
+/// within \param tolerance, whose gradients are not computed
+inline unsigned angle_gradients(const Points& p1,
+                                const Points& p2,
+                                const Points& p3,
+                                Lanes& q,
+                                Points& g1,
+                                Points& g2,
+                                Points& g3,
+                                double tolerance = 1e-6) {
+  Lanes c;
+
+  for (std::size_t l{0}; l < width; l++) {
+    double ux{p1.x[l] - p2.x[l]};
+    double uy{p1.y[l] - p2.y[l]};
+    double uz{p1.z[l] - p2.z[l]};
+
+    double vx{p3.x[l] - p2.x[l]};
+    double vy{p3.y[l] - p2.y[l]};
+    double vz{p3.z[l] - p2.z[l]};
+
+    const double bond21{std::sqrt(ux * ux + uy * uy + uz * uz)};
+    const double bond23{std::sqrt(vx * vx + vy * vy + vz * vz)};
+
+    ux /= bond21;
+    uy /= bond21;
+    uz /= bond21;
+    vx /= bond23;
+    vy /= bond23;
+    vz /= bond23;
+
+    c[l] = ux * vx + uy * vy + uz * vz;
+
+    // Unit normal to the plane of the angle
+    double wx{uy * vz - uz * vy};
+    double wy{uz * vx - ux * vz};
+    double wz{ux * vy - uy * vx};
+
+    const double iw{1. / std::sqrt(wx * wx + wy * wy + wz * wz)};
+    wx *= iw;
+    wy *= iw;
+    wz *= iw;
+
+    g1.x[l] = (uy * wz - uz * wy) / bond21;
+    g1.y[l] = (uz * wx - ux * wz) / bond21;
+    g1.z[l] = (ux * wy - uy * wx) / bond21;
+
+    g3.x[l] = (wy * vz - wz * vy) / bond23;
+    g3.y[l] = (wz * vx - wx * vz) / bond23;
+    g3.z[l] = (wx * vy - wy * vx) / bond23;
+
+    g2.x[l] = -g1.x[l] - g3.x[l];
+    g2.y[l] = -g1.y[l] - g3.y[l];
+    g2.z[l] = -g1.z[l] - g3.z[l];
+  }
+
+  // Angles within tolerance from pi
+  const double cos_linear{-std::cos(tolerance)};
+
+  unsigned linear{0};
+  for (std::size_t l{0}; l < width; l++) {
+    if (c[l] <= cos_linear) {
+      linear |= 1u << l;
+    }
+  }
+
+  for (std::size_t l{0}; l < width; l++) {
+    q[l] = std::acos(std::min(std::max(c[l], -1.), 1.));
+  }
+
+  return linear;
+}
+
+/// Dihedral angles \param q and gradients (see \function
+/// wilson::dihedral_gradient)
+inline void dihedral_gradients(const Points& p1,
+                               const Points& p2,
+                               const Points& p3,
+                               const Points& p4,
+                               Lanes& q,
+                               Points& g1,
+                               Points& g2,
+                               Points& g3,
+                               Points& g4) {
+  for (std::size_t l{0}; l < width; l++) {
+    double b12x{p2.x[l] - p1.x[l]};
+    double b12y{p2.y[l] - p1.y[l]};
+    double b12z{p2.z[l] - p1.z[l]};
+
+    double b23x{p3.x[l] - p2.x[l]};
+    double b23y{p3.y[l] - p2.y[l]};
+    double b23z{p3.z[l] - p2.z[l]};
+
+    double b34x{p4.x[l] - p3.x[l]};
+    double b34y{p4.y[l] - p3.y[l]};
+    double b34z{p4.z[l] - p3.z[l]};
+
+    const double bond12{std::sqrt(b12x * b12x + b12y * b12y + b12z * b12z)};
+    const double bond23{std::sqrt(b23x * b23x + b23y * b23y + b23z * b23z)};
+    const double bond34{std::sqrt(b34x * b34x + b34y * b34y + b34z * b34z)};
+
+    b12x /= bond12;
+    b12y /= bond12;
+    b12z /= bond12;
+    b23x /= bond23;
+    b23y /= bond23;
+    b23z /= bond23;
+    b34x /= bond34;
+    b34y /= bond34;
+    b34z /= bond34;
+
+    // Angles (1,2,3) and (2,3,4)
+    const double cos_angle123{std::min(
+        std::max(-(b12x * b23x + b12y * b23y + b12z * b23z), -1.), 1.)};
+    const double cos_angle234{std::min(
+        std::max(-(b23x * b34x + b23y * b34y + b23z * b34z), -1.), 1.)};
+    const double sin_angle123{std::sqrt(1. - cos_angle123 * cos_angle123)};
+    const double sin_angle234{std::sqrt(1. - cos_angle234 * cos_angle234)};
+
+    // b12 x b23 and b43 x b32 = b34 x b23
+    const double n1x{b12y * b23z - b12z * b23y};
+    const double n1y{b12z * b23x - b12x * b23z};
+    const double n1z{b12x * b23y - b12y * b23x};
+
+    const double n2x{b34y * b23z - b34z * b23y};
+    const double n2y{b34z * b23x - b34x * b23z};
+    const double n2z{b34x * b23y - b34y * b23x};
+
+    // Dihedral angle (see dihedral_values, where the normals are normalized
+    // and the second one is opposite)
+    const double mx{n1y * b23z - n1z * b23y};
+    const double my{n1z * b23x - n1x * b23z};
+    const double mz{n1x * b23y - n1y * b23x};
+
+    q[l] = std::atan2(mx * n2x + my * n2y + mz * n2z,
+                      -(n1x * n2x + n1y * n2y + n1z * n2z));
+
+    const double f1{-1. / (bond12 * sin_angle123 * sin_angle123)};
+    g1.x[l] = f1 * n1x;
+    g1.y[l] = f1 * n1y;
+    g1.z[l] = f1 * n1z;
+
+    const double f4{-1. / (bond34 * sin_angle234 * sin_angle234)};
+    g4.x[l] = f4 * n2x;
+    g4.y[l] = f4 * n2y;
+    g4.z[l] = f4 * n2z;
+
+    const double f21{(bond23 - bond12 * cos_angle123) /
+                     (bond12 * bond23 * sin_angle123 * sin_angle123)};
+    const double f22{cos_angle234 /
+                     (bond23 * sin_angle234 * sin_angle234)};
+    g2.x[l] = f21 * n1x + f22 * n2x;
+    g2.y[l] = f21 * n1y + f22 * n2y;
+    g2.z[l] = f21 * n1z + f22 * n2z;
+
+    const double f31{(bond23 - bond34 * cos_angle234) /
+                     (bond23 * bond34 * sin_angle234 * sin_angle234)};
+    const double f32{cos_angle123 /
+                     (bond23 * sin_angle123 * sin_angle123)};
+    g3.x[l] = f31 * n2x + f32 * n1x;
+    g3.y[l] = f31 * n2y + f32 * n1y;
+    g3.z[l] = f31 * n2z + f32 * n1z;
+  }
+}
+
+/// Out of plane angles \param q and gradients (see \function
+/// wilson::out_of_plane_gradient)
+inline void out_of_plane_gradients(const Points& pc,
+                                   const Points& p1,
+                                   const Points& p2,
+                                   const Points& p3,
+                                   Lanes& q,
+                                   Points& gc,
+                                   Points& g1,
+                                   Points& g2,
+                                   Points& g3) {
+  Points e1, e2, e3;
+  Lanes r1, r2, r3, s;
+
+  out_of_plane_sines(pc, p1, p2, p3, e1, e2, e3, r1, r2, r3, s);
+
+  for (std::size_t l{0}; l < width; l++) {
+    const double cos_a1{std::min(
+        std::max(e2.x[l] * e3.x[l] + e2.y[l] * e3.y[l] + e2.z[l] * e3.z[l],
+                 -1.),
+        1.)};
+    const double cos_a2{std::min(
+        std::max(e3.x[l] * e1.x[l] + e3.y[l] * e1.y[l] + e3.z[l] * e1.z[l],
+                 -1.),
+        1.)};
+    const double cos_a3{std::min(
+        std::max(e1.x[l] * e2.x[l] + e1.y[l] * e2.y[l] + e1.z[l] * e2.z[l],
+                 -1.),
+        1.)};
+    const double sin_a1{std::sqrt(1. - cos_a1 * cos_a1)};
+
+    const double t1x{(e2.y[l] * e3.z[l] - e2.z[l] * e3.y[l]) / sin_a1};
+    const double t1y{(e2.z[l] * e3.x[l] - e2.x[l] * e3.z[l]) / sin_a1};
+    const double t1z{(e2.x[l] * e3.y[l] - e2.y[l] * e3.x[l]) / sin_a1};
+
+    // Out of plane angle
+    const double cos_angle{std::sqrt(1. - s[l] * s[l])};
+    const double tan_angle{s[l] / cos_angle};
+
+    const double f1{1. / (r1[l] * cos_angle)};
+    const double h1{tan_angle / r1[l]};
+    g1.x[l] = f1 * t1x - h1 * e1.x[l];
+    g1.y[l] = f1 * t1y - h1 * e1.y[l];
+    g1.z[l] = f1 * t1z - h1 * e1.z[l];
+
+    const double denominator{cos_angle * sin_a1 * sin_a1};
+    const double f2{(cos_a1 * cos_a2 - cos_a3) / (r2[l] * denominator)};
+    g2.x[l] = f2 * t1x;
+    g2.y[l] = f2 * t1y;
+    g2.z[l] = f2 * t1z;
+
+    const double f3{(cos_a1 * cos_a3 - cos_a2) / (r3[l] * denominator)};
+    g3.x[l] = f3 * t1x;
+    g3.y[l] = f3 * t1y;
+    g3.z[l] = f3 * t1z;
+
+    gc.x[l] = -g1.x[l] - g2.x[l] - g3.x[l];
+    gc.y[l] = -g1.y[l] - g2.y[l] - g3.y[l];
+    gc.z[l] = -g1.z[l] - g2.z[l] - g3.z[l];
+  }
+
+  for (std::size_t l{0}; l < width; l++) {
+    q[l] = std::asin(s[l]);
+  }
+}
+
+} // namespace batch
+
+} // namespace irc
+
+#endif // IRC_BATCH_H
@@ -2,25 +2,31 @@
 #define IRC_CONNECTIVITY_H
 
 #include "libirc/atom.h"
+#include "libirc/batch.h"
 #include "libirc/constants.h"
+#include "libirc/graph.h"
 #include "libirc/linalg.h"
 #include "libirc/molecule.h"
+#include "libirc/neighbors.h"
+#include "libirc/parallel.h"
+#include "libirc/periodic.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <exception>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/connected_components.hpp>
-#include <boost/graph/dijkstra_shortest_paths.hpp>
-#include <boost/graph/exterior_property.hpp>
-#include <boost/graph/graph_traits.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/math/special_functions/round.hpp>
 
 namespace irc {
@@ -28,20 +34,8 @@ namespace irc {
 /// Connectivity
 namespace connectivity {
 
-using EdgeProperty = boost::property<boost::edge_weight_t, int>;
-
-using UGraph = boost::adjacency_list<boost::vecS,        //
-                                     boost::vecS,        //
-                                     boost::undirectedS, // Graph type
-                                     boost::no_property, // Vertex property
-                                     EdgeProperty        // Edge property
-                                     >;
-
-using Vertex = boost::graph_traits<UGraph>::vertex_descriptor;
-using Edge = boost::graph_traits<UGraph>::edge_descriptor;
-
-using DistanceProperty = boost::exterior_vertex_property<UGraph, int>;
-using DistanceMatrix = DistanceProperty::matrix_type;
+/// Molecular graph (atoms and bonds)
+using UGraph = graph::MolecularGraph;
 
 enum class Constraint { constrained, unconstrained };
 
@@ -247,6 +241,86 @@ public:
   bool operator!=(const OutOfPlaneBend& d) const { return !(*this == d); }
 };
 
+} // namespace connectivity
+
+} // namespace irc
+
+// Hash functions of the primitive internal coordinates
+//
+// Only the atom indices (and the tag of linear angles) are hashed, consistently
+// with the comparison operators: the constraint and the orthogonal direction
+// of linear angles are ignored.
+namespace std {
+
+template<>
+struct hash<irc::connectivity::Bond> {
+  std::size_t operator()(const irc::connectivity::Bond& b) const {
+    std::size_t seed{0};
+    boost::hash_combine(seed, b.i);
+    boost::hash_combine(seed, b.j);
+
+    return seed;
+  }
+};
+
+template<>
+struct hash<irc::connectivity::Angle> {
+  std::size_t operator()(const irc::connectivity::Angle& a) const {
+    std::size_t seed{0};
+    boost::hash_combine(seed, a.i);
+    boost::hash_combine(seed, a.j);
+    boost::hash_combine(seed, a.k);
+
+    return seed;
+  }
+};
+
+template<typename Vector3>
+struct hash<irc::connectivity::LinearAngle<Vector3>> {
+  std::size_t
+  operator()(const irc::connectivity::LinearAngle<Vector3>& a) const {
+    std::size_t seed{0};
+    boost::hash_combine(seed, a.i);
+    boost::hash_combine(seed, a.j);
+    boost::hash_combine(seed, a.k);
+    boost::hash_combine(seed, static_cast<int>(a.tag));
+
+    return seed;
+  }
+};
+
+template<>
+struct hash<irc::connectivity::Dihedral> {
+  std::size_t operator()(const irc::connectivity::Dihedral& d) const {
+    std::size_t seed{0};
+    boost::hash_combine(seed, d.i);
+    boost::hash_combine(seed, d.j);
+    boost::hash_combine(seed, d.k);
+    boost::hash_combine(seed, d.l);
+
+    return seed;
+  }
+};
+
+template<>
+struct hash<irc::connectivity::OutOfPlaneBend> {
+  std::size_t operator()(const irc::connectivity::OutOfPlaneBend& b) const {
+    std::size_t seed{0};
+    boost::hash_combine(seed, b.c);
+    boost::hash_combine(seed, b.i);
+    boost::hash_combine(seed, b.j);
+    boost::hash_combine(seed, b.k);
+
+    return seed;
+  }
+};
+
+} // namespace std
+
+namespace irc {
+
+namespace connectivity {
+
 /// Compute the distance between two points
 ///
 /// \tparam Vector3
@@ -264,6 +338,25 @@ inline double distance(const Vector3& v1, const Vector3& v2) {
   return linalg::norm(v1 - v2);
 }
 
+/// Compute the distance between atoms \param i and \param j
+///
+/// \tparam Vector3
+/// \param molecule Molecule
+/// \param i Atom index
+/// \param j Atom index
+/// \return Distance between atoms \param i and \param j
+///
+/// For periodic systems the distance between the closest images is returned.
+template<typename Vector3>
+inline double distance(const molecule::Molecule<Vector3>& molecule,
+                       std::size_t i,
+                       std::size_t j) {
+  const Vector3& p{molecule[i].position};
+
+  return distance(
+      p, periodic::closest_image(p, molecule[j].position, molecule.lattice));
+}
+
 /// Compute bond length
 ///
 /// \tparam Vector3
@@ -273,9 +366,13 @@ inline double distance(const Vector3& v1, const Vector3& v2) {
 /// \return Bond length
 ///
 /// Given a (linear) vector of cartesian atomic coordinates \param x_cartesian
-/// and a bond \param b, the corresponding bond length is computed.
+/// and a bond \param b, the corresponding bond length is computed. For
+/// periodic systems (\param lattice) the closest images are used.
 template<typename Vector3, typename Vector>
-inline double bond(const Bond& b, const Vector& x_cartesian) {
+inline double bond(
+    const Bond& b,
+    const Vector& x_cartesian,
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
   // Temporary positions
   const Vector3 b1{x_cartesian(3 * b.i + 0),
                    x_cartesian(3 * b.i + 1),
@@ -285,7 +382,7 @@ inline double bond(const Bond& b, const Vector& x_cartesian) {
                    x_cartesian(3 * b.j + 1),
                    x_cartesian(3 * b.j + 2)};
 
-  return distance(b1, b2);
+  return distance(b1, periodic::closest_image(b1, b2, lattice));
 }
 
 /// Compute bond length
@@ -296,10 +393,7 @@ inline double bond(const Bond& b, const Vector& x_cartesian) {
 /// \return Bond length
 template<typename Vector3>
 inline double bond(const Bond& b, const molecule::Molecule<Vector3>& molecule) {
-  const Vector3 b1{molecule[b.i].position};
-  const Vector3 b2{molecule[b.j].position};
-
-  return distance(b1, b2);
+  return distance(molecule, b.i, b.j);
 }
 
 /// Compute angle formed by three points
@@ -346,7 +440,10 @@ inline double angle(const Vector3& v1, const Vector3& v2, const Vector3& v3) {
 /// Given a (linear) vector of cartesian atomic coordinates \param x_cartesian
 /// and a bond \param b, the corresponding bond length is computed.
 template<typename Vector3, typename Vector>
-inline double angle(const Angle& a, const Vector& x_cartesian) {
+inline double angle(
+    const Angle& a,
+    const Vector& x_cartesian,
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
   // Temporary positions
   const Vector3 a1{x_cartesian(3 * a.i + 0),
                    x_cartesian(3 * a.i + 1),
@@ -360,11 +457,16 @@ inline double angle(const Angle& a, const Vector& x_cartesian) {
                    x_cartesian(3 * a.k + 1),
                    x_cartesian(3 * a.k + 2)};
 
-  return angle(a1, a2, a3);
+  return angle(periodic::closest_image(a2, a1, lattice),
+               a2,
+               periodic::closest_image(a2, a3, lattice));
 }
 
 template<typename Vector3, typename Vector>
-inline double angle(const LinearAngle<Vector3>& a, const Vector& x_cartesian) {
+inline double angle(
+    const LinearAngle<Vector3>& a,
+    const Vector& x_cartesian,
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
 
   // Temporary positions
   const Vector3 a1{x_cartesian(3 * a.i + 0),
@@ -381,7 +483,8 @@ inline double angle(const LinearAngle<Vector3>& a, const Vector& x_cartesian) {
 
   const Vector3 aOrth = a2 + a.orthogonal_direction;
 
-  return angle(a1, a2, aOrth) + angle(aOrth, a2, a3);
+  return angle(periodic::closest_image(a2, a1, lattice), a2, aOrth) +
+         angle(aOrth, a2, periodic::closest_image(a2, a3, lattice));
 }
 
 /// Compute angle
@@ -393,18 +496,22 @@ inline double angle(const LinearAngle<Vector3>& a, const Vector& x_cartesian) {
 template<typename Vector3>
 inline double angle(const Angle& a,
                     const molecule::Molecule<Vector3>& molecule) {
-  const Vector3 a1{molecule[a.i].position};
   const Vector3 a2{molecule[a.j].position};
-  const Vector3 a3{molecule[a.k].position};
+  const Vector3 a1{
+      periodic::closest_image(a2, molecule[a.i].position, molecule.lattice)};
+  const Vector3 a3{
+      periodic::closest_image(a2, molecule[a.k].position, molecule.lattice)};
 
   return angle(a1, a2, a3);
 }
 template<typename Vector3>
 inline double angle(const LinearAngle<Vector3>& a,
                     const molecule::Molecule<Vector3>& molecule) {
-  const Vector3 a1{molecule[a.i].position};
   const Vector3 a2{molecule[a.j].position};
-  const Vector3 a3{molecule[a.k].position};
+  const Vector3 a1{
+      periodic::closest_image(a2, molecule[a.i].position, molecule.lattice)};
+  const Vector3 a3{
+      periodic::closest_image(a2, molecule[a.k].position, molecule.lattice)};
 
   return angle(a1, a2, a3);
 }
@@ -454,7 +561,10 @@ inline double dihedral(const Vector3& v1,
 /// Given a (linear) vector of cartesian atomic coordinates \param x_cartesian
 /// and a bond \param b, the corresponding bond length is computed.
 template<typename Vector3, typename Vector>
-inline double dihedral(const Dihedral& d, const Vector& x_cartesian) {
+inline double dihedral(
+    const Dihedral& d,
+    const Vector& x_cartesian,
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
   // Temporary positions
   const Vector3 d1{x_cartesian(3 * d.i + 0),
                    x_cartesian(3 * d.i + 1),
@@ -472,7 +582,13 @@ inline double dihedral(const Dihedral& d, const Vector& x_cartesian) {
                    x_cartesian(3 * d.l + 1),
                    x_cartesian(3 * d.l + 2)};
 
-  return dihedral(d1, d2, d3, d4);
+  // Closest images along the chain of bonds
+  const Vector3 d3i{periodic::closest_image(d2, d3, lattice)};
+
+  return dihedral(periodic::closest_image(d2, d1, lattice),
+                  d2,
+                  d3i,
+                  periodic::closest_image(d3i, d4, lattice));
 }
 
 /// Compute dihedral angle \param d, given a molecule
@@ -484,10 +600,14 @@ inline double dihedral(const Dihedral& d, const Vector& x_cartesian) {
 template<typename Vector3>
 inline double dihedral(const Dihedral& d,
                        const molecule::Molecule<Vector3>& molecule) {
-  const Vector3 d1{molecule[d.i].position};
+  // Closest images along the chain of bonds
   const Vector3 d2{molecule[d.j].position};
-  const Vector3 d3{molecule[d.k].position};
-  const Vector3 d4{molecule[d.l].position};
+  const Vector3 d1{
+      periodic::closest_image(d2, molecule[d.i].position, molecule.lattice)};
+  const Vector3 d3{
+      periodic::closest_image(d2, molecule[d.k].position, molecule.lattice)};
+  const Vector3 d4{
+      periodic::closest_image(d3, molecule[d.l].position, molecule.lattice)};
 
   return dihedral(d1, d2, d3, d4);
 }
@@ -517,7 +637,10 @@ double out_of_plane_angle(const Vector3& vc,
 /// Given a (linear) vector of cartesian atomic coordinates \param x_cartesian
 /// and a bond \param b, the corresponding bond length is computed.
 template<typename Vector3, typename Vector>
-double out_of_plane_angle(const OutOfPlaneBend& d, const Vector& x_cartesian) {
+double out_of_plane_angle(
+    const OutOfPlaneBend& d,
+    const Vector& x_cartesian,
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
   // Temporary positions
   const Vector3 dc{x_cartesian(3 * d.c + 0),
                    x_cartesian(3 * d.c + 1),
@@ -535,7 +658,10 @@ double out_of_plane_angle(const OutOfPlaneBend& d, const Vector& x_cartesian) {
                    x_cartesian(3 * d.k + 1),
                    x_cartesian(3 * d.k + 2)};
 
-  return out_of_plane_angle(dc, d1, d2, d3);
+  return out_of_plane_angle(dc,
+                            periodic::closest_image(dc, d1, lattice),
+                            periodic::closest_image(dc, d2, lattice),
+                            periodic::closest_image(dc, d3, lattice));
 }
 
 /// Compute dihedral angle \param d, given a molecule
@@ -544,9 +670,12 @@ double out_of_plane_angle(const OutOfPlaneBend& d,
                           const molecule::Molecule<Vector3>& molecule) {
 
   const Vector3 dc{molecule[d.c].position};
-  const Vector3 d1{molecule[d.i].position};
-  const Vector3 d2{molecule[d.j].position};
-  const Vector3 d3{molecule[d.k].position};
+  const Vector3 d1{
+      periodic::closest_image(dc, molecule[d.i].position, molecule.lattice)};
+  const Vector3 d2{
+      periodic::closest_image(dc, molecule[d.j].position, molecule.lattice)};
+  const Vector3 d3{
+      periodic::closest_image(dc, molecule[d.k].position, molecule.lattice)};
 
   return out_of_plane_angle(dc, d1, d2, d3);
 }
@@ -574,7 +703,7 @@ Matrix distances(const molecule::Molecule<Vector3>& molecule) {
   for (std::size_t j{0}; j < n_atoms; j++) {
     for (std::size_t i{0}; i < j; i++) {
 
-      r = distance(molecule[i].position, molecule[j].position);
+      r = distance(molecule, i, j);
 
       distances_m(i, j) = r;
       distances_m(j, i) = r;
@@ -629,26 +758,21 @@ min_interfragment_distance(std::size_t i,
   return std::make_tuple(k_min, l_min, min_distance);
 }
 
-// TODO: Test
 /*! Identify fragments (connected components)
  *
  * The function returns the number of fragments and a vector containing
  * the index of the fragment each atom belongs to.
  *
+ * The fragments are tracked by \p ug as bonds are added, therefore the graph
+ * is not traversed.
+ *
  * @param ug Unsigned graph
  * @return Number of fragments and fragments indices
  */
 inline std::pair<std::size_t, std::vector<std::size_t>>
 identify_fragments(const UGraph& ug) {
-  // Fragment indices
-  std::vector<std::size_t> fragments(boost::num_vertices(ug));
-
-  // Fill component std::vector and return number of different fragments
-  // If num_fragments == 1 the graph is connected
-  const std::size_t num_fragments{
-      boost::connected_components(ug, &fragments[0])};
-
-  return {num_fragments, fragments};
+  // If the number of fragments is 1 the graph is connected
+  return {ug.n_fragments(), ug.fragment_labels()};
 }
 
 /*! Search for regular bonds (covalent bonds)
@@ -669,6 +793,8 @@ void add_regular_bonds(UGraph& ug,
 
   double sum_covalent_radii{0.};
 
+  std::vector<std::pair<std::size_t, std::size_t>> bonds;
+
   for (std::size_t j{0}; j < n_atoms; j++) {
     for (std::size_t i{j + 1}; i < n_atoms; i++) {
       d = distances(i, j);
@@ -678,29 +804,148 @@ void add_regular_bonds(UGraph& ug,
 
       // Determine if atoms i and j are bonded
       if (d < tools::constants::covalent_bond_multiplier * sum_covalent_radii) {
-        // Add edge to boost::adjacency_list between vertices i and j
-        // The weights are set to 1 for all edges.
-        boost::add_edge(i, j, 1, ug);
+        bonds.emplace_back(i, j);
       }
     }
   }
+
+  ug.add_edges(bonds);
 }
 
-// TODO: Improve algorithm
-// TODO: Test
-/*! Recursive search of interfragment bonds
+/*! Search for regular bonds (covalent bonds) using a cell list
  *
- * At each iteration of the recursive search the interfragment bonds (and
- * auxiliary interfragment bonds) are added between closest fragments.
+ * The cell edge is given by the largest covalent radius in \p molecule, so
+ * that only pairs of atoms in the same or in adjacent cells are candidates
+ * for a covalent bond. The interatomic distances are computed only for such
+ * candidate pairs.
  *
- * @tparam Matrix
+ * @tparam Vector3
  * @param ug Adjacency matrix
- * @param distances Distance matrix
+ * @param molecule Molecule
  */
-template<typename Matrix>
-void add_interfragment_bonds(UGraph& ug, const Matrix& distances) {
+template<typename Vector3>
+void add_regular_bonds(UGraph& ug,
+                       const molecule::Molecule<Vector3>& molecule) {
+  double max_covalent_radius{0.};
+  for (const auto& atom : molecule) {
+    max_covalent_radius = std::max(max_covalent_radius,
+                                   atom::covalent_radius(atom.atomic_number));
+  }
+
+  const neighbors::CellList<Vector3> cells(
+      molecule,
+      tools::constants::covalent_bond_multiplier * 2. * max_covalent_radius);
+
+  std::vector<std::pair<std::size_t, std::size_t>> bonds;
+
+  cells.for_each_pair([&bonds, &molecule](std::size_t i, std::size_t j) {
+    const double d{distance(molecule, i, j)};
+
+    const double sum_covalent_radii{
+        atom::covalent_radius(molecule[i].atomic_number) +
+        atom::covalent_radius(molecule[j].atomic_number)};
+
+    // Determine if atoms i and j are bonded
+    if (d < tools::constants::covalent_bond_multiplier * sum_covalent_radii) {
+      bonds.emplace_back(i, j);
+    }
+  });
+
+  ug.add_edges(bonds);
+}
+
+/*! Search for regular bonds (covalent bonds) within a neighbour list
+ *
+ * @tparam Vector3
+ * @param ug Adjacency matrix
+ * @param neighbors Interatomic distances within a cutoff
+ * @param molecule Molecule
+ *
+ * The cutoff of \p neighbors must be larger than the covalent bond threshold
+ * (see \function bonding_cutoff).
+ */
+template<typename Vector3>
+void add_regular_bonds(UGraph& ug,
+                       const neighbors::NeighborList& neighbors,
+                       const molecule::Molecule<Vector3>& molecule) {
+  const std::size_t n_atoms{molecule.size()};
+
+  double sum_covalent_radii{0.};
+
+  std::vector<std::pair<std::size_t, std::size_t>> bonds;
+
+  for (std::size_t i{0}; i < n_atoms; i++) {
+    for (const auto& n : neighbors.neighbors(i)) {
+      const std::size_t j{n.index};
+
+      if (j <= i) {
+        continue;
+      }
+
+      sum_covalent_radii = atom::covalent_radius(molecule[i].atomic_number) +
+                           atom::covalent_radius(molecule[j].atomic_number);
+
+      // Determine if atoms i and j are bonded
+      if (n.distance <
+          tools::constants::covalent_bond_multiplier * sum_covalent_radii) {
+        bonds.emplace_back(i, j);
+      }
+    }
+  }
+
+  ug.add_edges(bonds);
+}
+
+/// Closest pair of atoms between two fragments
+struct InterfragmentDistance {
+  /// Interatomic distance
+  double d;
+
+  /// Atom of the fragment with the lower index
+  std::size_t i;
+
+  /// Atom of the fragment with the higher index
+  std::size_t j;
+
+  /// Order by distance, then by atom indices
+  bool operator<(const InterfragmentDistance& other) const {
+    return std::tie(d, i, j) < std::tie(other.d, other.i, other.j);
+  }
+};
+
+/// Closest pairs of atoms, for pairs of fragments (lower index first)
+using InterfragmentDistances =
+    std::map<std::pair<std::size_t, std::size_t>, InterfragmentDistance>;
+
+/*! Bond every fragment to its closest fragment, until the graph is connected
+ *
+ * At every round each fragment is bonded to its closest fragment, together
+ * with the auxiliary interfragment bonds between the two. This is Boruvka's
+ * minimum spanning tree algorithm on the graph of fragments: the number of
+ * fragments is at least halved at every round. Fragments are merged with a
+ * copy of the disjoint sets of \p ug and labelled in order of their first
+ * atom (as \function identify_fragments).
+ *
+ * @tparam Closest Callable with signature InterfragmentDistances(
+ * const std::vector<std::size_t>& fragments,
+ * const std::vector<std::vector<std::size_t>>& members)
+ * @tparam Auxiliary Callable with signature void(std::size_t j,
+ * std::size_t i, double threshold, const std::vector<std::size_t>& fragments,
+ * const std::vector<std::vector<std::size_t>>& members)
+ * @param ug Adjacency matrix
+ * @param closest Closest pairs of atoms between fragments
+ * @param auxiliary Add auxiliary bonds between fragments j and i
+ *
+ * The fragments are tracked with the copied disjoint sets only, so that the
+ * bonds can be added to \p ug in a single batch at the end (\p auxiliary
+ * should collect its bonds as well).
+ * The pairs returned by \p closest must include, for every fragment, the
+ * pairs with its closest fragments; other pairs can be omitted.
+ */
+template<typename Closest, typename Auxiliary>
+void connect_fragments(UGraph& ug, Closest&& closest, Auxiliary&& auxiliary) {
 
-  const size_t n_atoms{boost::num_vertices(ug)};
+  const size_t n_atoms{ug.n_vertices()};
 
   std::size_t num_fragments;
   std::vector<std::size_t> fragments;
@@ -708,265 +953,970 @@ void add_interfragment_bonds(UGraph& ug, const Matrix& distances) {
   // Get number of fragments and fragment indices
   std::tie(num_fragments, fragments) = identify_fragments(ug);
 
+  // Union-find structure of the atoms, initialised with the fragments
+  graph::DisjointSets sets{ug.fragments()};
+
+  // Shortest interfragment bonds
+  std::vector<std::pair<std::size_t, std::size_t>> bonds;
+
   while (num_fragments > 1) {
 
-    struct InterfragmentDistance {
-      double d;
-      size_t i;
-      size_t j;
-    };
+    // Atoms belonging to each fragment
+    std::vector<std::vector<std::size_t>> members(num_fragments);
+    for (std::size_t k{0}; k < n_atoms; k++) {
+      members[fragments[k]].push_back(k);
+    }
 
     // Minimum interfragment distances
-    // Matrix
-    // min_dist_fragments{linalg::zeros<Matrix>(num_fragments,num_fragments)};
-    std::vector<std::vector<InterfragmentDistance>> min_dist_fragments(
-        num_fragments, std::vector<InterfragmentDistance>(num_fragments));
-
-    // Determine minimal interfragment distances
-    std::size_t i_min{0}, j_min{0};
-    double min_d{0};
-    for (std::size_t j{0}; j < num_fragments; j++) {
-      for (std::size_t i{0}; i < j; i++) {
-        std::tie(i_min, j_min, min_d) =
-            min_interfragment_distance<Matrix>(i, j, fragments, distances);
-
-        min_dist_fragments[i][j] = {min_d, i_min, j_min};
-        min_dist_fragments[j][i] = {min_d, i_min, j_min};
-      }
+    const InterfragmentDistances min_dist_fragments{
+        closest(fragments, members)};
+
+    // Closest fragment of every fragment (lowest index for equal distances)
+    std::vector<std::pair<double, std::size_t>> nearest(
+        num_fragments, {std::numeric_limits<double>::max(), 0});
+    for (const auto& p : min_dist_fragments) {
+      const std::size_t i{p.first.first}, j{p.first.second};
+      const double d{p.second.d};
+
+      nearest[i] = std::min(nearest[i], std::make_pair(d, j));
+      nearest[j] = std::min(nearest[j], std::make_pair(d, i));
     }
 
     // Add interfragment distances between closest fragments
-    double d{0.};
     for (std::size_t j{0}; j < num_fragments; j++) {
-      size_t i_min_fragment{0};
-      double d_min{std::numeric_limits<double>::max()};
-      for (std::size_t i{0}; i < num_fragments; i++) {
-        d = min_dist_fragments[i][j].d;
-        if (d < d_min && i != j) {
-          i_min_fragment = i;
-          i_min = min_dist_fragments[i][j].i;
-          j_min = min_dist_fragments[i][j].j;
-          d_min = d;
-        }
-      }
+      const std::size_t i_min_fragment{nearest[j].second};
+
+      const InterfragmentDistance& ifd{min_dist_fragments.at(
+          {std::min(i_min_fragment, j), std::max(i_min_fragment, j)})};
 
       // Add shortest interfragment bond
-      boost::add_edge(i_min, j_min, 1, ug);
+      bonds.emplace_back(ifd.i, ifd.j);
+      sets.unite(ifd.i, ifd.j);
 
       // Add auxiliary interfragment distances
-      double d{0};
-      for (std::size_t k{0}; k < n_atoms; k++) {
-        for (std::size_t l{0}; l < n_atoms; l++) {
-          if (k != l and fragments[k] == i_min_fragment and fragments[l] == j) {
-            d = distances(l, k);
-
-            // TODO: Check
-            if (d < std::min(
-                        min_d * tools::constants::interfragment_bond_multiplier,
-                        2. * tools::conversion::angstrom_to_bohr)) {
-              boost::add_edge(l, k, 1, ug);
-            }
-          }
-        }
-      }
+      const double threshold{
+          std::min(ifd.d * tools::constants::interfragment_bond_multiplier,
+                   2. * tools::conversion::angstrom_to_bohr)};
+      auxiliary(j, i_min_fragment, threshold, fragments, members);
     }
 
-    // Recursive search of fragments
-    // add_interfragment_bonds(ug, distances);
-    // Get number of fragments and fragment indices
-    std::tie(num_fragments, fragments) = identify_fragments(ug);
+    // Update number of fragments and fragment indices
+    num_fragments = sets.n_sets();
+    fragments = sets.labels();
   }
 
-  return;
+  ug.add_edges(bonds);
 }
 
-// TODO: Better strategy to look for H-bonds (regular bonds are known)
-/*! Search for hydrogen bonds
+/*! Recursive search of interfragment bonds
+ *
+ * At each iteration of the recursive search the interfragment bonds (and
+ * auxiliary interfragment bonds) are added between closest fragments.
  *
- * @tparam Vector3
  * @tparam Matrix
  * @param ug Adjacency matrix
  * @param distances Distance matrix
- * @param molecule Molecule
  */
-template<typename Vector3, typename Matrix>
-void add_hydrogen_bonds(UGraph& ug,
-                        const Matrix& distances,
-                        const molecule::Molecule<Vector3>& molecule) {
-
-  const std::size_t n_atoms{molecule.size()};
-
-  double d{0.};
+template<typename Matrix>
+void add_interfragment_bonds(UGraph& ug, const Matrix& distances) {
 
-  double sum_covalent_radii{0.};
-  double sum_vdw_radii{0.};
-  for (std::size_t j{0}; j < n_atoms; j++) {
-    for (std::size_t i{j + 1}; i < n_atoms; i++) {
+  const size_t n_atoms{ug.n_vertices()};
 
-      d = distances(i, j);
+  // Minimal distances between all pairs of fragments, in a single pass over
+  // all pairs of atoms
+  auto closest = [&distances, n_atoms](
+                     const std::vector<std::size_t>& fragments,
+                     const std::vector<std::vector<std::size_t>>& members) {
+    const std::size_t num_fragments{members.size()};
+    const double max{std::numeric_limits<double>::max()};
 
-      sum_covalent_radii = atom::covalent_radius(molecule[i].atomic_number) +
-                           atom::covalent_radius(molecule[j].atomic_number);
+    std::vector<std::vector<InterfragmentDistance>> min_dist(
+        num_fragments,
+        std::vector<InterfragmentDistance>(num_fragments, {max, 0, 0}));
 
-      // Determine if atoms i and j are bonded
-      if (d < tools::constants::covalent_bond_multiplier * sum_covalent_radii) {
+    for (std::size_t k{0}; k < n_atoms; k++) {
+      for (std::size_t l{0}; l < n_atoms; l++) {
+        const std::size_t fk{fragments[k]};
+        const std::size_t fl{fragments[l]};
 
-        // TODO: Better ways of doing this?
-        // Search for H-bonds: XH...Y
-        if ((atom::is_NOFPSCl(molecule[i].atomic_number) and
-             atom::is_H(molecule[j].atomic_number)) or
-            (atom::is_NOFPSCl(molecule[j].atomic_number) and
-             atom::is_H(molecule[i].atomic_number))) { // Possible H-bond
-          // On atom is H, while the other is either N, O, F, P, S or Cl
-
-          std::size_t idx{0};   // X atom index
-          std::size_t h_idx{0}; // Hydrogen bond index
-
-          double a{0}; // Angle between X, H and Y in XH...Y
-
-          // Assign correct indices to X and H
-          if (atom::is_H(molecule[j].atomic_number)) {
-            idx = i;
-            h_idx = j;
-          } else {
-            idx = j;
-            h_idx = i;
+        if (fk < fl) {
+          const InterfragmentDistance ifd{distances(l, k), k, l};
+          if (ifd < min_dist[fk][fl]) {
+            min_dist[fk][fl] = ifd;
           }
+        }
+      }
+    }
 
-          // Loop over all other atoms, excluding i and j, to find Y
-          for (std::size_t k{0}; k < n_atoms; k++) {
-            if (atom::is_NOFPSCl(molecule[k].atomic_number) and k != idx and
-                k != h_idx) {
-
-              d = distances(h_idx, k);
+    InterfragmentDistances min_dist_fragments;
+    for (std::size_t j{0}; j < num_fragments; j++) {
+      for (std::size_t i{0}; i < j; i++) {
+        min_dist_fragments[{i, j}] = min_dist[i][j];
+      }
+    }
 
-              sum_vdw_radii = atom::vdw_radius(molecule[h_idx].atomic_number) +
-                              atom::vdw_radius(molecule[k].atomic_number);
+    return min_dist_fragments;
+  };
+
+  // Auxiliary interfragment bonds from all pairs of atoms
+  std::vector<std::pair<std::size_t, std::size_t>> auxiliary_bonds;
+  auto auxiliary = [&auxiliary_bonds, &distances](
+                       std::size_t j,
+                       std::size_t i,
+                       double threshold,
+                       const std::vector<std::size_t>&,
+                       const std::vector<std::vector<std::size_t>>& members) {
+    for (const auto k : members[i]) {
+      for (const auto l : members[j]) {
+        // TODO: Check
+        if (distances(l, k) < threshold) {
+          auxiliary_bonds.emplace_back(l, k);
+        }
+      }
+    }
+  };
 
-              sum_covalent_radii =
-                  atom::covalent_radius(molecule[h_idx].atomic_number) +
-                  atom::covalent_radius(molecule[k].atomic_number);
+  connect_fragments(ug, closest, auxiliary);
 
-              a = angle(molecule[idx].position,
-                        molecule[h_idx].position,
-                        molecule[k].position);
+  ug.add_edges(auxiliary_bonds);
+}
 
-              // Check H-bond properties
-              if (d > sum_covalent_radii and
-                  d < sum_vdw_radii * tools::constants::vdw_bond_multiplier and
-                  a > tools::constants::pi / 2.) {
-                // Add hydrogen bond
-                boost::add_edge(h_idx, k, 1, ug);
-              }
-            }
+/*! Recursive search of interfragment bonds within a neighbour list
+ *
+ * The minimal distance between two fragments is obtained from \p neighbors
+ * when the fragments are within the cutoff. For fragments without any atom
+ * within the cutoff of another fragment, the closest fragment is searched
+ * with cell lists of increasing size. Auxiliary interfragment bonds are
+ * shorter than the cutoff and are therefore always found in \p neighbors.
+ *
+ * @tparam Vector3
+ * @param ug Adjacency matrix
+ * @param neighbors Interatomic distances within a cutoff
+ * @param molecule Molecule
+ */
+template<typename Vector3>
+void add_interfragment_bonds(UGraph& ug,
+                             const neighbors::NeighborList& neighbors,
+                             const molecule::Molecule<Vector3>& molecule) {
+
+  const size_t n_atoms{ug.n_vertices()};
+
+  // Minimal interfragment distances for neighbouring fragments
+  auto closest = [&neighbors, &molecule, n_atoms](
+                     const std::vector<std::size_t>& fragments,
+                     const std::vector<std::vector<std::size_t>>& members) {
+    const std::size_t num_fragments{members.size()};
+
+    InterfragmentDistances min_dist_fragments;
+
+    // Minimal interfragment distances within the cutoff
+    std::vector<bool> isolated(num_fragments, true);
+    for (std::size_t k{0}; k < n_atoms; k++) {
+      for (const auto& n : neighbors.neighbors(k)) {
+        const std::size_t l{n.index};
+        const std::size_t fk{fragments[k]};
+        const std::size_t fl{fragments[l]};
+
+        if (fk < fl) {
+          const InterfragmentDistance ifd{n.distance, k, l};
+
+          auto it = min_dist_fragments.find({fk, fl});
+          if (it == min_dist_fragments.end()) {
+            min_dist_fragments.insert({{fk, fl}, ifd});
+          } else if (ifd < it->second) {
+            it->second = ifd;
           }
+
+          isolated[fk] = false;
+          isolated[fl] = false;
         }
       }
     }
-  } // End search for hydrogen bonds
-}
 
-/// Compute adjacency matrix for \param molecule
-///
-/// \tparam Vector3 3D vector
-/// \tparam Matrix Matrix
-/// \param distance_m Distance matrix for \param molecule
-/// \param molecule Molecule
-/// \return Adjacency matrix
-///
-/// The adjacency matrix is represented here by a boost::adjacency_list object
-/// as implemented in the Boost Graph Library (BGL).
-/// The number of vertices corresponds to the number of atoms, while the
-/// number of edges is determined by bonding.
-template<typename Vector3, typename Matrix>
-UGraph adjacency_matrix(const Matrix& distances,
-                        const molecule::Molecule<Vector3>& molecule) {
-  const std::size_t n_atoms{molecule.size()};
+    // Closest fragment beyond the cutoff, for fragments without neighbouring
+    // fragments: distance, closest fragment and pair of atoms
+    using Closest = std::tuple<double, std::size_t, std::size_t, std::size_t>;
+    std::vector<Closest> closest_beyond(
+        num_fragments,
+        Closest{std::numeric_limits<double>::infinity(), 0, 0, 0});
+
+    // Search pairs of atoms within increasing distances from isolated
+    // fragments; all pairs within the search radius are visited
+    double radius{std::max(neighbors.cutoff(), 1.)};
+    while (std::find(isolated.begin(), isolated.end(), true) !=
+           isolated.end()) {
+      radius *= 2.;
+
+      const neighbors::CellList<Vector3> cells(molecule, radius);
+      cells.for_each_pair([&](std::size_t k, std::size_t l) {
+        const std::size_t fk{fragments[k]};
+        const std::size_t fl{fragments[l]};
+
+        if (fk == fl or (not isolated[fk] and not isolated[fl])) {
+          return;
+        }
 
-  // Define a undirected graph with n_atoms vertices
-  UGraph ug(n_atoms);
+        const double d{distance(molecule, k, l)};
+        if (d >= radius) {
+          return;
+        }
 
-  add_regular_bonds(ug, distances, molecule);
+        // Atom of the fragment with the lower index first
+        const std::size_t a{fk < fl ? k : l};
+        const std::size_t b{fk < fl ? l : k};
 
-  add_interfragment_bonds(ug, distances);
+        if (isolated[fk]) {
+          closest_beyond[fk] =
+              std::min(closest_beyond[fk], Closest{d, fl, a, b});
+        }
+        if (isolated[fl]) {
+          closest_beyond[fl] =
+              std::min(closest_beyond[fl], Closest{d, fk, a, b});
+        }
+      });
 
-  add_hydrogen_bonds(ug, distances, molecule);
+      for (std::size_t j{0}; j < num_fragments; j++) {
+        if (isolated[j] and std::get<0>(closest_beyond[j]) < radius) {
+          const std::size_t i{std::get<1>(closest_beyond[j])};
 
-  // TODO: Extra redundant coordinates.
+          min_dist_fragments.insert({{std::min(i, j), std::max(i, j)},
+                                     {std::get<0>(closest_beyond[j]),
+                                      std::get<2>(closest_beyond[j]),
+                                      std::get<3>(closest_beyond[j])}});
 
-  return ug;
+          isolated[j] = false;
+        }
+      }
+    }
+
+    return min_dist_fragments;
+  };
+
+  // Auxiliary interfragment bonds from the neighbour list
+  std::vector<std::pair<std::size_t, std::size_t>> auxiliary_bonds;
+  auto auxiliary = [&auxiliary_bonds, &neighbors](
+                       std::size_t j,
+                       std::size_t i,
+                       double threshold,
+                       const std::vector<std::size_t>& fragments,
+                       const std::vector<std::vector<std::size_t>>& members) {
+    for (const auto l : members[j]) {
+      for (const auto& n : neighbors.neighbors(l)) {
+        if (fragments[n.index] == i and n.distance < threshold) {
+          auxiliary_bonds.emplace_back(l, n.index);
+        }
+      }
+    }
+  };
+
+  connect_fragments(ug, closest, auxiliary);
+
+  ug.add_edges(auxiliary_bonds);
 }
 
-/// Find the distance and predecessors matrices of the graph \param ug
-/// \tparam Matrix
-/// \param ug Graph
-/// \return Distance matrix
-///
-/// The element \f$(i,j)\f$ of the distance matrix is an integer indicating
-/// how many bonds (along the shortest path) are between atom \f$i\f$ and atom
-/// \f$j\f$, since the weight of each edge is set to 1 in \function
-/// adjacency_matrix. This allow to easily determine if two atoms are connected
-/// via one bond, two bonds (they form an angle) or three bonds (they form a
-/// dihedral).
-template<typename Matrix>
-Matrix distance_matrix(const UGraph& ug) {
+/// Donor of a hydrogen bond XH...Y
+struct HydrogenBondDonor {
+  /// Index of the atom X (N, O, F, P, S or Cl)
+  std::size_t x;
 
-  using namespace boost;
+  /// Index of the hydrogen atom
+  std::size_t h;
+};
 
-  // Store number of vertices (number of atoms)
-  const std::size_t n_vertices{boost::num_vertices(ug)};
+/*! Donors of hydrogen bonds, from the regular (covalent) bonds
+ *
+ * @tparam Vector3
+ * @param ug Adjacency matrix
+ * @param molecule Molecule
+ * @return XH pairs, sorted by their lower and then higher atom index
+ *
+ * Only the bonds in \p ug satisfying the covalent bond criterion are
+ * considered, so that interfragment bonds are ignored.
+ */
+template<typename Vector3>
+std::vector<HydrogenBondDonor>
+hydrogen_bond_donors(const UGraph& ug,
+                     const molecule::Molecule<Vector3>& molecule) {
 
-  // Allocate distance matrix
-  Matrix dist{linalg::zeros<Matrix>(n_vertices, n_vertices)};
+  std::vector<HydrogenBondDonor> donors;
 
-  // Allocate distance map for single-source problem
-  std::vector<int> d_map(n_vertices, 0);
+  for (const auto& e : ug.edges()) {
+    std::size_t idx{e.first}; // X atom index
+    std::size_t h_idx{e.second}; // Hydrogen atom index
 
-  // Allocate predecessors map for single-source problem
-  std::vector<int> p_map(n_vertices, 0);
+    if (atom::is_H(molecule[idx].atomic_number)) {
+      std::swap(idx, h_idx);
+    }
 
-  // Loop over vertices
-  for (std::size_t i{0}; i < n_vertices; i++) {
-    // Solve single-source problem for every vertex
-    dijkstra_shortest_paths(
-        ug, i, distance_map(&d_map[0]).predecessor_map(&p_map[0]));
-
-    // Store distance and predecessors maps
-    for (std::size_t j{0}; j < n_vertices; j++) {
-      // Fill distance matrix
-      dist(i, j) = d_map[j];
+    if (not atom::is_NOFPSCl(molecule[idx].atomic_number) or
+        not atom::is_H(molecule[h_idx].atomic_number)) {
+      continue;
     }
-  }
 
-  // Return distance matrix
-  return dist;
-}
+    const double sum_covalent_radii{
+        atom::covalent_radius(molecule[idx].atomic_number) +
+        atom::covalent_radius(molecule[h_idx].atomic_number)};
 
-/// Returns the bonds in \param molecule
-///
-/// \tparam Vector3
-/// \tparam Matrix
-/// \param distance_m Distance matrix
-/// \param molecule Molecule
-/// \return List of bonds
-///
-/// The bonds can be covalent bonds, hydrogen bonds or inter-fragment bonds.
-template<typename Vector3, typename Matrix>
-std::vector<Bond> bonds(const Matrix& distance_m,
-                        const molecule::Molecule<Vector3>& molecule) {
+    // Determine if atoms X and H are covalently bonded
+    if (distance(molecule, idx, h_idx) <
+        tools::constants::covalent_bond_multiplier * sum_covalent_radii) {
+      donors.push_back({idx, h_idx});
+    }
+  }
 
-  using boost::math::iround;
+  // Sort donors and remove duplicates (parallel edges)
+  auto key = [](const HydrogenBondDonor& d) {
+    return std::make_pair(std::min(d.x, d.h), std::max(d.x, d.h));
+  };
+  std::sort(donors.begin(),
+            donors.end(),
+            [&key](const HydrogenBondDonor& a, const HydrogenBondDonor& b) {
+              return key(a) < key(b);
+            });
+  auto same = [&key](const HydrogenBondDonor& a, const HydrogenBondDonor& b) {
+    return key(a) == key(b);
+  };
+  donors.erase(std::unique(donors.begin(), donors.end(), same), donors.end());
+
+  return donors;
+}
+
+/*! Check hydrogen bond XH...Y properties
+ *
+ * @tparam Vector3
+ * @param donor Donor XH
+ * @param k Index of the acceptor Y
+ * @param d Distance between H and Y
+ * @param molecule Molecule
+ * @return True if XH...Y is a hydrogen bond
+ */
+template<typename Vector3>
+bool is_hydrogen_bond(const HydrogenBondDonor& donor,
+                      std::size_t k,
+                      double d,
+                      const molecule::Molecule<Vector3>& molecule) {
+  if (not atom::is_NOFPSCl(molecule[k].atomic_number) or k == donor.x or
+      k == donor.h) {
+    return false;
+  }
+
+  const double sum_vdw_radii{
+      atom::vdw_radius(molecule[donor.h].atomic_number) +
+      atom::vdw_radius(molecule[k].atomic_number)};
+
+  const double sum_covalent_radii{
+      atom::covalent_radius(molecule[donor.h].atomic_number) +
+      atom::covalent_radius(molecule[k].atomic_number)};
+
+  const double a{angle<Vector3>(Angle(donor.x, donor.h, k), molecule)};
+
+  // Check H-bond properties
+  return d > sum_covalent_radii and
+         d < sum_vdw_radii * tools::constants::vdw_bond_multiplier and
+         a > tools::constants::pi / 2.;
+}
+
+/*! Search for hydrogen bonds
+ *
+ * @tparam Vector3
+ * @tparam Matrix
+ * @param ug Adjacency matrix
+ * @param distances Distance matrix
+ * @param molecule Molecule
+ *
+ * Regular bonds must already be present in \p ug.
+ */
+template<typename Vector3, typename Matrix>
+void add_hydrogen_bonds(UGraph& ug,
+                        const Matrix& distances,
+                        const molecule::Molecule<Vector3>& molecule) {
 
   const std::size_t n_atoms{molecule.size()};
 
-  std::vector<Bond> b;
+  std::vector<std::pair<std::size_t, std::size_t>> bonds;
 
-  for (std::size_t j{0}; j < n_atoms; j++) {
-    for (std::size_t i{0}; i < j; i++) {
+  // Search for H-bonds: XH...Y
+  for (const auto& donor : hydrogen_bond_donors(ug, molecule)) {
+
+    // Loop over all other atoms to find Y
+    for (std::size_t k{0}; k < n_atoms; k++) {
+      if (is_hydrogen_bond(donor, k, distances(donor.h, k), molecule)) {
+        // Add hydrogen bond
+        bonds.emplace_back(donor.h, k);
+      }
+    }
+  }
+
+  ug.add_edges(bonds);
+}
+
+/*! Search for hydrogen bonds using a grid of acceptors
+ *
+ * The acceptors (N, O, F, P, S and Cl atoms) are stored in a cell list with
+ * the largest hydrogen bond distance as cell edge. Only the acceptors in
+ * the cells around the hydrogen atom of every donor are checked.
+ *
+ * @tparam Vector3
+ * @param ug Adjacency matrix
+ * @param molecule Molecule
+ *
+ * Regular bonds must already be present in \p ug.
+ */
+template<typename Vector3>
+void add_hydrogen_bonds(UGraph& ug,
+                        const molecule::Molecule<Vector3>& molecule) {
+
+  const std::vector<HydrogenBondDonor> donors{
+      hydrogen_bond_donors(ug, molecule)};
+
+  if (donors.empty()) {
+    return;
+  }
+
+  // Acceptors
+  std::vector<std::size_t> acceptors;
+  molecule::Molecule<Vector3> acceptor_atoms;
+  acceptor_atoms.lattice = molecule.lattice;
+  double max_vdw_radius{0.};
+  for (std::size_t k{0}; k < molecule.size(); k++) {
+    if (atom::is_NOFPSCl(molecule[k].atomic_number)) {
+      acceptors.push_back(k);
+      acceptor_atoms.push_back(molecule[k]);
+      max_vdw_radius = std::max(max_vdw_radius,
+                                atom::vdw_radius(molecule[k].atomic_number));
+    }
+  }
+
+  const neighbors::CellList<Vector3> grid(
+      acceptor_atoms,
+      tools::constants::vdw_bond_multiplier *
+          (atom::vdw_radius(molecule[donors.front().h].atomic_number) +
+           max_vdw_radius));
+
+  // Search for H-bonds: XH...Y
+  std::vector<std::pair<std::size_t, std::size_t>> bonds;
+  std::vector<std::size_t> candidates;
+  for (const auto& donor : donors) {
+    const auto& h_position = molecule[donor.h].position;
+
+    candidates.clear();
+    grid.for_each_near(h_position, [&](std::size_t a) {
+      candidates.push_back(acceptors[a]);
+    });
+    std::sort(candidates.begin(), candidates.end());
+
+    for (const auto k : candidates) {
+      const double d{distance(molecule, donor.h, k)};
+
+      if (is_hydrogen_bond(donor, k, d, molecule)) {
+        // Add hydrogen bond
+        bonds.emplace_back(donor.h, k);
+      }
+    }
+  }
+
+  ug.add_edges(bonds);
+}
+
+/*! Search for hydrogen bonds within a neighbour list
+ *
+ * @tparam Vector3
+ * @param ug Adjacency matrix
+ * @param neighbors Interatomic distances within a cutoff
+ * @param molecule Molecule
+ *
+ * Regular bonds must already be present in \p ug. The cutoff of \p neighbors
+ * must be larger than the hydrogen bond threshold (see
+ * \function bonding_cutoff).
+ */
+template<typename Vector3>
+void add_hydrogen_bonds(UGraph& ug,
+                        const neighbors::NeighborList& neighbors,
+                        const molecule::Molecule<Vector3>& molecule) {
+
+  std::vector<std::pair<std::size_t, std::size_t>> bonds;
+
+  // Search for H-bonds: XH...Y
+  for (const auto& donor : hydrogen_bond_donors(ug, molecule)) {
+
+    // Loop over neighbours of the hydrogen atom to find Y
+    for (const auto& m : neighbors.neighbors(donor.h)) {
+      if (is_hydrogen_bond(donor, m.index, m.distance, molecule)) {
+        // Add hydrogen bond
+        bonds.emplace_back(donor.h, m.index);
+      }
+    }
+  }
+
+  ug.add_edges(bonds);
+}
+
+/// Cutoff distance for the perception of bonds in \param molecule
+///
+/// \tparam Vector3 3D vector
+/// \param molecule Molecule
+/// \return Cutoff distance
+///
+/// All the interatomic distances needed for the perception of covalent bonds,
+/// hydrogen bonds and auxiliary interfragment bonds are shorter than the
+/// returned cutoff.
+template<typename Vector3>
+double bonding_cutoff(const molecule::Molecule<Vector3>& molecule) {
+  double max_covalent_radius{0.};
+  double max_vdw_radius_H{0.};
+  double max_vdw_radius_NOFPSCl{0.};
+
+  for (const auto& atom : molecule) {
+    max_covalent_radius = std::max(max_covalent_radius,
+                                   atom::covalent_radius(atom.atomic_number));
+
+    if (atom::is_H(atom.atomic_number)) {
+      max_vdw_radius_H = atom::vdw_radius(atom.atomic_number);
+    } else if (atom::is_NOFPSCl(atom.atomic_number)) {
+      max_vdw_radius_NOFPSCl = std::max(max_vdw_radius_NOFPSCl,
+                                        atom::vdw_radius(atom.atomic_number));
+    }
+  }
+
+  // Covalent bonds
+  double cutoff{tools::constants::covalent_bond_multiplier * 2. *
+                max_covalent_radius};
+
+  // Auxiliary interfragment bonds
+  cutoff = std::max(cutoff, 2. * tools::conversion::angstrom_to_bohr);
+
+  // Hydrogen bonds
+  if (max_vdw_radius_H > 0. and max_vdw_radius_NOFPSCl > 0.) {
+    cutoff = std::max(cutoff,
+                      tools::constants::vdw_bond_multiplier *
+                          (max_vdw_radius_H + max_vdw_radius_NOFPSCl));
+  }
+
+  return cutoff;
+}
+
+/// Compute adjacency matrix for \param molecule
+///
+/// \tparam Vector3 3D vector
+/// \tparam Matrix Matrix
+/// \param distance_m Distance matrix for \param molecule
+/// \param molecule Molecule
+/// \return Adjacency matrix
+///
+/// The adjacency matrix is represented here by a graph::MolecularGraph
+/// object (compressed sparse row format).
+/// The number of vertices corresponds to the number of atoms, while the
+/// number of edges is determined by bonding.
+template<typename Vector3, typename Matrix>
+UGraph adjacency_matrix(const Matrix& distances,
+                        const molecule::Molecule<Vector3>& molecule) {
+  const std::size_t n_atoms{molecule.size()};
+
+  // Define a undirected graph with n_atoms vertices
+  UGraph ug(n_atoms);
+
+  add_regular_bonds(ug, molecule);
+
+  add_interfragment_bonds(ug, distances);
+
+  add_hydrogen_bonds(ug, molecule);
+
+  // TODO: Extra redundant coordinates.
+
+  return ug;
+}
+
+/// Compute adjacency matrix for \param molecule from a neighbour list
+///
+/// \tparam Vector3 3D vector
+/// \param neighbors Interatomic distances within a cutoff
+/// \param molecule Molecule
+/// \return Adjacency matrix
+///
+/// Only the interatomic distances within the cutoff of \param neighbors are
+/// needed, instead of the full distance matrix. The cutoff must not be
+/// shorter than \function bonding_cutoff.
+template<typename Vector3>
+UGraph adjacency_matrix(const neighbors::NeighborList& neighbors,
+                        const molecule::Molecule<Vector3>& molecule) {
+  const std::size_t n_atoms{molecule.size()};
+
+  // Define a undirected graph with n_atoms vertices
+  UGraph ug(n_atoms);
+
+  add_regular_bonds(ug, neighbors, molecule);
+
+  add_interfragment_bonds(ug, neighbors, molecule);
+
+  add_hydrogen_bonds(ug, neighbors, molecule);
+
+  return ug;
+}
+
+/// Find the distance and predecessors matrices of the graph \param ug
+/// \tparam Matrix
+/// \param ug Graph
+/// \return Distance matrix
+///
+/// The element \f$(i,j)\f$ of the distance matrix is an integer indicating
+/// how many bonds (along the shortest path) are between atom \f$i\f$ and atom
+/// \f$j\f$, since the weight of each edge is set to 1 in \function
+/// adjacency_matrix. This allow to easily determine if two atoms are connected
+/// via one bond, two bonds (they form an angle) or three bonds (they form a
+/// dihedral).
+template<typename Matrix>
+Matrix distance_matrix(const UGraph& ug) {
+
+  // Store number of vertices (number of atoms)
+  const std::size_t n_vertices{ug.n_vertices()};
+
+  // Allocate distance matrix (disconnected atoms are infinitely far apart)
+  Matrix dist{linalg::zeros<Matrix>(n_vertices, n_vertices)};
+  for (std::size_t j{0}; j < n_vertices; j++) {
+    for (std::size_t i{0}; i < n_vertices; i++) {
+      dist(i, j) = std::numeric_limits<int>::max();
+    }
+  }
+
+  // Solve single-source problem for every vertex (all edges have weight 1)
+  graph::BreadthFirstSearch bfs(ug);
+  for (std::size_t i{0}; i < n_vertices; i++) {
+    for (const std::size_t j : bfs(i)) {
+      dist(i, j) = bfs.depth(j);
+    }
+  }
+
+  // Return distance matrix
+  return dist;
+}
+
+/// Topological distances between atoms, up to a maximum depth
+///
+/// Only the pairs of atoms separated by at most \p max_depth bonds are stored,
+/// in compressed sparse row (CSR) format. The neighbours of every atom are
+/// sorted by index.
+class BoundedDistanceMatrix {
+public:
+  /// Atom within the maximum depth, with its topological distance
+  struct Entry {
+    /// Index of the atom
+    std::size_t index;
+
+    /// Number of bonds along the shortest path
+    std::size_t distance;
+  };
+
+  /// Contiguous range of entries
+  struct Range {
+    const Entry* first;
+    const Entry* last;
+
+    const Entry* begin() const { return first; }
+    const Entry* end() const { return last; }
+    std::size_t size() const { return last - first; }
+  };
+
+  BoundedDistanceMatrix(std::size_t max_depth,
+                        std::vector<std::size_t> offsets,
+                        std::vector<Entry> entries)
+    : depth(max_depth), offsets(std::move(offsets)),
+      entries(std::move(entries)) {}
+
+  /// Number of atoms
+  std::size_t size() const { return offsets.size() - 1; }
+
+  /// Maximum topological distance stored
+  std::size_t max_depth() const { return depth; }
+
+  /// Atoms within the maximum depth from atom \param i, sorted by index
+  Range row(std::size_t i) const {
+    return {entries.data() + offsets[i], entries.data() + offsets[i + 1]};
+  }
+
+  /// Topological distance between atoms \param i and \param j
+  ///
+  /// \return Number of bonds along the shortest path between \param i and
+  /// \param j if smaller than \function max_depth, \function max_depth + 1
+  /// otherwise
+  std::size_t operator()(std::size_t i, std::size_t j) const {
+    if (i == j) {
+      return 0;
+    }
+
+    const Range r{row(i)};
+    const Entry* e{std::lower_bound(
+        r.begin(), r.end(), j, [](const Entry& a, std::size_t idx) {
+          return a.index < idx;
+        })};
+
+    return (e != r.end() and e->index == j) ? e->distance : depth + 1;
+  }
+
+private:
+  /// Maximum topological distance stored
+  std::size_t depth;
+
+  /// Offsets of the rows
+  std::vector<std::size_t> offsets;
+
+  /// Entries of all rows
+  std::vector<Entry> entries;
+};
+
+/// Find the topological distances up to \param max_depth in the graph
+/// \param ug
+///
+/// \param ug Graph
+/// \param max_depth Maximum topological distance
+/// \return Bounded distance matrix
+///
+/// A breadth-first search from every vertex is stopped at \param max_depth.
+/// The cost is therefore proportional to the number of atoms times the
+/// number of atoms within \param max_depth bonds, instead of the square of
+/// the number of atoms (as for \function distance_matrix). The default
+/// \param max_depth is enough to identify bonds, angles and dihedrals.
+inline BoundedDistanceMatrix
+bounded_distance_matrix(const UGraph& ug, std::size_t max_depth = 3) {
+  const std::size_t n_atoms{ug.n_vertices()};
+
+  std::vector<std::size_t> offsets(n_atoms + 1, 0);
+  std::vector<BoundedDistanceMatrix::Entry> entries;
+
+  graph::BreadthFirstSearch bfs(ug);
+  for (std::size_t s{0}; s < n_atoms; s++) {
+    // Breadth-first search
+    const std::vector<std::size_t>& queue{bfs(s, max_depth)};
+
+    // Store visited vertices (excluding the source)
+    const std::size_t begin{entries.size()};
+    for (std::size_t q{1}; q < queue.size(); q++) {
+      entries.push_back({queue[q], bfs.depth(queue[q])});
+    }
+    std::sort(entries.begin() + begin,
+              entries.end(),
+              [](const BoundedDistanceMatrix::Entry& a,
+                 const BoundedDistanceMatrix::Entry& b) {
+                return a.index < b.index;
+              });
+    offsets[s + 1] = entries.size();
+  }
+
+  return {max_depth, std::move(offsets), std::move(entries)};
+}
+
+/// Compact topological distances between atoms
+///
+/// Hop counts are stored as saturating unsigned bytes in packed (strictly)
+/// lower triangular form: topological distances larger than
+/// \function max_depth are stored as \function max_depth + 1. This uses 8 to
+/// 16 times less memory than a dense matrix of doubles, and lookups need no
+/// rounding.
+class TopologicalDistance {
+public:
+  /// Type of the stored hop counts
+  using value_type = std::uint8_t;
+
+  /// Empty topological distance matrix
+  TopologicalDistance() : n_atoms(0) {}
+
+  /// Topological distances from bounded distances
+  ///
+  /// \param distance_m Bounded distance matrix
+  explicit TopologicalDistance(const BoundedDistanceMatrix& distance_m)
+    : n_atoms(distance_m.size()),
+      hops(n_atoms * (n_atoms - 1) / 2, max_depth() + 1) {
+    for (std::size_t i{0}; i < n_atoms; i++) {
+      for (const auto& e : distance_m.row(i)) {
+        if (e.index < i and e.distance <= max_depth()) {
+          hops[index(i, e.index)] = static_cast<value_type>(e.distance);
+        }
+      }
+    }
+  }
+
+  /// Number of atoms
+  std::size_t size() const { return n_atoms; }
+
+  /// Largest topological distance stored exactly
+  static constexpr std::size_t max_depth() { return 3; }
+
+  /// Topological distance between atoms \param i and \param j
+  ///
+  /// \return Number of bonds along the shortest path between \param i and
+  /// \param j if not larger than \function max_depth, \function max_depth + 1
+  /// otherwise
+  value_type operator()(std::size_t i, std::size_t j) const {
+    if (i == j) {
+      return 0;
+    }
+
+    return i > j ? hops[index(i, j)] : hops[index(j, i)];
+  }
+
+private:
+  /// Position of element (i, j), with i > j, in packed storage
+  static std::size_t index(std::size_t i, std::size_t j) {
+    return i * (i - 1) / 2 + j;
+  }
+
+  /// Number of atoms
+  std::size_t n_atoms;
+
+  /// Packed lower triangle (without diagonal)
+  std::vector<value_type> hops;
+};
+
+/// Compute compact topological distances in the graph \param ug
+///
+/// \param ug Graph
+/// \return Topological distances, saturated at
+/// TopologicalDistance::max_depth() + 1
+inline TopologicalDistance topological_distance(const UGraph& ug) {
+  return TopologicalDistance(
+      bounded_distance_matrix(ug, TopologicalDistance::max_depth()));
+}
+
+/// Number of bonds along the shortest path between atoms \param i and
+/// \param j
+///
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \param i Atom index
+/// \param j Atom index
+/// \return Topological distance
+template<typename Matrix>
+inline std::size_t
+path_length(const Matrix& distance_m, std::size_t i, std::size_t j) {
+  return boost::math::iround(distance_m(i, j));
+}
+
+/// Number of bonds along the shortest path between atoms \param i and
+/// \param j
+///
+/// \param distance_m Bounded distance matrix
+/// \param i Atom index
+/// \param j Atom index
+/// \return Topological distance (saturated at the maximum depth plus one)
+inline std::size_t path_length(const BoundedDistanceMatrix& distance_m,
+                               std::size_t i,
+                               std::size_t j) {
+  return distance_m(i, j);
+}
 
-      if (iround(distance_m(i, j)) == 1) {
-        b.emplace(b.end(), i, j);
+/// Number of atoms in a distance matrix
+///
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \return Number of atoms
+template<typename Matrix>
+inline std::size_t n_vertices(const Matrix& distance_m) {
+  assert(linalg::n_rows(distance_m) == linalg::n_cols(distance_m));
+  return linalg::n_rows(distance_m);
+}
+
+/// Number of atoms in a bounded distance matrix
+///
+/// \param distance_m Bounded distance matrix
+/// \return Number of atoms
+inline std::size_t n_vertices(const BoundedDistanceMatrix& distance_m) {
+  return distance_m.size();
+}
+
+/// Number of bonds along the shortest path between atoms \param i and
+/// \param j
+///
+/// \param distance_m Topological distances
+/// \param i Atom index
+/// \param j Atom index
+/// \return Topological distance (saturated at the maximum depth plus one)
+inline std::size_t path_length(const TopologicalDistance& distance_m,
+                               std::size_t i,
+                               std::size_t j) {
+  return distance_m(i, j);
+}
+
+/// Number of atoms in a topological distance matrix
+///
+/// \param distance_m Topological distances
+/// \return Number of atoms
+inline std::size_t n_vertices(const TopologicalDistance& distance_m) {
+  return distance_m.size();
+}
+
+/// Bonded neighbours of every atom
+///
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \return Indices of the atoms bonded to every atom, sorted by index
+template<typename Matrix>
+std::vector<std::vector<std::size_t>>
+bonded_neighbors(const Matrix& distance_m) {
+  const std::size_t n_atoms{n_vertices(distance_m)};
+
+  std::vector<std::vector<std::size_t>> neighbors(n_atoms);
+
+  for (std::size_t i{0}; i < n_atoms; i++) {
+    for (std::size_t j{0}; j < n_atoms; j++) {
+      if (path_length(distance_m, i, j) == 1) {
+        neighbors[i].push_back(j);
+      }
+    }
+  }
+
+  return neighbors;
+}
+
+/// Bonded neighbours of every atom
+///
+/// \param distance_m Bounded distance matrix
+/// \return Indices of the atoms bonded to every atom, sorted by index
+///
+/// Only the stored entries are visited, so that the cost is linear in the
+/// number of atoms.
+inline std::vector<std::vector<std::size_t>>
+bonded_neighbors(const BoundedDistanceMatrix& distance_m) {
+  const std::size_t n_atoms{distance_m.size()};
+
+  std::vector<std::vector<std::size_t>> neighbors(n_atoms);
+
+  for (std::size_t i{0}; i < n_atoms; i++) {
+    for (const auto& e : distance_m.row(i)) {
+      if (e.distance == 1) {
+        neighbors[i].push_back(e.index);
+      }
+    }
+  }
+
+  return neighbors;
+}
+
+/// Check if atoms \param i and \param j are bonded
+///
+/// \param neighbors Bonded neighbours of every atom, sorted by index
+/// \param i Atom index
+/// \param j Atom index
+/// \return True if \param i and \param j are bonded
+inline bool is_bonded(const std::vector<std::vector<std::size_t>>& neighbors,
+                      std::size_t i,
+                      std::size_t j) {
+  return std::binary_search(neighbors[i].begin(), neighbors[i].end(), j);
+}
+
+/// Returns the bonds between bonded neighbours
+///
+/// \param neighbors Bonded neighbours of every atom, sorted by index
+/// \return List of bonds, sorted by last atom
+inline std::vector<Bond>
+neighbor_bonds(const std::vector<std::vector<std::size_t>>& neighbors) {
+  std::vector<Bond> b;
+
+  for (std::size_t j{0}; j < neighbors.size(); j++) {
+    for (const std::size_t i : neighbors[j]) {
+      if (i >= j) {
+        break;
       }
+
+      b.emplace(b.end(), i, j);
     }
   }
 
@@ -974,6 +1924,22 @@ std::vector<Bond> bonds(const Matrix& distance_m,
   return b;
 }
 
+/// Returns the bonds in \param molecule
+///
+/// \tparam Vector3
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \param molecule Molecule
+/// \return List of bonds
+///
+/// The bonds can be covalent bonds, hydrogen bonds or inter-fragment bonds.
+template<typename Vector3, typename Matrix>
+std::vector<Bond> bonds(const Matrix& distance_m,
+                        const molecule::Molecule<Vector3>&) {
+  // Return list of bonds
+  return neighbor_bonds(bonded_neighbors(distance_m));
+}
+
 /// Determine all possible angles between atoms i and j
 ///
 /// \tparam Matrix
@@ -989,14 +1955,13 @@ template<typename Matrix>
 std::vector<Angle>
 angles(std::size_t i, std::size_t j, const Matrix& distance) {
 
-  using boost::math::iround;
-
   std::vector<Angle> angles;
 
-  const std::size_t n_atoms{linalg::n_rows(distance)};
+  const std::size_t n_atoms{n_vertices(distance)};
 
   for (std::size_t k{0}; k < n_atoms; k++) {
-    if (iround(distance(k, i)) == 1 and iround(distance(k, j)) == 1) {
+    if (path_length(distance, k, i) == 1 and
+        path_length(distance, k, j) == 1) {
       angles.emplace(angles.end(), i, k, j);
     }
   }
@@ -1004,23 +1969,65 @@ angles(std::size_t i, std::size_t j, const Matrix& distance) {
   return angles;
 }
 
+/// Bend angles of a molecule, computed at most once for every triplet of atoms
+///
+/// \tparam Vector3 3D vector
+///
+/// The filters of the primitive internal coordinates (angles, linear angles,
+/// dihedrals and out-of-plane bends) test the same bend angles several times.
+/// A cache shared between the filters avoids computing them again. The cache
+/// refers to \p molecule, which must outlive it and must not be displaced.
+template<typename Vector3>
+class AngleCache {
+public:
+  /// Empty cache for \param molecule
+  explicit AngleCache(const molecule::Molecule<Vector3>& molecule)
+    : mol(molecule) {}
+
+  /// Bend angle \param a (computed on first request)
+  double operator()(const Angle& a) {
+    const auto it = cache.find(a);
+
+    if (it != cache.end()) {
+      return it->second;
+    }
+
+    const double value{angle<Vector3>(a, mol)};
+    cache.emplace(a, value);
+
+    return value;
+  }
+
+  /// Molecule
+  const molecule::Molecule<Vector3>& molecule() const { return mol; }
+
+  /// Number of angles computed
+  std::size_t size() const { return cache.size(); }
+
+private:
+  /// Molecule
+  const molecule::Molecule<Vector3>& mol;
+
+  /// Computed angles
+  std::unordered_map<Angle, double> cache;
+};
+
 /// \brief Returns list from \p angles whose angle is not quasi linear
 ///
-/// Quasi linear angles are those whose angle in \p molecule is greater than
+/// Quasi linear angles are those whose angle is greater than
 /// tools::constants::quasi_linear_angle.
 ///
 /// \tparam Vector3
 /// \param angles Set of potential angles
-/// \param molecule Molecule
+/// \param cache Bend angles of the molecule
 /// \return List of angles
 template<typename Vector3>
 std::vector<Angle> valid_angles(const std::vector<Angle>& angles,
-                                const molecule::Molecule<Vector3>& molecule) {
+                                AngleCache<Vector3>& cache) {
   std::vector<Angle> new_angles;
 
   for (const auto& aa : angles) {
-    const double a = angle<Vector3>(aa, molecule);
-    if (a <= tools::constants::quasi_linear_angle) {
+    if (cache(aa) <= tools::constants::quasi_linear_angle) {
       new_angles.push_back(aa);
     }
   }
@@ -1029,42 +2036,63 @@ std::vector<Angle> valid_angles(const std::vector<Angle>& angles,
   return new_angles;
 }
 
-/// Determine paths between nodes seperated by 1 other
+/// \brief Returns list from \p angles whose angle is not quasi linear
 ///
-/// Finds all elements of \p distance_m that has value <= 2.
-/// It then determines all connections from these two indices
+/// Quasi linear angles are those whose angle in \p molecule is greater than
+/// tools::constants::quasi_linear_angle.
 ///
-/// \tparam Matrix
-/// \param distance_m Distance matrix
+/// \tparam Vector3
+/// \param angles Set of potential angles
+/// \param molecule Molecule
 /// \return List of angles
-template<typename Matrix>
-std::vector<Angle> all_angles(const Matrix& distance_m) {
-
-  using boost::math::iround;
+template<typename Vector3>
+std::vector<Angle> valid_angles(const std::vector<Angle>& angles,
+                                const molecule::Molecule<Vector3>& molecule) {
+  AngleCache<Vector3> cache(molecule);
 
-  assert(linalg::n_rows(distance_m) == linalg::n_cols(distance_m));
-  const std::size_t n_rows = linalg::n_rows(distance_m);
+  return valid_angles(angles, cache);
+}
 
+/// Returns the angles between bonded neighbours
+///
+/// Every pair of atoms bonded to the same central atom forms an angle. The
+/// angles are sorted by last atom, first atom and central atom.
+///
+/// \param neighbors Bonded neighbours of every atom, sorted by index
+/// \return List of angles
+inline std::vector<Angle>
+neighbor_angles(const std::vector<std::vector<std::size_t>>& neighbors) {
   std::vector<Angle> angs;
 
-  for (std::size_t j{0}; j < n_rows; j++) {
-    for (std::size_t i{0}; i < j; i++) {
-
-      if (iround(distance_m(i, j)) <= 2) {
-
-        std::vector<Angle> A = angles(i, j, distance_m);
+  // Pairs of neighbours of every central atom
+  for (std::size_t k{0}; k < neighbors.size(); k++) {
+    const auto& bonded_to_k = neighbors[k];
 
-        for (const auto& aa : A) {
-          angs.push_back(aa);
-        }
+    for (std::size_t b_j{0}; b_j < bonded_to_k.size(); b_j++) {
+      for (std::size_t b_i{0}; b_i < b_j; b_i++) {
+        angs.emplace_back(bonded_to_k[b_i], k, bonded_to_k[b_j]);
       }
     }
   }
 
+  std::sort(angs.begin(), angs.end(), [](const Angle& a, const Angle& b) {
+    return std::tie(a.k, a.i, a.j) < std::tie(b.k, b.i, b.j);
+  });
+
   // Return list of angles
   return angs;
 }
 
+/// Determine paths between nodes seperated by 1 other
+///
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \return List of angles (see \function neighbor_angles)
+template<typename Matrix>
+std::vector<Angle> all_angles(const Matrix& distance_m) {
+  return neighbor_angles(bonded_neighbors(distance_m));
+}
+
 /// Returns the angles between bonded atoms in \p molecule
 ///
 /// \tparam Vector3
@@ -1079,6 +2107,20 @@ std::vector<Angle> angles(const Matrix& distance_m,
   return valid_angles<Vector3>(all_angles(distance_m), molecule);
 }
 
+/// Returns the angles between bonded atoms
+///
+/// \tparam Vector3
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \param cache Bend angles of the molecule
+/// \return List of angles
+template<typename Vector3, typename Matrix>
+std::vector<Angle> angles(const Matrix& distance_m,
+                          AngleCache<Vector3>& cache) {
+  // Return list of angles
+  return valid_angles(all_angles(distance_m), cache);
+}
+
 /// Determine all possible dihedrals between atoms i and j
 ///
 /// \tparam Matrix
@@ -1094,18 +2136,17 @@ template<typename Matrix>
 std::vector<Dihedral>
 dihedrals(std::size_t i, std::size_t j, const Matrix& distance) {
 
-  using boost::math::iround;
-
   std::vector<Dihedral> dihedrals;
 
-  const std::size_t n_atoms{linalg::n_rows(distance)};
+  const std::size_t n_atoms{n_vertices(distance)};
 
   // Compute possible (i,k,l,j) dihedral angles
   for (std::size_t k{0}; k < n_atoms; k++) {
-    if (iround(distance(k, i)) == 1 && iround(distance(k, j)) == 2) {
+    if (path_length(distance, k, i) == 1 && path_length(distance, k, j) == 2) {
       for (std::size_t l{0}; l < n_atoms; l++) {
-        if (iround(distance(l, i)) == 2 && iround(distance(l, j)) == 1 &&
-            iround(distance(l, k)) == 1) {
+        if (path_length(distance, l, i) == 2 &&
+            path_length(distance, l, j) == 1 &&
+            path_length(distance, l, k) == 1) {
           dihedrals.emplace(dihedrals.end(), i, k, l, j);
         }
       }
@@ -1115,127 +2156,236 @@ dihedrals(std::size_t i, std::size_t j, const Matrix& distance) {
   return dihedrals;
 }
 
-/// Returns the dihedral angles between bonded atoms in \param molecule
+/// Returns the candidate dihedral angles between bonded neighbours
 ///
-/// \tparam Vector3
-/// \tparam Matrix
-/// \param distance_m Distance matrix
-/// \param molecule Molecule
-/// \return List of dihedral angles
-template<typename Vector3, typename Matrix>
-std::vector<Dihedral>
-dihedrals(const Matrix& distance_m,
-          const molecule::Molecule<Vector3>& molecule,
-          const double linear_angle = tools::constants::quasi_linear_angle) {
-
-  using boost::math::iround;
-
-  const std::size_t n_atoms{molecule.size()};
+/// \param neighbors Bonded neighbours of every atom, sorted by index
+/// \return List of dihedral angles, including quasi-linear ones
+inline std::vector<Dihedral>
+neighbor_dihedrals(const std::vector<std::vector<std::size_t>>& neighbors) {
 
   std::vector<Dihedral> dih;
 
-  for (std::size_t j{0}; j < n_atoms; j++) {
-    for (std::size_t i{0}; i < j; i++) {
-
-      // A dihedral angle with terminal atoms i and j can still be present
-      // when the shortest path between i and j is smaller than 3. This
-      // happen when a pentagon is present (i.e. in caffeine)
-      if (iround(distance_m(i, j)) <= 3) {
-
-        const std::vector<Dihedral> D = dihedrals(i, j, distance_m);
-
-        for (const auto& dd : D) {
-          const double a1 = angle<Vector3>({dd.i, dd.j, dd.k}, molecule);
-          if (a1 > linear_angle) {
-            continue;
-          }
+  // Dihedral angles (i,k,l,j) around every central bond k-l
+  //
+  // A dihedral angle with terminal atoms i and j can still be present
+  // when the shortest path between i and j is smaller than 3. This
+  // happen when a pentagon is present (i.e. in caffeine)
+  for (std::size_t k{0}; k < neighbors.size(); k++) {
+    for (const std::size_t l : neighbors[k]) {
+      for (const std::size_t i : neighbors[k]) {
+        if (i == l or is_bonded(neighbors, i, l)) {
+          continue;
+        }
 
-          const double a2 = angle<Vector3>({dd.j, dd.k, dd.l}, molecule);
-          if (a2 > linear_angle) {
+        for (const std::size_t j : neighbors[l]) {
+          if (j <= i or j == k or is_bonded(neighbors, k, j)) {
             continue;
           }
 
-          dih.push_back(dd);
+          dih.emplace_back(i, k, l, j);
         }
       }
     }
   }
 
+  std::sort(dih.begin(), dih.end(), [](const Dihedral& a, const Dihedral& b) {
+    return std::tie(a.l, a.i, a.j, a.k) < std::tie(b.l, b.i, b.j, b.k);
+  });
+
+  // Return list of dihedral angles
+  return dih;
+}
+
+/// Returns the dihedral angles from \param dihedrals without quasi-linear
+/// bend angles
+///
+/// \tparam Vector3
+/// \param dihedrals Set of potential dihedral angles
+/// \param cache Bend angles of the molecule
+/// \param linear_angle Threshold for quasi-linear bend angles
+/// \return List of dihedral angles
+template<typename Vector3>
+std::vector<Dihedral> valid_dihedrals(const std::vector<Dihedral>& dihedrals,
+                                      AngleCache<Vector3>& cache,
+                                      const double linear_angle) {
+  std::vector<Dihedral> dih;
+
+  for (const auto& dd : dihedrals) {
+    if (cache({dd.i, dd.j, dd.k}) <= linear_angle and
+        cache({dd.j, dd.k, dd.l}) <= linear_angle) {
+      dih.push_back(dd);
+    }
+  }
+
   // TODO Check if enough coordinates found elsewhere
 
   // Return list of dihedral angles
   return dih;
 }
 
+/// Returns the dihedral angles between bonded neighbours
+///
+/// \tparam Vector3
+/// \param neighbors Bonded neighbours of every atom, sorted by index
+/// \param cache Bend angles of the molecule
+/// \param linear_angle Threshold for quasi-linear bend angles
+/// \return List of dihedral angles
+template<typename Vector3>
+std::vector<Dihedral>
+neighbor_dihedrals(const std::vector<std::vector<std::size_t>>& neighbors,
+                   AngleCache<Vector3>& cache,
+                   const double linear_angle) {
+  return valid_dihedrals(neighbor_dihedrals(neighbors), cache, linear_angle);
+}
+
+/// Returns the dihedral angles between bonded atoms
+///
+/// \tparam Vector3
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \param cache Bend angles of the molecule
+/// \param linear_angle Threshold for quasi-linear bend angles
+/// \return List of dihedral angles
 template<typename Vector3, typename Matrix>
-std::vector<OutOfPlaneBend> out_of_plane_bends(
-    const Matrix& distance_m,
-    const molecule::Molecule<Vector3>& molecule,
-    const double angle_threshold = 10.0 * tools::conversion::deg_to_rad) {
+std::vector<Dihedral>
+dihedrals(const Matrix& distance_m,
+          AngleCache<Vector3>& cache,
+          const double linear_angle = tools::constants::quasi_linear_angle) {
+  return neighbor_dihedrals(bonded_neighbors(distance_m), cache, linear_angle);
+}
 
-  using boost::math::iround;
+/// Returns the dihedral angles between bonded atoms in \param molecule
+///
+/// \tparam Vector3
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \param molecule Molecule
+/// \return List of dihedral angles
+template<typename Vector3, typename Matrix>
+std::vector<Dihedral>
+dihedrals(const Matrix& distance_m,
+          const molecule::Molecule<Vector3>& molecule,
+          const double linear_angle = tools::constants::quasi_linear_angle) {
+  AngleCache<Vector3> cache(molecule);
 
-  const std::size_t n_atoms{molecule.size()};
+  return dihedrals(distance_m, cache, linear_angle);
+}
 
+/// Returns the candidate out-of-plane bends around atoms with at least three
+/// bonded neighbours
+///
+/// \param neighbors Bonded neighbours of every atom, sorted by index
+/// \return List of out-of-plane bends, including quasi-linear and bent ones
+inline std::vector<OutOfPlaneBend> neighbor_out_of_plane_bends(
+    const std::vector<std::vector<std::size_t>>& neighbors) {
   std::vector<OutOfPlaneBend> bends;
 
-  for (std::size_t c{0}; c < n_atoms; c++) {
-    std::vector<size_t> bonded_to_c;
+  for (std::size_t c{0}; c < neighbors.size(); c++) {
+    const std::vector<size_t>& bonded_to_c = neighbors[c];
+
+    // Every set of three atoms bonded to c
+    for (std::size_t b_i{0}; b_i < bonded_to_c.size(); b_i++) {
+      for (std::size_t b_j{0}; b_j < b_i; b_j++) {
+        for (std::size_t b_k{0}; b_k < b_j; b_k++) {
+          bends.emplace_back(
+              c, bonded_to_c[b_i], bonded_to_c[b_j], bonded_to_c[b_k]);
+        }
+      }
+    }
+  }
+
+  return bends;
+}
 
-    for (std::size_t i{0}; i < n_atoms; i++) {
-      if (iround(distance_m(i, c)) == 1) {
-        bonded_to_c.push_back(i);
-      }
+/// Returns the out-of-plane bends from \param bends without quasi-linear bend
+/// angles and with a small out-of-plane angle
+///
+/// \tparam Vector3
+/// \param bends Set of potential out-of-plane bends
+/// \param cache Bend angles of the molecule
+/// \param angle_threshold Largest out-of-plane angle
+/// \return List of out-of-plane bends
+template<typename Vector3>
+std::vector<OutOfPlaneBend>
+valid_out_of_plane_bends(const std::vector<OutOfPlaneBend>& bends,
+                         AngleCache<Vector3>& cache,
+                         const double angle_threshold) {
+  const molecule::Molecule<Vector3>& molecule{cache.molecule()};
+
+  std::vector<OutOfPlaneBend> new_bends;
+
+  for (const auto& bend : bends) {
+    // No linear angles in the out-of-plane bend
+    if (cache(Angle(bend.i, bend.c, bend.j)) >
+            tools::constants::quasi_linear_angle or
+        cache(Angle(bend.i, bend.c, bend.k)) >
+            tools::constants::quasi_linear_angle or
+        cache(Angle(bend.j, bend.c, bend.k)) >
+            tools::constants::quasi_linear_angle) {
+      continue;
     }
-    const size_t n_bonded = bonded_to_c.size();
-    if (n_bonded < 3) {
+
+    const double angle = connectivity::out_of_plane_angle(bend, molecule);
+    if (std::abs(angle) > angle_threshold) {
       continue;
     }
 
-    // determine all set of 3 others with no linear angles
-    for (std::size_t b_i{0}; b_i < n_bonded; b_i++) {
-      const size_t i = bonded_to_c[b_i];
-      for (std::size_t b_j{0}; b_j < b_i; b_j++) {
-        const size_t j = bonded_to_c[b_j];
+    new_bends.push_back(bend);
+  }
 
-        // Check i-c-j angle not linear
-        {
-          const double a_icj = angle<Vector3>(Angle(i, c, j), molecule);
-          if (a_icj > tools::constants::quasi_linear_angle) {
-            continue;
-          }
-        }
-        for (std::size_t b_k{0}; b_k < b_j; b_k++) {
-          const size_t k = bonded_to_c[b_k];
-          // Check i-c-k angle not linear
-          {
-            const double a_ick = angle<Vector3>(Angle(i, c, k), molecule);
-            if (a_ick > tools::constants::quasi_linear_angle) {
-              continue;
-            }
-          }
+  return new_bends;
+}
 
-          // Check j-c-k angle not linear
-          {
-            const double a_jck = angle<Vector3>(Angle(j, c, k), molecule);
-            if (a_jck > tools::constants::quasi_linear_angle) {
-              continue;
-            }
-          }
+/// Returns the out-of-plane bends around atoms with at least three bonded
+/// neighbours
+///
+/// \tparam Vector3
+/// \param neighbors Bonded neighbours of every atom, sorted by index
+/// \param cache Bend angles of the molecule
+/// \param angle_threshold Largest out-of-plane angle
+/// \return List of out-of-plane bends
+template<typename Vector3>
+std::vector<OutOfPlaneBend> neighbor_out_of_plane_bends(
+    const std::vector<std::vector<std::size_t>>& neighbors,
+    AngleCache<Vector3>& cache,
+    const double angle_threshold) {
+  return valid_out_of_plane_bends(
+      neighbor_out_of_plane_bends(neighbors), cache, angle_threshold);
+}
 
-          const OutOfPlaneBend bend = OutOfPlaneBend(c, i, j, k);
-          const double angle = connectivity::out_of_plane_angle(bend, molecule);
-          if (std::abs(angle) > angle_threshold) {
-            continue;
-          }
-          // No linear angles in the out-of-plane bend
-          bends.push_back(bend);
-        }
-      }
-    }
-  }
+/// Returns the out-of-plane bends around atoms with at least three bonds
+///
+/// \tparam Vector3
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \param cache Bend angles of the molecule
+/// \param angle_threshold Largest out-of-plane angle
+/// \return List of out-of-plane bends
+template<typename Vector3, typename Matrix>
+std::vector<OutOfPlaneBend> out_of_plane_bends(
+    const Matrix& distance_m,
+    AngleCache<Vector3>& cache,
+    const double angle_threshold = 10.0 * tools::conversion::deg_to_rad) {
+  return neighbor_out_of_plane_bends(
+      bonded_neighbors(distance_m), cache, angle_threshold);
+}
 
-  return bends;
+/// Returns the out-of-plane bends around atoms with at least three bonds
+///
+/// \tparam Vector3
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \param molecule Molecule
+/// \param angle_threshold Largest out-of-plane angle
+/// \return List of out-of-plane bends
+template<typename Vector3, typename Matrix>
+std::vector<OutOfPlaneBend> out_of_plane_bends(
+    const Matrix& distance_m,
+    const molecule::Molecule<Vector3>& molecule,
+    const double angle_threshold = 10.0 * tools::conversion::deg_to_rad) {
+  AngleCache<Vector3> cache(molecule);
+
+  return out_of_plane_bends(distance_m, cache, angle_threshold);
 }
 
 /// \brief Determines where x, y or z is most orthogonal to direction \p d.
@@ -1255,7 +2405,10 @@ template<typename Vector3>
 inline Vector3
 non_parallel_direction(const Angle& a,
                        const molecule::Molecule<Vector3>& molecule) {
-  const Vector3 d = molecule[a.k].position - molecule[a.i].position;
+  const Vector3& p{molecule[a.j].position};
+  const Vector3 d =
+      periodic::closest_image(p, molecule[a.k].position, molecule.lattice) -
+      periodic::closest_image(p, molecule[a.i].position, molecule.lattice);
   return non_parallel_direction(d);
 }
 
@@ -1283,19 +2436,32 @@ inline std::pair<Vector3, Vector3>
 orthogonal_axis(const Angle& a,
                 const molecule::Molecule<Vector3>& molecule,
                 const Vector3& axis) {
-  const Vector3 d = molecule[a.k].position - molecule[a.i].position;
+  const Vector3& p{molecule[a.j].position};
+  const Vector3 d =
+      periodic::closest_image(p, molecule[a.k].position, molecule.lattice) -
+      periodic::closest_image(p, molecule[a.i].position, molecule.lattice);
   return orthogonal_axis(d, axis);
 }
 
+/// \brief Returns the linear angles from \p angles whose angle is quasi linear
+///
+/// For each quasi-linear angle two instances of a LinearAngle are formed to
+/// allow bending in any direction.
+///
+/// \tparam Vector3
+/// \param angles Set of potential angles
+/// \param cache Bend angles of the molecule
+/// \return List of linear angles
 template<typename Vector3>
 std::vector<LinearAngle<Vector3>>
 valid_linear_angles(const std::vector<Angle>& angles,
-                    const molecule::Molecule<Vector3>& molecule) {
+                    AngleCache<Vector3>& cache) {
+  const molecule::Molecule<Vector3>& molecule{cache.molecule()};
+
   std::vector<LinearAngle<Vector3>> new_linear_angles;
 
   for (const auto& aa : angles) {
-    const double a = angle<Vector3>(aa, molecule);
-    if (a > tools::constants::quasi_linear_angle) {
+    if (cache(aa) > tools::constants::quasi_linear_angle) {
       Vector3 direction = non_parallel_direction(aa, molecule);
       std::pair<Vector3, Vector3> axis =
           orthogonal_axis(aa, molecule, direction);
@@ -1314,6 +2480,21 @@ valid_linear_angles(const std::vector<Angle>& angles,
   return new_linear_angles;
 }
 
+/// \brief Returns the linear angles from \p angles whose angle is quasi linear
+///
+/// \tparam Vector3
+/// \param angles Set of potential angles
+/// \param molecule Molecule
+/// \return List of linear angles
+template<typename Vector3>
+std::vector<LinearAngle<Vector3>>
+valid_linear_angles(const std::vector<Angle>& angles,
+                    const molecule::Molecule<Vector3>& molecule) {
+  AngleCache<Vector3> cache(molecule);
+
+  return valid_linear_angles(angles, cache);
+}
+
 /// \brief Constructs all linear angles in the \p molecule.
 ///
 /// An angle is consider linear if it is greater than
@@ -1327,6 +2508,587 @@ linear_angles(const Matrix& distance_m,
   return valid_linear_angles(all_angles(distance_m), molecule);
 }
 
+/// \brief Constructs all linear angles from the bend angles in \p cache.
+template<typename Vector3, typename Matrix>
+std::vector<LinearAngle<Vector3>>
+linear_angles(const Matrix& distance_m, AngleCache<Vector3>& cache) {
+
+  return valid_linear_angles(all_angles(distance_m), cache);
+}
+
+/// Primitive internal coordinates
+///
+/// \tparam Vector3 3D vector
+template<typename Vector3>
+struct Primitives {
+  /// Bonds
+  std::vector<Bond> bonds;
+
+  /// Angles (not quasi-linear)
+  std::vector<Angle> angles;
+
+  /// Dihedral angles
+  std::vector<Dihedral> dihedrals;
+
+  /// Linear angles (pairs for every quasi-linear angle)
+  std::vector<LinearAngle<Vector3>> linear_angles;
+
+  /// Out-of-plane bends
+  std::vector<OutOfPlaneBend> out_of_plane_bends;
+};
+
+/// Candidate primitive internal coordinates of a molecular graph
+///
+/// The topology depends only on the bond graph: the geometric filters
+/// (quasi-linear angles and out-of-plane angles) have not been applied yet.
+struct Topology {
+  /// Bonds
+  std::vector<Bond> bonds;
+
+  /// All the angles between bonded atoms
+  std::vector<Angle> angles;
+
+  /// All the dihedral angles between bonded atoms
+  std::vector<Dihedral> dihedrals;
+
+  /// All the out-of-plane bends around atoms with at least three bonds
+  std::vector<OutOfPlaneBend> out_of_plane_bends;
+
+  /// Fragment of every atom, covalent bonds only (empty if unknown)
+  std::vector<std::size_t> fragments;
+};
+
+/// Returns the candidate primitive internal coordinates between bonded atoms
+///
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \return Bonds, angles, dihedrals and out-of-plane bends before the
+/// geometric filters
+template<typename Matrix>
+Topology topology(const Matrix& distance_m) {
+  const auto neighbors = bonded_neighbors(distance_m);
+
+  return {neighbor_bonds(neighbors),
+          neighbor_angles(neighbors),
+          neighbor_dihedrals(neighbors),
+          neighbor_out_of_plane_bends(neighbors)};
+}
+
+/// Perceive the connectivity of \param molecule and returns the candidate
+/// primitive internal coordinates between bonded atoms
+///
+/// \tparam Vector3
+/// \param molecule Molecule
+/// \return Bonds, angles, dihedrals and out-of-plane bends before the
+/// geometric filters
+///
+/// The bonds can be covalent bonds, hydrogen bonds or inter-fragment bonds.
+/// The covalently bonded fragments are identified along the way, before the
+/// other bonds join them.
+template<typename Vector3>
+Topology topology(const molecule::Molecule<Vector3>& molecule) {
+  // Compute interatomic distances within the bonding cutoff
+  const neighbors::NeighborList nl{molecule, bonding_cutoff(molecule)};
+
+  // Same stages as adjacency_matrix
+  UGraph ug(molecule.size());
+  add_regular_bonds(ug, nl, molecule);
+  std::vector<std::size_t> fragments{ug.fragment_labels()};
+  add_interfragment_bonds(ug, nl, molecule);
+  add_hydrogen_bonds(ug, nl, molecule);
+
+  // Compute topological distances (up to dihedral angles)
+  Topology t{topology(bounded_distance_matrix(ug))};
+  t.fragments = std::move(fragments);
+
+  return t;
+}
+
+/// Returns the primitive internal coordinates of \param topology which are
+/// valid for the geometry in \param cache
+///
+/// \tparam Vector3
+/// \param topology Candidate primitive internal coordinates
+/// \param cache Bend angles of the molecule
+/// \return Bonds, angles, dihedrals, linear angles and out-of-plane bends
+///
+/// Every angle between bonded atoms is classified either as an angle or as a
+/// linear angle.
+template<typename Vector3>
+Primitives<Vector3> primitives(const Topology& topology,
+                               AngleCache<Vector3>& cache) {
+  Primitives<Vector3> p;
+
+  p.bonds = topology.bonds;
+
+  // Split angles between regular and quasi-linear angles
+  std::vector<Angle> linear;
+  for (const auto& a : topology.angles) {
+    if (cache(a) > tools::constants::quasi_linear_angle) {
+      linear.push_back(a);
+    } else {
+      p.angles.push_back(a);
+    }
+  }
+  p.linear_angles = valid_linear_angles(linear, cache);
+
+  p.dihedrals = valid_dihedrals(
+      topology.dihedrals, cache, tools::constants::quasi_linear_angle);
+
+  p.out_of_plane_bends = valid_out_of_plane_bends(
+      topology.out_of_plane_bends, cache, 10.0 * tools::conversion::deg_to_rad);
+
+  return p;
+}
+
+/// Returns all the primitive internal coordinates between bonded atoms
+///
+/// \tparam Vector3
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \param cache Bend angles of the molecule
+/// \return Bonds, angles, dihedrals, linear angles and out-of-plane bends
+///
+/// The bonded neighbours are extracted from \param distance_m once and every
+/// angle between bonded atoms is enumerated once: it is classified either as
+/// an angle or as a linear angle. The primitives are the same, in the same
+/// order, as those of \function bonds, \function angles, \function dihedrals,
+/// \function linear_angles and \function out_of_plane_bends.
+template<typename Vector3, typename Matrix>
+Primitives<Vector3> primitives(const Matrix& distance_m,
+                               AngleCache<Vector3>& cache) {
+  return primitives(topology(distance_m), cache);
+}
+
+/// Returns all the primitive internal coordinates between bonded atoms in
+/// \param molecule
+///
+/// \tparam Vector3
+/// \tparam Matrix
+/// \param distance_m Distance matrix
+/// \param molecule Molecule
+/// \return Bonds, angles, dihedrals, linear angles and out-of-plane bends
+template<typename Vector3, typename Matrix>
+Primitives<Vector3> primitives(const Matrix& distance_m,
+                               const molecule::Molecule<Vector3>& molecule) {
+  AngleCache<Vector3> cache(molecule);
+
+  return primitives(distance_m, cache);
+}
+
+/// Topologies of the molecules already seen, keyed by their covalent bonds
+///
+/// \tparam Vector3 3D vector
+///
+/// Conformers of the same molecule share the same elements and covalent bond
+/// graph, which are cheap to obtain (see \function add_regular_bonds). The
+/// full connectivity perception (hydrogen bonds, inter-fragment bonds and
+/// topological distances) is performed only for the first conformer; the
+/// following ones reuse its topology. The geometric filters still have to be
+/// applied to the new geometry (see \function primitives).
+///
+/// Hydrogen bonds and inter-fragment bonds are those of the first conformer.
+template<typename Vector3>
+class TopologyCache {
+public:
+  /// Topology of \param molecule, perceived only for a new covalent graph
+  ///
+  /// \param molecule Molecule
+  /// \param covalent Covalent bonds of \param molecule
+  /// \return Candidate primitive internal coordinates
+  const Topology& operator()(const molecule::Molecule<Vector3>& molecule,
+                             const UGraph& covalent);
+
+  /// Topology of \param molecule, perceived only for a new covalent graph
+  ///
+  /// \param molecule Molecule
+  /// \return Candidate primitive internal coordinates
+  const Topology& operator()(const molecule::Molecule<Vector3>& molecule);
+
+  /// Number of topologies stored
+  std::size_t size() const { return topologies.size(); }
+
+  /// Number of requests answered from the cache
+  std::size_t n_hits() const { return hits; }
+
+  /// Number of topologies perceived
+  std::size_t n_misses() const { return misses; }
+
+  /// Remove all the topologies and reset the counters
+  void clear() {
+    topologies.clear();
+    hits = 0;
+    misses = 0;
+  }
+
+private:
+  /// Elements, periodicity and covalent bonds of a molecule
+  struct Key {
+    std::vector<std::size_t> atomic_numbers;
+    bool periodic;
+    std::vector<std::pair<std::size_t, std::size_t>> bonds;
+
+    bool operator==(const Key& k) const {
+      return periodic == k.periodic and atomic_numbers == k.atomic_numbers and
+             bonds == k.bonds;
+    }
+  };
+
+  /// Fingerprint of the molecular graph
+  struct KeyHash {
+    std::size_t operator()(const Key& k) const {
+      std::size_t seed{0};
+      boost::hash_combine(seed, k.periodic);
+      boost::hash_range(seed, k.atomic_numbers.begin(), k.atomic_numbers.end());
+      boost::hash_range(seed, k.bonds.begin(), k.bonds.end());
+      return seed;
+    }
+  };
+
+  /// Topologies
+  std::unordered_map<Key, Topology, KeyHash> topologies;
+
+  /// Number of requests answered from the cache
+  std::size_t hits{0};
+
+  /// Number of topologies perceived
+  std::size_t misses{0};
+};
+
+template<typename Vector3>
+const Topology& TopologyCache<Vector3>::operator()(
+    const molecule::Molecule<Vector3>& molecule, const UGraph& covalent) {
+  Key key;
+  key.atomic_numbers.reserve(molecule.size());
+  for (const auto& atom : molecule) {
+    key.atomic_numbers.push_back(atom.atomic_number.atomic_number);
+  }
+  key.periodic = static_cast<bool>(molecule.lattice);
+
+  // The sorted list of edges does not depend on the order of insertion
+  key.bonds = covalent.edges();
+
+  const auto it = topologies.find(key);
+
+  if (it != topologies.end()) {
+    hits++;
+    return it->second;
+  }
+
+  misses++;
+  return topologies.emplace(std::move(key), topology(molecule)).first->second;
+}
+
+template<typename Vector3>
+const Topology& TopologyCache<Vector3>::
+operator()(const molecule::Molecule<Vector3>& molecule) {
+  UGraph covalent(molecule.size());
+  add_regular_bonds(covalent, molecule);
+
+  return (*this)(molecule, covalent);
+}
+
+/// Connectivity of a molecule revalidated incrementally along an optimization
+///
+/// \tparam Vector3 3D vector
+///
+/// The neighbour list is built with the bonding cutoff extended by a skin
+/// (Verlet list). After a geometry update only the distances of the pairs in
+/// the list are recomputed and tested again; the neighbour list is rebuilt
+/// only when an atom moved by more than half the skin since it was built.
+///
+/// Besides the bond graph, the primitive internal coordinates depend on the
+/// geometry through the quasi-linear angles and the out-of-plane bends. These
+/// are re-tested as well, so that \function update reports exactly when the
+/// primitive internal coordinates (and therefore the IRC) must be rebuilt.
+template<typename Vector3>
+class IncrementalConnectivity {
+public:
+  /// Perceive the connectivity of \param molecule
+  ///
+  /// \param molecule Molecule
+  /// \param skin Skin added to the bonding cutoff (in Bohr)
+  IncrementalConnectivity(const molecule::Molecule<Vector3>& molecule,
+                          double skin = 1.);
+
+  /// Revalidate the connectivity for the new geometry \param molecule
+  ///
+  /// \param molecule Molecule (same atoms, displaced)
+  /// \return True if the primitive internal coordinates changed
+  bool update(const molecule::Molecule<Vector3>& molecule);
+
+  /// Bond graph for the last geometry
+  const UGraph& graph() const { return ug; }
+
+  /// Number of times the neighbour list has been built
+  std::size_t n_builds() const { return builds; }
+
+private:
+  /// Build the neighbour list and store the reference positions
+  void build(const molecule::Molecule<Vector3>& molecule);
+
+  /// Largest displacement of an atom since the neighbour list was built
+  double max_displacement(const molecule::Molecule<Vector3>& molecule) const;
+
+  /// Quasi-linear angles of the graph, from the bend angles in \param cache
+  std::vector<bool> quasi_linear(AngleCache<Vector3>& cache) const;
+
+  /// Skin added to the bonding cutoff
+  double skin;
+
+  /// Bonding cutoff
+  double cutoff;
+
+  /// Neighbour list (bonding cutoff extended by the skin)
+  neighbors::NeighborList nl;
+
+  /// Atomic positions when the neighbour list was built
+  std::vector<Vector3> reference;
+
+  /// Number of times the neighbour list has been built
+  std::size_t builds;
+
+  /// Bond graph
+  UGraph ug;
+
+  /// Bonds of \p ug
+  std::vector<std::pair<std::size_t, std::size_t>> bonds;
+
+  /// Bonded neighbours in \p ug (topological distances up to one bond)
+  BoundedDistanceMatrix bonded;
+
+  /// All the angles between bonded atoms in \p ug
+  std::vector<Angle> angles;
+
+  /// Quasi-linear angles within \p angles
+  std::vector<bool> linear;
+
+  /// Out-of-plane bends
+  std::vector<OutOfPlaneBend> bends;
+};
+
+template<typename Vector3>
+IncrementalConnectivity<Vector3>::IncrementalConnectivity(
+    const molecule::Molecule<Vector3>& molecule, double skin)
+  : skin(skin), cutoff(bonding_cutoff(molecule)), builds(0),
+    bonded(1, {0}, {}) {
+  build(molecule);
+
+  ug = adjacency_matrix(nl, molecule);
+  bonds = ug.edges();
+  bonded = bounded_distance_matrix(ug, 1);
+  angles = all_angles(bonded);
+
+  AngleCache<Vector3> cache(molecule);
+  linear = quasi_linear(cache);
+  bends = out_of_plane_bends(bonded, cache);
+}
+
+template<typename Vector3>
+bool IncrementalConnectivity<Vector3>::update(
+    const molecule::Molecule<Vector3>& molecule) {
+  if (max_displacement(molecule) > skin / 2.) {
+    build(molecule);
+  } else {
+    nl.update(molecule);
+  }
+
+  UGraph new_ug{adjacency_matrix(nl, molecule)};
+  std::vector<std::pair<std::size_t, std::size_t>> new_bonds{new_ug.edges()};
+
+  // Bonds formed or broken
+  if (new_bonds != bonds) {
+    ug = std::move(new_ug);
+    bonds = std::move(new_bonds);
+    bonded = bounded_distance_matrix(ug, 1);
+    angles = all_angles(bonded);
+
+    AngleCache<Vector3> cache(molecule);
+    linear = quasi_linear(cache);
+    bends = out_of_plane_bends(bonded, cache);
+
+    return true;
+  }
+
+  // Same bonds, but angles becoming (or no longer) quasi-linear and
+  // out-of-plane bends appearing or disappearing change the primitives
+  AngleCache<Vector3> cache(molecule);
+  std::vector<bool> new_linear{quasi_linear(cache)};
+  std::vector<OutOfPlaneBend> new_bends{out_of_plane_bends(bonded, cache)};
+
+  const bool changed{new_linear != linear or new_bends != bends};
+
+  linear = std::move(new_linear);
+  bends = std::move(new_bends);
+
+  return changed;
+}
+
+template<typename Vector3>
+void IncrementalConnectivity<Vector3>::build(
+    const molecule::Molecule<Vector3>& molecule) {
+  nl = neighbors::NeighborList(molecule, cutoff + skin);
+
+  reference.clear();
+  reference.reserve(molecule.size());
+  for (const auto& atom : molecule) {
+    reference.push_back(atom.position);
+  }
+
+  builds++;
+}
+
+template<typename Vector3>
+double IncrementalConnectivity<Vector3>::max_displacement(
+    const molecule::Molecule<Vector3>& molecule) const {
+  double d_max{0.};
+
+  for (std::size_t i{0}; i < molecule.size(); i++) {
+    d_max = std::max(d_max,
+                     distance(reference[i],
+                              periodic::closest_image(reference[i],
+                                                      molecule[i].position,
+                                                      molecule.lattice)));
+  }
+
+  return d_max;
+}
+
+template<typename Vector3>
+std::vector<bool> IncrementalConnectivity<Vector3>::quasi_linear(
+    AngleCache<Vector3>& cache) const {
+  std::vector<bool> l(angles.size());
+
+  for (std::size_t i{0}; i < angles.size(); i++) {
+    l[i] = cache(angles[i]) > tools::constants::quasi_linear_angle;
+  }
+
+  return l;
+}
+
+/// Position of atom \param i in the cartesian coordinates \param x_cartesian
+template<typename Vector3, typename Vector>
+inline Vector3 atom_position(const Vector& x_cartesian, std::size_t i) {
+  return {x_cartesian(3 * i + 0),
+          x_cartesian(3 * i + 1),
+          x_cartesian(3 * i + 2)};
+}
+
+/// Load the positions of the atoms of the batch of bonds starting at
+/// \param start
+///
+/// The lanes past the last bond repeat the last bond. For periodic systems
+/// (\param lattice) the closest images are used, as in \function bond.
+template<typename Vector3, typename Vector>
+void load_batch(const std::vector<Bond>& bonds,
+                std::size_t start,
+                const Vector& x_cartesian,
+                const boost::optional<periodic::Lattice<Vector3>>& lattice,
+                batch::Points& p1,
+                batch::Points& p2) {
+  const std::size_t n{batch::batch_size(start, bonds.size())};
+
+  for (std::size_t l{0}; l < batch::width; l++) {
+    const Bond& b = bonds[start + std::min(l, n - 1)];
+
+    const Vector3 b1{atom_position<Vector3>(x_cartesian, b.i)};
+    const Vector3 b2{atom_position<Vector3>(x_cartesian, b.j)};
+
+    p1.set(l, b1);
+    p2.set(l, periodic::closest_image(b1, b2, lattice));
+  }
+}
+
+/// Load the positions of the atoms of the batch of angles starting at
+/// \param start (see \function load_batch for bonds)
+template<typename Vector3, typename Vector>
+void load_batch(const std::vector<Angle>& angles,
+                std::size_t start,
+                const Vector& x_cartesian,
+                const boost::optional<periodic::Lattice<Vector3>>& lattice,
+                batch::Points& p1,
+                batch::Points& p2,
+                batch::Points& p3) {
+  const std::size_t n{batch::batch_size(start, angles.size())};
+
+  for (std::size_t l{0}; l < batch::width; l++) {
+    const Angle& a = angles[start + std::min(l, n - 1)];
+
+    const Vector3 a2{atom_position<Vector3>(x_cartesian, a.j)};
+
+    p1.set(l,
+           periodic::closest_image(
+               a2, atom_position<Vector3>(x_cartesian, a.i), lattice));
+    p2.set(l, a2);
+    p3.set(l,
+           periodic::closest_image(
+               a2, atom_position<Vector3>(x_cartesian, a.k), lattice));
+  }
+}
+
+/// Load the positions of the atoms of the batch of dihedral angles starting
+/// at \param start (see \function load_batch for bonds)
+template<typename Vector3, typename Vector>
+void load_batch(const std::vector<Dihedral>& dihedrals,
+                std::size_t start,
+                const Vector& x_cartesian,
+                const boost::optional<periodic::Lattice<Vector3>>& lattice,
+                batch::Points& p1,
+                batch::Points& p2,
+                batch::Points& p3,
+                batch::Points& p4) {
+  const std::size_t n{batch::batch_size(start, dihedrals.size())};
+
+  for (std::size_t l{0}; l < batch::width; l++) {
+    const Dihedral& d = dihedrals[start + std::min(l, n - 1)];
+
+    // Closest images along the chain of bonds
+    const Vector3 d2{atom_position<Vector3>(x_cartesian, d.j)};
+    const Vector3 d3{periodic::closest_image(
+        d2, atom_position<Vector3>(x_cartesian, d.k), lattice)};
+
+    p1.set(l,
+           periodic::closest_image(
+               d2, atom_position<Vector3>(x_cartesian, d.i), lattice));
+    p2.set(l, d2);
+    p3.set(l, d3);
+    p4.set(l,
+           periodic::closest_image(
+               d3, atom_position<Vector3>(x_cartesian, d.l), lattice));
+  }
+}
+
+/// Load the positions of the atoms of the batch of out of plane bends
+/// starting at \param start (see \function load_batch for bonds)
+template<typename Vector3, typename Vector>
+void load_batch(const std::vector<OutOfPlaneBend>& bends,
+                std::size_t start,
+                const Vector& x_cartesian,
+                const boost::optional<periodic::Lattice<Vector3>>& lattice,
+                batch::Points& pc,
+                batch::Points& p1,
+                batch::Points& p2,
+                batch::Points& p3) {
+  const std::size_t n{batch::batch_size(start, bends.size())};
+
+  for (std::size_t l{0}; l < batch::width; l++) {
+    const OutOfPlaneBend& b = bends[start + std::min(l, n - 1)];
+
+    const Vector3 c{atom_position<Vector3>(x_cartesian, b.c)};
+
+    pc.set(l, c);
+    p1.set(l,
+           periodic::closest_image(
+               c, atom_position<Vector3>(x_cartesian, b.i), lattice));
+    p2.set(l,
+           periodic::closest_image(
+               c, atom_position<Vector3>(x_cartesian, b.j), lattice));
+    p3.set(l,
+           periodic::closest_image(
+               c, atom_position<Vector3>(x_cartesian, b.k), lattice));
+  }
+}
+
 // TODO: Move to transformation? (Circular dependency?)
 /// Transform cartesian coordinates to internal redundant coordinates using
 /// information contained in the lists of bonds, angles and dihedrals
@@ -1337,7 +3099,12 @@ linear_angles(const Matrix& distance_m,
 /// \param bonds List of bonds
 /// \param angles List of angles
 /// \param dihedrals List of dihedral angles
+/// \param lattice Lattice (periodic systems only)
 /// \return
+///
+/// Bonds, angles, dihedrals and out of plane bends are computed in batches
+/// (see \namespace batch). Large sets of internal coordinates are computed in
+/// parallel (see \namespace parallel).
 template<typename Vector3, typename Vector>
 Vector cartesian_to_irc(
     const Vector& x_c,
@@ -1345,7 +3112,8 @@ Vector cartesian_to_irc(
     const std::vector<connectivity::Angle>& angles,
     const std::vector<connectivity::Dihedral>& dihedrals,
     const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles,
-    const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends) {
+    const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends,
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
 
   const auto n_bonds = bonds.size();
   const auto n_angles = angles.size();
@@ -1363,35 +3131,65 @@ Vector cartesian_to_irc(
   // Offset
   std::size_t offset{0};
 
+  // Compute n primitives in batches, starting at row first: values(s, q)
+  // computes the values q of the batch starting at s
+  auto batches = [&q_irc](std::size_t n, std::size_t first, auto values) {
+    parallel::for_each_range(
+        n,
+        [&](std::size_t begin, std::size_t end) {
+          batch::Lanes q;
+
+          for (std::size_t s{begin}; s < end; s += batch::width) {
+            values(s, q);
+
+            for (std::size_t l{0}; l < batch::batch_size(s, n); l++) {
+              q_irc(s + l + first) = q[l];
+            }
+          }
+        },
+        batch::width);
+  };
+
   // Compute bonds
-  for (std::size_t i{0}; i < n_bonds; i++) {
-    q_irc(i) = bond<Vector3, Vector>(bonds[i], x_c);
-  }
+  batches(n_bonds, offset, [&](std::size_t s, batch::Lanes& q) {
+    batch::Points p1, p2;
+    load_batch(bonds, s, x_c, lattice, p1, p2);
+    batch::bond_values(p1, p2, q);
+  });
 
   // Compute angles
   offset = n_bonds;
-  for (std::size_t i{0}; i < n_angles; i++) {
-    q_irc(i + offset) = angle<Vector3, Vector>(angles[i], x_c);
-  }
+  batches(n_angles, offset, [&](std::size_t s, batch::Lanes& q) {
+    batch::Points p1, p2, p3;
+    load_batch(angles, s, x_c, lattice, p1, p2, p3);
+    batch::angle_values(p1, p2, p3, q);
+  });
 
   // Compute dihedrals
   offset = n_bonds + n_angles;
-  for (std::size_t i{0}; i < n_dihedrals; i++) {
-    q_irc(i + offset) = dihedral<Vector3, Vector>(dihedrals[i], x_c);
-  }
+  batches(n_dihedrals, offset, [&](std::size_t s, batch::Lanes& q) {
+    batch::Points p1, p2, p3, p4;
+    load_batch(dihedrals, s, x_c, lattice, p1, p2, p3, p4);
+    batch::dihedral_values(p1, p2, p3, p4, q);
+  });
 
   // Compute linear angles
   offset = n_bonds + n_angles + n_dihedrals;
-  for (std::size_t i{0}; i < n_linear_angles; i++) {
-    q_irc(i + offset) = angle<Vector3, Vector>(linear_angles[i], x_c);
-  }
+  parallel::for_each_range(
+      n_linear_angles, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i{begin}; i < end; i++) {
+          q_irc(i + offset) =
+              angle<Vector3, Vector>(linear_angles[i], x_c, lattice);
+        }
+      });
 
   // Compute out of plane bends
   offset = n_bonds + n_angles + n_dihedrals + n_linear_angles;
-  for (std::size_t i{0}; i < n_bends; i++) {
-    q_irc(i + offset) =
-        out_of_plane_angle<Vector3, Vector>(out_of_plane_bends[i], x_c);
-  }
+  batches(n_bends, offset, [&](std::size_t s, batch::Lanes& q) {
+    batch::Points pc, p1, p2, p3;
+    load_batch(out_of_plane_bends, s, x_c, lattice, pc, p1, p2, p3);
+    batch::out_of_plane_values(pc, p1, p2, p3, q);
+  });
 
   // Return internal redundant coordinates
   return q_irc;
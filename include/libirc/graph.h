@@ -0,0 +1,412 @@
+#ifndef IRC_GRAPH_H
+#define IRC_GRAPH_H
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace irc {
+
+/// Molecular graphs
+namespace graph {
+
+/// Disjoint sets of vertices (union-find)
+///
+/// Sets are merged by size and paths are halved during searches, so that
+/// every operation costs nearly constant time.
+class DisjointSets {
+public:
+  /// \param n Singletons \f$\{0\}, \dots, \{n - 1\}\f$
+  explicit DisjointSets(std::size_t n = 0)
+    : parent(n), sizes(n, 1), count(n) {
+    for (std::size_t i{0}; i < n; i++) {
+      parent[i] = i;
+    }
+  }
+
+  /// Number of elements
+  std::size_t size() const { return parent.size(); }
+
+  /// Number of disjoint sets
+  std::size_t n_sets() const { return count; }
+
+  /// Representative of the set containing \param i
+  std::size_t find(std::size_t i) const {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+
+    return i;
+  }
+
+  /// Check if \param i and \param j belong to the same set
+  bool same(std::size_t i, std::size_t j) const { return find(i) == find(j); }
+
+  /// Number of elements of the set containing \param i
+  std::size_t set_size(std::size_t i) const { return sizes[find(i)]; }
+
+  /// Merge the sets containing \param i and \param j
+  ///
+  /// \return True if \p i and \p j belonged to different sets
+  bool unite(std::size_t i, std::size_t j) {
+    i = find(i);
+    j = find(j);
+
+    if (i == j) {
+      return false;
+    }
+
+    if (sizes[i] < sizes[j]) {
+      std::swap(i, j);
+    }
+
+    parent[j] = i;
+    sizes[i] += sizes[j];
+    count--;
+
+    return true;
+  }
+
+  /// Set of every element
+  ///
+  /// Sets are numbered from 0 in order of their element with the lowest index.
+  std::vector<std::size_t> labels() const;
+
+private:
+  /// Parent of every element (roots are their own parents)
+  ///
+  /// Paths are compressed by \function find, which does not change the sets.
+  mutable std::vector<std::size_t> parent;
+
+  /// Number of elements of every set (valid for roots only)
+  std::vector<std::size_t> sizes;
+
+  /// Number of disjoint sets
+  std::size_t count;
+};
+
+inline std::vector<std::size_t> DisjointSets::labels() const {
+  const std::size_t n{size()};
+
+  std::vector<std::size_t> label(n, n), l(n);
+  std::size_t n_labels{0};
+  for (std::size_t i{0}; i < n; i++) {
+    const std::size_t root{find(i)};
+
+    if (label[root] == n) {
+      label[root] = n_labels++;
+    }
+
+    l[i] = label[root];
+  }
+
+  return l;
+}
+
+/// Undirected molecular graph
+///
+/// The neighbours of every vertex (atom) are stored contiguously and sorted
+/// by index, in compressed sparse row (CSR) format. Every edge (bond) is
+/// stored twice, once for each vertex. Multiple edges and self-loops are
+/// ignored.
+///
+/// Edges are merged into the CSR arrays in a single pass, therefore edges
+/// should be added in batches (see \function add_edges) rather than one by
+/// one.
+///
+/// Fragments (connected components) are tracked with disjoint sets, updated
+/// as edges are added, and are therefore available at any time without
+/// traversing the graph.
+class MolecularGraph {
+public:
+  /// Contiguous range of neighbours
+  struct Range {
+    const std::size_t* first;
+    const std::size_t* last;
+
+    const std::size_t* begin() const { return first; }
+    const std::size_t* end() const { return last; }
+    std::size_t size() const { return last - first; }
+  };
+
+  /// Graph with \param n_vertices vertices and no edges
+  explicit MolecularGraph(std::size_t n_vertices = 0)
+    : offsets(n_vertices + 1, 0), sets(n_vertices) {}
+
+  /// Number of vertices
+  std::size_t n_vertices() const { return offsets.size() - 1; }
+
+  /// Number of edges
+  std::size_t n_edges() const { return adjacency.size() / 2; }
+
+  /// Neighbours of vertex \param i, sorted by index
+  Range neighbors(std::size_t i) const {
+    return {adjacency.data() + offsets[i], adjacency.data() + offsets[i + 1]};
+  }
+
+  /// Number of neighbours of vertex \param i
+  std::size_t degree(std::size_t i) const {
+    return offsets[i + 1] - offsets[i];
+  }
+
+  /// Check if vertices \param i and \param j are adjacent
+  bool has_edge(std::size_t i, std::size_t j) const {
+    const Range r{neighbors(i)};
+
+    return std::binary_search(r.begin(), r.end(), j);
+  }
+
+  /// Add the edge between vertices \param i and \param j
+  ///
+  /// \return True if the edge was not already present
+  ///
+  /// A new edge is merged into the CSR arrays, which costs time linear in the
+  /// number of vertices and edges of the graph: building a graph edge by edge
+  /// is quadratic. Edges should be collected and added with \function
+  /// add_edges instead. Edges already present (and self-loops) are detected
+  /// without rebuilding the arrays.
+  bool add_edge(std::size_t i, std::size_t j) {
+    const std::size_t n{n_vertices()};
+    if (i < n and j < n and (i == j or has_edge(i, j))) {
+      return false;
+    }
+
+    return add_edges({{i, j}}) == 1;
+  }
+
+  /// Add the edges \param edges
+  ///
+  /// \param edges Pairs of vertices
+  /// \return Number of edges not already present
+  ///
+  /// The cost is linear in the number of vertices and edges of the graph (plus
+  /// the sorting of \param edges).
+  std::size_t add_edges(const std::vector<std::pair<std::size_t, std::size_t>>&
+                            edges);
+
+  /// Edges \f$(i, j)\f$ with \f$i < j\f$, sorted
+  std::vector<std::pair<std::size_t, std::size_t>> edges() const;
+
+  /// Number of fragments (connected components)
+  std::size_t n_fragments() const { return sets.n_sets(); }
+
+  /// Check if vertices \param i and \param j belong to the same fragment
+  bool same_fragment(std::size_t i, std::size_t j) const {
+    return sets.same(i, j);
+  }
+
+  /// Fragment of every vertex
+  ///
+  /// Fragments are numbered in order of their vertex with the lowest index
+  /// (as \function connected_components).
+  std::vector<std::size_t> fragment_labels() const { return sets.labels(); }
+
+  /// Fragments, as disjoint sets of vertices
+  const DisjointSets& fragments() const { return sets; }
+
+private:
+  /// Offsets of the neighbours of every vertex
+  std::vector<std::size_t> offsets;
+
+  /// Neighbours of all vertices
+  std::vector<std::size_t> adjacency;
+
+  /// Fragments
+  DisjointSets sets;
+};
+
+inline std::size_t MolecularGraph::add_edges(
+    const std::vector<std::pair<std::size_t, std::size_t>>& edges) {
+  const std::size_t n{n_vertices()};
+
+  // New entries of the adjacency lists (both directions), sorted by row
+  std::vector<std::pair<std::size_t, std::size_t>> entries;
+  entries.reserve(2 * edges.size());
+  for (const auto& e : edges) {
+    if (e.first >= n or e.second >= n) {
+      throw std::out_of_range("Edge between non-existing vertices.");
+    }
+  }
+  for (const auto& e : edges) {
+    sets.unite(e.first, e.second);
+
+    if (e.first != e.second) {
+      entries.emplace_back(e.first, e.second);
+      entries.emplace_back(e.second, e.first);
+    }
+  }
+  std::sort(entries.begin(), entries.end());
+
+  // Merge new entries with the current adjacency lists
+  std::vector<std::size_t> new_offsets(n + 1, 0);
+  std::vector<std::size_t> new_adjacency;
+  new_adjacency.reserve(adjacency.size() + entries.size());
+
+  std::size_t added{0};
+  auto entry = entries.cbegin();
+  for (std::size_t i{0}; i < n; i++) {
+    auto a = adjacency.cbegin() + offsets[i];
+    const auto a_end = adjacency.cbegin() + offsets[i + 1];
+
+    while (a != a_end or (entry != entries.cend() and entry->first == i)) {
+      const bool from_entries{
+          entry != entries.cend() and entry->first == i and
+          (a == a_end or entry->second < *a)};
+
+      const std::size_t j{from_entries ? (entry++)->second : *(a++)};
+
+      if (new_adjacency.size() > new_offsets[i] and
+          new_adjacency.back() == j) {
+        continue;
+      }
+
+      new_adjacency.push_back(j);
+      if (from_entries) {
+        added++;
+      }
+    }
+
+    new_offsets[i + 1] = new_adjacency.size();
+  }
+
+  offsets = std::move(new_offsets);
+  adjacency = std::move(new_adjacency);
+
+  // Every new edge is counted in both directions
+  return added / 2;
+}
+
+inline std::vector<std::pair<std::size_t, std::size_t>>
+MolecularGraph::edges() const {
+  std::vector<std::pair<std::size_t, std::size_t>> e;
+  e.reserve(n_edges());
+
+  for (std::size_t i{0}; i < n_vertices(); i++) {
+    for (const std::size_t j : neighbors(i)) {
+      if (i < j) {
+        e.emplace_back(i, j);
+      }
+    }
+  }
+
+  return e;
+}
+
+/// Breadth-first search on a molecular graph
+///
+/// The work space is allocated once and reused for searches from different
+/// sources, so that every search costs only in proportion to the number of
+/// vertices visited.
+class BreadthFirstSearch {
+public:
+  /// Breadth-first search on \param g
+  explicit BreadthFirstSearch(const MolecularGraph& g)
+    : g(g), depths(g.n_vertices(), unvisited()) {}
+
+  /// Visit the vertices within \param max_depth edges from \param source
+  ///
+  /// \param source Source vertex
+  /// \param max_depth Maximum depth of the search
+  /// \return Visited vertices, in order of discovery (source first)
+  const std::vector<std::size_t>&
+  operator()(std::size_t source,
+             std::size_t max_depth = std::numeric_limits<std::size_t>::max());
+
+  /// Depth of vertex \param v in the last search (\function unvisited if \p v
+  /// was not visited)
+  std::size_t depth(std::size_t v) const { return depths[v]; }
+
+  /// Depth of vertices not visited
+  static constexpr std::size_t unvisited() {
+    return std::numeric_limits<std::size_t>::max();
+  }
+
+private:
+  /// Graph
+  const MolecularGraph& g;
+
+  /// Depth of every vertex
+  std::vector<std::size_t> depths;
+
+  /// Visited vertices
+  std::vector<std::size_t> queue;
+};
+
+inline const std::vector<std::size_t>&
+BreadthFirstSearch::operator()(std::size_t source, std::size_t max_depth) {
+  // Reset depths of the previous search
+  for (const std::size_t v : queue) {
+    depths[v] = unvisited();
+  }
+
+  queue.clear();
+  queue.push_back(source);
+  depths[source] = 0;
+
+  for (std::size_t head{0}; head < queue.size(); head++) {
+    const std::size_t v{queue[head]};
+
+    if (depths[v] == max_depth) {
+      continue;
+    }
+
+    for (const std::size_t w : g.neighbors(v)) {
+      if (depths[w] == unvisited()) {
+        depths[w] = depths[v] + 1;
+        queue.push_back(w);
+      }
+    }
+  }
+
+  return queue;
+}
+
+/// Connected components of \param g
+///
+/// \param g Graph
+/// \param component Component of every vertex (output)
+/// \return Number of connected components
+///
+/// Components are numbered in order of their vertex with the lowest index.
+inline std::size_t connected_components(const MolecularGraph& g,
+                                        std::vector<std::size_t>& component) {
+  const std::size_t n{g.n_vertices()};
+  const std::size_t unassigned{std::numeric_limits<std::size_t>::max()};
+
+  component.assign(n, unassigned);
+
+  std::size_t n_components{0};
+  std::vector<std::size_t> stack;
+  for (std::size_t s{0}; s < n; s++) {
+    if (component[s] != unassigned) {
+      continue;
+    }
+
+    component[s] = n_components;
+    stack.push_back(s);
+    while (not stack.empty()) {
+      const std::size_t v{stack.back()};
+      stack.pop_back();
+
+      for (const std::size_t w : g.neighbors(v)) {
+        if (component[w] == unassigned) {
+          component[w] = n_components;
+          stack.push_back(w);
+        }
+      }
+    }
+
+    n_components++;
+  }
+
+  return n_components;
+}
+
+} // namespace graph
+
+} // namespace irc
+
+#endif // IRC_GRAPH_H
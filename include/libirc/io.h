@@ -4,21 +4,101 @@
 #include "libirc/connectivity.h"
 #include "libirc/conversion.h"
 #include "libirc/molecule.h"
+#include "libirc/periodic.h"
 
+#include <array>
+#include <cctype>
 #include <fstream>
 #include <iomanip>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
+#include <boost/optional.hpp>
+
 namespace irc {
 
 namespace io {
 
+/// Value of the quoted property \param key in the comment line of an
+/// extended XYZ file (i.e. \p Lattice="..."), if present
+inline boost::optional<std::string> xyz_property(const std::string& comment,
+                                                 const std::string& key) {
+  const std::string token{key + "=\""};
+
+  std::size_t begin{comment.find(token)};
+  while (begin != std::string::npos and begin > 0 and
+         not std::isspace(static_cast<unsigned char>(comment[begin - 1]))) {
+    begin = comment.find(token, begin + 1);
+  }
+
+  if (begin == std::string::npos) {
+    return boost::none;
+  }
+
+  begin += token.size();
+  const std::size_t end{comment.find('"', begin)};
+
+  if (end == std::string::npos) {
+    throw std::runtime_error("Unterminated property " + key + " in XYZ file.");
+  }
+
+  return comment.substr(begin, end - begin);
+}
+
+/// Lattice in the comment line of an extended XYZ file
+///
+/// \tparam Vector3 3D vector
+/// \param comment Comment line
+/// \return Lattice (in Angstrom), if present
+///
+/// The lattice vectors are given as \p Lattice="ax ay az bx by bz cx cy cz"
+/// and the periodic directions as \p pbc="T T F" (periodic along all lattice
+/// vectors by default).
+template<typename Vector3>
+boost::optional<periodic::Lattice<Vector3>>
+xyz_lattice(const std::string& comment) {
+  const boost::optional<std::string> vectors{xyz_property(comment, "Lattice")};
+
+  if (not vectors) {
+    return boost::none;
+  }
+
+  std::istringstream in_vectors{*vectors};
+  std::array<double, 9> v;
+  for (auto& x : v) {
+    if (not(in_vectors >> x)) {
+      throw std::runtime_error("Invalid lattice in XYZ file.");
+    }
+  }
+
+  std::array<bool, 3> pbc{{true, true, true}};
+  const boost::optional<std::string> periodic{xyz_property(comment, "pbc")};
+  if (periodic) {
+    std::istringstream in_pbc{*periodic};
+    std::string flag;
+    for (auto& p : pbc) {
+      if (not(in_pbc >> flag)) {
+        throw std::runtime_error("Invalid pbc in XYZ file.");
+      }
+      p = (flag == "T" or flag == "t" or flag == "True" or flag == "true" or
+           flag == "1");
+    }
+  }
+
+  return periodic::Lattice<Vector3>{
+      {v[0], v[1], v[2]}, {v[3], v[4], v[5]}, {v[6], v[7], v[8]}, pbc};
+}
+
 /// Load molecule in XYZ format from input stream
 ///
 /// Input units must be in Angstrom.
 /// Generated molecule is in Bohr
 ///
+/// The lattice of periodic systems is read from the comment line in the
+/// extended XYZ format (see \p xyz_lattice).
+///
 /// \tparam Vector3 3D vector
 /// \param in Input stream
 /// \return Molecule
@@ -33,10 +113,16 @@ molecule::Molecule<Vector3> load_xyz(std::istream& in) {
   in >> n_atoms;
   std::getline(in, dummy);
 
+  // Comment line
+  std::string comment{""};
+  std::getline(in, comment);
+
   std::string atom{""};
   double x{0.}, y{0.}, z{0.};
 
   molecule::Molecule<Vector3> molecule;
+  molecule.lattice = xyz_lattice<Vector3>(comment);
+
   while (in >> atom >> x >> y >> z) {
     molecule.push_back({atom, {x, y, z}});
   }
@@ -4,10 +4,19 @@
 #include "libirc/connectivity.h"
 #include "libirc/linalg.h"
 #include "libirc/molecule.h"
+#include "libirc/neighbors.h"
+#include "libirc/periodic.h"
+#include "libirc/serialization.h"
 #include "libirc/transformation.h"
 #include "libirc/wilson.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <utility>
 
 #include <boost/optional.hpp>
@@ -17,12 +26,37 @@ namespace irc {
 template<typename Vector3, typename Vector, typename Matrix>
 class IRC {
 public:
+  /// Build the IRC of \param molecule
+  ///
+  /// \param molecule Molecule
+  /// \param sparse Store Wilson's B matrix as a sparse matrix from the start
+  /// (see \function use_sparse_wilson_matrix)
   IRC(const molecule::Molecule<Vector3>& molecule = {},
       const std::vector<connectivity::Bond>& mybonds = {},
       const std::vector<connectivity::Angle>& myangles = {},
       const std::vector<connectivity::Dihedral>& mydihedrals = {},
       const std::vector<connectivity::OutOfPlaneBend>& myout_of_plane_bends =
-          {});
+          {},
+      bool sparse = false);
+
+  /// Build the IRC of \param molecule from a cached topology
+  ///
+  /// \param molecule Molecule
+  /// \param topologies Topologies of the molecules already seen
+  /// \param sparse Store Wilson's B matrix as a sparse matrix from the start
+  ///
+  /// The connectivity perception is skipped when a molecule with the same
+  /// elements and covalent bonds (i.e. a conformer) is found in
+  /// \param topologies; only the geometric filters of the primitive internal
+  /// coordinates are applied again (see connectivity::TopologyCache).
+  IRC(const molecule::Molecule<Vector3>& molecule,
+      connectivity::TopologyCache<Vector3>& topologies,
+      const std::vector<connectivity::Bond>& mybonds = {},
+      const std::vector<connectivity::Angle>& myangles = {},
+      const std::vector<connectivity::Dihedral>& mydihedrals = {},
+      const std::vector<connectivity::OutOfPlaneBend>& myout_of_plane_bends =
+          {},
+      bool sparse = false);
 
   /// Compute initial projected inverted Hessian estimate
   ///
@@ -57,6 +91,28 @@ public:
   /// \return Gradient in redundant internal coordinates
   Vector grad_cartesian_to_projected_irc(const Vector& grad_c) const;
 
+  /// Transform Hessian from cartesian coordinates to projected redundant
+  /// internal coordinates
+  ///
+  /// \param hessian_c Hessian in cartesian coordinates
+  /// \param grad_c Gradient in cartesian coordinates
+  /// \param x_c Cartesian coordinates
+  /// \return Projected Hessian in redundant internal coordinates
+  Matrix hessian_cartesian_to_projected_irc(const Matrix& hessian_c,
+                                            const Vector& grad_c,
+                                            const Vector& x_c) const;
+
+  /// Transform Hessian from redundant internal coordinates to cartesian
+  /// coordinates
+  ///
+  /// \param hessian_irc Hessian in redundant internal coordinates
+  /// \param grad_irc Gradient in redundant internal coordinates
+  /// \param x_c Cartesian coordinates
+  /// \return Hessian in cartesian coordinates
+  Matrix hessian_irc_to_cartesian(const Matrix& hessian_irc,
+                                  const Vector& grad_irc,
+                                  const Vector& x_c) const;
+
   /// Transform cartesian coordinates to redundant internal coordinates
   ///
   /// \param x_c Cartesian coordinates
@@ -88,7 +144,112 @@ public:
 
   std::vector<connectivity::OutOfPlaneBend> get_out_of_plane_bends() const;
 
+  /// Store the projector block by block, one block per fragment
+  ///
+  /// \param enable Enable (or disable) the fragment blocks
+  ///
+  /// Suited to clusters of weakly bound fragments (covalently bonded atoms),
+  /// linked by a few interfragment coordinates: the projector is factorised
+  /// fragment by fragment (see wilson::FragmentProjector) instead of as a
+  /// single dense matrix.
+  void use_fragment_blocks(bool enable = true);
+
+  /// Check if the projector is stored block by block
+  bool fragment_blocks() const { return block_projector; }
+
+  /// Store Wilson's B matrix as a sparse matrix
+  ///
+  /// \param enable Enable (or disable) the sparse Wilson's B matrix
+  ///
+  /// The gradient transformation and the back-transformation of internal
+  /// displacements then use sparse products and least-squares solutions
+  /// instead of pseudo-inverses of the dense matrix (see
+  /// wilson::SparseWilsonMatrix). The projector and the Hessian
+  /// transformations are computed from the sparse rows as well.
+  void use_sparse_wilson_matrix(bool enable = true);
+
+  /// Check if Wilson's B matrix is stored as a sparse matrix
+  bool sparse_wilson_matrix() const { return static_cast<bool>(sparse_B); }
+
+  /// Save the primitive internal coordinates (and the projector) to a binary
+  /// file, for a fast restart
+  ///
+  /// \param filename Name of the binary file
+  /// \param hessian Hessian to store along the internal coordinates (in
+  /// internal or in Cartesian coordinates)
+  /// \param matrices Store Wilson's B matrix and the projector
+  ///
+  /// Without the matrices the file is much smaller (its size grows linearly
+  /// with the number of atoms), but the Cartesian coordinates are needed to
+  /// load it (see \function load). Wilson's B matrix is always saved as a
+  /// dense matrix; the sparse storage is restored by \function load.
+  void save(const std::string& filename,
+            const boost::optional<Matrix>& hessian = boost::none,
+            bool matrices = true) const;
+
+  /// Load the internal coordinates saved in \param filename
+  ///
+  /// \param filename Name of the binary file (memory mapped)
+  /// \param x_c Cartesian coordinates (required if the matrices are not saved)
+  /// \return Internal redundant coordinates
+  ///
+  /// The connectivity is not perceived again. Wilson's B matrix is computed
+  /// for \param x_c, if given; the projector is computed only if it is not
+  /// saved in \param filename. The storage of Wilson's B matrix (dense or
+  /// sparse) and of the projector (fragment blocks) is restored. Atom indices
+  /// and matrix sizes are checked against the number of atoms, and
+  /// inconsistent files are rejected with a std::runtime_error.
+  static IRC load(const std::string& filename,
+                  const boost::optional<Vector>& x_c = boost::none);
+
+  /// Load the internal coordinates and the Hessian saved in \param filename
+  ///
+  /// \param filename Name of the binary file (memory mapped)
+  /// \param hessian Hessian saved with the internal coordinates (if any)
+  /// \param x_c Cartesian coordinates (required if the matrices are not saved)
+  /// \return Internal redundant coordinates
+  static IRC load(const std::string& filename,
+                  boost::optional<Matrix>& hessian,
+                  const boost::optional<Vector>& x_c = boost::none);
+
 private:
+  /// Tag for an IRC without internal coordinates, filled by \function load
+  struct Empty {};
+
+  /// IRC without internal coordinates
+  explicit IRC(Empty) : n_irc(0), n_c(0) {}
+
+  /// Build the primitive internal coordinates from \param topology and the
+  /// user-defined ones, then Wilson B matrix and projector
+  void build(const molecule::Molecule<Vector3>& molecule,
+             const connectivity::Topology& topology,
+             const std::vector<connectivity::Bond>& mybonds,
+             const std::vector<connectivity::Angle>& myangles,
+             const std::vector<connectivity::Dihedral>& mydihedrals,
+             const std::vector<connectivity::OutOfPlaneBend>&
+                 myout_of_plane_bends,
+             bool sparse);
+
+  /// Compute the projector for the current Wilson B matrix
+  void update_projector();
+
+  /// Compute Wilson B matrix (dense or sparse) and the internal coordinates at
+  /// \param x_c, in a single sweep
+  void evaluate(const Vector& x_c);
+
+  /// Check if the internal coordinates at \param x_c are already known
+  bool evaluated_at(const Vector& x_c) const;
+
+  /// Projection \f$\mathbf{P}\mathbf{H}\mathbf{P}\f$ of \param H
+  Matrix project(const Matrix& H) const;
+
+  /// Projection of \param v
+  Vector project(const Vector& v) const;
+
+  /// Second derivatives of the internal coordinates at \param x_c, contracted
+  /// with the gradient \param grad_irc in redundant internal coordinates
+  Matrix curvature(const Vector& x_c, const Vector& grad_irc) const;
+
   /// List of bonds
   std::vector<connectivity::Bond> bonds;
 
@@ -104,21 +265,41 @@ private:
   /// List of out of plane bends
   std::vector<connectivity::OutOfPlaneBend> out_of_plane_bends;
 
+  /// Lattice (periodic systems only)
+  boost::optional<periodic::Lattice<Vector3>> lattice;
+
   /// Number of internal coordinates
   std::size_t n_irc;
 
   /// Number of cartesian coordinates
   std::size_t n_c;
 
-  /// Wilson B matrix
+  /// Wilson B matrix (dense storage only)
   Matrix B;
 
-  // TODO: Move to std::optional with C++17
-  /// Constraint matrix
-  boost::optional<Matrix> C;
+  /// Wilson B matrix (sparse storage only)
+  boost::optional<wilson::SparseWilsonMatrix<Vector>> sparse_B;
+
+  /// Cartesian coordinates of the last evaluation (empty if unknown)
+  Vector x_evaluated;
+
+  /// Internal coordinates at x_evaluated, computed along with Wilson B matrix
+  Vector q_evaluated;
+
+  /// Indices of the constrained internal coordinates
+  std::vector<std::size_t> constrained;
+
+  /// Projector, as an orthonormal basis of its range (no fragment blocks)
+  boost::optional<wilson::LowRankProjector<Vector, Matrix>> P;
+
+  /// Fragment of every atom (covalent bonds only)
+  std::vector<std::size_t> fragments;
 
-  /// Projector
-  Matrix P;
+  /// Store the projector block by block
+  bool block_projector{false};
+
+  /// Projector stored block by block (fragment blocks only)
+  boost::optional<wilson::FragmentProjector<Vector, Matrix>> blocks;
 };
 
 /*!
@@ -128,81 +309,95 @@ private:
  * @param v2 Vector to add to @param v2
  * @return Number of elements effectively added
  *
- * Add the elements of @param v2 not present in @param v1 to @param v1.
+ * Add the elements of @param v2 not present in @param v1 to @param v1. The
+ * constraint of elements already present is overridden by the one in
+ * @param v2.
+ *
+ * The elements of @param v1 are indexed in a hash table (std::hash must be
+ * specialised for T), so that the cost is linear in the size of both vectors.
  */
-// TODO: Use std::remove_copy_if?
 template<typename T>
 size_t add_without_duplicates(std::vector<T>& v1, const std::vector<T>& v2) {
   size_t n{0};
 
+  // Position of the elements of v1 (first occurrence)
+  std::unordered_map<T, std::size_t> index;
+  index.reserve(v1.size() + v2.size());
+  for (std::size_t i{0}; i < v1.size(); i++) {
+    index.emplace(v1[i], i);
+  }
+
   for (const auto& e : v2) {
-    auto iterator = std::find(std::begin(v1), std::end(v1), e);
+    const auto inserted = index.emplace(e, v1.size());
 
-    if (iterator == std::cend(v1)) {
+    if (inserted.second) {
       v1.push_back(e);
       n++;
     } else {
-      iterator->constraint = e.constraint;
+      v1[inserted.first->second].constraint = e.constraint;
     }
   }
 
   return n;
 }
 
-// TODO: Switch to std::optional with C++17
-template<typename Matrix, typename Vector3>
-boost::optional<Matrix>
+/// Indices of the constrained internal coordinates
+///
+/// \tparam Vector3
+/// \param B Bonds
+/// \param A Angles
+/// \param D Dihedral angles
+/// \param LA Linear angles
+/// \param OOPB Out of plane bends
+/// \return Indices of the constrained coordinates, in increasing order
+///
+/// Internal coordinates are indexed in the order bonds, angles, dihedral
+/// angles, linear angles and out of plane bends.
+template<typename Vector3>
+std::vector<std::size_t>
 constraints(const std::vector<connectivity::Bond>& B,
             const std::vector<connectivity::Angle>& A,
             const std::vector<connectivity::Dihedral>& D,
             const std::vector<connectivity::LinearAngle<Vector3>>& LA,
             const std::vector<connectivity::OutOfPlaneBend>& OOPB) {
-  std::size_t n{B.size() + A.size() + D.size() + LA.size() + OOPB.size()};
-  Matrix C{linalg::zeros<Matrix>(n, n)};
-
-  bool constrained{false};
+  std::vector<std::size_t> constrained;
 
   std::size_t offset{0};
   for (std::size_t i{0}; i < B.size(); i++) {
     if (B[i].constraint == connectivity::Constraint::constrained) {
-      C(i + offset, i + offset) = 1;
-      constrained = true;
+      constrained.push_back(i + offset);
     }
   }
 
   offset = B.size();
   for (std::size_t i{0}; i < A.size(); i++) {
     if (A[i].constraint == connectivity::Constraint::constrained) {
-      C(i + offset, i + offset) = 1;
-      constrained = true;
+      constrained.push_back(i + offset);
     }
   }
 
   offset = B.size() + A.size();
   for (std::size_t i{0}; i < D.size(); i++) {
     if (D[i].constraint == connectivity::Constraint::constrained) {
-      C(i + offset, i + offset) = 1;
-      constrained = true;
+      constrained.push_back(i + offset);
     }
   }
 
   offset = B.size() + A.size() + D.size();
   for (std::size_t i{0}; i < LA.size(); i++) {
     if (LA[i].constraint == connectivity::Constraint::constrained) {
-      C(i + offset, i + offset) = 1;
-      constrained = true;
+      constrained.push_back(i + offset);
     }
   }
 
   offset = B.size() + A.size() + D.size() + LA.size();
   for (std::size_t i{0}; i < OOPB.size(); i++) {
     if (OOPB[i].constraint == connectivity::Constraint::constrained) {
-      C(i + offset, i + offset) = 1;
-      constrained = true;
+      constrained.push_back(i + offset);
     }
   }
 
-  return constrained ? boost::optional<Matrix>(C) : boost::none;
+  return constrained;
 }
 
 template<typename Vector3, typename Vector, typename Matrix>
@@ -211,22 +406,64 @@ IRC<Vector3, Vector, Matrix>::IRC(
     const std::vector<connectivity::Bond>& mybonds,
     const std::vector<connectivity::Angle>& myangles,
     const std::vector<connectivity::Dihedral>& mydihedrals,
-    const std::vector<connectivity::OutOfPlaneBend>& myout_of_plane_bends) {
+    const std::vector<connectivity::OutOfPlaneBend>& myout_of_plane_bends,
+    bool sparse)
+  : lattice(molecule.lattice) {
+
+  build(molecule,
+        connectivity::topology(molecule),
+        mybonds,
+        myangles,
+        mydihedrals,
+        myout_of_plane_bends,
+        sparse);
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+IRC<Vector3, Vector, Matrix>::IRC(
+    const molecule::Molecule<Vector3>& molecule,
+    connectivity::TopologyCache<Vector3>& topologies,
+    const std::vector<connectivity::Bond>& mybonds,
+    const std::vector<connectivity::Angle>& myangles,
+    const std::vector<connectivity::Dihedral>& mydihedrals,
+    const std::vector<connectivity::OutOfPlaneBend>& myout_of_plane_bends,
+    bool sparse)
+  : lattice(molecule.lattice) {
+
+  build(molecule,
+        topologies(molecule),
+        mybonds,
+        myangles,
+        mydihedrals,
+        myout_of_plane_bends,
+        sparse);
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+void IRC<Vector3, Vector, Matrix>::build(
+    const molecule::Molecule<Vector3>& molecule,
+    const connectivity::Topology& topology,
+    const std::vector<connectivity::Bond>& mybonds,
+    const std::vector<connectivity::Angle>& myangles,
+    const std::vector<connectivity::Dihedral>& mydihedrals,
+    const std::vector<connectivity::OutOfPlaneBend>& myout_of_plane_bends,
+    bool sparse) {
 
   // Number of cartesian coordinates
   n_c = 3 * molecule.size();
 
-  // Compute interatomic distances
-  const Matrix dd{connectivity::distances<Vector3, Matrix>(molecule)};
+  // Covalently bonded fragments, perceived along with the topology
+  fragments = topology.fragments;
 
-  // Compute adjacency matrix (graph)
-  const connectivity::UGraph adj{connectivity::adjacency_matrix(dd, molecule)};
+  // Bend angles, shared by the filters of the primitive internal coordinates
+  connectivity::AngleCache<Vector3> cache(molecule);
 
-  // Compute distance matrix and predecessor matrix
-  Matrix distance_m{connectivity::distance_matrix<Matrix>(adj)};
+  // Compute all primitive internal coordinates for the current geometry
+  connectivity::Primitives<Vector3> primitives{
+      connectivity::primitives(topology, cache)};
 
   // Compute bonds
-  bonds = connectivity::bonds(distance_m, molecule);
+  bonds = std::move(primitives.bonds);
 
   // Add user-defined bonds
   if (!mybonds.empty()) { // For CodeCov, can be removed after tests
@@ -234,15 +471,15 @@ IRC<Vector3, Vector, Matrix>::IRC(
   }
 
   // Compute angles
-  angles = connectivity::angles(distance_m, molecule);
+  angles = std::move(primitives.angles);
 
   // Add user-defined angles
   if (!myangles.empty()) { // For CodeCov, can be removed after tests
-    add_without_duplicates(angles, valid_angles(myangles, molecule));
+    add_without_duplicates(angles, valid_angles(myangles, cache));
   }
 
   // Compute dihedrals
-  dihedrals = connectivity::dihedrals(distance_m, molecule);
+  dihedrals = std::move(primitives.dihedrals);
 
   // Add user-defined dihedrals
   if (!mydihedrals.empty()) { // For CodeCov, can be removed after tests
@@ -250,16 +487,16 @@ IRC<Vector3, Vector, Matrix>::IRC(
   }
 
   // Compute linear angles
-  linear_angles = connectivity::linear_angles<Vector3>(distance_m, molecule);
+  linear_angles = std::move(primitives.linear_angles);
 
   std::vector<connectivity::LinearAngle<Vector3>> mylinearangles =
-      valid_linear_angles(myangles, molecule);
+      valid_linear_angles(myangles, cache);
   if (!mylinearangles.empty()) { // For CodeCov, can be removed after tests
     add_without_duplicates(linear_angles, mylinearangles);
   }
 
   // Compute dihedrals
-  out_of_plane_bends = connectivity::out_of_plane_bends(distance_m, molecule);
+  out_of_plane_bends = std::move(primitives.out_of_plane_bends);
 
   // Add user-defined out of plane bends
   if (!myout_of_plane_bends
@@ -271,25 +508,18 @@ IRC<Vector3, Vector, Matrix>::IRC(
   n_irc = bonds.size() + angles.size() + dihedrals.size() +
           linear_angles.size() + out_of_plane_bends.size();
 
-  // Store initial Wilson's B matrix
-  B = wilson::wilson_matrix<Vector3, Vector, Matrix>(
-      molecule::to_cartesian<Vector3, Vector>(molecule),
-      bonds,
-      angles,
-      dihedrals,
-      linear_angles,
-      out_of_plane_bends);
+  // Store initial Wilson's B matrix, directly in sparse storage if requested
+  if (sparse) {
+    sparse_B = wilson::SparseWilsonMatrix<Vector>{};
+  }
+  evaluate(molecule::to_cartesian<Vector3, Vector>(molecule));
 
-  // Compute (optional) constraint matrix
-  C = constraints<Matrix>(
-      bonds, angles, dihedrals, linear_angles, out_of_plane_bends);
+  // Find constrained internal coordinates
+  constrained =
+      constraints(bonds, angles, dihedrals, linear_angles, out_of_plane_bends);
 
   // Compute projector P
-  if (C) {
-    P = wilson::projector(B, *C);
-  } else {
-    P = wilson::projector(B);
-  }
+  update_projector();
 }
 
 /// Initial estimate of the inverse Hessian in internal redundant coordinates
@@ -325,7 +555,7 @@ Matrix IRC<Vector3, Vector, Matrix>::projected_initial_hessian_inv(
     iH0(i + offset, i + offset) = 1. / k_angle;
   }
 
-  return P * iH0 * P;
+  return project(iH0);
 }
 
 /// Initial estimate of the Hessian in internal redundant coordinates
@@ -361,7 +591,7 @@ Matrix IRC<Vector3, Vector, Matrix>::projected_initial_hessian(
     H0(i + offset, i + offset) = k_angle;
   }
 
-  return P * H0 * P;
+  return project(H0);
 }
 
 template<typename Vector3, typename Vector, typename Matrix>
@@ -372,7 +602,7 @@ IRC<Vector3, Vector, Matrix>::projected_hessian_inv(const Matrix& Hinv) const {
     throw std::length_error("ERROR: Wrong Hessian size.");
   }
 
-  return P * Hinv * P;
+  return project(Hinv);
 }
 
 template<typename Vector3, typename Vector, typename Matrix>
@@ -382,7 +612,7 @@ Matrix IRC<Vector3, Vector, Matrix>::projected_hessian(const Matrix& H) const {
     throw std::length_error("ERROR: Wrong Hessian size.");
   }
 
-  return P * H * P;
+  return project(H);
 }
 
 /// Transform gradient in cartesian coordinates to gradient in internal
@@ -408,8 +638,153 @@ Vector IRC<Vector3, Vector, Matrix>::grad_cartesian_to_projected_irc(
     throw std::length_error("ERROR: Wrong cartesian gradient size.");
   }
 
-  return P *
-         transformation::gradient_cartesian_to_irc<Vector, Matrix>(grad_c, B);
+  if (sparse_B) {
+    return project(
+        transformation::gradient_cartesian_to_irc(grad_c, *sparse_B));
+  }
+
+  return project(
+      transformation::gradient_cartesian_to_irc<Vector, Matrix>(grad_c, B));
+}
+
+/// Transform Hessian in cartesian coordinates to Hessian in internal
+/// redundant coordinates and project the latter in the non-redundant part of
+/// the internal coordinate space
+///
+/// \param hessian_c Hessian in cartesian coordinates
+/// \param grad_c Gradient in cartesian coordinates
+/// \param x_c Cartesian coordinates
+/// \return Projected Hessian in internal redundant coordinates
+///
+/// The Hessian in redundant internal coordinates is given by
+/// \f\[
+///   \mathbf{H}_q = (\mathbf{B}^T)^+ \left(\mathbf{H}_x -
+///     \sum_i (\mathbf{g}_q)_i \mathbf{B}'_i \right) \mathbf{B}^+,
+/// \f\]
+/// where \f$\mathbf{g}_q = (\mathbf{B}^T)^+\mathbf{g}_x\f$ is the gradient in
+/// redundant internal coordinates and \f$\mathbf{B}'_i\f$ are the second
+/// derivatives of the internal coordinates (see wilson::WilsonDerivative).
+/// Wilson's B matrix, its derivative and the projector are computed at
+/// \param x_c.
+template<typename Vector3, typename Vector, typename Matrix>
+Matrix IRC<Vector3, Vector, Matrix>::hessian_cartesian_to_projected_irc(
+    const Matrix& hessian_c, const Vector& grad_c, const Vector& x_c) const {
+  if (linalg::size(hessian_c) != n_c * n_c) {
+    throw std::length_error("ERROR: Wrong Hessian size.");
+  }
+
+  if (linalg::size(grad_c) != n_c) {
+    throw std::length_error("ERROR: Wrong cartesian gradient size.");
+  }
+
+  if (linalg::size(x_c) != n_c) {
+    throw std::length_error("ERROR: Wrong cartesian coordinates size.");
+  }
+
+  // Projector at x_c (the stored one belongs to the last evaluation) and
+  // pseudo-inverse of the transpose of Wilson's B matrix
+  boost::optional<wilson::LowRankProjector<Vector, Matrix>> P_x;
+  Matrix iBt;
+  if (sparse_B) {
+    const wilson::SparseWilsonMatrix<Vector> B_x{
+        wilson::sparse_wilson_matrix<Vector3, Vector>(x_c,
+                                                      bonds,
+                                                      angles,
+                                                      dihedrals,
+                                                      linear_angles,
+                                                      out_of_plane_bends,
+                                                      lattice)};
+
+    P_x = wilson::LowRankProjector<Vector, Matrix>(B_x);
+    iBt = P_x->transpose_pseudo_inverse(B_x);
+  } else {
+    const Matrix B_x{
+        wilson::wilson_matrix<Vector3, Vector, Matrix>(x_c,
+                                                       bonds,
+                                                       angles,
+                                                       dihedrals,
+                                                       linear_angles,
+                                                       out_of_plane_bends,
+                                                       lattice)};
+
+    P_x = wilson::LowRankProjector<Vector, Matrix>(B_x);
+    iBt = P_x->transpose_pseudo_inverse(B_x);
+  }
+
+  // Gradient in redundant internal coordinates
+  const Vector grad_irc{iBt * grad_c};
+
+  const Matrix K{curvature(x_c, grad_irc)};
+
+  if (not constrained.empty()) {
+    P_x->constrain(constrained);
+  }
+
+  return P_x->project(Matrix{iBt * (hessian_c - K) * linalg::transpose(iBt)});
+}
+
+/// Transform Hessian in internal redundant coordinates to Hessian in cartesian
+/// coordinates
+///
+/// \param hessian_irc Hessian in redundant internal coordinates
+/// \param grad_irc Gradient in redundant internal coordinates
+/// \param x_c Cartesian coordinates
+/// \return Hessian in cartesian coordinates
+///
+/// The Hessian in cartesian coordinates is given by
+/// \f\[
+///   \mathbf{H}_x = \mathbf{B}^T \mathbf{H}_q \mathbf{B} +
+///     \sum_i (\mathbf{g}_q)_i \mathbf{B}'_i,
+/// \f\]
+/// where \f$\mathbf{B}'_i\f$ are the second derivatives of the internal
+/// coordinates (see wilson::WilsonDerivative). Wilson's B matrix and its
+/// derivative are computed at \param x_c.
+template<typename Vector3, typename Vector, typename Matrix>
+Matrix IRC<Vector3, Vector, Matrix>::hessian_irc_to_cartesian(
+    const Matrix& hessian_irc,
+    const Vector& grad_irc,
+    const Vector& x_c) const {
+  if (linalg::size(hessian_irc) != n_irc * n_irc) {
+    throw std::length_error("ERROR: Wrong Hessian size.");
+  }
+
+  if (linalg::size(grad_irc) != n_irc) {
+    throw std::length_error("ERROR: Wrong IRC gradient size.");
+  }
+
+  if (linalg::size(x_c) != n_c) {
+    throw std::length_error("ERROR: Wrong cartesian coordinates size.");
+  }
+
+  const Matrix K{curvature(x_c, grad_irc)};
+
+  if (sparse_B) {
+    const wilson::SparseWilsonMatrix<Vector> B_x{
+        wilson::sparse_wilson_matrix<Vector3, Vector>(x_c,
+                                                      bonds,
+                                                      angles,
+                                                      dihedrals,
+                                                      linear_angles,
+                                                      out_of_plane_bends,
+                                                      lattice)};
+
+    // B^T H B = B^T (B^T H^T)^T, with sparse products only
+    const Matrix BtHt{
+        B_x.transpose_matrix_product(linalg::transpose(hessian_irc))};
+
+    return B_x.transpose_matrix_product(linalg::transpose(BtHt)) + K;
+  }
+
+  const Matrix B_x{
+      wilson::wilson_matrix<Vector3, Vector, Matrix>(x_c,
+                                                     bonds,
+                                                     angles,
+                                                     dihedrals,
+                                                     linear_angles,
+                                                     out_of_plane_bends,
+                                                     lattice)};
+
+  return linalg::transpose(B_x) * hessian_irc * B_x + K;
 }
 
 template<typename Vector3, typename Vector, typename Matrix>
@@ -418,8 +793,19 @@ Vector IRC<Vector3, Vector, Matrix>::cartesian_to_irc(const Vector& x_c) const {
     throw std::length_error("ERROR: Wrong cartesian coordinates size.");
   }
 
+  // Computed along with Wilson's B matrix
+  if (evaluated_at(x_c)) {
+    return q_evaluated;
+  }
+
   return connectivity::cartesian_to_irc<Vector3, Vector>(
-      x_c, bonds, angles, dihedrals, linear_angles, out_of_plane_bends);
+      x_c,
+      bonds,
+      angles,
+      dihedrals,
+      linear_angles,
+      out_of_plane_bends,
+      lattice);
 }
 
 template<typename Vector3, typename Vector, typename Matrix>
@@ -442,6 +828,32 @@ IRC<Vector3, Vector, Matrix>::irc_to_cartesian(const Vector& q_irc_old,
     throw std::length_error("ERROR: Wrong old cartesian coordinates size.");
   }
 
+  if (sparse_B) {
+    const auto irc_result = transformation::irc_to_cartesian<
+        Vector3,
+        Vector,
+        wilson::SparseWilsonMatrix<Vector>>(q_irc_old,
+                                            dq_irc,
+                                            x_c_old,
+                                            bonds,
+                                            angles,
+                                            dihedrals,
+                                            linear_angles,
+                                            out_of_plane_bends,
+                                            max_iters,
+                                            tolerance,
+                                            6, // Maximum number of bisections
+                                            lattice);
+
+    // Update Wilson's B matrix
+    evaluate(irc_result.x_c);
+
+    // Update projector P
+    update_projector();
+
+    return irc_result;
+  }
+
   const auto irc_result =
       transformation::irc_to_cartesian<Vector3, Vector, Matrix>(
           q_irc_old,
@@ -453,23 +865,16 @@ IRC<Vector3, Vector, Matrix>::irc_to_cartesian(const Vector& q_irc_old,
           linear_angles,
           out_of_plane_bends,
           max_iters,
-          tolerance);
+          tolerance,
+          6, // Maximum number of bisections (default)
+          lattice);
 
   // TODO: This computation can be avoided; B is computed in irc_to_cartesian
-  // Update Wilson's B matrix
-  B = wilson::wilson_matrix<Vector3, Vector, Matrix>(irc_result.x_c,
-                                                     bonds,
-                                                     angles,
-                                                     dihedrals,
-                                                     linear_angles,
-                                                     out_of_plane_bends);
+  // Update Wilson's B matrix (and the internal coordinates for the next step)
+  evaluate(irc_result.x_c);
 
   // Update projector P
-  if (C) {
-    P = wilson::projector(B, *C);
-  } else {
-    P = wilson::projector(B);
-  }
+  update_projector();
 
   // Return new cartesian coordinates
   return irc_result;
@@ -505,6 +910,344 @@ IRC<Vector3, Vector, Matrix>::get_out_of_plane_bends() const {
   return out_of_plane_bends;
 }
 
+template<typename Vector3, typename Vector, typename Matrix>
+void IRC<Vector3, Vector, Matrix>::use_fragment_blocks(bool enable) {
+  if (enable != block_projector) {
+    block_projector = enable;
+
+    update_projector();
+  }
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+void IRC<Vector3, Vector, Matrix>::save(const std::string& filename,
+                                        const boost::optional<Matrix>& hessian,
+                                        bool matrices) const {
+  std::ofstream out(filename, std::ios::binary);
+
+  if (!out.is_open()) {
+    throw std::runtime_error("Impossible to open file " + filename);
+  }
+
+  serialization::Writer w(out);
+  serialization::write_header(w);
+
+  // The basis of the projector is not available with fragment blocks
+  const bool basis{matrices and not block_projector};
+
+  w.write(static_cast<std::uint8_t>(static_cast<bool>(lattice)));
+  w.write(static_cast<std::uint8_t>(matrices));
+  w.write(static_cast<std::uint8_t>(basis));
+  w.write(static_cast<std::uint8_t>(static_cast<bool>(hessian)));
+  w.write(static_cast<std::uint8_t>(block_projector));
+  w.write(static_cast<std::uint8_t>(static_cast<bool>(sparse_B)));
+
+  w.write_size(n_c);
+
+  if (lattice) {
+    serialization::write(w, *lattice);
+  }
+
+  serialization::write(w, bonds);
+  serialization::write(w, angles);
+  serialization::write(w, dihedrals);
+  serialization::write(w, linear_angles);
+  serialization::write(w, out_of_plane_bends);
+
+  w.write_size(fragments.size());
+  for (const std::size_t f : fragments) {
+    w.write_index(f);
+  }
+
+  if (matrices and sparse_B) {
+    serialization::write(w, *sparse_B);
+  } else if (matrices) {
+    serialization::write_matrix(w, B);
+  }
+
+  if (basis) {
+    serialization::write_matrix(w, P->basis());
+  }
+
+  if (hessian) {
+    serialization::write_matrix(w, *hessian);
+  }
+
+  if (!out) {
+    throw std::runtime_error("Impossible to write file " + filename);
+  }
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+IRC<Vector3, Vector, Matrix>
+IRC<Vector3, Vector, Matrix>::load(const std::string& filename,
+                                   const boost::optional<Vector>& x_c) {
+  boost::optional<Matrix> hessian;
+
+  return load(filename, hessian, x_c);
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+IRC<Vector3, Vector, Matrix>
+IRC<Vector3, Vector, Matrix>::load(const std::string& filename,
+                                   boost::optional<Matrix>& hessian,
+                                   const boost::optional<Vector>& x_c) {
+  const serialization::MappedFile file(filename);
+  serialization::Reader r{file.reader()};
+
+  serialization::read_header(r);
+
+  const bool has_lattice{r.read<std::uint8_t>() != 0};
+  const bool has_matrices{r.read<std::uint8_t>() != 0};
+  const bool has_projector{r.read<std::uint8_t>() != 0};
+  const bool has_hessian{r.read<std::uint8_t>() != 0};
+
+  IRC irc{Empty{}};
+
+  irc.block_projector = r.read<std::uint8_t>() != 0;
+  const bool sparse{r.read<std::uint8_t>() != 0};
+
+  irc.n_c = r.read_size();
+
+  if (irc.n_c % 3 != 0) {
+    throw std::runtime_error(
+        "Invalid number of Cartesian coordinates in binary file.");
+  }
+
+  // The basis of the projector is saved with Wilson's B matrix, and only
+  // without fragment blocks
+  if (has_projector and (not has_matrices or irc.block_projector)) {
+    throw std::runtime_error("Invalid flags in binary file.");
+  }
+
+  if (has_lattice) {
+    irc.lattice = serialization::read_lattice<Vector3>(r);
+  }
+
+  irc.bonds = serialization::read_vector(r, serialization::read_bond);
+  irc.angles = serialization::read_vector(r, serialization::read_angle);
+  irc.dihedrals = serialization::read_vector(r, serialization::read_dihedral);
+  irc.linear_angles = serialization::read_vector(
+      r, serialization::read_linear_angle<Vector3>);
+  irc.out_of_plane_bends =
+      serialization::read_vector(r, serialization::read_out_of_plane_bend);
+
+  irc.fragments = serialization::read_vector(
+      r, [](serialization::Reader& r) { return r.read_index(); });
+
+  // Atom indices of the primitives and of the fragments
+  const std::size_t n_atoms{irc.n_c / 3};
+  auto check_atoms = [n_atoms](std::initializer_list<std::size_t> indices) {
+    for (const std::size_t a : indices) {
+      if (a >= n_atoms) {
+        throw std::runtime_error("Invalid atom index in binary file.");
+      }
+    }
+  };
+
+  for (const auto& b : irc.bonds) {
+    check_atoms({b.i, b.j});
+  }
+  for (const auto& a : irc.angles) {
+    check_atoms({a.i, a.j, a.k});
+  }
+  for (const auto& d : irc.dihedrals) {
+    check_atoms({d.i, d.j, d.k, d.l});
+  }
+  for (const auto& a : irc.linear_angles) {
+    check_atoms({a.i, a.j, a.k});
+  }
+  for (const auto& b : irc.out_of_plane_bends) {
+    check_atoms({b.c, b.i, b.j, b.k});
+  }
+
+  // Fragment labels are unknown (empty) or given for every atom
+  if (not irc.fragments.empty() and irc.fragments.size() != n_atoms) {
+    throw std::runtime_error("Invalid number of fragments in binary file.");
+  }
+  for (const std::size_t f : irc.fragments) {
+    check_atoms({f});
+  }
+
+  irc.n_irc = irc.bonds.size() + irc.angles.size() + irc.dihedrals.size() +
+              irc.linear_angles.size() + irc.out_of_plane_bends.size();
+
+  // Shape of the saved matrices
+  auto check_size = [](const Matrix& M, std::size_t rows, std::size_t cols) {
+    if (linalg::n_rows(M) != rows or linalg::n_cols(M) != cols) {
+      throw std::runtime_error("Invalid matrix size in binary file.");
+    }
+  };
+
+  irc.constrained = constraints(irc.bonds,
+                                irc.angles,
+                                irc.dihedrals,
+                                irc.linear_angles,
+                                irc.out_of_plane_bends);
+
+  if (has_matrices and sparse) {
+    irc.sparse_B = serialization::read_sparse_wilson_matrix<Vector>(r);
+
+    if (irc.sparse_B->n_rows() != irc.n_irc or
+        irc.sparse_B->n_cols() != irc.n_c) {
+      throw std::runtime_error("Invalid matrix size in binary file.");
+    }
+  } else if (has_matrices) {
+    irc.B = serialization::read_matrix<Matrix>(r);
+    check_size(irc.B, irc.n_irc, irc.n_c);
+  } else if (!x_c) {
+    throw std::runtime_error("Cartesian coordinates needed to load " +
+                             filename);
+  }
+
+  if (has_projector) {
+    const Matrix U{serialization::read_matrix<Matrix>(r)};
+
+    // The rank is at most the number of Cartesian coordinates
+    check_size(U, irc.n_irc, std::min(linalg::n_cols(U), irc.n_c));
+
+    irc.P = wilson::LowRankProjector<Vector, Matrix>::from_basis(U);
+  }
+
+  hessian = boost::none;
+  if (has_hessian) {
+    hessian = serialization::read_matrix<Matrix>(r);
+
+    // Hessian in internal or in Cartesian coordinates
+    const std::size_t n{linalg::n_rows(*hessian)};
+    check_size(*hessian, n == irc.n_c ? irc.n_c : irc.n_irc, n);
+  }
+
+  if (x_c) {
+    if (linalg::size(*x_c) != irc.n_c) {
+      throw std::length_error("ERROR: Wrong number of Cartesian coordinates.");
+    }
+
+    // Wilson's B matrix is computed directly with the saved storage
+    if (sparse) {
+      irc.sparse_B = wilson::SparseWilsonMatrix<Vector>{};
+    }
+
+    irc.evaluate(*x_c);
+  }
+
+  // The saved projector is valid only for the saved Wilson's B matrix
+  if (x_c or not has_projector) {
+    irc.update_projector();
+  }
+
+  return irc;
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+void IRC<Vector3, Vector, Matrix>::use_sparse_wilson_matrix(bool enable) {
+  if (enable and not sparse_B) {
+    sparse_B = wilson::to_sparse<Vector>(B);
+
+    // Release the dense Wilson's B matrix
+    B = Matrix{};
+  } else if (not enable and sparse_B) {
+    B = sparse_B->template dense<Matrix>();
+    sparse_B = boost::none;
+  }
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+void IRC<Vector3, Vector, Matrix>::update_projector() {
+  if (block_projector) {
+    P = boost::none;
+
+    if (sparse_B) {
+      blocks = wilson::FragmentProjector<Vector, Matrix>(*sparse_B, fragments);
+    } else {
+      blocks = wilson::FragmentProjector<Vector, Matrix>(B, fragments);
+    }
+
+    if (not constrained.empty()) {
+      blocks->constrain(constrained);
+    }
+  } else {
+    blocks = boost::none;
+
+    if (sparse_B) {
+      P = wilson::LowRankProjector<Vector, Matrix>(*sparse_B);
+    } else {
+      P = wilson::LowRankProjector<Vector, Matrix>(B);
+    }
+
+    if (not constrained.empty()) {
+      P->constrain(constrained);
+    }
+  }
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+Matrix IRC<Vector3, Vector, Matrix>::project(const Matrix& H) const {
+  return blocks ? blocks->project(H) : P->project(H);
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+Vector IRC<Vector3, Vector, Matrix>::project(const Vector& v) const {
+  return blocks ? *blocks * v : *P * v;
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+void IRC<Vector3, Vector, Matrix>::evaluate(const Vector& x_c) {
+  if (sparse_B) {
+    auto e = wilson::sparse_evaluate<Vector3, Vector>(x_c,
+                                                      bonds,
+                                                      angles,
+                                                      dihedrals,
+                                                      linear_angles,
+                                                      out_of_plane_bends,
+                                                      lattice);
+
+    sparse_B = std::move(e.B);
+    q_evaluated = std::move(e.q);
+  } else {
+    auto e = wilson::evaluate<Vector3, Vector, Matrix>(x_c,
+                                                       bonds,
+                                                       angles,
+                                                       dihedrals,
+                                                       linear_angles,
+                                                       out_of_plane_bends,
+                                                       lattice);
+
+    B = std::move(e.B);
+    q_evaluated = std::move(e.q);
+  }
+
+  x_evaluated = x_c;
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+bool IRC<Vector3, Vector, Matrix>::evaluated_at(const Vector& x_c) const {
+  if (linalg::size(x_evaluated) != linalg::size(x_c)) {
+    return false;
+  }
+
+  for (std::size_t i{0}; i < linalg::size(x_c); i++) {
+    if (x_evaluated(i) != x_c(i)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template<typename Vector3, typename Vector, typename Matrix>
+Matrix IRC<Vector3, Vector, Matrix>::curvature(const Vector& x_c,
+                                               const Vector& grad_irc) const {
+  return wilson::wilson_derivative<Vector3, Vector>(x_c,
+                                                    bonds,
+                                                    angles,
+                                                    dihedrals,
+                                                    linear_angles,
+                                                    out_of_plane_bends,
+                                                    lattice)
+      .template contract<Matrix>(grad_irc);
+}
+
 } // namespace irc
 
 #endif // IRC_IRC_H
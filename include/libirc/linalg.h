@@ -11,6 +11,10 @@
 #error
 #endif
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
 namespace irc {
 
 namespace linalg {
@@ -236,6 +240,180 @@ Matrix pseudo_inverse(const Matrix& mat) {
 #endif
 }
 
+/// Singular value decomposition
+///
+/// \tparam Vector
+/// \tparam Matrix
+/// \param mat Matrix
+/// \param U Left singular vectors (square)
+/// \param s Singular values, in decreasing order
+/// \param V Right singular vectors (square)
+///
+/// The decomposition \f$\mathbf{A} = \mathbf{U}\mathbf{S}\mathbf{V}^T\f$ is
+/// complete: \param U and \param V span the whole row and column spaces,
+/// including the null spaces of \param mat.
+template<typename Vector, typename Matrix>
+void svd(const Matrix& mat, Matrix& U, Vector& s, Matrix& V) {
+#ifdef HAVE_ARMA
+  if (!arma::svd(U, s, V, mat)) {
+    throw std::runtime_error("SVD failed.");
+  }
+#elif HAVE_EIGEN3
+  Eigen::JacobiSVD<Matrix> decomposition(mat,
+                                         Eigen::ComputeFullU |
+                                             Eigen::ComputeFullV);
+  U = decomposition.matrixU();
+  s = decomposition.singularValues();
+  V = decomposition.matrixV();
+#else
+#error
+#endif
+}
+
+/// Thin singular value decomposition, left singular vectors only
+///
+/// \tparam Vector
+/// \tparam Matrix
+/// \param mat Matrix (\f$m \times n\f$)
+/// \param U Left singular vectors (\f$m \times \min(m, n)\f$)
+/// \param s Singular values, in decreasing order
+///
+/// Unlike \function svd, the null space of \f$\mathbf{A}^T\f$ is not computed:
+/// for tall matrices the cost scales as \f$mn^2\f$ instead of \f$m^3\f$.
+template<typename Vector, typename Matrix>
+void svd_thin(const Matrix& mat, Matrix& U, Vector& s) {
+#ifdef HAVE_ARMA
+  Matrix V;
+  if (!arma::svd_econ(U, s, V, mat, "left")) {
+    throw std::runtime_error("SVD failed.");
+  }
+#elif HAVE_EIGEN3
+  Eigen::JacobiSVD<Matrix> decomposition(mat, Eigen::ComputeThinU);
+  U = decomposition.matrixU();
+  s = decomposition.singularValues();
+#else
+#error
+#endif
+}
+
+/// Eigendecomposition of a symmetric matrix
+///
+/// \tparam Vector
+/// \tparam Matrix
+/// \param mat Symmetric matrix
+/// \param values Eigenvalues, in increasing order
+/// \param vectors Eigenvectors (columns)
+template<typename Vector, typename Matrix>
+void eig_sym(const Matrix& mat, Vector& values, Matrix& vectors) {
+#ifdef HAVE_ARMA
+  if (!arma::eig_sym(values, vectors, mat)) {
+    throw std::runtime_error("Eigendecomposition failed.");
+  }
+#elif HAVE_EIGEN3
+  Eigen::SelfAdjointEigenSolver<Matrix> decomposition(mat);
+  if (decomposition.info() != Eigen::Success) {
+    throw std::runtime_error("Eigendecomposition failed.");
+  }
+  values = decomposition.eigenvalues();
+  vectors = decomposition.eigenvectors();
+#else
+#error
+#endif
+}
+
+/// Result of an iterative least-squares solution
+///
+/// \tparam Vector
+template<typename Vector>
+struct LeastSquaresResult {
+  /// Solution
+  Vector x;
+
+  /// Whether the tolerance was reached within the maximum number of
+  /// iterations
+  bool converged;
+
+  /// Number of iterations
+  std::size_t n_iterations;
+};
+
+/// Minimum-norm least-squares solution of a linear system
+///
+/// \tparam Vector
+/// \tparam Apply
+/// \tparam ApplyTranspose
+/// \param b Right-hand side
+/// \param n Number of unknowns
+/// \param apply Product \f$\mathbf{A}\mathbf{x}\f$
+/// \param apply_transpose Product \f$\mathbf{A}^T\mathbf{y}\f$
+/// \param tolerance Relative tolerance on the normal equations residual
+/// \param max_iters Maximum number of iterations (\f$2n\f$ if zero)
+/// \return \f$\mathbf{A}^+\mathbf{b}\f$, with the convergence status
+///
+/// The system is solved with conjugate gradients on the normal equations
+/// (CGLS), using only products with \f$\mathbf{A}\f$ and its transpose.
+/// Starting from zero, the iterates stay in the row space of \f$\mathbf{A}\f$
+/// and converge to the pseudo-inverse solution, even for rank-deficient
+/// matrices.
+///
+/// The iterations stop when the residual of the normal equations
+/// \f$\mathbf{A}^T\mathbf{r}\f$ is small compared either to its initial value
+/// or to \f$\lVert\mathbf{A}\rVert\lVert\mathbf{r}\rVert\f$. The latter
+/// criterion is reached when \f$\mathbf{b}\f$ is mostly outside the range of
+/// \f$\mathbf{A}\f$, where rounding errors prevent the former. For
+/// ill-conditioned matrices neither might be reached within the maximum number
+/// of iterations; the last iterate is then returned as not converged.
+template<typename Vector, typename Apply, typename ApplyTranspose>
+LeastSquaresResult<Vector> least_squares(const Vector& b,
+                                         std::size_t n,
+                                         Apply apply,
+                                         ApplyTranspose apply_transpose,
+                                         double tolerance = 1e-12,
+                                         std::size_t max_iters = 0) {
+  if (max_iters == 0) {
+    max_iters = 2 * n;
+  }
+
+  Vector x{zeros<Vector>(n)};
+
+  // Residual of the system and of the normal equations
+  Vector r{b};
+  Vector s{apply_transpose(r)};
+
+  Vector p{s};
+
+  const double s0{norm(s)};
+  double gamma{s0 * s0};
+
+  // Estimate of the norm of A (lower bound)
+  double a_norm{0.};
+
+  auto converged = [&]() {
+    const double s_norm{std::sqrt(gamma)};
+    return s_norm <= tolerance * s0 or s_norm <= tolerance * a_norm * norm(r);
+  };
+
+  std::size_t n_iterations{0};
+  for (; n_iterations < max_iters and not converged(); n_iterations++) {
+    const Vector q{apply(p)};
+
+    const double q_norm{norm(q)};
+    a_norm = std::max(a_norm, q_norm / norm(p));
+
+    const double alpha{gamma / (q_norm * q_norm)};
+    x += alpha * p;
+    r -= alpha * q;
+
+    s = apply_transpose(r);
+
+    const double gamma_new{dot(s, s)};
+    p = s + (gamma_new / gamma) * p;
+    gamma = gamma_new;
+  }
+
+  return {x, converged(), n_iterations};
+}
+
 } // namespace linalg
 
 } // namespace irc
@@ -5,6 +5,10 @@
 #include "libirc/conversion.h"
 #include "libirc/linalg.h"
 
+#include <array>
+#include <cmath>
+#include <cstddef>
+
 namespace irc {
 
 namespace tools {
@@ -59,6 +63,237 @@ inline bool collinear(Vector3 v1, Vector3 v2, double tolerance = 1e-6) {
   return c;
 }
 
+/// Value of a function of \p N variables, with its first and second
+/// derivatives
+///
+/// \tparam N Number of variables
+///
+/// Arithmetic operators and elementary functions propagate the derivatives
+/// exactly (forward automatic differentiation to second order): a function
+/// evaluated with \class Jet arguments returns its gradient and its Hessian
+/// along with its value.
+template<std::size_t N>
+struct Jet {
+  /// Constant \param v
+  Jet(double v = 0.) : value(v) {}
+
+  /// Variable \param i, with value \param v
+  static Jet variable(std::size_t i, double v) {
+    Jet j(v);
+    j.gradient[i] = 1.;
+    return j;
+  }
+
+  /// Value
+  double value;
+
+  /// Gradient
+  std::array<double, N> gradient{};
+
+  /// Hessian (row-major)
+  std::array<double, N * N> hessian{};
+};
+
+/// Function of \param a, given its value \param f and its first and second
+/// derivatives \param df and \param d2f at \param a
+template<std::size_t N>
+Jet<N> chain(const Jet<N>& a, double f, double df, double d2f) {
+  Jet<N> r(f);
+
+  for (std::size_t i{0}; i < N; i++) {
+    r.gradient[i] = df * a.gradient[i];
+    for (std::size_t j{0}; j < N; j++) {
+      r.hessian[i * N + j] = df * a.hessian[i * N + j] +
+                             d2f * a.gradient[i] * a.gradient[j];
+    }
+  }
+
+  return r;
+}
+
+/// Function of \param a and \param b, given its value \param f, its first
+/// derivatives \param fa and \param fb and its second derivatives \param faa,
+/// \param fbb and \param fab at \param a and \param b
+template<std::size_t N>
+Jet<N> chain(const Jet<N>& a,
+             const Jet<N>& b,
+             double f,
+             double fa,
+             double fb,
+             double faa,
+             double fbb,
+             double fab) {
+  Jet<N> r(f);
+
+  for (std::size_t i{0}; i < N; i++) {
+    const double ai{a.gradient[i]};
+    const double bi{b.gradient[i]};
+
+    r.gradient[i] = fa * ai + fb * bi;
+    for (std::size_t j{0}; j < N; j++) {
+      const double aj{a.gradient[j]};
+      const double bj{b.gradient[j]};
+
+      r.hessian[i * N + j] = fa * a.hessian[i * N + j] +
+                             fb * b.hessian[i * N + j] + faa * ai * aj +
+                             fbb * bi * bj + fab * (ai * bj + bi * aj);
+    }
+  }
+
+  return r;
+}
+
+template<std::size_t N>
+Jet<N> operator+(const Jet<N>& a, const Jet<N>& b) {
+  Jet<N> r(a.value + b.value);
+
+  for (std::size_t i{0}; i < N; i++) {
+    r.gradient[i] = a.gradient[i] + b.gradient[i];
+  }
+  for (std::size_t i{0}; i < N * N; i++) {
+    r.hessian[i] = a.hessian[i] + b.hessian[i];
+  }
+
+  return r;
+}
+
+template<std::size_t N>
+Jet<N> operator-(const Jet<N>& a) {
+  Jet<N> r(-a.value);
+
+  for (std::size_t i{0}; i < N; i++) {
+    r.gradient[i] = -a.gradient[i];
+  }
+  for (std::size_t i{0}; i < N * N; i++) {
+    r.hessian[i] = -a.hessian[i];
+  }
+
+  return r;
+}
+
+template<std::size_t N>
+Jet<N> operator-(const Jet<N>& a, const Jet<N>& b) {
+  return a + (-b);
+}
+
+template<std::size_t N>
+Jet<N> operator-(double a, const Jet<N>& b) {
+  return Jet<N>(a) - b;
+}
+
+template<std::size_t N>
+Jet<N> operator*(const Jet<N>& a, const Jet<N>& b) {
+  return chain(a, b, a.value * b.value, b.value, a.value, 0., 0., 1.);
+}
+
+template<std::size_t N>
+Jet<N> operator*(double a, const Jet<N>& b) {
+  return chain(b, a * b.value, a, 0.);
+}
+
+template<std::size_t N>
+Jet<N> operator/(const Jet<N>& a, const Jet<N>& b) {
+  const double ib{1. / b.value};
+
+  return chain(a,
+               b,
+               a.value * ib,
+               ib,
+               -a.value * ib * ib,
+               0.,
+               2. * a.value * ib * ib * ib,
+               -ib * ib);
+}
+
+template<std::size_t N>
+Jet<N> sqrt(const Jet<N>& a) {
+  const double s{std::sqrt(a.value)};
+
+  return chain(a, s, 0.5 / s, -0.25 / (s * s * s));
+}
+
+template<std::size_t N>
+Jet<N> acos(const Jet<N>& a) {
+  const double x{a.value};
+  const double s{1. / std::sqrt(1. - x * x)};
+
+  return chain(a, std::acos(x), -s, -x * s * s * s);
+}
+
+template<std::size_t N>
+Jet<N> asin(const Jet<N>& a) {
+  const double x{a.value};
+  const double s{1. / std::sqrt(1. - x * x)};
+
+  return chain(a, std::asin(x), s, x * s * s * s);
+}
+
+template<std::size_t N>
+Jet<N> atan2(const Jet<N>& y, const Jet<N>& x) {
+  const double yv{y.value};
+  const double xv{x.value};
+  const double ir2{1. / (xv * xv + yv * yv)};
+
+  return chain(y,
+               x,
+               std::atan2(yv, xv),
+               xv * ir2,
+               -yv * ir2,
+               -2. * xv * yv * ir2 * ir2,
+               2. * xv * yv * ir2 * ir2,
+               (yv * yv - xv * xv) * ir2 * ir2);
+}
+
+/// 3D vector of \class Jet
+template<std::size_t N>
+using Jet3 = std::array<Jet<N>, 3>;
+
+/// Position \param p, as the variables \f$3i\f$, \f$3i+1\f$ and \f$3i+2\f$
+template<std::size_t N, typename Vector3>
+Jet3<N> jet_position(const Vector3& p, std::size_t i) {
+  return {{Jet<N>::variable(3 * i + 0, p(0)),
+           Jet<N>::variable(3 * i + 1, p(1)),
+           Jet<N>::variable(3 * i + 2, p(2))}};
+}
+
+/// Constant vector \param p
+template<std::size_t N, typename Vector3>
+Jet3<N> jet_constant(const Vector3& p) {
+  return {{Jet<N>(p(0)), Jet<N>(p(1)), Jet<N>(p(2))}};
+}
+
+template<std::size_t N>
+Jet3<N> operator+(const Jet3<N>& a, const Jet3<N>& b) {
+  return {{a[0] + b[0], a[1] + b[1], a[2] + b[2]}};
+}
+
+template<std::size_t N>
+Jet3<N> operator-(const Jet3<N>& a, const Jet3<N>& b) {
+  return {{a[0] - b[0], a[1] - b[1], a[2] - b[2]}};
+}
+
+template<std::size_t N>
+Jet3<N> operator/(const Jet3<N>& a, const Jet<N>& b) {
+  return {{a[0] / b, a[1] / b, a[2] / b}};
+}
+
+template<std::size_t N>
+Jet<N> dot(const Jet3<N>& a, const Jet3<N>& b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+template<std::size_t N>
+Jet3<N> cross(const Jet3<N>& a, const Jet3<N>& b) {
+  return {{a[1] * b[2] - a[2] * b[1],
+           a[2] * b[0] - a[0] * b[2],
+           a[0] * b[1] - a[1] * b[0]}};
+}
+
+template<std::size_t N>
+Jet<N> norm(const Jet3<N>& a) {
+  return sqrt(dot(a, a));
+}
+
 } // namespace math
 
 } // namespace tools
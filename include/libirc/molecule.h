@@ -3,18 +3,32 @@
 
 #include "libirc/atom.h"
 #include "libirc/linalg.h"
+#include "libirc/periodic.h"
 
 #include <ostream>
 #include <utility>
 #include <vector>
 
+#include <boost/optional.hpp>
+
 namespace irc {
 
 namespace molecule {
 
 /// Molecule as collection of atoms
+///
+/// \tparam Vector3 3D vector
+///
+/// Periodic systems (molecular crystals, surface slabs, ...) also carry the
+/// lattice of their unit cell; the atoms are then those of a single cell.
 template<typename Vector3>
-using Molecule = std::vector<atom::Atom<Vector3>>;
+class Molecule : public std::vector<atom::Atom<Vector3>> {
+public:
+  using std::vector<atom::Atom<Vector3>>::vector;
+
+  /// Lattice of the unit cell (periodic systems only)
+  boost::optional<periodic::Lattice<Vector3>> lattice;
+};
 
 /// Compute the total mass of a molecule
 ///
@@ -36,11 +50,17 @@ double mass(const Molecule<Vector3>& molecule) noexcept {
 /// \tparam T 3D vector
 /// \param molecule Molecule
 /// \param multiplier Multiplier for atomic positions
+///
+/// The lattice vectors of periodic systems are multiplied as well.
 template<typename T, typename Vector3>
 void multiply_positions(Molecule<Vector3>& molecule, T multiplier) {
   for (auto& atom : molecule) {
     atom.position = atom.position * multiplier;
   }
+
+  if (molecule.lattice) {
+    molecule.lattice = *molecule.lattice * multiplier;
+  }
 }
 
 /*! Multiply all atomic positions within a molecule by a given @param multiplier
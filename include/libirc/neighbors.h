@@ -0,0 +1,508 @@
+#ifndef IRC_NEIGHBORS_H
+#define IRC_NEIGHBORS_H
+
+#include "libirc/linalg.h"
+#include "libirc/molecule.h"
+#include "libirc/periodic.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+namespace irc {
+
+/// Neighbour search
+namespace neighbors {
+
+/// Cell list for the search of atoms within a given cutoff distance
+///
+/// \tparam Vector3 3D vector
+///
+/// The bounding box of the molecule is divided into cubic cells with an edge
+/// at least as long as the cutoff distance. Two atoms closer than the cutoff
+/// are therefore either in the same cell or in adjacent cells, and only such
+/// pairs are emitted as candidates. The number of cells is capped to be
+/// proportional to the number of atoms, so that memory and time are linear
+/// in the size of the molecule.
+///
+/// For periodic systems the unit cell is divided into cells along the lattice
+/// vectors, and cells are adjacent across the periodic boundaries. Two atoms
+/// whose minimum image is closer than the cutoff are therefore candidates.
+template<typename Vector3>
+class CellList {
+public:
+  /// Build a cell list for \param molecule
+  ///
+  /// \param molecule Molecule
+  /// \param cutoff Cutoff distance (minimum cell edge)
+  CellList(const molecule::Molecule<Vector3>& molecule, double cutoff);
+
+  /// Call \p f(i, j) for every candidate pair of atoms in the same cell or in
+  /// adjacent cells
+  ///
+  /// \tparam F Callable with signature void(std::size_t, std::size_t)
+  /// \param f Function called on each candidate pair
+  ///
+  /// Every pair is visited exactly once and \f$i < j\f$.
+  template<typename F>
+  void for_each_pair(F&& f) const;
+
+  /// Call \p f(i) for every atom in the cell containing \p position or in
+  /// adjacent cells
+  ///
+  /// \tparam F Callable with signature void(std::size_t)
+  /// \param position Position (not necessarily within the bounding box)
+  /// \param f Function called on each candidate atom
+  ///
+  /// All the atoms closer to \p position than the cell edge are visited.
+  template<typename F>
+  void for_each_near(const Vector3& position, F&& f) const;
+
+  /// Number of cells
+  std::size_t n_cells() const { return cell_start.size() - 1; }
+
+  /// Edge of the cells (smallest distance between opposite faces)
+  double cell_length() const { return length; }
+
+  /// Cell containing atom \param i
+  std::size_t cell(std::size_t i) const { return cell_of[i]; }
+
+private:
+  /// Linear cell index from cell coordinates
+  std::size_t index(std::size_t x, std::size_t y, std::size_t z) const {
+    return (x * n[1] + y) * n[2] + z;
+  }
+
+  /// Fractional coordinates of \param r (wrapped in the unit cell along
+  /// periodic directions), or Cartesian coordinates for non-periodic systems
+  std::array<double, 3> fractional(const Vector3& r) const;
+
+  /// Cell coordinates of the fractional coordinates \param s
+  std::array<std::size_t, 3> coordinates(const std::array<double, 3>& s) const;
+
+  /// Linear indices of the cell with coordinates \param c and its adjacent
+  /// cells, without repetitions
+  void adjacent(const std::array<std::size_t, 3>& c,
+                std::vector<std::size_t>& cells) const;
+
+  /// Lattice (periodic systems only)
+  boost::optional<periodic::Lattice<Vector3>> lattice;
+
+  /// Edge of the cells
+  double length;
+
+  /// Lower corner of the bounding box (in fractional coordinates)
+  std::array<double, 3> origin;
+
+  /// Edge of the cells (in fractional coordinates)
+  std::array<double, 3> step;
+
+  /// Number of cells in each direction
+  std::array<std::size_t, 3> n;
+
+  /// Periodicity in each direction
+  std::array<bool, 3> wrap;
+
+  /// Cell index of every atom
+  std::vector<std::size_t> cell_of;
+
+  /// Offsets of every cell in the sorted list of atoms (CSR)
+  std::vector<std::size_t> cell_start;
+
+  /// Atom indices sorted by cell
+  std::vector<std::size_t> atoms;
+};
+
+template<typename Vector3>
+CellList<Vector3>::CellList(const molecule::Molecule<Vector3>& molecule,
+                            double cutoff)
+  : lattice(molecule.lattice), length(cutoff > 0 ? cutoff : 1.),
+    origin{{0., 0., 0.}}, step{{1., 1., 1.}}, n{{1, 1, 1}},
+    wrap{{false, false, false}} {
+  const std::size_t n_atoms{molecule.size()};
+
+  // Distance between opposite faces of the unit cell
+  std::array<double, 3> width{{1., 1., 1.}};
+  if (lattice) {
+    for (std::size_t m{0}; m < 3; m++) {
+      width[m] = lattice->width(m);
+      wrap[m] = lattice->periodic(m);
+    }
+  }
+
+  std::vector<std::array<double, 3>> s(n_atoms);
+  for (std::size_t i{0}; i < n_atoms; i++) {
+    s[i] = fractional(molecule[i].position);
+  }
+
+  // Bounding box
+  std::array<double, 3> lo{{0., 0., 0.}}, hi{{0., 0., 0.}};
+  for (std::size_t m{0}; m < 3; m++) {
+    lo[m] = std::numeric_limits<double>::max();
+    hi[m] = std::numeric_limits<double>::lowest();
+    for (const auto& si : s) {
+      lo[m] = std::min(lo[m], si[m]);
+      hi[m] = std::max(hi[m], si[m]);
+    }
+  }
+
+  // Keep the number of cells linear in the number of atoms
+  const std::size_t max_cells{8 * std::max<std::size_t>(n_atoms, 1)};
+  while (true) {
+    double n_total{1.};
+    for (std::size_t m{0}; m < 3; m++) {
+      if (wrap[m]) {
+        n[m] = std::max<std::size_t>(
+            static_cast<std::size_t>(std::floor(width[m] / length)), 1);
+        step[m] = 1. / n[m];
+      } else {
+        const double extent{n_atoms > 0 ? (hi[m] - lo[m]) * width[m] : 0.};
+        n[m] = static_cast<std::size_t>(std::floor(extent / length)) + 1;
+        step[m] = length / width[m];
+      }
+      n_total *= n[m];
+    }
+
+    if (n_total <= max_cells) {
+      break;
+    }
+
+    length *= 2.;
+  }
+
+  for (std::size_t m{0}; m < 3; m++) {
+    origin[m] = (wrap[m] or n_atoms == 0) ? 0. : lo[m];
+  }
+
+  // Assign atoms to cells
+  cell_of.resize(n_atoms);
+  cell_start.assign(n[0] * n[1] * n[2] + 1, 0);
+  for (std::size_t i{0}; i < n_atoms; i++) {
+    const std::array<std::size_t, 3> c{coordinates(s[i])};
+
+    cell_of[i] = index(c[0], c[1], c[2]);
+    cell_start[cell_of[i] + 1]++;
+  }
+
+  // Counting sort of the atoms by cell
+  for (std::size_t c{0}; c < n_cells(); c++) {
+    cell_start[c + 1] += cell_start[c];
+  }
+
+  atoms.resize(n_atoms);
+  std::vector<std::size_t> position(cell_start.begin(), cell_start.end() - 1);
+  for (std::size_t i{0}; i < n_atoms; i++) {
+    atoms[position[cell_of[i]]++] = i;
+  }
+}
+
+template<typename Vector3>
+std::array<double, 3> CellList<Vector3>::fractional(const Vector3& r) const {
+  const Vector3 s{lattice ? lattice->to_fractional(r) : r};
+
+  std::array<double, 3> f{{s(0), s(1), s(2)}};
+  for (std::size_t m{0}; m < 3; m++) {
+    if (wrap[m]) {
+      f[m] -= std::floor(f[m]);
+    }
+  }
+
+  return f;
+}
+
+template<typename Vector3>
+std::array<std::size_t, 3>
+CellList<Vector3>::coordinates(const std::array<double, 3>& s) const {
+  std::array<std::size_t, 3> c{{0, 0, 0}};
+  for (std::size_t m{0}; m < 3; m++) {
+    const double x{std::floor((s[m] - origin[m]) / step[m])};
+    c[m] = static_cast<std::size_t>(
+        std::min(std::max(x, 0.), static_cast<double>(n[m] - 1)));
+  }
+
+  return c;
+}
+
+template<typename Vector3>
+void CellList<Vector3>::adjacent(const std::array<std::size_t, 3>& c,
+                                 std::vector<std::size_t>& cells) const {
+  cells.clear();
+
+  std::array<long, 3> cc{{0, 0, 0}};
+  for (int dx{-1}; dx <= 1; dx++) {
+    for (int dy{-1}; dy <= 1; dy++) {
+      for (int dz{-1}; dz <= 1; dz++) {
+        const std::array<int, 3> d{{dx, dy, dz}};
+
+        bool inside{true};
+        for (std::size_t m{0}; m < 3; m++) {
+          const long nm{static_cast<long>(n[m])};
+
+          cc[m] = static_cast<long>(c[m]) + d[m];
+          if (wrap[m]) {
+            cc[m] = (cc[m] + nm) % nm;
+          } else if (cc[m] < 0 or cc[m] >= nm) {
+            inside = false;
+          }
+        }
+
+        if (inside) {
+          cells.push_back(index(cc[0], cc[1], cc[2]));
+        }
+      }
+    }
+  }
+
+  // Periodic directions with less than three cells
+  std::sort(cells.begin(), cells.end());
+  cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+}
+
+template<typename Vector3>
+template<typename F>
+void CellList<Vector3>::for_each_pair(F&& f) const {
+  auto emit = [&f](std::size_t i, std::size_t j) {
+    if (i < j) {
+      f(i, j);
+    } else {
+      f(j, i);
+    }
+  };
+
+  std::vector<std::size_t> cells;
+  for (std::size_t x{0}; x < n[0]; x++) {
+    for (std::size_t y{0}; y < n[1]; y++) {
+      for (std::size_t z{0}; z < n[2]; z++) {
+        const std::size_t c{index(x, y, z)};
+
+        if (cell_start[c] == cell_start[c + 1]) {
+          continue;
+        }
+
+        // Pairs within the same cell
+        for (std::size_t a{cell_start[c]}; a < cell_start[c + 1]; a++) {
+          for (std::size_t b{a + 1}; b < cell_start[c + 1]; b++) {
+            emit(atoms[a], atoms[b]);
+          }
+        }
+
+        // Pairs with adjacent cells (every pair of cells is visited once)
+        adjacent({{x, y, z}}, cells);
+        for (const std::size_t cc : cells) {
+          if (cc <= c) {
+            continue;
+          }
+
+          for (std::size_t a{cell_start[c]}; a < cell_start[c + 1]; a++) {
+            for (std::size_t b{cell_start[cc]}; b < cell_start[cc + 1]; b++) {
+              emit(atoms[a], atoms[b]);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template<typename Vector3>
+template<typename F>
+void CellList<Vector3>::for_each_near(const Vector3& position, F&& f) const {
+  std::vector<std::size_t> cells;
+  adjacent(coordinates(fractional(position)), cells);
+
+  for (const std::size_t cc : cells) {
+    for (std::size_t a{cell_start[cc]}; a < cell_start[cc + 1]; a++) {
+      f(atoms[a]);
+    }
+  }
+}
+
+/// Neighbour of an atom, with the corresponding interatomic distance
+struct Neighbor {
+  /// Index of the neighbouring atom
+  std::size_t index;
+
+  /// Distance from the neighbouring atom
+  double distance;
+};
+
+/// Sparse interatomic distances within a cutoff
+///
+/// The distances are stored in compressed sparse row (CSR) format: the
+/// neighbours of every atom are stored contiguously and sorted by index.
+/// Every pair is stored twice, once for each atom, so that the neighbours of
+/// an atom can be accessed directly.
+class NeighborList {
+public:
+  /// Contiguous range of neighbours
+  struct Range {
+    const Neighbor* first;
+    const Neighbor* last;
+
+    const Neighbor* begin() const { return first; }
+    const Neighbor* end() const { return last; }
+    std::size_t size() const { return last - first; }
+  };
+
+  /// Empty neighbour list
+  NeighborList() : cutoff_distance(0.), offsets(1, 0) {}
+
+  /// Compute all interatomic distances within \param cutoff
+  ///
+  /// \tparam Vector3 3D vector
+  /// \param molecule Molecule
+  /// \param cutoff Cutoff distance
+  ///
+  /// For periodic systems the minimum image distances are stored; the cutoff
+  /// must be shorter than half the width of the unit cell along every periodic
+  /// direction, otherwise a pair would have more than one image within the
+  /// cutoff and std::invalid_argument is thrown.
+  template<typename Vector3>
+  NeighborList(const molecule::Molecule<Vector3>& molecule, double cutoff);
+
+  /// Recompute the stored distances for the atomic positions of \param
+  /// molecule
+  ///
+  /// \tparam Vector3 3D vector
+  /// \param molecule Molecule (same atoms, displaced)
+  ///
+  /// Pairs are neither added nor removed, so that distances can grow beyond
+  /// the cutoff. If the list was built with a cutoff extended by a skin
+  /// (Verlet list), it still contains every pair within the original cutoff
+  /// as long as no atom moved by more than half the skin.
+  template<typename Vector3>
+  void update(const molecule::Molecule<Vector3>& molecule);
+
+  /// Number of atoms
+  std::size_t size() const { return offsets.size() - 1; }
+
+  /// Number of pairs of atoms within the cutoff
+  std::size_t n_pairs() const { return entries.size() / 2; }
+
+  /// Cutoff distance
+  double cutoff() const { return cutoff_distance; }
+
+  /// Neighbours of atom \param i, sorted by index
+  Range neighbors(std::size_t i) const {
+    return {entries.data() + offsets[i], entries.data() + offsets[i + 1]};
+  }
+
+  /// Distance between atoms \param i and \param j
+  ///
+  /// \return Interatomic distance if atoms \param i and \param j are within
+  /// the cutoff, infinity otherwise
+  double operator()(std::size_t i, std::size_t j) const;
+
+private:
+  /// Cutoff distance
+  double cutoff_distance;
+
+  /// Offsets of the neighbours of every atom
+  std::vector<std::size_t> offsets;
+
+  /// Neighbours of all atoms
+  std::vector<Neighbor> entries;
+};
+
+template<typename Vector3>
+NeighborList::NeighborList(const molecule::Molecule<Vector3>& molecule,
+                           double cutoff)
+  : cutoff_distance(cutoff), offsets(molecule.size() + 1, 0) {
+  const std::size_t n_atoms{molecule.size()};
+
+  if (molecule.lattice) {
+    for (std::size_t m{0}; m < 3; m++) {
+      if (molecule.lattice->periodic(m) and
+          molecule.lattice->width(m) < 2 * cutoff) {
+        throw std::invalid_argument(
+            "Cutoff longer than half the width of the unit cell.");
+      }
+    }
+  }
+
+  struct Pair {
+    std::size_t i;
+    std::size_t j;
+    double d;
+  };
+
+  // Find pairs within the cutoff
+  std::vector<Pair> pairs;
+  const CellList<Vector3> cells(molecule, cutoff);
+  cells.for_each_pair([&](std::size_t i, std::size_t j) {
+    const Vector3& pi{molecule[i].position};
+    const double d{linalg::norm(Vector3(
+        periodic::closest_image(pi, molecule[j].position, molecule.lattice) -
+        pi))};
+
+    if (d < cutoff) {
+      pairs.push_back({i, j, d});
+      offsets[i + 1]++;
+      offsets[j + 1]++;
+    }
+  });
+
+  for (std::size_t i{0}; i < n_atoms; i++) {
+    offsets[i + 1] += offsets[i];
+  }
+
+  // Store pairs for both atoms
+  entries.resize(offsets[n_atoms]);
+  std::vector<std::size_t> position(offsets.begin(), offsets.end() - 1);
+  for (const auto& p : pairs) {
+    entries[position[p.i]++] = {p.j, p.d};
+    entries[position[p.j]++] = {p.i, p.d};
+  }
+
+  // Sort neighbours by index
+  for (std::size_t i{0}; i < n_atoms; i++) {
+    std::sort(entries.begin() + offsets[i],
+              entries.begin() + offsets[i + 1],
+              [](const Neighbor& a, const Neighbor& b) {
+                return a.index < b.index;
+              });
+  }
+}
+
+template<typename Vector3>
+void NeighborList::update(const molecule::Molecule<Vector3>& molecule) {
+  const std::size_t n_atoms{size()};
+
+  for (std::size_t i{0}; i < n_atoms; i++) {
+    const Vector3& pi{molecule[i].position};
+
+    for (std::size_t e{offsets[i]}; e < offsets[i + 1]; e++) {
+      const std::size_t j{entries[e].index};
+
+      entries[e].distance = linalg::norm(Vector3(
+          periodic::closest_image(pi, molecule[j].position, molecule.lattice) -
+          pi));
+    }
+  }
+}
+
+inline double NeighborList::operator()(std::size_t i, std::size_t j) const {
+  const Range range{neighbors(i)};
+
+  const Neighbor* n{std::lower_bound(
+      range.begin(), range.end(), j, [](const Neighbor& a, std::size_t idx) {
+        return a.index < idx;
+      })};
+
+  if (n != range.end() and n->index == j) {
+    return n->distance;
+  }
+
+  return std::numeric_limits<double>::infinity();
+}
+
+} // namespace neighbors
+
+} // namespace irc
+
+#endif // IRC_NEIGHBORS_H
@@ -0,0 +1,267 @@
+#ifndef IRC_PARALLEL_H
+#define IRC_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace irc {
+
+/// Parallel evaluation of independent primitive internal coordinates
+///
+/// Primitives are partitioned in contiguous ranges, which are processed by the
+/// threads of a persistent pool. Every range writes its own rows or entries
+/// only, therefore the results do not depend on the number of threads.
+///
+/// The pool has a single thread by default: parallel evaluation is enabled with
+/// \function set_n_threads. Ranges contain at least \function grain_size
+/// primitives, so that small molecules are still processed serially.
+namespace parallel {
+
+/// Pool of threads running tasks of the same function
+class ThreadPool {
+public:
+  /// Pool of \param n_threads threads, including the calling thread
+  explicit ThreadPool(std::size_t n_threads);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool();
+
+  /// Number of threads, including the calling thread
+  std::size_t size() const { return workers.size() + 1; }
+
+  /// Call \param f for every task index in \f$[0, n_{tasks})\f$
+  ///
+  /// The calling thread takes part in the work and returns when all the tasks
+  /// are completed. The first exception thrown by a task is rethrown.
+  /// Nested calls (from within a task) run serially.
+  template<typename F>
+  void run(std::size_t n_tasks, F f);
+
+private:
+  /// Worker loop
+  void work();
+
+  /// Run tasks until there are none left
+  void execute();
+
+  /// Whether the current thread is running tasks of a pool
+  static bool& running() {
+    static thread_local bool r{false};
+    return r;
+  }
+
+  /// Workers
+  std::vector<std::thread> workers;
+
+  /// Serializes calls to \function run
+  std::mutex run_mutex;
+
+  /// Protects the state of the pool
+  std::mutex mutex;
+
+  /// Signals a new set of tasks (or the end of the pool)
+  std::condition_variable start;
+
+  /// Signals that all workers are done
+  std::condition_variable done;
+
+  /// Current function
+  std::function<void(std::size_t)> task;
+
+  /// Number of tasks
+  std::size_t n_tasks{0};
+
+  /// Next task index
+  std::atomic<std::size_t> next{0};
+
+  /// Number of workers still running the current set of tasks
+  std::size_t n_running{0};
+
+  /// Index of the current set of tasks
+  std::size_t generation{0};
+
+  /// Stop the workers
+  bool stop{false};
+
+  /// First exception thrown by a task
+  std::exception_ptr error;
+};
+
+inline ThreadPool::ThreadPool(std::size_t n_threads) {
+  for (std::size_t i{1}; i < n_threads; i++) {
+    workers.emplace_back([this]() { work(); });
+  }
+}
+
+inline ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  start.notify_all();
+
+  for (auto& w : workers) {
+    w.join();
+  }
+}
+
+template<typename F>
+void ThreadPool::run(std::size_t n_tasks, F f) {
+  if (workers.empty() or n_tasks < 2 or running()) {
+    for (std::size_t t{0}; t < n_tasks; t++) {
+      f(t);
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> serial(run_mutex);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    task = f;
+    this->n_tasks = n_tasks;
+    next = 0;
+    n_running = workers.size();
+    error = nullptr;
+    generation++;
+  }
+  start.notify_all();
+
+  execute();
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]() { return n_running == 0; });
+    task = nullptr;
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+inline void ThreadPool::work() {
+  std::size_t current{0};
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      start.wait(lock, [&]() { return stop or generation != current; });
+
+      if (stop) {
+        return;
+      }
+
+      current = generation;
+    }
+
+    execute();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--n_running == 0) {
+        done.notify_one();
+      }
+    }
+  }
+}
+
+inline void ThreadPool::execute() {
+  running() = true;
+
+  for (std::size_t t{next++}; t < n_tasks; t = next++) {
+    try {
+      task(t);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+
+  running() = false;
+}
+
+/// Settings of the parallel evaluation
+struct Settings {
+  /// Thread pool
+  std::unique_ptr<ThreadPool> pool{new ThreadPool(1)};
+
+  /// Minimum number of primitives per range
+  std::size_t grain_size{512};
+};
+
+/// Global settings
+///
+/// The settings must not be changed while internal coordinates are computed.
+inline Settings& settings() {
+  static Settings s;
+  return s;
+}
+
+/// Use \param n threads (one thread per core if zero)
+inline void set_n_threads(std::size_t n) {
+  if (n == 0) {
+    n = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  if (n != settings().pool->size()) {
+    settings().pool.reset(new ThreadPool(n));
+  }
+}
+
+/// Number of threads
+inline std::size_t n_threads() { return settings().pool->size(); }
+
+/// Set the minimum number of primitives per range to \param n
+inline void set_grain_size(std::size_t n) {
+  settings().grain_size = std::max<std::size_t>(n, 1);
+}
+
+/// Minimum number of primitives per range
+inline std::size_t grain_size() { return settings().grain_size; }
+
+/// Call \param f for contiguous ranges covering \f$[0, n)\f$, in parallel
+///
+/// \tparam F Callable taking the first and the past-the-end indices of a range
+/// \param n Number of primitives
+/// \param f Function processing a range (must be thread-safe)
+/// \param align Ranges start at multiples of \param align
+///
+/// The ranges contain at least \function grain_size primitives; when a
+/// single range is needed \param f is called directly with \f$[0, n)\f$.
+template<typename F>
+void for_each_range(std::size_t n, F f, std::size_t align = 1) {
+  ThreadPool& pool = *settings().pool;
+
+  const std::size_t n_ranges{std::min(pool.size(), n / grain_size())};
+  if (n_ranges < 2) {
+    f(std::size_t{0}, n);
+    return;
+  }
+
+  // Range size, rounded up to a multiple of align
+  std::size_t size{(n + n_ranges - 1) / n_ranges};
+  size = (size + align - 1) / align * align;
+
+  pool.run((n + size - 1) / size, [n, size, &f](std::size_t t) {
+    f(t * size, std::min(n, (t + 1) * size));
+  });
+}
+
+} // namespace parallel
+
+} // namespace irc
+
+#endif // IRC_PARALLEL_H
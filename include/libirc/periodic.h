@@ -0,0 +1,176 @@
+#ifndef IRC_PERIODIC_H
+#define IRC_PERIODIC_H
+
+#include "libirc/linalg.h"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <boost/optional.hpp>
+
+namespace irc {
+
+/// Periodic boundary conditions
+namespace periodic {
+
+/// Lattice of a periodic system
+///
+/// \tparam Vector3 3D vector
+///
+/// The unit cell is spanned by three lattice vectors. Periodic boundary
+/// conditions can be switched off along each lattice vector (i.e. for
+/// surface slabs). Displacements between atoms are reduced to their minimum
+/// image along the periodic directions.
+template<typename Vector3>
+class Lattice {
+public:
+  /// Lattice from lattice vectors \param a, \param b and \param c
+  ///
+  /// \param a First lattice vector
+  /// \param b Second lattice vector
+  /// \param c Third lattice vector
+  /// \param pbc Periodic boundary conditions along each lattice vector
+  Lattice(const Vector3& a,
+          const Vector3& b,
+          const Vector3& c,
+          const std::array<bool, 3>& pbc = {{true, true, true}});
+
+  /// Lattice vector \param m
+  const Vector3& vector(std::size_t m) const { return vectors[m]; }
+
+  /// Periodic boundary conditions along lattice vector \param m
+  bool periodic(std::size_t m) const { return pbc[m]; }
+
+  /// Volume of the unit cell
+  double volume() const {
+    return std::abs(
+        linalg::dot(vectors[0], linalg::cross(vectors[1], vectors[2])));
+  }
+
+  /// Distance between the faces of the unit cell spanned by the other two
+  /// lattice vectors
+  ///
+  /// \param m Lattice vector index
+  /// \return Width of the unit cell along lattice vector \param m
+  double width(std::size_t m) const {
+    return 1. / linalg::norm(reciprocal[m]);
+  }
+
+  /// Fractional coordinates of \param r
+  Vector3 to_fractional(const Vector3& r) const {
+    return {linalg::dot(reciprocal[0], r),
+            linalg::dot(reciprocal[1], r),
+            linalg::dot(reciprocal[2], r)};
+  }
+
+  /// Cartesian coordinates of fractional coordinates \param s
+  Vector3 to_cartesian(const Vector3& s) const {
+    return Vector3(s(0) * vectors[0] + s(1) * vectors[1] + s(2) * vectors[2]);
+  }
+
+  /// Minimum image of the displacement \param d
+  ///
+  /// \param d Displacement
+  /// \return Shortest periodic image of \param d
+  Vector3 minimum_image(const Vector3& d) const;
+
+  /// Lattice with all lattice vectors multiplied by \param multiplier
+  template<typename T>
+  Lattice operator*(T multiplier) const {
+    return {Vector3(vectors[0] * multiplier),
+            Vector3(vectors[1] * multiplier),
+            Vector3(vectors[2] * multiplier),
+            pbc};
+  }
+
+private:
+  /// Lattice vectors
+  std::array<Vector3, 3> vectors;
+
+  /// Reciprocal vectors (without the factor of 2 pi)
+  std::array<Vector3, 3> reciprocal;
+
+  /// Periodic boundary conditions along each lattice vector
+  std::array<bool, 3> pbc;
+};
+
+template<typename Vector3>
+Lattice<Vector3>::Lattice(const Vector3& a,
+                          const Vector3& b,
+                          const Vector3& c,
+                          const std::array<bool, 3>& pbc)
+  : vectors{{a, b, c}}, reciprocal{{a, b, c}}, pbc(pbc) {
+  const double v{linalg::dot(a, linalg::cross(b, c))};
+
+  if (std::abs(v) < 1e-12) {
+    throw std::invalid_argument("Degenerate lattice vectors.");
+  }
+
+  reciprocal[0] = linalg::cross(b, c) / v;
+  reciprocal[1] = linalg::cross(c, a) / v;
+  reciprocal[2] = linalg::cross(a, b) / v;
+}
+
+template<typename Vector3>
+Vector3 Lattice<Vector3>::minimum_image(const Vector3& d) const {
+  // Wrap fractional coordinates in [-0.5, 0.5]
+  Vector3 s{to_fractional(d)};
+  for (std::size_t m{0}; m < 3; m++) {
+    if (pbc[m]) {
+      s(m) -= std::round(s(m));
+    }
+  }
+
+  const Vector3 d0{to_cartesian(s)};
+
+  // For skewed cells the shortest image can be in a neighbouring cell
+  Vector3 d_min{d0};
+  double n_min{linalg::norm(d0)};
+  for (int i{-1}; i <= 1; i++) {
+    for (int j{-1}; j <= 1; j++) {
+      for (int k{-1}; k <= 1; k++) {
+        if ((i != 0 and not pbc[0]) or (j != 0 and not pbc[1]) or
+            (k != 0 and not pbc[2])) {
+          continue;
+        }
+
+        const Vector3 di{d0 + to_cartesian({double(i), double(j), double(k)})};
+        const double n{linalg::norm(di)};
+
+        if (n < n_min) {
+          d_min = di;
+          n_min = n;
+        }
+      }
+    }
+  }
+
+  return d_min;
+}
+
+/// Periodic image of \param p closest to \param reference
+///
+/// \tparam Vector3 3D vector
+/// \param reference Reference position
+/// \param p Position
+/// \param lattice Lattice (if any)
+/// \return Image of \param p closest to \param reference, or \param p itself
+/// for non-periodic systems
+template<typename Vector3>
+Vector3 closest_image(const Vector3& reference,
+                      const Vector3& p,
+                      const boost::optional<Lattice<Vector3>>& lattice) {
+  if (not lattice) {
+    return p;
+  }
+
+  return Vector3(reference + lattice->minimum_image(Vector3(p - reference)));
+}
+
+} // namespace periodic
+
+} // namespace irc
+
+#endif // IRC_PERIODIC_H
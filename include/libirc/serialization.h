@@ -0,0 +1,458 @@
+#ifndef IRC_SERIALIZATION_H
+#define IRC_SERIALIZATION_H
+
+#include "libirc/connectivity.h"
+#include "libirc/linalg.h"
+#include "libirc/periodic.h"
+#include "libirc/wilson.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace irc {
+
+/// Binary serialization
+///
+/// Binary files are sequences of fixed-width fields in native byte order:
+/// 64-bit sizes, 32-bit atom indices, 8-bit flags and double precision
+/// numbers. They start with a magic number and the version of the format, so
+/// that files written with another byte order or with another version of the
+/// format are rejected.
+namespace serialization {
+
+/// Magic number ("IRCB" on little-endian machines)
+constexpr std::uint32_t magic{0x42435249};
+
+/// Version of the binary format
+constexpr std::uint32_t version{4};
+
+/// Binary output stream
+class Writer {
+public:
+  /// Write to \param out (opened in binary mode)
+  explicit Writer(std::ostream& out) : out(out) {}
+
+  /// Write \param value as it is stored in memory
+  template<typename T>
+  void write(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be written.");
+
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  /// Write atom index \param i
+  void write_index(std::size_t i) {
+    if (i > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::length_error("ERROR: Atom index too large.");
+    }
+
+    write(static_cast<std::uint32_t>(i));
+  }
+
+  /// Write size \param n
+  void write_size(std::size_t n) { write(static_cast<std::uint64_t>(n)); }
+
+private:
+  /// Output stream
+  std::ostream& out;
+};
+
+/// Binary input from a memory buffer
+///
+/// The buffer (i.e. a memory-mapped file) must outlive the reader. Reading
+/// past the end of the buffer throws.
+class Reader {
+public:
+  /// Read from the \param size bytes starting at \param data
+  Reader(const char* data, std::size_t size) : data(data), length(size) {}
+
+  /// Read a value stored as it is in memory
+  template<typename T>
+  T read() {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be read.");
+
+    require(sizeof(T));
+
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+
+    return value;
+  }
+
+  /// Read an atom index
+  std::size_t read_index() { return read<std::uint32_t>(); }
+
+  /// Read a size
+  ///
+  /// \param element_size Smallest size (in bytes) of one of the elements
+  /// \return Number of elements
+  std::size_t read_size(std::size_t element_size = 1) {
+    const std::uint64_t n{read<std::uint64_t>()};
+
+    // Reject sizes that cannot fit in the remaining bytes
+    if (element_size != 0 and n > remaining() / element_size) {
+      throw std::runtime_error("Truncated binary file.");
+    }
+
+    return n;
+  }
+
+  /// Number of bytes left
+  std::size_t remaining() const { return length - offset; }
+
+private:
+  /// Check that \param n bytes are left
+  void require(std::size_t n) const {
+    if (n > remaining()) {
+      throw std::runtime_error("Truncated binary file.");
+    }
+  }
+
+  /// Buffer
+  const char* data;
+
+  /// Size of the buffer
+  std::size_t length;
+
+  /// Position in the buffer
+  std::size_t offset{0};
+};
+
+/// Read-only memory-mapped file
+class MappedFile {
+public:
+  /// Map \param filename in memory
+  explicit MappedFile(const std::string& filename);
+
+  /// Reader for the whole file
+  Reader reader() const {
+    return {static_cast<const char*>(region.get_address()), region.get_size()};
+  }
+
+private:
+  /// File
+  boost::interprocess::file_mapping file;
+
+  /// Mapped region (whole file)
+  boost::interprocess::mapped_region region;
+};
+
+inline MappedFile::MappedFile(const std::string& filename) {
+  try {
+    file = boost::interprocess::file_mapping(filename.c_str(),
+                                             boost::interprocess::read_only);
+    region = boost::interprocess::mapped_region(
+        file, boost::interprocess::read_only);
+  } catch (const boost::interprocess::interprocess_exception&) {
+    throw std::runtime_error("Impossible to map file " + filename);
+  }
+}
+
+/// Write the magic number and the version of the format
+inline void write_header(Writer& w) {
+  w.write(magic);
+  w.write(version);
+}
+
+/// Check the magic number and the version of the format
+inline void read_header(Reader& r) {
+  if (r.read<std::uint32_t>() != magic) {
+    throw std::runtime_error("Not a binary IRC file.");
+  }
+
+  if (r.read<std::uint32_t>() != version) {
+    throw std::runtime_error("Unsupported version of the binary IRC file.");
+  }
+}
+
+inline void write(Writer& w, connectivity::Constraint c) {
+  w.write(
+      static_cast<std::uint8_t>(c == connectivity::Constraint::constrained));
+}
+
+inline connectivity::Constraint read_constraint(Reader& r) {
+  return r.read<std::uint8_t>() != 0 ? connectivity::Constraint::constrained
+                                     : connectivity::Constraint::unconstrained;
+}
+
+/// Check that the atom indices \param indices of an internal coordinate are
+/// all different
+///
+/// The constructors of the internal coordinates throw std::logic_error for
+/// repeated indices, which is reserved for programming errors.
+inline void check_distinct(std::initializer_list<std::size_t> indices) {
+  for (auto i = indices.begin(); i != indices.end(); i++) {
+    if (std::find(i + 1, indices.end(), *i) != indices.end()) {
+      throw std::runtime_error("Repeated atom index in binary file.");
+    }
+  }
+}
+
+inline void write(Writer& w, const connectivity::Bond& b) {
+  w.write_index(b.i);
+  w.write_index(b.j);
+  write(w, b.constraint);
+}
+
+inline connectivity::Bond read_bond(Reader& r) {
+  const std::size_t i{r.read_index()};
+  const std::size_t j{r.read_index()};
+  check_distinct({i, j});
+
+  return {i, j, read_constraint(r)};
+}
+
+inline void write(Writer& w, const connectivity::Angle& a) {
+  w.write_index(a.i);
+  w.write_index(a.j);
+  w.write_index(a.k);
+  write(w, a.constraint);
+}
+
+inline connectivity::Angle read_angle(Reader& r) {
+  const std::size_t i{r.read_index()};
+  const std::size_t j{r.read_index()};
+  const std::size_t k{r.read_index()};
+  check_distinct({i, j, k});
+
+  return {i, j, k, read_constraint(r)};
+}
+
+inline void write(Writer& w, const connectivity::Dihedral& d) {
+  w.write_index(d.i);
+  w.write_index(d.j);
+  w.write_index(d.k);
+  w.write_index(d.l);
+  write(w, d.constraint);
+}
+
+inline connectivity::Dihedral read_dihedral(Reader& r) {
+  const std::size_t i{r.read_index()};
+  const std::size_t j{r.read_index()};
+  const std::size_t k{r.read_index()};
+  const std::size_t l{r.read_index()};
+  check_distinct({i, j, k, l});
+
+  return {i, j, k, l, read_constraint(r)};
+}
+
+template<typename Vector3>
+void write(Writer& w, const connectivity::LinearAngle<Vector3>& a) {
+  w.write_index(a.i);
+  w.write_index(a.j);
+  w.write_index(a.k);
+  for (std::size_t m{0}; m < 3; m++) {
+    w.write<double>(a.orthogonal_direction(m));
+  }
+  w.write(static_cast<std::uint8_t>(a.tag ==
+                                    connectivity::LinearAngleTag::Second));
+  write(w, a.constraint);
+}
+
+template<typename Vector3>
+connectivity::LinearAngle<Vector3> read_linear_angle(Reader& r) {
+  const std::size_t i{r.read_index()};
+  const std::size_t j{r.read_index()};
+  const std::size_t k{r.read_index()};
+  check_distinct({i, j, k});
+
+  Vector3 direction;
+  for (std::size_t m{0}; m < 3; m++) {
+    direction(m) = r.read<double>();
+  }
+
+  const connectivity::LinearAngleTag tag{
+      r.read<std::uint8_t>() != 0 ? connectivity::LinearAngleTag::Second
+                                  : connectivity::LinearAngleTag::First};
+
+  return {i, j, k, direction, tag, read_constraint(r)};
+}
+
+inline void write(Writer& w, const connectivity::OutOfPlaneBend& b) {
+  w.write_index(b.c);
+  w.write_index(b.i);
+  w.write_index(b.j);
+  w.write_index(b.k);
+  write(w, b.constraint);
+}
+
+inline connectivity::OutOfPlaneBend read_out_of_plane_bend(Reader& r) {
+  const std::size_t c{r.read_index()};
+  const std::size_t i{r.read_index()};
+  const std::size_t j{r.read_index()};
+  const std::size_t k{r.read_index()};
+  check_distinct({c, i, j, k});
+
+  return {c, i, j, k, read_constraint(r)};
+}
+
+template<typename Vector3>
+void write(Writer& w, const periodic::Lattice<Vector3>& lattice) {
+  for (std::size_t m{0}; m < 3; m++) {
+    for (std::size_t n{0}; n < 3; n++) {
+      w.write<double>(lattice.vector(m)(n));
+    }
+  }
+  for (std::size_t m{0}; m < 3; m++) {
+    w.write(static_cast<std::uint8_t>(lattice.periodic(m)));
+  }
+}
+
+template<typename Vector3>
+periodic::Lattice<Vector3> read_lattice(Reader& r) {
+  std::array<Vector3, 3> vectors;
+  for (std::size_t m{0}; m < 3; m++) {
+    for (std::size_t n{0}; n < 3; n++) {
+      vectors[m](n) = r.read<double>();
+    }
+  }
+
+  std::array<bool, 3> pbc;
+  for (std::size_t m{0}; m < 3; m++) {
+    pbc[m] = r.read<std::uint8_t>() != 0;
+  }
+
+  return {vectors[0], vectors[1], vectors[2], pbc};
+}
+
+/// Write the number of elements of \param v, followed by the elements
+template<typename T>
+void write(Writer& w, const std::vector<T>& v) {
+  w.write_size(v.size());
+  for (const auto& e : v) {
+    write(w, e);
+  }
+}
+
+/// Read a vector written by \function write
+///
+/// \tparam F Callable reading one element
+/// \param r Reader
+/// \param read_element Function reading one element
+/// \return Vector of elements
+template<typename F>
+auto read_vector(Reader& r, F read_element)
+    -> std::vector<decltype(read_element(r))> {
+  const std::size_t n{r.read_size()};
+
+  std::vector<decltype(read_element(r))> v;
+  v.reserve(n);
+  for (std::size_t i{0}; i < n; i++) {
+    v.push_back(read_element(r));
+  }
+
+  return v;
+}
+
+/// Write the dimensions of \param m, followed by its elements (column-major)
+template<typename Matrix>
+void write_matrix(Writer& w, const Matrix& m) {
+  const std::size_t n_rows{linalg::n_rows(m)};
+  const std::size_t n_cols{linalg::n_cols(m)};
+
+  w.write_size(n_rows);
+  w.write_size(n_cols);
+  for (std::size_t j{0}; j < n_cols; j++) {
+    for (std::size_t i{0}; i < n_rows; i++) {
+      w.write<double>(m(i, j));
+    }
+  }
+}
+
+/// Read a matrix written by \function write_matrix
+template<typename Matrix>
+Matrix read_matrix(Reader& r) {
+  const std::size_t n_rows{r.read_size()};
+  const std::size_t n_cols{r.read_size()};
+
+  if (n_rows != 0 and n_cols > r.remaining() / sizeof(double) / n_rows) {
+    throw std::runtime_error("Truncated binary file.");
+  }
+
+  Matrix m{linalg::zeros<Matrix>(n_rows, n_cols)};
+  for (std::size_t j{0}; j < n_cols; j++) {
+    for (std::size_t i{0}; i < n_rows; i++) {
+      m(i, j) = r.read<double>();
+    }
+  }
+
+  return m;
+}
+
+/// Size (in bytes) of a row of sparse Wilson's B matrix
+constexpr std::size_t sparse_row_size{
+    sizeof(std::uint8_t) + 4 * sizeof(std::uint32_t) + 12 * sizeof(double)};
+
+/// Write sparse Wilson's B matrix \param B
+///
+/// Every row is a fixed-width record: number of atoms, four atom indices and
+/// twelve gradient components (unused entries are zero).
+template<typename Vector>
+void write(Writer& w, const wilson::SparseWilsonMatrix<Vector>& B) {
+  w.write_size(B.n_rows());
+  w.write_size(B.n_cols());
+  for (std::size_t i{0}; i < B.n_rows(); i++) {
+    const auto& row = B.row(i);
+
+    w.write(static_cast<std::uint8_t>(row.n_atoms));
+    for (std::size_t a{0}; a < 4; a++) {
+      w.write_index(a < row.n_atoms ? row.atoms[a] : 0);
+    }
+    for (std::size_t v{0}; v < 12; v++) {
+      w.write<double>(v < 3 * row.n_atoms ? row.values[v] : 0.);
+    }
+  }
+}
+
+/// Read a sparse Wilson's B matrix written by \function write
+template<typename Vector>
+wilson::SparseWilsonMatrix<Vector> read_sparse_wilson_matrix(Reader& r) {
+  const std::size_t n_rows{r.read_size(sparse_row_size)};
+  const std::size_t n_cols{r.read_size()};
+
+  wilson::SparseWilsonMatrix<Vector> B(n_rows, n_cols);
+
+  typename wilson::SparseWilsonMatrix<Vector>::Row row;
+  for (std::size_t i{0}; i < n_rows; i++) {
+    row.n_atoms = r.read<std::uint8_t>();
+    if (row.n_atoms > 4) {
+      throw std::runtime_error("Invalid number of atoms in binary file.");
+    }
+
+    for (std::size_t a{0}; a < 4; a++) {
+      const std::size_t atom{r.read_index()};
+      if (a < row.n_atoms and 3 * atom >= n_cols) {
+        throw std::runtime_error("Invalid atom index in binary file.");
+      }
+      row.atoms[a] = atom;
+    }
+    for (std::size_t v{0}; v < 12; v++) {
+      row.values[v] = r.read<double>();
+    }
+
+    B.set_row(i, row);
+  }
+
+  return B;
+}
+
+} // namespace serialization
+
+} // namespace irc
+
+#endif // IRC_SERIALIZATION_H
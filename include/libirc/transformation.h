@@ -4,10 +4,13 @@
 #include "libirc/connectivity.h"
 #include "libirc/linalg.h"
 #include "libirc/mathtools.h"
+#include "libirc/periodic.h"
 #include "libirc/wilson.h"
 
 #include <iostream>
 
+#include <boost/optional.hpp>
+
 namespace irc {
 
 namespace transformation {
@@ -50,6 +53,155 @@ Vector gradient_irc_to_cartesian(const Vector& grad_irc, const Matrix& B) {
   return linalg::transpose(B) * grad_irc;
 }
 
+/// Transform gradient from cartesian to internal redundant coordinates,
+/// without projection, with a sparse Wilson \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector
+/// \param grad_c Gradient in cartesian coordinates
+/// \param B Sparse Wilson \f$\mathbf{B}\f$ matrix
+/// \return Gradient in internal redundant coordinates
+template<typename Vector>
+Vector gradient_cartesian_to_irc(const Vector& grad_c,
+                                 const wilson::SparseWilsonMatrix<Vector>& B) {
+  return B.solve_transpose(grad_c);
+}
+
+/// Transform gradient from internal redundant coordinates (non-projected)
+/// to cartesian coordinates, with a sparse Wilson \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector
+/// \param grad_irc Gradient in internal redundant coordinates
+/// \param B Sparse Wilson \f$\mathbf{B}\f$ matrix
+/// \return Gradient in cartesian coordinates
+template<typename Vector>
+Vector gradient_irc_to_cartesian(const Vector& grad_irc,
+                                 const wilson::SparseWilsonMatrix<Vector>& B) {
+  return B.transpose_product(grad_irc);
+}
+
+/// Transform gradient from cartesian to internal redundant coordinates,
+/// without projection, with a matrix-free Wilson \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector3
+/// \tparam Vector
+/// \param grad_c Gradient in cartesian coordinates
+/// \param B Matrix-free Wilson \f$\mathbf{B}\f$ matrix
+/// \return Gradient in internal redundant coordinates
+template<typename Vector3, typename Vector>
+Vector
+gradient_cartesian_to_irc(const Vector& grad_c,
+                          const wilson::WilsonOperator<Vector3, Vector>& B) {
+  return B.solve_transpose(grad_c);
+}
+
+/// Transform gradient from internal redundant coordinates (non-projected)
+/// to cartesian coordinates, with a matrix-free Wilson \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector3
+/// \tparam Vector
+/// \param grad_irc Gradient in internal redundant coordinates
+/// \param B Matrix-free Wilson \f$\mathbf{B}\f$ matrix
+/// \return Gradient in cartesian coordinates
+template<typename Vector3, typename Vector>
+Vector
+gradient_irc_to_cartesian(const Vector& grad_irc,
+                          const wilson::WilsonOperator<Vector3, Vector>& B) {
+  return B.transpose_product(grad_irc);
+}
+
+/// Pseudo-inverse of Wilson's \f$\mathbf{B}\f$ matrix, for the
+/// transformation of internal displacements to cartesian displacements
+///
+/// \tparam Vector3
+/// \tparam Vector
+/// \tparam Matrix Dense matrix (stored pseudo-inverse),
+/// wilson::SparseWilsonMatrix or wilson::WilsonOperator (least-squares solution
+/// for every product)
+template<typename Vector3, typename Vector, typename Matrix>
+class WilsonInverse {
+public:
+  /// Pseudo-inverse of Wilson's B matrix at \param x_c
+  WilsonInverse(
+      const Vector& x_c,
+      const std::vector<connectivity::Bond>& bonds,
+      const std::vector<connectivity::Angle>& angles,
+      const std::vector<connectivity::Dihedral>& dihedrals,
+      const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles,
+      const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends,
+      const boost::optional<periodic::Lattice<Vector3>>& lattice)
+    : iB(linalg::pseudo_inverse(
+          wilson::wilson_matrix<Vector3, Vector, Matrix>(x_c,
+                                                         bonds,
+                                                         angles,
+                                                         dihedrals,
+                                                         linear_angles,
+                                                         out_of_plane_bends,
+                                                         lattice))) {}
+
+  /// Cartesian displacement corresponding to \param dq
+  Vector operator*(const Vector& dq) const { return iB * dq; }
+
+private:
+  /// Pseudo-inverse
+  Matrix iB;
+};
+
+template<typename Vector3, typename Vector>
+class WilsonInverse<Vector3, Vector, wilson::SparseWilsonMatrix<Vector>> {
+public:
+  /// Sparse Wilson's B matrix at \param x_c
+  WilsonInverse(
+      const Vector& x_c,
+      const std::vector<connectivity::Bond>& bonds,
+      const std::vector<connectivity::Angle>& angles,
+      const std::vector<connectivity::Dihedral>& dihedrals,
+      const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles,
+      const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends,
+      const boost::optional<periodic::Lattice<Vector3>>& lattice)
+    : B(wilson::sparse_wilson_matrix<Vector3, Vector>(x_c,
+                                                      bonds,
+                                                      angles,
+                                                      dihedrals,
+                                                      linear_angles,
+                                                      out_of_plane_bends,
+                                                      lattice)) {}
+
+  /// Cartesian displacement corresponding to \param dq
+  Vector operator*(const Vector& dq) const { return B.solve(dq); }
+
+private:
+  /// Sparse Wilson's B matrix
+  wilson::SparseWilsonMatrix<Vector> B;
+};
+
+template<typename Vector3, typename Vector>
+class WilsonInverse<Vector3, Vector, wilson::WilsonOperator<Vector3, Vector>> {
+public:
+  /// Matrix-free Wilson's B matrix at \param x_c
+  WilsonInverse(
+      const Vector& x_c,
+      const std::vector<connectivity::Bond>& bonds,
+      const std::vector<connectivity::Angle>& angles,
+      const std::vector<connectivity::Dihedral>& dihedrals,
+      const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles,
+      const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends,
+      const boost::optional<periodic::Lattice<Vector3>>& lattice)
+    : B(x_c,
+        bonds,
+        angles,
+        dihedrals,
+        linear_angles,
+        out_of_plane_bends,
+        lattice) {}
+
+  /// Cartesian displacement corresponding to \param dq
+  Vector operator*(const Vector& dq) const { return B.solve(dq); }
+
+private:
+  /// Matrix-free Wilson's B matrix
+  wilson::WilsonOperator<Vector3, Vector> B;
+};
+
 template<typename Vector>
 struct IrcToCartesianResult {
   Vector x_c;
@@ -70,10 +222,16 @@ struct IrcToCartesianResult {
 /// \param dihedrals List of dihedral angles
 /// \param max_iters Maximum number of iterations
 /// \param tolerance Tolerance on change in cartesian coordinates
+/// \param lattice Lattice (periodic systems only)
 /// \return New cartesian coordinates
 ///
 /// Since Cartesian coordinates are rectilinear and the internal coordinates are
 /// curvilinear, the transformation must be done iteratively.
+///
+/// With \p Matrix set to wilson::SparseWilsonMatrix, Wilson's B matrix is
+/// stored sparse and its pseudo-inverse is never formed: every step solves a
+/// least-squares problem instead (see \class WilsonInverse). With \p Matrix
+/// set to wilson::WilsonOperator, Wilson's B matrix is not stored at all.
 template<typename Vector3, typename Vector, typename Matrix>
 IrcToCartesianResult<Vector> irc_to_cartesian_single(
     const Vector& q_irc_old,
@@ -85,7 +243,8 @@ IrcToCartesianResult<Vector> irc_to_cartesian_single(
     const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles,
     const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends,
     const std::size_t max_iters = 25,
-    const double tolerance = 1e-6) {
+    const double tolerance = 1e-6,
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
 
   bool converged{false};
 
@@ -101,12 +260,14 @@ IrcToCartesianResult<Vector> irc_to_cartesian_single(
   // Change in cartesian coordinates
   Vector dx{linalg::zeros<Vector>(linalg::size(x_c_old))};
 
-  // Wilson's B matrix
-  const Matrix B{wilson::wilson_matrix<Vector3, Vector, Matrix>(
-      x_c, bonds, angles, dihedrals, linear_angles, out_of_plane_bends)};
-
-  // Transpose of B
-  const Matrix iB{linalg::pseudo_inverse(B)};
+  // Pseudo-inverse of Wilson's B matrix
+  const WilsonInverse<Vector3, Vector, Matrix> iB(x_c,
+                                                  bonds,
+                                                  angles,
+                                                  dihedrals,
+                                                  linear_angles,
+                                                  out_of_plane_bends,
+                                                  lattice);
 
   double RMS{0};
 
@@ -134,7 +295,13 @@ IrcToCartesianResult<Vector> irc_to_cartesian_single(
 
     // Compute new internal coordinates
     q_new = connectivity::cartesian_to_irc<Vector3, Vector>(
-        x_c, bonds, angles, dihedrals, linear_angles, out_of_plane_bends);
+        x_c,
+        bonds,
+        angles,
+        dihedrals,
+        linear_angles,
+        out_of_plane_bends,
+        lattice);
 
     // Restrain dihedral angle on the interval (-pi,pi]
     for (std::size_t i{offset}; i < offset + dihedrals.size(); i++) {
@@ -167,7 +334,8 @@ IrcToCartesianResult<Vector> irc_to_cartesian(
     const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends,
     const std::size_t max_iters = 25,
     const double tolerance = 1e-6,
-    const std::size_t max_bisects = 6) {
+    const std::size_t max_bisects = 6,
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
 
   const auto result =
       irc_to_cartesian_single<Vector3, Vector, Matrix>(q_irc_old,
@@ -179,7 +347,8 @@ IrcToCartesianResult<Vector> irc_to_cartesian(
                                                        linear_angles,
                                                        out_of_plane_bends,
                                                        max_iters,
-                                                       tolerance);
+                                                       tolerance,
+                                                       lattice);
 
   if (result.converged) {
     return result;
@@ -204,7 +373,8 @@ IrcToCartesianResult<Vector> irc_to_cartesian(
                                                     out_of_plane_bends,
                                                     max_iters,
                                                     tolerance,
-                                                    max_bisects - 1);
+                                                    max_bisects - 1,
+                                                    lattice);
 
       // Update starting cartesian for next iteration
       x_c_start = partial_step.x_c;
@@ -1,18 +1,27 @@
 #ifndef IRC_WILSON_H
 #define IRC_WILSON_H
 
+#include "libirc/batch.h"
 #include "libirc/connectivity.h"
 
 #include "libirc/constants.h"
 #include "libirc/mathtools.h"
 #include "libirc/molecule.h"
+#include "libirc/parallel.h"
+#include "libirc/periodic.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include <boost/optional.hpp>
+
 namespace irc {
 
 namespace wilson {
@@ -264,6 +273,362 @@ linear_angle_gradient(const Vector3& p1,
   return std::make_tuple(v1, -(v1 + v3), v3);
 }
 
+/// Bond length, with its gradient and Hessian
+///
+/// The derivatives are taken with respect to the cartesian coordinates of
+/// \p p1 and \p p2, in this order.
+///
+/// \tparam Vector3
+/// \param p1 Point 1
+/// \param p2 Point 2
+/// \return Bond length and its derivatives
+template<typename Vector3>
+tools::math::Jet<6> bond_hessian(const Vector3& p1, const Vector3& p2) {
+  using namespace tools::math;
+
+  return norm(jet_position<6>(p1, 0) - jet_position<6>(p2, 1));
+}
+
+/// Angle, with its gradient and Hessian
+///
+/// The derivatives are taken with respect to the cartesian coordinates of
+/// \p p1, \p p2 and \p p3, in this order. The Hessian diverges for linear
+/// angles.
+///
+/// \tparam Vector3
+/// \param p1 Point 1
+/// \param p2 Point 2
+/// \param p3 Point 3
+/// \return Angle and its derivatives
+template<typename Vector3>
+tools::math::Jet<9>
+angle_hessian(const Vector3& p1, const Vector3& p2, const Vector3& p3) {
+  using namespace tools::math;
+
+  const Jet3<9> x2{jet_position<9>(p2, 1)};
+  const Jet3<9> r1{jet_position<9>(p1, 0) - x2};
+  const Jet3<9> r2{jet_position<9>(p3, 2) - x2};
+
+  return acos(dot(r1, r2) / (norm(r1) * norm(r2)));
+}
+
+/// Dihedral angle, with its gradient and Hessian
+///
+/// The derivatives are taken with respect to the cartesian coordinates of
+/// \p p1, \p p2, \p p3 and \p p4, in this order.
+///
+/// \tparam Vector3
+/// \param p1 Point 1
+/// \param p2 Point 2
+/// \param p3 Point 3
+/// \param p4 Point 4
+/// \return Dihedral angle and its derivatives
+template<typename Vector3>
+tools::math::Jet<12> dihedral_hessian(const Vector3& p1,
+                                      const Vector3& p2,
+                                      const Vector3& p3,
+                                      const Vector3& p4) {
+  using namespace tools::math;
+
+  const Jet3<12> x2{jet_position<12>(p2, 1)};
+  const Jet3<12> x3{jet_position<12>(p3, 2)};
+
+  const Jet3<12> b1{jet_position<12>(p1, 0) - x2};
+  const Jet3<12> b2{x2 - x3};
+  const Jet3<12> b3{x3 - jet_position<12>(p4, 3)};
+
+  Jet3<12> n1{cross(b1, b2)};
+  Jet3<12> n2{cross(b2, b3)};
+  n1 = n1 / norm(n1);
+  n2 = n2 / norm(n2);
+
+  const Jet3<12> m{cross(n1, b2) / norm(b2)};
+
+  return atan2(dot(m, n2), dot(n1, n2));
+}
+
+/// Out of plane angle, with its gradient and Hessian
+///
+/// The derivatives are taken with respect to the cartesian coordinates of
+/// \p vc, \p v1, \p v2 and \p v3, in this order.
+///
+/// \tparam Vector3
+/// \param vc Central point
+/// \param v1 Point 1
+/// \param v2 Point 2
+/// \param v3 Point 3
+/// \return Out of plane angle and its derivatives
+template<typename Vector3>
+tools::math::Jet<12> out_of_plane_hessian(const Vector3& vc,
+                                          const Vector3& v1,
+                                          const Vector3& v2,
+                                          const Vector3& v3) {
+  using namespace tools::math;
+
+  const Jet3<12> c{jet_position<12>(vc, 0)};
+  const Jet3<12> b1{jet_position<12>(v1, 1) - c};
+  const Jet3<12> b2{jet_position<12>(v2, 2) - c};
+  const Jet3<12> b3{jet_position<12>(v3, 3) - c};
+
+  const Jet3<12> e1{b1 / norm(b1)};
+  const Jet3<12> e2{b2 / norm(b2)};
+  const Jet3<12> e3{b3 / norm(b3)};
+
+  // Sine of the angle between v2 and v3
+  const Jet<12> cos_a1{dot(e2, e3)};
+  const Jet<12> sin_a1{sqrt(1. - cos_a1 * cos_a1)};
+
+  return asin(dot(cross(e2, e3) / sin_a1, e1));
+}
+
+/// Linear angle in the plane with the \p orthogonal_direction, with its
+/// gradient and Hessian
+///
+/// The linear angle is the sum of the angles \f$(p_1, p_2, p_2+d_{orth})\f$
+/// and \f$(p_2+d_{orth}, p_2, p_3)\f$ (see \function linear_angle_gradient).
+/// The derivatives are taken with respect to the cartesian coordinates of
+/// \p p1, \p p2 and \p p3, in this order.
+///
+/// \tparam Vector3
+/// \param p1 Point 1
+/// \param p2 Point 2
+/// \param p3 Point 3
+/// \param orthogonal_direction orthogonal director to the \p p1 to \p p3 vector
+/// \return Linear angle and its derivatives
+template<typename Vector3>
+tools::math::Jet<9> linear_angle_hessian(const Vector3& p1,
+                                         const Vector3& p2,
+                                         const Vector3& p3,
+                                         const Vector3& orthogonal_direction) {
+  using namespace tools::math;
+
+  const Jet3<9> x2{jet_position<9>(p2, 1)};
+  const Jet3<9> r1{jet_position<9>(p1, 0) - x2};
+  const Jet3<9> r2{jet_position<9>(p3, 2) - x2};
+
+  // The orthogonal point moves with p2
+  const Jet3<9> d{jet_constant<9>(orthogonal_direction)};
+
+  const Jet<9> nd{norm(d)};
+  return acos(dot(r1, d) / (norm(r1) * nd)) +
+         acos(dot(d, r2) / (nd * norm(r2)));
+}
+
+/// Nonzero elements of a row of Wilson's \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector3 3D vector
+template<typename Vector3>
+struct WilsonRow {
+  /// Number of atoms (2 for bonds, 3 for angles and linear angles, 4 for
+  /// dihedral angles and out-of-plane bends)
+  std::size_t n_atoms;
+
+  /// Atoms of the internal coordinate
+  std::array<std::size_t, 4> atoms;
+
+  /// Value of the internal coordinate
+  double value;
+
+  /// Gradients of the internal coordinate with respect to the atomic positions
+  std::array<Vector3, 4> gradients;
+};
+
+/// Compute every row of Wilson's \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector3 3D vector type
+/// \tparam Vector Vector type
+/// \tparam F Callable taking a row index and a \class WilsonRow
+/// \param x_cartesian Atomic positions in cartesian coordinates
+/// \param bonds Collection of bonds
+/// \param angles Collection of angles between bonded atoms
+/// \param dihedrals Collection of dihedral angles
+/// \param linear_angles Collection of linear angles
+/// \param out_of_plane_bends Collection of out-of-plane bends
+/// \param lattice Lattice (periodic systems only)
+/// \param f Function called with every row, in order
+/// \param parallel Compute ranges of rows in parallel (see \namespace
+/// parallel); \param f is then called concurrently, in no particular order,
+/// and must be thread-safe
+///
+/// The rows are ordered as bonds, angles, dihedral angles, linear angles and
+/// out-of-plane bends. For periodic systems the gradients are computed for the
+/// closest images of the atoms involved in each internal coordinate.
+///
+/// The values of the internal coordinates are computed along with the
+/// gradients, in the same sweep (see \class WilsonRow).
+///
+/// The gradients of bonds, angles, dihedral angles and out-of-plane bends are
+/// computed in batches (see \namespace batch); angles that are linear within
+/// the tolerance of \function angle_gradient fall back to the scalar
+/// gradient.
+template<typename Vector3, typename Vector, typename F>
+void for_each_row(
+    const Vector& x_cartesian,
+    const std::vector<connectivity::Bond>& bonds,
+    const std::vector<connectivity::Angle>& angles,
+    const std::vector<connectivity::Dihedral>& dihedrals,
+    const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles,
+    const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends,
+    const boost::optional<periodic::Lattice<Vector3>>& lattice,
+    F f,
+    bool parallel = false) {
+
+  // Call body for ranges of primitives covering [0, n)
+  auto ranges = [parallel](std::size_t n, auto body, std::size_t align) {
+    if (parallel) {
+      parallel::for_each_range(n, body, align);
+    } else {
+      body(std::size_t{0}, n);
+    }
+  };
+
+  // Rows of primitives computed in batches: gradients(s, q, g) computes the
+  // values q and the gradients g of the batch starting at s, atoms(p) returns
+  // the atoms of the primitive p
+  auto batches = [&](const auto& primitives,
+                     std::size_t offset,
+                     std::size_t n_atoms,
+                     auto gradients,
+                     auto atoms) {
+    const std::size_t n{primitives.size()};
+
+    ranges(
+        n,
+        [&](std::size_t begin, std::size_t end) {
+          batch::Lanes q;
+          std::array<batch::Points, 4> g;
+
+          WilsonRow<Vector3> row;
+          row.n_atoms = n_atoms;
+
+          for (std::size_t s{begin}; s < end; s += batch::width) {
+            gradients(s, q, g);
+
+            for (std::size_t l{0}; l < batch::batch_size(s, n); l++) {
+              row.atoms = atoms(primitives[s + l]);
+              row.value = q[l];
+              for (std::size_t a{0}; a < n_atoms; a++) {
+                row.gradients[a] = g[a].template get<Vector3>(l);
+              }
+
+              f(s + l + offset, row);
+            }
+          }
+        },
+        batch::width);
+  };
+
+  // Rows corresponding to bonds
+  batches(
+      bonds,
+      0,
+      2,
+      [&](std::size_t s, batch::Lanes& q, std::array<batch::Points, 4>& g) {
+        batch::Points p1, p2;
+        connectivity::load_batch(bonds, s, x_cartesian, lattice, p1, p2);
+        batch::bond_gradients(p1, p2, q, g[0], g[1]);
+      },
+      [](const connectivity::Bond& b) {
+        return std::array<std::size_t, 4>{{b.i, b.j, 0, 0}};
+      });
+
+  // Rows corresponding to angles
+  batches(
+      angles,
+      bonds.size(),
+      3,
+      [&](std::size_t s, batch::Lanes& q, std::array<batch::Points, 4>& g) {
+        batch::Points p1, p2, p3;
+        connectivity::load_batch(angles, s, x_cartesian, lattice, p1, p2, p3);
+        const unsigned linear{
+            batch::angle_gradients(p1, p2, p3, q, g[0], g[1], g[2])};
+
+        // Linear angles need special care: use the scalar gradients
+        for (std::size_t l{0}; l < batch::batch_size(s, angles.size()); l++) {
+          if (linear & (1u << l)) {
+            Vector3 v1, v2, v3;
+            std::tie(v1, v2, v3) = angle_gradient(p1.get<Vector3>(l),
+                                                  p2.get<Vector3>(l),
+                                                  p3.get<Vector3>(l));
+            g[0].set(l, v1);
+            g[1].set(l, v2);
+            g[2].set(l, v3);
+          }
+        }
+      },
+      [](const connectivity::Angle& a) {
+        return std::array<std::size_t, 4>{{a.i, a.j, a.k, 0}};
+      });
+
+  // Rows corresponding to dihedrals
+  batches(
+      dihedrals,
+      bonds.size() + angles.size(),
+      4,
+      [&](std::size_t s, batch::Lanes& q, std::array<batch::Points, 4>& g) {
+        batch::Points p1, p2, p3, p4;
+        connectivity::load_batch(
+            dihedrals, s, x_cartesian, lattice, p1, p2, p3, p4);
+        batch::dihedral_gradients(
+            p1, p2, p3, p4, q, g[0], g[1], g[2], g[3]);
+      },
+      [](const connectivity::Dihedral& d) {
+        return std::array<std::size_t, 4>{{d.i, d.j, d.k, d.l}};
+      });
+
+  // Rows corresponding to linear angles
+  const std::size_t offset{bonds.size() + angles.size() + dihedrals.size()};
+  ranges(
+      linear_angles.size(),
+      [&](std::size_t begin, std::size_t end) {
+        // Utility vectors for atomic positions
+        Vector3 p1, p2, p3;
+
+        WilsonRow<Vector3> row;
+        row.n_atoms = 3;
+
+        for (std::size_t i{begin}; i < end; i++) {
+          auto linear_angle = linear_angles[i];
+
+          for (std::size_t m{0}; m < 3; m++) {
+            p1(m) = x_cartesian(3 * linear_angle.i + m);
+            p2(m) = x_cartesian(3 * linear_angle.j + m);
+            p3(m) = x_cartesian(3 * linear_angle.k + m);
+          }
+          p1 = periodic::closest_image(p2, p1, lattice);
+          p3 = periodic::closest_image(p2, p3, lattice);
+
+          row.atoms = {{linear_angle.i, linear_angle.j, linear_angle.k, 0}};
+
+          const Vector3 p_orth{p2 + linear_angle.orthogonal_direction};
+          row.value = connectivity::angle(p1, p2, p_orth) +
+                      connectivity::angle(p_orth, p2, p3);
+          std::tie(row.gradients[0], row.gradients[1], row.gradients[2]) =
+              linear_angle_gradient(
+                  p1, p2, p3, linear_angle.orthogonal_direction);
+
+          f(i + offset, row);
+        }
+      },
+      1);
+
+  // Rows corresponding to out of plane bends
+  batches(
+      out_of_plane_bends,
+      offset + linear_angles.size(),
+      4,
+      [&](std::size_t s, batch::Lanes& q, std::array<batch::Points, 4>& g) {
+        batch::Points pc, p1, p2, p3;
+        connectivity::load_batch(
+            out_of_plane_bends, s, x_cartesian, lattice, pc, p1, p2, p3);
+        batch::out_of_plane_gradients(
+            pc, p1, p2, p3, q, g[0], g[1], g[2], g[3]);
+      },
+      [](const connectivity::OutOfPlaneBend& b) {
+        return std::array<std::size_t, 4>{{b.c, b.i, b.j, b.k}};
+      });
+}
+
 /// Function computing Wilson's \f$\mathbf{B}\f$ matrix from a set of internal
 /// redundant coordinates, defined as a collection of bonds, angles and
 /// dihedral angles.
@@ -274,6 +639,7 @@ linear_angle_gradient(const Vector3& p1,
 /// \param bonds Collection of bonds
 /// \param angles Collection of angles between bonded atoms
 /// \patam Atomic positions in cartesian coordinates
+/// \param lattice Lattice (periodic systems only)
 /// \return Wilson's B matrix
 ///
 /// This function returns Wilson's \f$\mathbf{B}\f$ matrix given a collection
@@ -291,6 +657,12 @@ linear_angle_gradient(const Vector3& p1,
 /// \f]
 ///
 /// More details can be found in Peng et al., J. Comp. Chem. 17, 49-56, 1996.
+///
+/// For periodic systems the gradients are computed for the closest images of
+/// the atoms involved in each internal coordinate.
+///
+/// Large sets of internal coordinates are computed in parallel (see
+/// \namespace parallel).
 template<typename Vector3, typename Vector, typename Matrix>
 Matrix wilson_matrix(
     const Vector& x_cartesian,
@@ -298,7 +670,8 @@ Matrix wilson_matrix(
     const std::vector<connectivity::Angle>& angles = {},
     const std::vector<connectivity::Dihedral>& dihedrals = {},
     const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles = {},
-    const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends = {}) {
+    const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends = {},
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
   const std::size_t n_atoms{linalg::size<Vector>(x_cartesian) / 3};
 
   const std::size_t n_irc{bonds.size() + angles.size() + dihedrals.size() +
@@ -307,120 +680,978 @@ Matrix wilson_matrix(
   // Wilson's B matrix
   Matrix B{linalg::zeros<Matrix>(n_irc, 3 * n_atoms)};
 
-  // Utility vectors for atomic positions
-  Vector3 p1, p2, p3, p4;
+  for_each_row<Vector3>(
+      x_cartesian,
+      bonds,
+      angles,
+      dihedrals,
+      linear_angles,
+      out_of_plane_bends,
+      lattice,
+      [&B](std::size_t i, const WilsonRow<Vector3>& row) {
+        for (std::size_t a{0}; a < row.n_atoms; a++) {
+          for (std::size_t idx{0}; idx < 3; idx++) {
+            B(i, 3 * row.atoms[a] + idx) = row.gradients[a](idx);
+          }
+        }
+      },
+      true);
 
-  // Utility vector for gradients storage
-  Vector3 g1, g2, g3, g4;
+  return B;
+}
 
-  // B-matrix rows offset
-  std::size_t offset{0};
+/// Solution of a least-squares problem with Wilson's B matrix
+///
+/// \tparam Vector Vector type
+/// \param result Result of \function linalg::least_squares
+/// \return Solution
+///
+/// Throws std::runtime_error if the tolerance was not reached, which only
+/// happens for extremely ill-conditioned B matrices.
+template<typename Vector>
+Vector converged_solution(const linalg::LeastSquaresResult<Vector>& result) {
+  if (!result.converged) {
+    throw std::runtime_error(
+        "ERROR: Least-squares solution did not converge.");
+  }
+
+  return result.x;
+}
 
-  // Populate B matrix's rows corresponding to bonds
-  for (std::size_t i{0}; i < bonds.size(); i++) {
-    auto bond = bonds[i];
+/// Sparse Wilson's \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector Vector type
+///
+/// Every internal coordinate depends on at most four atoms, therefore every
+/// row of \f$\mathbf{B}\f$ is stored with a fixed width: four atom indices and
+/// twelve gradient components. The storage grows linearly with the number of
+/// internal coordinates, instead of as the product of the numbers of internal
+/// and Cartesian coordinates.
+template<typename Vector>
+class SparseWilsonMatrix {
+public:
+  /// Fixed-width row
+  struct Row {
+    /// Number of atoms
+    std::size_t n_atoms{0};
+
+    /// Atoms
+    std::array<std::size_t, 4> atoms;
+
+    /// Gradient components (three per atom)
+    std::array<double, 12> values;
+  };
+
+  /// Empty matrix (all zeros)
+  ///
+  /// \param n_rows Number of internal coordinates
+  /// \param n_cols Number of cartesian coordinates
+  SparseWilsonMatrix(std::size_t n_rows = 0, std::size_t n_cols = 0)
+    : rows(n_rows), cols(n_cols) {}
+
+  /// Number of rows (internal coordinates)
+  std::size_t n_rows() const { return rows.size(); }
+
+  /// Number of columns (cartesian coordinates)
+  std::size_t n_cols() const { return cols; }
+
+  /// Set row \param i
+  template<typename Vector3>
+  void set_row(std::size_t i, const WilsonRow<Vector3>& row);
+
+  /// Set row \param i
+  void set_row(std::size_t i, const Row& row) { rows[i] = row; }
+
+  /// Product \f$\mathbf{B}\mathbf{x}\f$
+  Vector operator*(const Vector& x) const;
+
+  /// Product \f$\mathbf{B}^T\mathbf{y}\f$
+  Vector transpose_product(const Vector& y) const;
+
+  /// Minimum-norm least-squares solution of \f$\mathbf{B}\mathbf{x} =
+  /// \mathbf{q}\f$, i.e. \f$\mathbf{B}^+\mathbf{q}\f$ (see \function
+  /// converged_solution)
+  Vector solve(const Vector& q, double tolerance = 1e-12) const;
+
+  /// Minimum-norm least-squares solution of \f$\mathbf{B}^T\mathbf{y} =
+  /// \mathbf{g}\f$, i.e. \f$(\mathbf{B}^T)^+\mathbf{g}\f$ (see
+  /// \function converged_solution)
+  Vector solve_transpose(const Vector& g, double tolerance = 1e-12) const;
+
+  /// Dense matrix
+  template<typename Matrix>
+  Matrix dense() const;
+
+  /// Product \f$\mathbf{B}\mathbf{M}\f$ with the dense matrix \param M
+  template<typename Matrix>
+  Matrix matrix_product(const Matrix& M) const;
+
+  /// Product \f$\mathbf{B}^T\mathbf{M}\f$ with the dense matrix \param M
+  template<typename Matrix>
+  Matrix transpose_matrix_product(const Matrix& M) const;
+
+  /// Gram matrix \f$\mathbf{B}^T\mathbf{B}\f$ (Cartesian coordinates only)
+  template<typename Matrix>
+  Matrix gram() const;
+
+  /// Row \param i
+  const Row& row(std::size_t i) const { return rows[i]; }
+
+private:
+  /// Rows
+  std::vector<Row> rows;
+
+  /// Number of columns
+  std::size_t cols;
+};
+
+template<typename Vector>
+template<typename Vector3>
+void SparseWilsonMatrix<Vector>::set_row(std::size_t i,
+                                         const WilsonRow<Vector3>& row) {
+  Row& r = rows[i];
 
-    for (std::size_t m{0}; m < 3; m++) {
-      p1(m) = x_cartesian(3 * bond.i + m);
-      p2(m) = x_cartesian(3 * bond.j + m);
+  r.n_atoms = row.n_atoms;
+  for (std::size_t a{0}; a < row.n_atoms; a++) {
+    r.atoms[a] = row.atoms[a];
+    for (std::size_t idx{0}; idx < 3; idx++) {
+      r.values[3 * a + idx] = row.gradients[a](idx);
     }
+  }
+}
 
-    std::tie(g1, g2) = bond_gradient(p1, p2);
+template<typename Vector>
+Vector SparseWilsonMatrix<Vector>::operator*(const Vector& x) const {
+  if (linalg::size(x) != cols) {
+    throw std::length_error("ERROR: Wrong vector size.");
+  }
 
-    for (std::size_t idx{0}; idx < 3; idx++) {
-      B(i, 3 * bond.i + idx) = g1(idx);
-      B(i, 3 * bond.j + idx) = g2(idx);
+  Vector y{linalg::zeros<Vector>(rows.size())};
+
+  for (std::size_t i{0}; i < rows.size(); i++) {
+    const Row& r = rows[i];
+
+    double v{0.};
+    for (std::size_t a{0}; a < r.n_atoms; a++) {
+      for (std::size_t idx{0}; idx < 3; idx++) {
+        v += r.values[3 * a + idx] * x(3 * r.atoms[a] + idx);
+      }
     }
+    y(i) = v;
+  }
+
+  return y;
+}
+
+template<typename Vector>
+Vector SparseWilsonMatrix<Vector>::transpose_product(const Vector& y) const {
+  if (linalg::size(y) != rows.size()) {
+    throw std::length_error("ERROR: Wrong vector size.");
   }
 
-  // Populate B matrix's rows corresponding to angles
-  offset = bonds.size();
-  for (std::size_t i{0}; i < angles.size(); i++) {
-    auto angle = angles[i];
+  Vector x{linalg::zeros<Vector>(cols)};
+
+  for (std::size_t i{0}; i < rows.size(); i++) {
+    const Row& r = rows[i];
 
-    for (std::size_t m{0}; m < 3; m++) {
-      p1(m) = x_cartesian(3 * angle.i + m);
-      p2(m) = x_cartesian(3 * angle.j + m);
-      p3(m) = x_cartesian(3 * angle.k + m);
+    for (std::size_t a{0}; a < r.n_atoms; a++) {
+      for (std::size_t idx{0}; idx < 3; idx++) {
+        x(3 * r.atoms[a] + idx) += r.values[3 * a + idx] * y(i);
+      }
     }
+  }
 
-    std::tie(g1, g2, g3) = angle_gradient(p1, p2, p3);
+  return x;
+}
 
-    for (std::size_t idx{0}; idx < 3; idx++) {
-      B(i + offset, 3 * angle.i + idx) = g1(idx);
-      B(i + offset, 3 * angle.j + idx) = g2(idx);
-      B(i + offset, 3 * angle.k + idx) = g3(idx);
+template<typename Vector>
+Vector SparseWilsonMatrix<Vector>::solve(const Vector& q,
+                                         double tolerance) const {
+  return converged_solution(linalg::least_squares(
+      q,
+      cols,
+      [this](const Vector& x) { return (*this) * x; },
+      [this](const Vector& y) { return transpose_product(y); },
+      tolerance));
+}
+
+template<typename Vector>
+Vector SparseWilsonMatrix<Vector>::solve_transpose(const Vector& g,
+                                                   double tolerance) const {
+  return converged_solution(linalg::least_squares(
+      g,
+      rows.size(),
+      [this](const Vector& y) { return transpose_product(y); },
+      [this](const Vector& x) { return (*this) * x; },
+      tolerance));
+}
+
+template<typename Vector>
+template<typename Matrix>
+Matrix SparseWilsonMatrix<Vector>::dense() const {
+  Matrix B{linalg::zeros<Matrix>(rows.size(), cols)};
+
+  for (std::size_t i{0}; i < rows.size(); i++) {
+    const Row& r = rows[i];
+
+    for (std::size_t a{0}; a < r.n_atoms; a++) {
+      for (std::size_t idx{0}; idx < 3; idx++) {
+        B(i, 3 * r.atoms[a] + idx) = r.values[3 * a + idx];
+      }
     }
   }
 
-  // Populate B matrix's rows corresponding to dihedrals
-  offset = bonds.size() + angles.size();
-  for (std::size_t i{0}; i < dihedrals.size(); i++) {
-    auto dihedral = dihedrals[i];
+  return B;
+}
 
-    for (std::size_t m{0}; m < 3; m++) {
-      p1(m) = x_cartesian(3 * dihedral.i + m);
-      p2(m) = x_cartesian(3 * dihedral.j + m);
-      p3(m) = x_cartesian(3 * dihedral.k + m);
-      p4(m) = x_cartesian(3 * dihedral.l + m);
+template<typename Vector>
+template<typename Matrix>
+Matrix SparseWilsonMatrix<Vector>::matrix_product(const Matrix& M) const {
+  if (linalg::n_rows(M) != cols) {
+    throw std::length_error("ERROR: Wrong matrix size.");
+  }
+
+  const std::size_t n_cols{linalg::n_cols(M)};
+
+  Matrix BM{linalg::zeros<Matrix>(rows.size(), n_cols)};
+  for (std::size_t i{0}; i < rows.size(); i++) {
+    const Row& r = rows[i];
+
+    for (std::size_t a{0}; a < r.n_atoms; a++) {
+      for (std::size_t idx{0}; idx < 3; idx++) {
+        const std::size_t k{3 * r.atoms[a] + idx};
+        for (std::size_t j{0}; j < n_cols; j++) {
+          BM(i, j) += r.values[3 * a + idx] * M(k, j);
+        }
+      }
     }
+  }
 
-    std::tie(g1, g2, g3, g4) = dihedral_gradient(p1, p2, p3, p4);
+  return BM;
+}
 
-    for (std::size_t idx{0}; idx < 3; idx++) {
-      B(i + offset, 3 * dihedral.i + idx) = g1(idx);
-      B(i + offset, 3 * dihedral.j + idx) = g2(idx);
-      B(i + offset, 3 * dihedral.k + idx) = g3(idx);
-      B(i + offset, 3 * dihedral.l + idx) = g4(idx);
+template<typename Vector>
+template<typename Matrix>
+Matrix
+SparseWilsonMatrix<Vector>::transpose_matrix_product(const Matrix& M) const {
+  if (linalg::n_rows(M) != rows.size()) {
+    throw std::length_error("ERROR: Wrong matrix size.");
+  }
+
+  const std::size_t n_cols{linalg::n_cols(M)};
+
+  Matrix BtM{linalg::zeros<Matrix>(cols, n_cols)};
+  for (std::size_t i{0}; i < rows.size(); i++) {
+    const Row& r = rows[i];
+
+    for (std::size_t a{0}; a < r.n_atoms; a++) {
+      for (std::size_t idx{0}; idx < 3; idx++) {
+        const std::size_t k{3 * r.atoms[a] + idx};
+        for (std::size_t j{0}; j < n_cols; j++) {
+          BtM(k, j) += r.values[3 * a + idx] * M(i, j);
+        }
+      }
     }
   }
 
-  // Populate B matrix's rows corresponding to linear angles
-  offset = bonds.size() + angles.size() + dihedrals.size();
-  for (std::size_t i{0}; i < linear_angles.size(); i++) {
-    auto linear_angle = linear_angles[i];
+  return BtM;
+}
 
-    for (std::size_t m{0}; m < 3; m++) {
-      p1(m) = x_cartesian(3 * linear_angle.i + m);
-      p2(m) = x_cartesian(3 * linear_angle.j + m);
-      p3(m) = x_cartesian(3 * linear_angle.k + m);
+template<typename Vector>
+template<typename Matrix>
+Matrix SparseWilsonMatrix<Vector>::gram() const {
+  Matrix G{linalg::zeros<Matrix>(cols, cols)};
+
+  // Every row contributes a block of at most 12 x 12 elements
+  for (const Row& r : rows) {
+    for (std::size_t a{0}; a < 3 * r.n_atoms; a++) {
+      const std::size_t k{3 * r.atoms[a / 3] + a % 3};
+      for (std::size_t b{0}; b < 3 * r.n_atoms; b++) {
+        G(k, 3 * r.atoms[b / 3] + b % 3) += r.values[a] * r.values[b];
+      }
     }
+  }
 
-    std::tie(g1, g2, g3) =
-        linear_angle_gradient(p1, p2, p3, linear_angle.orthogonal_direction);
+  return G;
+}
 
-    for (std::size_t idx{0}; idx < 3; idx++) {
-      B(i + offset, 3 * linear_angle.i + idx) = g1(idx);
-      B(i + offset, 3 * linear_angle.j + idx) = g2(idx);
-      B(i + offset, 3 * linear_angle.k + idx) = g3(idx);
+/// Sparse copy of the dense Wilson's \f$\mathbf{B}\f$ matrix \param B
+///
+/// \tparam Vector Vector type
+/// \tparam Matrix Matrix type
+/// \param B Wilson's B matrix
+/// \return Sparse Wilson's B matrix
+template<typename Vector, typename Matrix>
+SparseWilsonMatrix<Vector> to_sparse(const Matrix& B) {
+  const std::size_t n_rows{linalg::n_rows(B)};
+  const std::size_t n_atoms{linalg::n_cols(B) / 3};
+
+  SparseWilsonMatrix<Vector> sparse(n_rows, 3 * n_atoms);
+
+  // Gradients are stored as vectors of the vector type
+  WilsonRow<Vector> row;
+  for (auto& g : row.gradients) {
+    g = linalg::zeros<Vector>(3);
+  }
+
+  for (std::size_t i{0}; i < n_rows; i++) {
+    row.n_atoms = 0;
+
+    for (std::size_t a{0}; a < n_atoms; a++) {
+      if (B(i, 3 * a) == 0. and B(i, 3 * a + 1) == 0. and
+          B(i, 3 * a + 2) == 0.) {
+        continue;
+      }
+
+      if (row.n_atoms == 4) {
+        throw std::length_error("ERROR: More than four atoms in a row.");
+      }
+
+      row.atoms[row.n_atoms] = a;
+      for (std::size_t idx{0}; idx < 3; idx++) {
+        row.gradients[row.n_atoms](idx) = B(i, 3 * a + idx);
+      }
+      row.n_atoms++;
     }
+
+    sparse.set_row(i, row);
+  }
+
+  return sparse;
+}
+
+/// Compute the sparse Wilson's \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector3 3D vector type
+/// \tparam Vector Vector type
+/// \return Sparse Wilson's B matrix (see \function wilson_matrix)
+template<typename Vector3, typename Vector>
+SparseWilsonMatrix<Vector> sparse_wilson_matrix(
+    const Vector& x_cartesian,
+    const std::vector<connectivity::Bond>& bonds,
+    const std::vector<connectivity::Angle>& angles = {},
+    const std::vector<connectivity::Dihedral>& dihedrals = {},
+    const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles = {},
+    const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends = {},
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
+  const std::size_t n_irc{bonds.size() + angles.size() + dihedrals.size() +
+                          linear_angles.size() + out_of_plane_bends.size()};
+
+  SparseWilsonMatrix<Vector> B(n_irc, linalg::size(x_cartesian));
+
+  for_each_row<Vector3>(x_cartesian,
+                        bonds,
+                        angles,
+                        dihedrals,
+                        linear_angles,
+                        out_of_plane_bends,
+                        lattice,
+                        [&B](std::size_t i, const WilsonRow<Vector3>& row) {
+                          B.set_row(i, row);
+                        },
+                        true);
+
+  return B;
+}
+
+/// Internal coordinates and Wilson's \f$\mathbf{B}\f$ matrix at the same
+/// cartesian coordinates
+///
+/// \tparam Vector Vector type
+/// \tparam Matrix Matrix type (dense, or \class SparseWilsonMatrix)
+template<typename Vector, typename Matrix>
+struct Evaluation {
+  /// Internal coordinates
+  Vector q;
+
+  /// Wilson's B matrix
+  Matrix B;
+};
+
+/// Compute the internal coordinates and Wilson's \f$\mathbf{B}\f$ matrix in a
+/// single sweep over the primitive internal coordinates
+///
+/// \tparam Vector3 3D vector type
+/// \tparam Vector Vector type
+/// \tparam Matrix Matrix type
+/// \return Internal coordinates (see connectivity::cartesian_to_irc) and
+/// Wilson's B matrix (see \function wilson_matrix)
+///
+/// The values and the gradients of every internal coordinate share most of
+/// their intermediate results, therefore computing both costs little more
+/// than computing the B matrix alone. When only the values are needed,
+/// connectivity::cartesian_to_irc is cheaper.
+template<typename Vector3, typename Vector, typename Matrix>
+Evaluation<Vector, Matrix> evaluate(
+    const Vector& x_cartesian,
+    const std::vector<connectivity::Bond>& bonds,
+    const std::vector<connectivity::Angle>& angles = {},
+    const std::vector<connectivity::Dihedral>& dihedrals = {},
+    const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles = {},
+    const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends = {},
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
+  const std::size_t n_irc{bonds.size() + angles.size() + dihedrals.size() +
+                          linear_angles.size() + out_of_plane_bends.size()};
+
+  Evaluation<Vector, Matrix> e{
+      linalg::zeros<Vector>(n_irc),
+      linalg::zeros<Matrix>(n_irc, linalg::size(x_cartesian))};
+
+  for_each_row<Vector3>(
+      x_cartesian,
+      bonds,
+      angles,
+      dihedrals,
+      linear_angles,
+      out_of_plane_bends,
+      lattice,
+      [&e](std::size_t i, const WilsonRow<Vector3>& row) {
+        e.q(i) = row.value;
+        for (std::size_t a{0}; a < row.n_atoms; a++) {
+          for (std::size_t idx{0}; idx < 3; idx++) {
+            e.B(i, 3 * row.atoms[a] + idx) = row.gradients[a](idx);
+          }
+        }
+      },
+      true);
+
+  return e;
+}
+
+/// Compute the internal coordinates and the sparse Wilson's
+/// \f$\mathbf{B}\f$ matrix in a single sweep (see \function evaluate)
+///
+/// \tparam Vector3 3D vector type
+/// \tparam Vector Vector type
+/// \return Internal coordinates and sparse Wilson's B matrix
+template<typename Vector3, typename Vector>
+Evaluation<Vector, SparseWilsonMatrix<Vector>> sparse_evaluate(
+    const Vector& x_cartesian,
+    const std::vector<connectivity::Bond>& bonds,
+    const std::vector<connectivity::Angle>& angles = {},
+    const std::vector<connectivity::Dihedral>& dihedrals = {},
+    const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles = {},
+    const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends = {},
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
+  const std::size_t n_irc{bonds.size() + angles.size() + dihedrals.size() +
+                          linear_angles.size() + out_of_plane_bends.size()};
+
+  Evaluation<Vector, SparseWilsonMatrix<Vector>> e{
+      linalg::zeros<Vector>(n_irc),
+      SparseWilsonMatrix<Vector>(n_irc, linalg::size(x_cartesian))};
+
+  for_each_row<Vector3>(x_cartesian,
+                        bonds,
+                        angles,
+                        dihedrals,
+                        linear_angles,
+                        out_of_plane_bends,
+                        lattice,
+                        [&e](std::size_t i, const WilsonRow<Vector3>& row) {
+                          e.q(i) = row.value;
+                          e.B.set_row(i, row);
+                        },
+                        true);
+
+  return e;
+}
+
+/// Matrix-free Wilson's \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector3 3D vector type
+/// \tparam Vector Vector type
+///
+/// Products with \f$\mathbf{B}\f$ and its transpose are computed directly from
+/// the primitive internal coordinates, recomputing the gradients of every
+/// primitive on the fly. Only the cartesian coordinates are stored, therefore
+/// the memory grows linearly with the number of atoms; every product costs a
+/// full evaluation of the gradients.
+///
+/// The primitive internal coordinates are not copied: they must outlive the
+/// operator. The lattice is a small value and is copied.
+template<typename Vector3, typename Vector>
+class WilsonOperator {
+public:
+  /// Wilson's B matrix at \param x_cartesian
+  WilsonOperator(
+      const Vector& x_cartesian,
+      const std::vector<connectivity::Bond>& bonds,
+      const std::vector<connectivity::Angle>& angles,
+      const std::vector<connectivity::Dihedral>& dihedrals,
+      const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles,
+      const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends,
+      const boost::optional<periodic::Lattice<Vector3>>& lattice)
+    : x_c(x_cartesian), bonds(bonds), angles(angles), dihedrals(dihedrals),
+      linear_angles(linear_angles), out_of_plane_bends(out_of_plane_bends),
+      lattice(lattice) {}
+
+  /// Number of rows (internal coordinates)
+  std::size_t n_rows() const {
+    return bonds.size() + angles.size() + dihedrals.size() +
+           linear_angles.size() + out_of_plane_bends.size();
+  }
+
+  /// Number of columns (cartesian coordinates)
+  std::size_t n_cols() const { return linalg::size(x_c); }
+
+  /// Product \f$\mathbf{B}\mathbf{x}\f$
+  Vector operator*(const Vector& x) const;
+
+  /// Product \f$\mathbf{B}^T\mathbf{y}\f$
+  Vector transpose_product(const Vector& y) const;
+
+  /// Minimum-norm least-squares solution of \f$\mathbf{B}\mathbf{x} =
+  /// \mathbf{q}\f$, i.e. \f$\mathbf{B}^+\mathbf{q}\f$ (see \function
+  /// converged_solution)
+  Vector solve(const Vector& q, double tolerance = 1e-12) const;
+
+  /// Minimum-norm least-squares solution of \f$\mathbf{B}^T\mathbf{y} =
+  /// \mathbf{g}\f$, i.e. \f$(\mathbf{B}^T)^+\mathbf{g}\f$ (see
+  /// \function converged_solution)
+  Vector solve_transpose(const Vector& g, double tolerance = 1e-12) const;
+
+private:
+  /// Call \param f for every row of the B matrix (see \function
+  /// for_each_row)
+  template<typename F>
+  void rows(F f, bool parallel = false) const {
+    for_each_row<Vector3>(x_c,
+                          bonds,
+                          angles,
+                          dihedrals,
+                          linear_angles,
+                          out_of_plane_bends,
+                          lattice,
+                          f,
+                          parallel);
   }
 
-  // Populate B matrix's rows corresponding to out of plane bends
-  offset =
-      bonds.size() + angles.size() + dihedrals.size() + linear_angles.size();
-  for (std::size_t i{0}; i < out_of_plane_bends.size(); i++) {
-    auto bend = out_of_plane_bends[i];
+  /// Cartesian coordinates
+  Vector x_c;
+
+  /// Bonds
+  const std::vector<connectivity::Bond>& bonds;
+
+  /// Angles
+  const std::vector<connectivity::Angle>& angles;
+
+  /// Dihedral angles
+  const std::vector<connectivity::Dihedral>& dihedrals;
+
+  /// Linear angles
+  const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles;
+
+  /// Out of plane bends
+  const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends;
+
+  /// Lattice (periodic systems only)
+  boost::optional<periodic::Lattice<Vector3>> lattice;
+};
 
-    for (std::size_t m{0}; m < 3; m++) {
-      p4(m) = x_cartesian(3 * bend.c + m);
-      p1(m) = x_cartesian(3 * bend.i + m);
-      p2(m) = x_cartesian(3 * bend.j + m);
-      p3(m) = x_cartesian(3 * bend.k + m);
+template<typename Vector3, typename Vector>
+Vector WilsonOperator<Vector3, Vector>::operator*(const Vector& x) const {
+  if (linalg::size(x) != n_cols()) {
+    throw std::length_error("ERROR: Wrong vector size.");
+  }
+
+  Vector y{linalg::zeros<Vector>(n_rows())};
+
+  // Every row writes its own element: rows are computed in parallel
+  rows(
+      [&x, &y](std::size_t i, const WilsonRow<Vector3>& row) {
+        double v{0.};
+        for (std::size_t a{0}; a < row.n_atoms; a++) {
+          for (std::size_t idx{0}; idx < 3; idx++) {
+            v += row.gradients[a](idx) * x(3 * row.atoms[a] + idx);
+          }
+        }
+        y(i) = v;
+      },
+      true);
+
+  return y;
+}
+
+template<typename Vector3, typename Vector>
+Vector
+WilsonOperator<Vector3, Vector>::transpose_product(const Vector& y) const {
+  if (linalg::size(y) != n_rows()) {
+    throw std::length_error("ERROR: Wrong vector size.");
+  }
+
+  Vector x{linalg::zeros<Vector>(n_cols())};
+
+  rows([&x, &y](std::size_t i, const WilsonRow<Vector3>& row) {
+    for (std::size_t a{0}; a < row.n_atoms; a++) {
+      for (std::size_t idx{0}; idx < 3; idx++) {
+        x(3 * row.atoms[a] + idx) += row.gradients[a](idx) * y(i);
+      }
     }
+  });
 
-    std::tie(g4, g1, g2, g3) = out_of_plane_gradient(p4, p1, p2, p3);
+  return x;
+}
 
-    for (std::size_t idx{0}; idx < 3; idx++) {
-      B(i + offset, 3 * bend.c + idx) = g4(idx);
-      B(i + offset, 3 * bend.i + idx) = g1(idx);
-      B(i + offset, 3 * bend.j + idx) = g2(idx);
-      B(i + offset, 3 * bend.k + idx) = g3(idx);
+template<typename Vector3, typename Vector>
+Vector WilsonOperator<Vector3, Vector>::solve(const Vector& q,
+                                              double tolerance) const {
+  return converged_solution(linalg::least_squares(
+      q,
+      n_cols(),
+      [this](const Vector& x) { return (*this) * x; },
+      [this](const Vector& y) { return transpose_product(y); },
+      tolerance));
+}
+
+template<typename Vector3, typename Vector>
+Vector WilsonOperator<Vector3, Vector>::solve_transpose(
+    const Vector& g, double tolerance) const {
+  return converged_solution(linalg::least_squares(
+      g,
+      n_rows(),
+      [this](const Vector& y) { return transpose_product(y); },
+      [this](const Vector& x) { return (*this) * x; },
+      tolerance));
+}
+
+/// Derivative of Wilson's \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector Vector type
+///
+/// The derivative of \f$\mathbf{B}\f$ is the tensor of the second derivatives
+/// of the internal coordinates,
+/// \f[
+///   B'_{ijk} = \frac{\partial^2 q_i}{\partial x_j \partial x_k}.
+/// \f]
+/// Every internal coordinate depends on at most four atoms, therefore its
+/// second derivatives are stored as a \f$12 \times 12\f$ block, along with the
+/// corresponding atoms.
+template<typename Vector>
+class WilsonDerivative {
+public:
+  /// Empty derivative (all zeros)
+  ///
+  /// \param n_rows Number of internal coordinates
+  /// \param n_cols Number of cartesian coordinates
+  WilsonDerivative(std::size_t n_rows = 0, std::size_t n_cols = 0)
+    : rows(n_rows), cols(n_cols) {}
+
+  /// Number of internal coordinates
+  std::size_t n_rows() const { return rows.size(); }
+
+  /// Number of cartesian coordinates
+  std::size_t n_cols() const { return cols; }
+
+  /// Set the second derivatives of the internal coordinate \param i
+  ///
+  /// \param i Internal coordinate
+  /// \param atoms Atoms of the internal coordinate
+  /// \param q Internal coordinate, as a function of the positions of the
+  /// \f$N/3\f$ first \param atoms
+  template<std::size_t N>
+  void set_row(std::size_t i,
+               const std::array<std::size_t, 4>& atoms,
+               const tools::math::Jet<N>& q);
+
+  /// Second derivatives of the internal coordinate \param i
+  template<typename Matrix>
+  Matrix hessian(std::size_t i) const;
+
+  /// Contraction \f$\sum_i w_i \mathbf{B}'_i\f$ of the second derivatives with
+  /// the weights \param w
+  template<typename Matrix>
+  Matrix contract(const Vector& w) const;
+
+private:
+  /// Fixed-size block
+  struct Row {
+    /// Number of atoms
+    std::size_t n_atoms{0};
+
+    /// Atoms
+    std::array<std::size_t, 4> atoms;
+
+    /// Second derivatives (row-major, three components per atom)
+    std::array<double, 144> values;
+  };
+
+  /// Add the block of \param r, multiplied by \param w, to \param H
+  template<typename Matrix>
+  static void add(const Row& r, double w, Matrix& H);
+
+  /// Blocks
+  std::vector<Row> rows;
+
+  /// Number of cartesian coordinates
+  std::size_t cols;
+};
+
+template<typename Vector>
+template<std::size_t N>
+void WilsonDerivative<Vector>::set_row(std::size_t i,
+                                       const std::array<std::size_t, 4>& atoms,
+                                       const tools::math::Jet<N>& q) {
+  static_assert(N % 3 == 0 and N <= 12, "Wrong number of variables.");
+
+  Row& r = rows[i];
+
+  r.n_atoms = N / 3;
+  r.atoms = atoms;
+  for (std::size_t j{0}; j < N; j++) {
+    for (std::size_t k{0}; k < N; k++) {
+      r.values[12 * j + k] = q.hessian[N * j + k];
     }
   }
-  return B;
 }
 
+template<typename Vector>
+template<typename Matrix>
+void WilsonDerivative<Vector>::add(const Row& r, double w, Matrix& H) {
+  for (std::size_t a{0}; a < r.n_atoms; a++) {
+    for (std::size_t b{0}; b < r.n_atoms; b++) {
+      for (std::size_t m{0}; m < 3; m++) {
+        for (std::size_t n{0}; n < 3; n++) {
+          H(3 * r.atoms[a] + m, 3 * r.atoms[b] + n) +=
+              w * r.values[12 * (3 * a + m) + 3 * b + n];
+        }
+      }
+    }
+  }
+}
+
+template<typename Vector>
+template<typename Matrix>
+Matrix WilsonDerivative<Vector>::hessian(std::size_t i) const {
+  Matrix H{linalg::zeros<Matrix>(cols, cols)};
+
+  add(rows[i], 1., H);
+
+  return H;
+}
+
+template<typename Vector>
+template<typename Matrix>
+Matrix WilsonDerivative<Vector>::contract(const Vector& w) const {
+  if (linalg::size(w) != rows.size()) {
+    throw std::length_error("ERROR: Wrong vector size.");
+  }
+
+  Matrix H{linalg::zeros<Matrix>(cols, cols)};
+
+  for (std::size_t i{0}; i < rows.size(); i++) {
+    if (w(i) != 0.) {
+      add(rows[i], w(i), H);
+    }
+  }
+
+  return H;
+}
+
+/// Compute the derivative of Wilson's \f$\mathbf{B}\f$ matrix
+///
+/// \tparam Vector3 3D vector type
+/// \tparam Vector Vector type
+/// \param x_cartesian Atomic positions in cartesian coordinates
+/// \param bonds Collection of bonds
+/// \param angles Collection of angles between bonded atoms
+/// \param dihedrals Collection of dihedral angles
+/// \param linear_angles Collection of linear angles
+/// \param out_of_plane_bends Collection of out-of-plane bends
+/// \param lattice Lattice (periodic systems only)
+/// \return Second derivatives of the internal coordinates
+///
+/// The second derivatives are analytic: they are propagated exactly through
+/// the definitions of the internal coordinates (see \class tools::math::Jet).
+/// The internal coordinates are ordered as in \function wilson_matrix and, for
+/// periodic systems, the closest images of the atoms are used.
+///
+/// Large sets of internal coordinates are computed in parallel (see
+/// \namespace parallel).
+template<typename Vector3, typename Vector>
+WilsonDerivative<Vector> wilson_derivative(
+    const Vector& x_cartesian,
+    const std::vector<connectivity::Bond>& bonds,
+    const std::vector<connectivity::Angle>& angles = {},
+    const std::vector<connectivity::Dihedral>& dihedrals = {},
+    const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles = {},
+    const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends = {},
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
+  using connectivity::atom_position;
+  using periodic::closest_image;
+
+  const std::size_t n_irc{bonds.size() + angles.size() + dihedrals.size() +
+                          linear_angles.size() + out_of_plane_bends.size()};
+
+  WilsonDerivative<Vector> dB(n_irc, linalg::size(x_cartesian));
+
+  // Call f for every primitive p (and its row i), in parallel
+  auto rows = [&dB](const auto& primitives, std::size_t offset, auto f) {
+    parallel::for_each_range(
+        primitives.size(), [&](std::size_t begin, std::size_t end) {
+          for (std::size_t i{begin}; i < end; i++) {
+            f(i + offset, primitives[i]);
+          }
+        });
+  };
+
+  std::size_t offset{0};
+
+  rows(bonds, offset, [&](std::size_t i, const connectivity::Bond& b) {
+    const Vector3 p1{atom_position<Vector3>(x_cartesian, b.i)};
+    const Vector3 p2{atom_position<Vector3>(x_cartesian, b.j)};
+
+    dB.set_row(i,
+               {{b.i, b.j, 0, 0}},
+               bond_hessian(p1, closest_image(p1, p2, lattice)));
+  });
+  offset += bonds.size();
+
+  rows(angles, offset, [&](std::size_t i, const connectivity::Angle& a) {
+    const Vector3 p1{atom_position<Vector3>(x_cartesian, a.i)};
+    const Vector3 p2{atom_position<Vector3>(x_cartesian, a.j)};
+    const Vector3 p3{atom_position<Vector3>(x_cartesian, a.k)};
+
+    dB.set_row(i,
+               {{a.i, a.j, a.k, 0}},
+               angle_hessian(closest_image(p2, p1, lattice),
+                             p2,
+                             closest_image(p2, p3, lattice)));
+  });
+  offset += angles.size();
+
+  rows(dihedrals, offset, [&](std::size_t i, const connectivity::Dihedral& d) {
+    const Vector3 p1{atom_position<Vector3>(x_cartesian, d.i)};
+    const Vector3 p2{atom_position<Vector3>(x_cartesian, d.j)};
+    const Vector3 p4{atom_position<Vector3>(x_cartesian, d.l)};
+
+    // Closest images along the chain of bonds
+    const Vector3 p3{
+        closest_image(p2, atom_position<Vector3>(x_cartesian, d.k), lattice)};
+
+    dB.set_row(i,
+               {{d.i, d.j, d.k, d.l}},
+               dihedral_hessian(closest_image(p2, p1, lattice),
+                                p2,
+                                p3,
+                                closest_image(p3, p4, lattice)));
+  });
+  offset += dihedrals.size();
+
+  rows(linear_angles,
+       offset,
+       [&](std::size_t i, const connectivity::LinearAngle<Vector3>& a) {
+         const Vector3 p1{atom_position<Vector3>(x_cartesian, a.i)};
+         const Vector3 p2{atom_position<Vector3>(x_cartesian, a.j)};
+         const Vector3 p3{atom_position<Vector3>(x_cartesian, a.k)};
+
+         dB.set_row(i,
+                    {{a.i, a.j, a.k, 0}},
+                    linear_angle_hessian(closest_image(p2, p1, lattice),
+                                         p2,
+                                         closest_image(p2, p3, lattice),
+                                         a.orthogonal_direction));
+       });
+  offset += linear_angles.size();
+
+  rows(out_of_plane_bends,
+       offset,
+       [&](std::size_t i, const connectivity::OutOfPlaneBend& b) {
+         const Vector3 c{atom_position<Vector3>(x_cartesian, b.c)};
+         const Vector3 p1{atom_position<Vector3>(x_cartesian, b.i)};
+         const Vector3 p2{atom_position<Vector3>(x_cartesian, b.j)};
+         const Vector3 p3{atom_position<Vector3>(x_cartesian, b.k)};
+
+         dB.set_row(i,
+                    {{b.c, b.i, b.j, b.k}},
+                    out_of_plane_hessian(c,
+                                         closest_image(c, p1, lattice),
+                                         closest_image(c, p2, lattice),
+                                         closest_image(c, p3, lattice)));
+       });
+
+  return dB;
+}
+
+/// Internal coordinates involving every atom
+///
+/// \tparam Vector3 3D vector type
+/// \param n_atoms Total number of atoms
+/// \param bonds Collection of bonds
+/// \param angles Collection of angles between bonded atoms
+/// \param dihedrals Collection of dihedral angles
+/// \param linear_angles Collection of linear angles
+/// \param out_of_plane_bends Collection of out-of-plane bends
+/// \return Indices of the internal coordinates involving every atom
+///
+/// The internal coordinates are ordered as the rows of \function
+/// wilson_matrix.
+template<typename Vector3>
+std::vector<std::vector<std::size_t>> incidence(
+    std::size_t n_atoms,
+    const std::vector<connectivity::Bond>& bonds,
+    const std::vector<connectivity::Angle>& angles = {},
+    const std::vector<connectivity::Dihedral>& dihedrals = {},
+    const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles = {},
+    const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends = {}) {
+  std::vector<std::vector<std::size_t>> primitives(n_atoms);
+
+  // Add the internal coordinate i to the list of the atom a
+  auto add = [&primitives](std::size_t a, std::size_t i) {
+    if (primitives[a].empty() or primitives[a].back() != i) {
+      primitives[a].push_back(i);
+    }
+  };
+
+  std::size_t i{0};
+  for (const auto& b : bonds) {
+    add(b.i, i);
+    add(b.j, i++);
+  }
+  for (const auto& a : angles) {
+    add(a.i, i);
+    add(a.j, i);
+    add(a.k, i++);
+  }
+  for (const auto& d : dihedrals) {
+    add(d.i, i);
+    add(d.j, i);
+    add(d.k, i);
+    add(d.l, i++);
+  }
+  for (const auto& a : linear_angles) {
+    add(a.i, i);
+    add(a.j, i);
+    add(a.k, i++);
+  }
+  for (const auto& b : out_of_plane_bends) {
+    add(b.c, i);
+    add(b.i, i);
+    add(b.j, i);
+    add(b.k, i++);
+  }
+
+  return primitives;
+}
+
+/// Compute Wilson's \f$\mathbf{B}\f$ matrix by central finite differences
+///
+/// \tparam Vector3 3D vector type
+/// \tparam Vector Vector type
+/// \tparam Matrix Matrix type
+/// \param x_c Atomic positions in cartesian coordinates
+/// \param bonds Collection of bonds
+/// \param angles Collection of angles between bonded atoms
+/// \param dihedrals Collection of dihedral angles
+/// \param linear_angles Collection of linear angles
+/// \param out_of_plane_bends Collection of out-of-plane bends
+/// \param dx Displacement of the cartesian coordinates
+/// \param lattice Lattice (periodic systems only)
+/// \return Wilson's B matrix
+///
+/// Only the internal coordinates involving the displaced atom are computed
+/// again (see \function incidence), therefore the cost grows linearly with
+/// the number of internal coordinates. Large systems are displaced in
+/// parallel, atom by atom (see \namespace parallel).
 template<typename Vector3, typename Vector, typename Matrix>
 Matrix wilson_matrix_numerical(
     const Vector& x_c,
@@ -429,46 +1660,74 @@ Matrix wilson_matrix_numerical(
     const std::vector<connectivity::Dihedral>& dihedrals = {},
     const std::vector<connectivity::LinearAngle<Vector3>>& linear_angles = {},
     const std::vector<connectivity::OutOfPlaneBend>& out_of_plane_bends = {},
-    double dx = 1.e-6) {
+    double dx = 1.e-6,
+    const boost::optional<periodic::Lattice<Vector3>>& lattice = boost::none) {
 
   const std::size_t n_c{linalg::size(x_c)};
 
   const std::size_t n_irc{bonds.size() + angles.size() + dihedrals.size() +
                           linear_angles.size() + out_of_plane_bends.size()};
 
-  // Wilson B matrix
-  Matrix B{linalg::zeros<Matrix>(n_irc, n_c)};
+  // Internal coordinates involving every atom
+  const std::vector<std::vector<std::size_t>> primitives{
+      incidence(n_c / 3,
+                bonds,
+                angles,
+                dihedrals,
+                linear_angles,
+                out_of_plane_bends)};
+
+  // Value of the internal coordinate i at the cartesian coordinates x
+  auto value = [&](std::size_t i, const Vector& x) {
+    if (i < bonds.size()) {
+      return connectivity::bond(bonds[i], x, lattice);
+    }
+    i -= bonds.size();
+
+    if (i < angles.size()) {
+      return connectivity::angle(angles[i], x, lattice);
+    }
+    i -= angles.size();
+
+    if (i < dihedrals.size()) {
+      return connectivity::dihedral(dihedrals[i], x, lattice);
+    }
+    i -= dihedrals.size();
 
-  // Displaced cartesian coordinates
-  Vector x_c_pm{x_c};
+    if (i < linear_angles.size()) {
+      return connectivity::angle(linear_angles[i], x, lattice);
+    }
+    i -= linear_angles.size();
 
-  // Displaced IRC
-  Vector q_irc_plus{linalg::zeros<Vector>(n_irc)};
-  Vector q_irc_minus{linalg::zeros<Vector>(n_irc)};
+    return connectivity::out_of_plane_angle(out_of_plane_bends[i], x, lattice);
+  };
 
-  for (std::size_t j{0}; j < n_c; j++) {
-    // Positive displacement for cartesian coordinate j
-    x_c_pm(j) += dx;
+  // Wilson B matrix
+  Matrix B{linalg::zeros<Matrix>(n_irc, n_c)};
 
-    // IRC corresponding to positive displacement of x_c(j)
-    q_irc_plus = connectivity::cartesian_to_irc<Vector3, Vector>(
-        x_c_pm, bonds, angles, dihedrals, linear_angles, out_of_plane_bends);
+  // Every atom writes its own columns: atoms are displaced in parallel
+  parallel::for_each_range(
+      n_c / 3, [&](std::size_t begin, std::size_t end) {
+        // Displaced cartesian coordinates
+        Vector x_c_pm{x_c};
 
-    // Negative displacement for cartesian coordinate j
-    x_c_pm(j) -= 2 * dx;
+        for (std::size_t j{3 * begin}; j < 3 * end; j++) {
+          for (const std::size_t i : primitives[j / 3]) {
+            // Positive and negative displacements for cartesian coordinate j
+            x_c_pm(j) = x_c(j) + dx;
+            const double q_plus{value(i, x_c_pm)};
 
-    // IRC corresponding to negative displacement of x_c(j)
-    q_irc_minus = connectivity::cartesian_to_irc<Vector3, Vector>(
-        x_c_pm, bonds, angles, dihedrals, linear_angles, out_of_plane_bends);
+            x_c_pm(j) = x_c(j) - dx;
+            const double q_minus{value(i, x_c_pm)};
 
-    for (std::size_t i{0}; i < n_irc; i++) {
-      // Compute derivative (centered finite difference)
-      B(i, j) = (q_irc_plus(i) - q_irc_minus(i)) / (2 * dx);
-    }
+            // Compute derivative (centered finite difference)
+            B(i, j) = (q_plus - q_minus) / (2 * dx);
+          }
 
-    // Reset original cartesian coordinates
-    x_c_pm(j) = x_c(j);
-  }
+          // Reset original cartesian coordinates
+          x_c_pm(j) = x_c(j);
+        }
+      });
 
   return B;
 }
@@ -493,7 +1752,674 @@ Matrix projector(const Matrix& B, const Matrix& C) {
   Matrix P{B * linalg::pseudo_inverse(B)};
 
   // Projector with constraints
-  return P - P * C * linalg::inv<Matrix>(C * P * C) * C * P;
+  //
+  // C P C vanishes outside of the constrained coordinates, therefore its
+  // pseudo-inverse is used (inverse within the constrained coordinates)
+  return P - P * C * linalg::pseudo_inverse<Matrix>(C * P * C) * C * P;
+}
+
+/// Projector \f$\mathbf{P} = \mathbf{B}\mathbf{B}^+\f$, stored as an
+/// orthonormal basis of its range
+///
+/// \tparam Vector
+/// \tparam Matrix
+///
+/// The rank \f$r\f$ of the projector is at most the number of Cartesian
+/// coordinates, which is usually much smaller than the number \f$n\f$ of
+/// redundant internal coordinates. With an orthonormal basis \f$\mathbf{U}\f$
+/// of the range of \f$\mathbf{B}\f$, \f$\mathbf{P} = \mathbf{U}\mathbf{U}^T\f$
+/// is applied as \f$\mathbf{U}(\mathbf{U}^T\mathbf{x})\f$: storage and
+/// products scale with \f$nr\f$ instead of \f$n^2\f$.
+template<typename Vector, typename Matrix>
+class LowRankProjector {
+public:
+  /// Orthonormal basis of the range of \param B
+  ///
+  /// \param B Wilson's B matrix
+  explicit LowRankProjector(const Matrix& B);
+
+  /// Orthonormal basis of the range of the sparse \param B
+  ///
+  /// \param B Sparse Wilson's B matrix
+  ///
+  /// The eigendecomposition of the Gram matrix
+  /// \f$\mathbf{B}^T\mathbf{B} = \mathbf{V}\mathbf{S}^2\mathbf{V}^T\f$, of the
+  /// size of the Cartesian coordinates, gives the basis
+  /// \f$\mathbf{U} = \mathbf{B}\mathbf{V}\mathbf{S}^{-1}\f$ with sparse
+  /// products only. Singular values are resolved down to about
+  /// \f$\sqrt{\epsilon}\f$ times the largest one, instead of \f$\epsilon\f$
+  /// for the dense decomposition.
+  explicit LowRankProjector(const SparseWilsonMatrix<Vector>& B);
+
+  /// Projector \f$\mathbf{U}\mathbf{U}^T\f$
+  ///
+  /// \param U Orthonormal basis (see \function basis)
+  static LowRankProjector from_basis(const Matrix& U);
+
+  /// Add the constraints on the internal coordinates \param indices
+  ///
+  /// \param indices Indices of the constrained internal coordinates
+  ///
+  /// The projector becomes
+  /// \f$\mathbf{P} - \mathbf{P}\mathbf{C}(\mathbf{C}\mathbf{P}\mathbf{C})^+
+  /// \mathbf{C}\mathbf{P}\f$ (see \function projector). With
+  /// \f$\mathbf{U}_C\f$ the rows of \f$\mathbf{U}\f$ for the constrained
+  /// coordinates, this is the projector on
+  /// \f$\mathbf{U}\mathbf{N}\f$, where \f$\mathbf{N}\f$ is an orthonormal
+  /// basis of the null space of \f$\mathbf{U}_C\f$.
+  void constrain(const std::vector<std::size_t>& indices);
+
+  /// Number of internal coordinates
+  std::size_t size() const { return linalg::n_rows(U); }
+
+  /// Rank of the projector
+  std::size_t rank() const { return linalg::n_cols(U); }
+
+  /// Orthonormal basis of the range of the projector
+  const Matrix& basis() const { return U; }
+
+  /// Projection of \param x
+  Vector operator*(const Vector& x) const {
+    return U * Vector{linalg::transpose(U) * x};
+  }
+
+  /// Projection of the columns of \param M
+  Matrix operator*(const Matrix& M) const {
+    return U * Matrix{linalg::transpose(U) * M};
+  }
+
+  /// Projection \f$\mathbf{P}\mathbf{H}\mathbf{P}\f$ of \param H
+  Matrix project(const Matrix& H) const;
+
+  /// Projector as a dense matrix
+  Matrix dense() const { return U * linalg::transpose(U); }
+
+  /// Pseudo-inverse of the transpose of \param B
+  ///
+  /// \param B Wilson's B matrix the projector is built from
+  ///
+  /// The singular value decomposition of the projector gives
+  /// \f$(\mathbf{B}^T)^+ = \mathbf{U}\mathbf{S}^{-2}\mathbf{U}^T\mathbf{B}\f$.
+  /// The singular values are not known once constraints are added, nor for a
+  /// projector built with \function from_basis.
+  Matrix transpose_pseudo_inverse(const Matrix& B) const;
+
+  /// Pseudo-inverse of the transpose of the sparse \param B
+  ///
+  /// \param B Sparse Wilson's B matrix the projector is built from
+  Matrix transpose_pseudo_inverse(const SparseWilsonMatrix<Vector>& B) const;
+
+private:
+  LowRankProjector() = default;
+
+  /// \f$\mathbf{U}\mathbf{S}^{-2}\f$ applied to \param UtB, i.e.
+  /// \f$\mathbf{U}^T\mathbf{B}\f$
+  Matrix transpose_pseudo_inverse_from(Matrix UtB) const;
+
+  /// Orthonormal basis of the range of the projector
+  Matrix U;
+
+  /// Singular values of Wilson's B matrix (unconstrained projector only)
+  Vector s;
+};
+
+template<typename Vector, typename Matrix>
+LowRankProjector<Vector, Matrix>::LowRankProjector(const Matrix& B) {
+  const std::size_t n{linalg::n_rows(B)};
+  const std::size_t m{linalg::n_cols(B)};
+
+  Matrix UB;
+  Vector sB;
+  std::size_t r{0};
+  if (n > 0 and m > 0) {
+    linalg::svd_thin(B, UB, sB);
+
+    const double eps{std::numeric_limits<double>::epsilon()};
+    const double tol{std::max(n, m) * sB(0) * eps};
+    while (r < linalg::size(sB) and sB(r) > tol) {
+      r++;
+    }
+  }
+
+  U = linalg::zeros<Matrix>(n, r);
+  s = linalg::zeros<Vector>(r);
+  for (std::size_t j{0}; j < r; j++) {
+    for (std::size_t i{0}; i < n; i++) {
+      U(i, j) = UB(i, j);
+    }
+    s(j) = sB(j);
+  }
+}
+
+template<typename Vector, typename Matrix>
+LowRankProjector<Vector, Matrix>::LowRankProjector(
+    const SparseWilsonMatrix<Vector>& B) {
+  const std::size_t n{B.n_rows()};
+  const std::size_t m{B.n_cols()};
+
+  // Eigenvalues of B^T B (squared singular values), in increasing order
+  Vector lambda;
+  Matrix V;
+  std::size_t r{0};
+  if (n > 0 and m > 0) {
+    linalg::eig_sym(B.template gram<Matrix>(), lambda, V);
+
+    const double eps{std::numeric_limits<double>::epsilon()};
+    const double tol{std::max(n, m) * lambda(m - 1) * eps};
+    while (r < m and lambda(m - 1 - r) > tol) {
+      r++;
+    }
+  }
+
+  // Right singular vectors, in decreasing order of the singular values
+  Matrix Vr{linalg::zeros<Matrix>(m, r)};
+  s = linalg::zeros<Vector>(r);
+  for (std::size_t j{0}; j < r; j++) {
+    for (std::size_t i{0}; i < m; i++) {
+      Vr(i, j) = V(i, m - 1 - j);
+    }
+    s(j) = std::sqrt(lambda(m - 1 - j));
+  }
+
+  // U = B V S^-1
+  U = B.matrix_product(Vr);
+  for (std::size_t j{0}; j < r; j++) {
+    for (std::size_t i{0}; i < n; i++) {
+      U(i, j) /= s(j);
+    }
+  }
+}
+
+template<typename Vector, typename Matrix>
+LowRankProjector<Vector, Matrix>
+LowRankProjector<Vector, Matrix>::from_basis(const Matrix& U) {
+  LowRankProjector P;
+  P.U = U;
+  P.s = linalg::zeros<Vector>(0);
+
+  return P;
+}
+
+template<typename Vector, typename Matrix>
+void LowRankProjector<Vector, Matrix>::constrain(
+    const std::vector<std::size_t>& indices) {
+  const std::size_t m{indices.size()};
+  const std::size_t r{rank()};
+
+  if (m == 0 or r == 0) {
+    return;
+  }
+
+  Matrix UC{linalg::zeros<Matrix>(m, r)};
+  for (std::size_t j{0}; j < r; j++) {
+    for (std::size_t i{0}; i < m; i++) {
+      UC(i, j) = U(indices[i], j);
+    }
+  }
+
+  // Null space of the constrained rows (last right singular vectors)
+  Matrix UU, V;
+  Vector sC;
+  linalg::svd(UC, UU, sC, V);
+
+  const double eps{std::numeric_limits<double>::epsilon()};
+  const double tol{std::max(m, r) * sC(0) * eps};
+  std::size_t rank_C{0};
+  while (rank_C < linalg::size(sC) and sC(rank_C) > tol) {
+    rank_C++;
+  }
+
+  Matrix N{linalg::zeros<Matrix>(r, r - rank_C)};
+  for (std::size_t j{rank_C}; j < r; j++) {
+    for (std::size_t i{0}; i < r; i++) {
+      N(i, j - rank_C) = V(i, j);
+    }
+  }
+
+  U = U * N;
+
+  // The basis no longer comes from the decomposition of Wilson's B matrix
+  s = linalg::zeros<Vector>(0);
+}
+
+template<typename Vector, typename Matrix>
+Matrix LowRankProjector<Vector, Matrix>::transpose_pseudo_inverse(
+    const Matrix& B) const {
+  if (linalg::n_rows(B) != size()) {
+    throw std::length_error("ERROR: Wrong Wilson B matrix size.");
+  }
+
+  return transpose_pseudo_inverse_from(Matrix{linalg::transpose(U) * B});
+}
+
+template<typename Vector, typename Matrix>
+Matrix LowRankProjector<Vector, Matrix>::transpose_pseudo_inverse(
+    const SparseWilsonMatrix<Vector>& B) const {
+  if (B.n_rows() != size()) {
+    throw std::length_error("ERROR: Wrong Wilson B matrix size.");
+  }
+
+  // U^T B = (B^T U)^T
+  return transpose_pseudo_inverse_from(
+      linalg::transpose<Matrix>(B.transpose_matrix_product(U)));
+}
+
+template<typename Vector, typename Matrix>
+Matrix LowRankProjector<Vector, Matrix>::transpose_pseudo_inverse_from(
+    Matrix UtB) const {
+  if (linalg::size(s) != rank()) {
+    throw std::runtime_error("ERROR: Singular values not available.");
+  }
+
+  // S^-2 U^T B
+  for (std::size_t j{0}; j < linalg::n_cols(UtB); j++) {
+    for (std::size_t i{0}; i < rank(); i++) {
+      UtB(i, j) /= s(i) * s(i);
+    }
+  }
+
+  return U * UtB;
+}
+
+template<typename Vector, typename Matrix>
+Matrix LowRankProjector<Vector, Matrix>::project(const Matrix& H) const {
+  const Matrix Ut{linalg::transpose(U)};
+
+  return U * Matrix{Ut * H * U} * Ut;
+}
+
+/// Projector of a system of weakly coupled fragments, stored block by block
+///
+/// \tparam Vector
+/// \tparam Matrix
+///
+/// The rows of Wilson's B matrix involving the atoms of a single fragment
+/// form diagonal blocks \f$\mathbf{B}_f\f$, while the remaining \f$k\f$ rows
+/// \f$\mathbf{K}\f$ couple different fragments (interfragment bonds and the
+/// primitives around them). Every block is factorised separately,
+/// \f$\mathbf{B}_f = \mathbf{U}_f\mathbf{S}_f\mathbf{V}_f^T\f$, and the
+/// projector \f$\mathbf{P} = \mathbf{B}\mathbf{B}^+\f$ is the block-diagonal
+/// projector \f$\mathbf{U}_f\mathbf{U}_f^T\f$ corrected by terms of rank
+/// \f$k\f$. With the coupling rows last, the blocks of the projector are
+/// \f[
+///   \mathbf{P}_{ff'} = \delta_{ff'}\mathbf{U}_f\mathbf{U}_f^T -
+///     \mathbf{L}_f\mathbf{S}^{-1}\mathbf{L}_{f'}^T, \quad
+///   \mathbf{P}_{fK} = \mathbf{L}_f\mathbf{S}^{-1}, \quad
+///   \mathbf{P}_{KK} = \mathbf{I} - \mathbf{S}^{-1} + \mathbf{Q}\mathbf{Q}^T,
+/// \f]
+/// where \f$\mathbf{Q}\f$ is an orthonormal basis of the range of
+/// \f$\mathbf{K}\f$ over the null spaces of the blocks (relative motions of
+/// the fragments), \f$\mathbf{W}_f\f$ is the component of
+/// \f$\mathbf{K}\mathbf{V}_f\mathbf{S}_f^{-1}\f$ orthogonal to
+/// \f$\mathbf{Q}\f$, \f$\mathbf{L}_f = \mathbf{U}_f\mathbf{W}_f^T\f$ and
+/// \f$\mathbf{S} = \mathbf{I} + \sum_f \mathbf{W}_f\mathbf{W}_f^T\f$ is
+/// \f$k \times k\f$.
+///
+/// The cost of the factorisation and of every product therefore scales with
+/// the size of the fragments and with \f$k\f$, instead of the size of the
+/// whole system.
+template<typename Vector, typename Matrix>
+class FragmentProjector {
+public:
+  /// Factorise the blocks of \param B
+  ///
+  /// \param B Sparse Wilson's B matrix
+  /// \param fragments Fragment of every atom
+  ///
+  /// Every row is assigned to a fragment from the atoms of its internal
+  /// coordinate, without looking at the other columns.
+  FragmentProjector(const SparseWilsonMatrix<Vector>& B,
+                    const std::vector<std::size_t>& fragments);
+
+  /// Factorise the blocks of \param B
+  ///
+  /// \param B Wilson's B matrix
+  /// \param fragments Fragment of every atom
+  FragmentProjector(const Matrix& B, const std::vector<std::size_t>& fragments)
+    : FragmentProjector(to_sparse<Vector>(B), fragments) {}
+
+  /// Add the constraints on the internal coordinates \param indices
+  ///
+  /// \param indices Indices of the constrained internal coordinates
+  ///
+  /// The projector becomes
+  /// \f$\mathbf{P} - \mathbf{P}\mathbf{C}(\mathbf{C}\mathbf{P}\mathbf{C})^+
+  /// \mathbf{C}\mathbf{P}\f$ (see \function projector), which is a correction
+  /// of rank at most the number of constraints.
+  void constrain(const std::vector<std::size_t>& indices);
+
+  /// Number of internal coordinates
+  std::size_t size() const { return n; }
+
+  /// Number of fragments
+  std::size_t n_fragments() const { return rows.size(); }
+
+  /// Number of internal coordinates coupling different fragments
+  std::size_t n_coupling() const { return coupling.size(); }
+
+  /// Projection of \param x
+  Vector operator*(const Vector& x) const;
+
+  /// Projection of the columns of \param M
+  Matrix operator*(const Matrix& M) const;
+
+  /// Projection \f$\mathbf{P}\mathbf{H}\mathbf{P}\f$ of \param H
+  Matrix project(const Matrix& H) const;
+
+  /// Projector as a dense matrix
+  Matrix dense() const { return *this * linalg::identity<Matrix>(n); }
+
+private:
+  /// Unconstrained projection of \param x
+  Vector apply(const Vector& x) const;
+
+  /// Number of internal coordinates
+  std::size_t n;
+
+  /// Internal coordinates within every fragment
+  std::vector<std::vector<std::size_t>> rows;
+
+  /// Internal coordinates coupling different fragments
+  std::vector<std::size_t> coupling;
+
+  /// Orthonormal basis of the range of every block
+  std::vector<Matrix> U;
+
+  /// Coupling of every block, \f$\mathbf{U}_f\mathbf{W}_f^T\f$
+  std::vector<Matrix> L;
+
+  /// Inverse of \f$\mathbf{S}\f$
+  Matrix Sinv;
+
+  /// Projector within the coupling internal coordinates
+  Matrix T;
+
+  /// Constrained internal coordinates
+  std::vector<std::size_t> constrained;
+
+  /// Columns of the (unconstrained) projector for the constrained coordinates
+  Matrix PC;
+
+  /// Pseudo-inverse of the projector within the constrained coordinates
+  Matrix PCCinv;
+};
+
+template<typename Vector, typename Matrix>
+FragmentProjector<Vector, Matrix>::FragmentProjector(
+    const SparseWilsonMatrix<Vector>& B,
+    const std::vector<std::size_t>& fragments)
+  : n(B.n_rows()) {
+  const std::size_t n_atoms{fragments.size()};
+
+  if (B.n_cols() != 3 * n_atoms) {
+    throw std::length_error("ERROR: Wrong number of fragment indices.");
+  }
+
+  // Atoms of every fragment, and their position within the fragment
+  std::size_t n_frag{0};
+  for (const std::size_t f : fragments) {
+    n_frag = std::max(n_frag, f + 1);
+  }
+  std::vector<std::vector<std::size_t>> atoms(n_frag);
+  std::vector<std::size_t> local(n_atoms);
+  for (std::size_t a{0}; a < n_atoms; a++) {
+    local[a] = atoms[fragments[a]].size();
+    atoms[fragments[a]].push_back(a);
+  }
+
+  // Internal coordinates within a single fragment, or coupling fragments
+  rows.resize(n_frag);
+  for (std::size_t r{0}; r < n; r++) {
+    const auto& row = B.row(r);
+
+    std::size_t f{n_frag};
+    bool coupled{false};
+    for (std::size_t a{0}; a < row.n_atoms; a++) {
+      if (f == n_frag) {
+        f = fragments[row.atoms[a]];
+      } else if (f != fragments[row.atoms[a]]) {
+        coupled = true;
+      }
+    }
+
+    if (f == n_frag or coupled) {
+      coupling.push_back(r);
+    } else {
+      rows[f].push_back(r);
+    }
+  }
+
+  const std::size_t k{coupling.size()};
+  const double eps{std::numeric_limits<double>::epsilon()};
+
+  // Copy the gradients of row \param r for the atoms of fragment \param f in
+  // row \param i of \param M
+  auto fill = [&](Matrix& M, std::size_t i, std::size_t r, std::size_t f) {
+    const auto& row = B.row(r);
+    for (std::size_t a{0}; a < row.n_atoms; a++) {
+      if (fragments[row.atoms[a]] == f) {
+        for (std::size_t x{0}; x < 3; x++) {
+          M(i, 3 * local[row.atoms[a]] + x) = row.values[3 * a + x];
+        }
+      }
+    }
+  };
+
+  // Factorise every block and project the coupling rows on its singular
+  // vectors: range (W) and null space (KN)
+  U.resize(n_frag);
+  std::vector<Matrix> W(n_frag);
+  std::vector<Matrix> KN(n_frag);
+  std::size_t n_null{0};
+  for (std::size_t f{0}; f < n_frag; f++) {
+    const std::size_t m{rows[f].size()};
+    const std::size_t c{3 * atoms[f].size()};
+
+    Matrix Bf{linalg::zeros<Matrix>(m, c)};
+    for (std::size_t i{0}; i < m; i++) {
+      fill(Bf, i, rows[f][i], f);
+    }
+    Matrix Kf{linalg::zeros<Matrix>(k, c)};
+    for (std::size_t i{0}; i < k; i++) {
+      fill(Kf, i, coupling[i], f);
+    }
+
+    Matrix Uf, Vf;
+    Vector s;
+    std::size_t rank{0};
+    if (m > 0) {
+      linalg::svd(Bf, Uf, s, Vf);
+
+      const double tol{std::max(m, c) * s(0) * eps};
+      while (rank < linalg::size(s) and s(rank) > tol) {
+        rank++;
+      }
+    } else {
+      Vf = linalg::identity<Matrix>(c);
+    }
+
+    U[f] = linalg::zeros<Matrix>(m, rank);
+    for (std::size_t j{0}; j < rank; j++) {
+      for (std::size_t i{0}; i < m; i++) {
+        U[f](i, j) = Uf(i, j);
+      }
+    }
+
+    const Matrix KV{Kf * Vf};
+    W[f] = linalg::zeros<Matrix>(k, rank);
+    KN[f] = linalg::zeros<Matrix>(k, c - rank);
+    for (std::size_t i{0}; i < k; i++) {
+      for (std::size_t j{0}; j < rank; j++) {
+        W[f](i, j) = KV(i, j) / s(j);
+      }
+      for (std::size_t j{rank}; j < c; j++) {
+        KN[f](i, j - rank) = KV(i, j);
+      }
+    }
+    n_null += c - rank;
+  }
+
+  // Orthonormal basis of the range of the coupling rows over the null spaces
+  Matrix Q{linalg::zeros<Matrix>(k, 0)};
+  if (k > 0 and n_null > 0) {
+    Matrix KNall{linalg::zeros<Matrix>(k, n_null)};
+    std::size_t offset{0};
+    for (const auto& KNf : KN) {
+      for (std::size_t j{0}; j < linalg::n_cols(KNf); j++) {
+        for (std::size_t i{0}; i < k; i++) {
+          KNall(i, offset + j) = KNf(i, j);
+        }
+      }
+      offset += linalg::n_cols(KNf);
+    }
+
+    Matrix UK, VK;
+    Vector sK;
+    linalg::svd(KNall, UK, sK, VK);
+
+    const double tol{std::max(k, n_null) * sK(0) * eps};
+    std::size_t rank{0};
+    while (rank < linalg::size(sK) and sK(rank) > tol) {
+      rank++;
+    }
+
+    Q = linalg::zeros<Matrix>(k, rank);
+    for (std::size_t j{0}; j < rank; j++) {
+      for (std::size_t i{0}; i < k; i++) {
+        Q(i, j) = UK(i, j);
+      }
+    }
+  }
+
+  // Low-rank correction
+  Matrix S{linalg::identity<Matrix>(k)};
+  L.resize(n_frag);
+  for (std::size_t f{0}; f < n_frag; f++) {
+    const Matrix Wf{W[f] - Q * (linalg::transpose(Q) * W[f])};
+
+    S = S + Wf * linalg::transpose(Wf);
+    L[f] = U[f] * linalg::transpose(Wf);
+  }
+
+  if (k > 0) {
+    Sinv = linalg::inv(S);
+    T = linalg::identity<Matrix>(k) - Sinv + Q * linalg::transpose(Q);
+  } else {
+    Sinv = linalg::zeros<Matrix>(0, 0);
+    T = linalg::zeros<Matrix>(0, 0);
+  }
+}
+
+template<typename Vector, typename Matrix>
+void FragmentProjector<Vector, Matrix>::constrain(
+    const std::vector<std::size_t>& indices) {
+  constrained = indices;
+
+  const std::size_t m{constrained.size()};
+
+  PC = linalg::zeros<Matrix>(n, m);
+  for (std::size_t j{0}; j < m; j++) {
+    Vector e{linalg::zeros<Vector>(n)};
+    e(constrained[j]) = 1.;
+
+    const Vector p{apply(e)};
+    for (std::size_t i{0}; i < n; i++) {
+      PC(i, j) = p(i);
+    }
+  }
+
+  Matrix PCC{linalg::zeros<Matrix>(m, m)};
+  for (std::size_t j{0}; j < m; j++) {
+    for (std::size_t i{0}; i < m; i++) {
+      PCC(i, j) = PC(constrained[i], j);
+    }
+  }
+
+  // Singular for constraints that are dependent within the range of B
+  PCCinv = m > 0 ? linalg::pseudo_inverse(PCC) : linalg::zeros<Matrix>(0, 0);
+}
+
+template<typename Vector, typename Matrix>
+Vector FragmentProjector<Vector, Matrix>::apply(const Vector& x) const {
+  const std::size_t k{coupling.size()};
+
+  Vector xc{linalg::zeros<Vector>(k)};
+  for (std::size_t i{0}; i < k; i++) {
+    xc(i) = x(coupling[i]);
+  }
+
+  // Blocks of x
+  std::vector<Vector> xf(rows.size());
+  Vector t{linalg::zeros<Vector>(k)};
+  for (std::size_t f{0}; f < rows.size(); f++) {
+    xf[f] = linalg::zeros<Vector>(rows[f].size());
+    for (std::size_t i{0}; i < rows[f].size(); i++) {
+      xf[f](i) = x(rows[f][i]);
+    }
+
+    t = t + linalg::transpose(L[f]) * xf[f];
+  }
+
+  Vector y{linalg::zeros<Vector>(n)};
+
+  const Vector u{Sinv * (xc - t)};
+  for (std::size_t f{0}; f < rows.size(); f++) {
+    const Vector yf{U[f] * (linalg::transpose(U[f]) * xf[f]) + L[f] * u};
+    for (std::size_t i{0}; i < rows[f].size(); i++) {
+      y(rows[f][i]) = yf(i);
+    }
+  }
+
+  const Vector yc{Sinv * t + T * xc};
+  for (std::size_t i{0}; i < k; i++) {
+    y(coupling[i]) = yc(i);
+  }
+
+  return y;
+}
+
+template<typename Vector, typename Matrix>
+Vector FragmentProjector<Vector, Matrix>::operator*(const Vector& x) const {
+  Vector y{apply(x)};
+
+  if (not constrained.empty()) {
+    Vector yc{linalg::zeros<Vector>(constrained.size())};
+    for (std::size_t i{0}; i < constrained.size(); i++) {
+      yc(i) = y(constrained[i]);
+    }
+
+    y = y - PC * (PCCinv * yc);
+  }
+
+  return y;
+}
+
+template<typename Vector, typename Matrix>
+Matrix FragmentProjector<Vector, Matrix>::operator*(const Matrix& M) const {
+  const std::size_t n_cols{linalg::n_cols(M)};
+
+  Matrix PM{linalg::zeros<Matrix>(n, n_cols)};
+  Vector x{linalg::zeros<Vector>(n)};
+  for (std::size_t j{0}; j < n_cols; j++) {
+    for (std::size_t i{0}; i < n; i++) {
+      x(i) = M(i, j);
+    }
+
+    const Vector y{*this * x};
+    for (std::size_t i{0}; i < n; i++) {
+      PM(i, j) = y(i);
+    }
+  }
+
+  return PM;
+}
+
+template<typename Vector, typename Matrix>
+Matrix FragmentProjector<Vector, Matrix>::project(const Matrix& H) const {
+  // The projector is symmetric: P H P = (P (P H)^T)^T
+  const Matrix PH{*this * H};
+
+  return linalg::transpose<Matrix>(*this * linalg::transpose<Matrix>(PH));
 }
 
 } // namespace wilson
@@ -0,0 +1,153 @@
+#include "catch.hpp"
+
+#include "libirc/batch.h"
+
+#include "libirc/connectivity.h"
+#include "libirc/wilson.h"
+
+#include <array>
+#include <cmath>
+
+#ifdef HAVE_ARMA
+#include <armadillo>
+using vec3 = arma::vec3;
+#elif HAVE_EIGEN3
+#include <eigen3/Eigen/Dense>
+using vec3 = Eigen::Vector3d;
+#else
+#error
+#endif
+
+using namespace irc;
+
+namespace {
+
+/// Deterministic point, different for every lane \param l and index \param i
+vec3 point(std::size_t l, std::size_t i) {
+  const double t{1. + l + 10. * i};
+
+  return {1.5 * i + 0.4 * std::sin(t),
+          0.3 * i * i + 0.4 * std::cos(2. * t),
+          0.2 * i + 0.4 * std::sin(3. * t)};
+}
+
+void check(const batch::Points& p, std::size_t l, const vec3& ref) {
+  const vec3 v{p.get<vec3>(l)};
+
+  for (std::size_t m{0}; m < 3; m++) {
+    CHECK(v(m) == Approx(ref(m)).margin(1e-10));
+  }
+}
+
+} // namespace
+
+TEST_CASE("Batched kernels") {
+  using namespace connectivity;
+  using namespace wilson;
+
+  std::array<batch::Points, 4> p;
+  for (std::size_t l{0}; l < batch::width; l++) {
+    for (std::size_t i{0}; i < 4; i++) {
+      p[i].set(l, point(l, i));
+    }
+  }
+
+  batch::Lanes q, q_fused;
+  std::array<batch::Points, 4> g;
+
+  vec3 g1, g2, g3, g4;
+
+  SECTION("Bonds") {
+    batch::bond_values(p[0], p[1], q);
+    batch::bond_gradients(p[0], p[1], q_fused, g[0], g[1]);
+
+    for (std::size_t l{0}; l < batch::width; l++) {
+      CAPTURE(l);
+
+      CHECK(q[l] == Approx(distance(point(l, 0), point(l, 1))));
+      CHECK(q_fused[l] == Approx(q[l]).margin(1e-12));
+
+      std::tie(g1, g2) = bond_gradient(point(l, 0), point(l, 1));
+      check(g[0], l, g1);
+      check(g[1], l, g2);
+    }
+  }
+
+  SECTION("Angles") {
+    batch::angle_values(p[0], p[1], p[2], q);
+    const unsigned linear{
+        batch::angle_gradients(p[0], p[1], p[2], q_fused, g[0], g[1], g[2])};
+
+    CHECK(linear == 0);
+
+    for (std::size_t l{0}; l < batch::width; l++) {
+      CAPTURE(l);
+
+      CHECK(q[l] == Approx(angle(point(l, 0), point(l, 1), point(l, 2))));
+      CHECK(q_fused[l] == Approx(q[l]).margin(1e-12));
+
+      std::tie(g1, g2, g3) =
+          angle_gradient(point(l, 0), point(l, 1), point(l, 2));
+      check(g[0], l, g1);
+      check(g[1], l, g2);
+      check(g[2], l, g3);
+    }
+  }
+
+  SECTION("Linear angles") {
+    // Straight angle in lane 0
+    p[0].set(0, vec3{-1., 0., 0.});
+    p[1].set(0, vec3{0., 0., 0.});
+    p[2].set(0, vec3{2., 0., 0.});
+
+    batch::angle_values(p[0], p[1], p[2], q);
+    const unsigned linear{
+        batch::angle_gradients(p[0], p[1], p[2], q_fused, g[0], g[1], g[2])};
+
+    CHECK(q[0] == Approx(tools::constants::pi));
+    CHECK(q_fused[0] == Approx(tools::constants::pi));
+    CHECK(linear == 1u);
+  }
+
+  SECTION("Dihedral angles") {
+    batch::dihedral_values(p[0], p[1], p[2], p[3], q);
+    batch::dihedral_gradients(
+        p[0], p[1], p[2], p[3], q_fused, g[0], g[1], g[2], g[3]);
+
+    for (std::size_t l{0}; l < batch::width; l++) {
+      CAPTURE(l);
+
+      CHECK(q[l] == Approx(dihedral(
+                        point(l, 0), point(l, 1), point(l, 2), point(l, 3))));
+      CHECK(q_fused[l] == Approx(q[l]).margin(1e-12));
+
+      std::tie(g1, g2, g3, g4) = dihedral_gradient(
+          point(l, 0), point(l, 1), point(l, 2), point(l, 3));
+      check(g[0], l, g1);
+      check(g[1], l, g2);
+      check(g[2], l, g3);
+      check(g[3], l, g4);
+    }
+  }
+
+  SECTION("Out of plane bends") {
+    batch::out_of_plane_values(p[0], p[1], p[2], p[3], q);
+    batch::out_of_plane_gradients(
+        p[0], p[1], p[2], p[3], q_fused, g[0], g[1], g[2], g[3]);
+
+    for (std::size_t l{0}; l < batch::width; l++) {
+      CAPTURE(l);
+
+      CHECK(q[l] == Approx(out_of_plane_angle(
+                        point(l, 0), point(l, 1), point(l, 2), point(l, 3))));
+      CHECK(q_fused[l] == Approx(q[l]).margin(1e-12));
+
+      std::tie(g1, g2, g3, g4) = out_of_plane_gradient(
+          point(l, 0), point(l, 1), point(l, 2), point(l, 3));
+      check(g[0], l, g1);
+      check(g[1], l, g2);
+      check(g[2], l, g3);
+      check(g[3], l, g4);
+    }
+  }
+}
@@ -846,3 +846,591 @@ TEST_CASE("Connectivity of molecule database") {
     CHECK(OoPB.size() == molecule_parameters.n_out_of_plane_bends);
   }
 }
+
+TEST_CASE("Regular bonds from cell list") {
+  using namespace io;
+
+  using namespace connectivity;
+  using namespace molecule;
+
+  const std::vector<std::string> filenames{"carbon_dioxide.xyz",
+                                           "ethanol.xyz",
+                                           "caffeine.xyz",
+                                           "benzene_dimer.xyz",
+                                           "indene.xyz",
+                                           "issue41.xyz"};
+
+  for (const auto& filename : filenames) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+
+    // Regular bonds from all interatomic distances
+    UGraph ug_distances(mol.size());
+    add_regular_bonds(ug_distances, distances<vec3, mat>(mol), mol);
+
+    // Regular bonds from the cell list
+    UGraph ug_cells(mol.size());
+    add_regular_bonds(ug_cells, mol);
+
+    REQUIRE(ug_cells.n_edges() == ug_distances.n_edges());
+
+    for (std::size_t j{0}; j < mol.size(); j++) {
+      for (std::size_t i{0}; i < j; i++) {
+        CHECK(ug_cells.has_edge(i, j) ==
+              ug_distances.has_edge(i, j));
+      }
+    }
+  }
+}
+
+TEST_CASE("Adjacency matrix from neighbor list") {
+  using namespace io;
+
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace tools::conversion;
+
+  // Two stretched H2 molecules, farther apart than the bonding cutoff
+  const Molecule<vec3> h2_h2{{"H", {0.0, 0.0, 0.0}},
+                             {"H", {2.0, 0.0, 0.0}},
+                             {"H", {5.0, 0.0, 1.0}},
+                             {"H", {7.0, 0.0, 1.0}}};
+
+  std::vector<Molecule<vec3>> molecules{h2_h2 * angstrom_to_bohr};
+
+  for (const auto& filename : {"hydrogen_peroxide.xyz",
+                               "caffeine.xyz",
+                               "benzene_dimer.xyz",
+                               "water_dimer_1.xyz",
+                               "water_dimer_2.xyz",
+                               "issue41.xyz"}) {
+    molecules.push_back(load_xyz<vec3>(config::molecules_dir + filename));
+  }
+
+  for (std::size_t m{0}; m < molecules.size(); m++) {
+    CAPTURE(m);
+
+    const auto& mol = molecules[m];
+
+    // Graph from all interatomic distances
+    const UGraph adj_dense{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+
+    // Graph from interatomic distances within the bonding cutoff
+    const neighbors::NeighborList nl(mol, bonding_cutoff(mol));
+    const UGraph adj_sparse{adjacency_matrix(nl, mol)};
+
+    // The topology must be the same
+    const mat dist_dense{distance_matrix<mat>(adj_dense)};
+    const mat dist_sparse{distance_matrix<mat>(adj_sparse)};
+    for (std::size_t i{0}; i < linalg::size(dist_dense); i++) {
+      CHECK(dist_sparse(i) == Approx(dist_dense(i)));
+    }
+  }
+}
+
+TEST_CASE("Bounded distance matrix") {
+  using namespace io;
+
+  using namespace connectivity;
+  using namespace molecule;
+
+  for (const auto& filename : {"caffeine.xyz",
+                               "benzene_dimer.xyz",
+                               "glycerol.xyz",
+                               "octane.xyz",
+                               "water_dimer_2.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+    const std::size_t n_atoms{mol.size()};
+
+    const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+    const mat dist{distance_matrix<mat>(adj)};
+
+    SECTION("Distances within the maximum depth") {
+      for (const std::size_t max_depth : {1, 2, 3, 5}) {
+        CAPTURE(max_depth);
+
+        const BoundedDistanceMatrix bdist{
+            bounded_distance_matrix(adj, max_depth)};
+
+        REQUIRE(bdist.size() == n_atoms);
+        CHECK(bdist.max_depth() == max_depth);
+
+        for (std::size_t i{0}; i < n_atoms; i++) {
+          for (std::size_t j{0}; j < n_atoms; j++) {
+            const std::size_t d{path_length(dist, i, j)};
+
+            CHECK(bdist(i, j) == std::min(d, max_depth + 1));
+          }
+        }
+      }
+    }
+
+    SECTION("Primitives") {
+      const BoundedDistanceMatrix bdist{bounded_distance_matrix(adj)};
+
+      CHECK(bonds(bdist, mol) == bonds(dist, mol));
+      CHECK(angles(bdist, mol) == angles(dist, mol));
+      CHECK(dihedrals(bdist, mol) == dihedrals(dist, mol));
+      CHECK(out_of_plane_bends(bdist, mol) == out_of_plane_bends(dist, mol));
+      CHECK(linear_angles(bdist, mol) == linear_angles(dist, mol));
+    }
+  }
+}
+
+TEST_CASE("Topological distance") {
+  using namespace io;
+
+  using namespace connectivity;
+  using namespace molecule;
+
+  for (const auto& filename : {"caffeine.xyz",
+                               "benzene_dimer.xyz",
+                               "octane.xyz",
+                               "water_dimer_2.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+    const std::size_t n_atoms{mol.size()};
+
+    const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+    const mat dist{distance_matrix<mat>(adj)};
+
+    const TopologicalDistance tdist{topological_distance(adj)};
+
+    REQUIRE(tdist.size() == n_atoms);
+
+    for (std::size_t i{0}; i < n_atoms; i++) {
+      for (std::size_t j{0}; j < n_atoms; j++) {
+        const std::size_t d{path_length(dist, i, j)};
+
+        CHECK(tdist(i, j) == std::min<std::size_t>(d, 4));
+        CHECK(tdist(i, j) == tdist(j, i));
+      }
+    }
+
+    CHECK(bonds(tdist, mol) == bonds(dist, mol));
+    CHECK(angles(tdist, mol) == angles(dist, mol));
+    CHECK(dihedrals(tdist, mol) == dihedrals(dist, mol));
+    CHECK(out_of_plane_bends(tdist, mol) == out_of_plane_bends(dist, mol));
+  }
+
+  SECTION("Empty graph") {
+    const TopologicalDistance tdist{topological_distance(UGraph{})};
+
+    CHECK(tdist.size() == 0);
+  }
+}
+
+TEST_CASE("Enumeration of primitives from bonded neighbors") {
+  using namespace io;
+
+  using namespace connectivity;
+  using namespace molecule;
+
+  for (const auto& filename : {"caffeine.xyz",
+                               "benzene_dimer.xyz",
+                               "glycerol.xyz",
+                               "octane.xyz",
+                               "water_dimer_2.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+    const std::size_t n_atoms{mol.size()};
+
+    const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+    const mat dist{distance_matrix<mat>(adj)};
+
+    // Reference enumeration over all pairs of terminal atoms
+    std::vector<Angle> angs_ref;
+    std::vector<Dihedral> dihs_ref;
+    for (std::size_t j{0}; j < n_atoms; j++) {
+      for (std::size_t i{0}; i < j; i++) {
+        for (const auto& a : angles(i, j, dist)) {
+          angs_ref.push_back(a);
+        }
+
+        for (const auto& d : dihedrals(i, j, dist)) {
+          const double a1{angle<vec3>({d.i, d.j, d.k}, mol)};
+          const double a2{angle<vec3>({d.j, d.k, d.l}, mol)};
+
+          if (a1 <= tools::constants::quasi_linear_angle and
+              a2 <= tools::constants::quasi_linear_angle) {
+            dihs_ref.push_back(d);
+          }
+        }
+      }
+    }
+
+    const BoundedDistanceMatrix bdist{bounded_distance_matrix(adj)};
+
+    // Same primitives in the same order
+    CHECK(all_angles(dist) == angs_ref);
+    CHECK(all_angles(bdist) == angs_ref);
+    CHECK(dihedrals(dist, mol) == dihs_ref);
+    CHECK(dihedrals(bdist, mol) == dihs_ref);
+  }
+}
+
+TEST_CASE("Bend angles shared between filters") {
+  using namespace io;
+
+  using namespace connectivity;
+  using namespace molecule;
+
+  for (const auto& filename : {"caffeine.xyz",
+                               "benzene_dimer.xyz",
+                               "glycerol.xyz",
+                               "octane.xyz",
+                               "water_dimer_2.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+
+    const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+    const BoundedDistanceMatrix bdist{bounded_distance_matrix(adj)};
+
+    AngleCache<vec3> cache(mol);
+
+    // Same primitives as computed from the molecule
+    CHECK(angles(bdist, cache) == angles(bdist, mol));
+    CHECK(dihedrals(bdist, cache) == dihedrals(bdist, mol));
+    CHECK(linear_angles(bdist, cache) == linear_angles(bdist, mol));
+    CHECK(out_of_plane_bends(bdist, cache) == out_of_plane_bends(bdist, mol));
+
+    // All the bend angles tested are angles between bonded atoms, computed
+    // only once
+    const auto all = all_angles(bdist);
+    CHECK(cache.size() == all.size());
+    for (const auto& a : all) {
+      CHECK(cache(a) == Approx(angle<vec3>(a, mol)));
+    }
+    CHECK(cache.size() == all.size());
+  }
+}
+
+TEST_CASE("Primitives from a single pass") {
+  using namespace io;
+
+  using namespace connectivity;
+  using namespace molecule;
+
+  for (const auto& filename : {"caffeine.xyz",
+                               "benzene_dimer.xyz",
+                               "carbon_dioxide.xyz",
+                               "2-butyne.xyz",
+                               "glycerol.xyz",
+                               "octane.xyz",
+                               "water_dimer_2.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+
+    const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+    const BoundedDistanceMatrix bdist{bounded_distance_matrix(adj)};
+
+    const Primitives<vec3> p{primitives(bdist, mol)};
+
+    // Same primitives in the same order
+    CHECK(p.bonds == bonds(bdist, mol));
+    CHECK(p.angles == angles(bdist, mol));
+    CHECK(p.dihedrals == dihedrals(bdist, mol));
+    CHECK(p.out_of_plane_bends == out_of_plane_bends(bdist, mol));
+
+    const auto la = linear_angles(bdist, mol);
+    REQUIRE(p.linear_angles.size() == la.size());
+    for (std::size_t i{0}; i < la.size(); i++) {
+      CHECK(p.linear_angles[i] == la[i]);
+      CHECK(linalg::norm(p.linear_angles[i].orthogonal_direction -
+                         la[i].orthogonal_direction) == Approx(0));
+    }
+  }
+}
+
+TEST_CASE("Topology cache") {
+  using namespace io;
+
+  using namespace connectivity;
+  using namespace molecule;
+
+  TopologyCache<vec3> cache;
+
+  const std::vector<std::string> filenames{"caffeine.xyz",
+                                           "benzene_dimer.xyz",
+                                           "2-butyne.xyz",
+                                           "glycerol.xyz",
+                                           "water_dimer_2.xyz"};
+
+  for (const auto& filename : filenames) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+
+    // Conformer with the same covalent bonds
+    auto displaced = mol;
+    for (std::size_t i{0}; i < displaced.size(); i++) {
+      displaced[i].position += vec3{0.01 * (i % 3), -0.02 * (i % 2), 0.01};
+    }
+
+    const std::size_t misses{cache.n_misses()};
+    const Topology& t{cache(mol)};
+    CHECK(cache.n_misses() == misses + 1);
+
+    const std::size_t hits{cache.n_hits()};
+    const Topology& t_displaced{cache(displaced)};
+    CHECK(cache.n_hits() == hits + 1);
+    CHECK(&t_displaced == &t);
+
+    // Covalently bonded fragments
+    UGraph covalent(mol.size());
+    add_regular_bonds(covalent, mol);
+    CHECK(t.fragments == covalent.fragment_labels());
+
+    // Same primitives as a full connectivity perception
+    const UGraph adj{
+        adjacency_matrix(distances<vec3, mat>(displaced), displaced)};
+    const BoundedDistanceMatrix bdist{bounded_distance_matrix(adj)};
+
+    AngleCache<vec3> angles(displaced);
+    const Primitives<vec3> p{primitives(t_displaced, angles)};
+    const Primitives<vec3> p_ref{primitives(bdist, displaced)};
+
+    CHECK(p.bonds == p_ref.bonds);
+    CHECK(p.angles == p_ref.angles);
+    CHECK(p.dihedrals == p_ref.dihedrals);
+    CHECK(p.linear_angles == p_ref.linear_angles);
+    CHECK(p.out_of_plane_bends == p_ref.out_of_plane_bends);
+  }
+
+  CHECK(cache.size() == filenames.size());
+
+  SECTION("Geometric filters applied again") {
+    auto mol =
+        load_xyz<vec3>(config::molecules_dir + "carbon_dioxide.xyz");
+
+    AngleCache<vec3> linear(mol);
+    const Primitives<vec3> p_linear{primitives(cache(mol), linear)};
+    CHECK(p_linear.angles.empty());
+    CHECK(p_linear.linear_angles.size() == 2);
+
+    // Bend the molecule without breaking bonds
+    mol[0].position += vec3{0.0, 0.5, 0.0};
+
+    AngleCache<vec3> bent(mol);
+    const Primitives<vec3> p_bent{primitives(cache(mol), bent)};
+    CHECK(cache.n_hits() == filenames.size() + 1);
+    CHECK(p_bent.angles.size() == 1);
+    CHECK(p_bent.linear_angles.empty());
+  }
+
+  SECTION("Different molecules") {
+    auto mol = load_xyz<vec3>(config::molecules_dir + "water_dimer_2.xyz");
+
+    // Same bonds, different elements
+    mol[0].atomic_number = atom::AtomicNumber{"S"};
+    cache(mol);
+    CHECK(cache.n_misses() == filenames.size() + 1);
+
+    cache.clear();
+    CHECK(cache.size() == 0);
+    CHECK(cache.n_hits() == 0);
+    CHECK(cache.n_misses() == 0);
+  }
+}
+
+TEST_CASE("Interfragment bonds for many fragments") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace tools::conversion;
+
+  // Grids of water molecules, within and beyond the bonding cutoff
+  for (const double spacing : {3.0, 4.5, 8.0}) {
+    CAPTURE(spacing);
+
+    Molecule<vec3> mol;
+    for (std::size_t x{0}; x < 4; x++) {
+      for (std::size_t y{0}; y < 3; y++) {
+        for (std::size_t z{0}; z < 2; z++) {
+          // Distort the grid to avoid equal interfragment distances
+          const vec3 o{spacing * x + 0.1 * y,
+                       spacing * y + 0.2 * z * z,
+                       spacing * z + 0.05 * x * y};
+
+          mol.push_back({"O", o});
+          mol.push_back({"H", vec3{o + vec3{0.96, 0.0, 0.0}}});
+          mol.push_back({"H", vec3{o + vec3{-0.24, 0.93, 0.0}}});
+        }
+      }
+    }
+    mol = mol * angstrom_to_bohr;
+
+    // Water molecules are tracked as separate fragments
+    UGraph ug(mol.size());
+    add_regular_bonds(ug, mol);
+    const auto fragments = identify_fragments(ug);
+    CHECK(fragments.first == 24);
+    for (std::size_t k{0}; k < mol.size(); k++) {
+      CHECK(fragments.second[k] == k / 3);
+    }
+
+    const UGraph adj_dense{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+
+    const neighbors::NeighborList nl(mol, bonding_cutoff(mol));
+    const UGraph adj_sparse{adjacency_matrix(nl, mol)};
+
+    // All fragments are connected
+    CHECK(identify_fragments(adj_dense).first == 1);
+    CHECK(identify_fragments(adj_sparse).first == 1);
+
+    // Same interfragment and auxiliary interfragment bonds
+    REQUIRE(adj_sparse.n_edges() == adj_dense.n_edges());
+    for (std::size_t j{0}; j < mol.size(); j++) {
+      for (std::size_t i{0}; i < j; i++) {
+        CHECK(adj_sparse.has_edge(i, j) ==
+              adj_dense.has_edge(i, j));
+      }
+    }
+  }
+}
+
+TEST_CASE("Hydrogen bonds from donors and acceptor grid") {
+  using namespace io;
+
+  using namespace connectivity;
+  using namespace molecule;
+
+  SECTION("Donors") {
+    const auto mol =
+        load_xyz<vec3>(config::molecules_dir + "water_dimer_2.xyz");
+
+    UGraph ug(mol.size());
+    add_regular_bonds(ug, mol);
+
+    const auto donors = hydrogen_bond_donors(ug, mol);
+
+    REQUIRE(donors.size() == 4);
+    for (const auto& donor : donors) {
+      CHECK(atom::is_NOFPSCl(mol[donor.x].atomic_number));
+      CHECK(atom::is_H(mol[donor.h].atomic_number));
+    }
+  }
+
+  SECTION("Same hydrogen bonds") {
+    for (const auto& filename : {"water_dimer_1.xyz",
+                                 "water_dimer_2.xyz",
+                                 "glycerol.xyz",
+                                 "caffeine.xyz",
+                                 "ethanol.xyz",
+                                 "phenol.xyz"}) {
+      CAPTURE(filename);
+
+      const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+      const mat dd{distances<vec3, mat>(mol)};
+
+      // Hydrogen bonds from all interatomic distances
+      UGraph ug_distances(mol.size());
+      add_regular_bonds(ug_distances, mol);
+      add_hydrogen_bonds(ug_distances, dd, mol);
+
+      // Hydrogen bonds from the acceptor grid
+      UGraph ug_grid(mol.size());
+      add_regular_bonds(ug_grid, mol);
+      add_hydrogen_bonds(ug_grid, mol);
+
+      REQUIRE(ug_grid.n_edges() == ug_distances.n_edges());
+      for (std::size_t j{0}; j < mol.size(); j++) {
+        for (std::size_t i{0}; i < j; i++) {
+          CHECK(ug_grid.has_edge(i, j) ==
+                ug_distances.has_edge(i, j));
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Incremental connectivity") {
+  using namespace io;
+
+  using namespace connectivity;
+  using namespace molecule;
+
+  for (const auto& filename :
+       {"ethanol.xyz", "water_dimer_2.xyz", "glycerol.xyz"}) {
+    CAPTURE(filename);
+
+    auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+
+    const double skin{1.};
+    IncrementalConnectivity<vec3> connectivity(mol, skin);
+
+    const auto reference =
+        adjacency_matrix(neighbors::NeighborList(mol, bonding_cutoff(mol)), mol)
+            .edges();
+
+    CHECK(connectivity.graph().edges() == reference);
+    CHECK(connectivity.n_builds() == 1);
+
+    SECTION("Small displacements") {
+      // Small (alternating) displacements within the skin
+      for (std::size_t step{0}; step < 5; step++) {
+        for (std::size_t i{0}; i < mol.size(); i++) {
+          const double sign{(i + step) % 2 == 0 ? 1. : -1.};
+          mol[i].position = mol[i].position + vec3{0.02, -0.01, 0.015} * sign;
+        }
+
+        CHECK(not connectivity.update(mol));
+        CHECK(connectivity.graph().edges() == reference);
+      }
+
+      CHECK(connectivity.n_builds() == 1);
+    }
+
+    SECTION("Large displacement") {
+      // Pull the last atom away from the molecule
+      mol.back().position = mol.back().position * 4.;
+
+      const neighbors::NeighborList nl(mol, bonding_cutoff(mol));
+      const auto displaced = adjacency_matrix(nl, mol).edges();
+
+      CHECK(connectivity.update(mol) == (displaced != reference));
+      CHECK(connectivity.n_builds() == 2);
+      CHECK(connectivity.graph().edges() == displaced);
+
+      // No further changes
+      CHECK(not connectivity.update(mol));
+    }
+  }
+
+  SECTION("Bond formed and broken") {
+    Molecule<vec3> mol{
+        {"H", {0., 0., 0.}}, {"H", {1.4, 0., 0.}}, {"H", {2.8, 0., 0.}}};
+
+    IncrementalConnectivity<vec3> connectivity(mol);
+
+    using Edges = std::vector<std::pair<std::size_t, std::size_t>>;
+    CHECK(connectivity.graph().edges() == Edges{{0, 1}, {1, 2}});
+
+    // Move the last atom to the other end of the chain
+    mol[2].position = vec3{-1.4, 0., 0.};
+
+    CHECK(connectivity.update(mol));
+    CHECK(connectivity.graph().edges() == Edges{{0, 1}, {0, 2}});
+  }
+
+  SECTION("Quasi-linear angle") {
+    // Bending a linear molecule changes the primitives but not the bonds
+    Molecule<vec3> mol{{"C", {0., 0., 0.}},
+                       {"O", {2.2, 0., 0.}},
+                       {"O", {-2.2, 0., 0.}}};
+
+    IncrementalConnectivity<vec3> connectivity(mol);
+
+    mol[0].position = vec3{0., 0.5, 0.};
+
+    CHECK(connectivity.update(mol));
+    CHECK(connectivity.n_builds() == 1);
+    CHECK(connectivity.graph().edges().size() == 2);
+  }
+}
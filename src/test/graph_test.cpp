@@ -0,0 +1,124 @@
+#include "catch.hpp"
+
+#include "libirc/graph.h"
+
+#include <utility>
+#include <vector>
+
+using namespace irc;
+
+TEST_CASE("Disjoint sets") {
+  using namespace graph;
+
+  DisjointSets sets(5);
+  CHECK(sets.size() == 5);
+  CHECK(sets.n_sets() == 5);
+  CHECK(sets.labels() == std::vector<std::size_t>{0, 1, 2, 3, 4});
+
+  CHECK(sets.unite(3, 1));
+  CHECK(sets.unite(4, 1));
+  CHECK(not sets.unite(3, 4));
+
+  CHECK(sets.n_sets() == 3);
+  CHECK(sets.same(3, 4));
+  CHECK(not sets.same(0, 1));
+  CHECK(sets.set_size(4) == 3);
+  CHECK(sets.set_size(2) == 1);
+
+  // Sets are labelled in order of their lowest element
+  CHECK(sets.labels() == std::vector<std::size_t>{0, 1, 2, 1, 1});
+}
+
+TEST_CASE("Molecular graph") {
+  using namespace graph;
+
+  using Edges = std::vector<std::pair<std::size_t, std::size_t>>;
+
+  // Two fragments: a chain 0-1-2-3 with a branch 1-4, and a pair 5-6
+  MolecularGraph g(7);
+  CHECK(g.n_vertices() == 7);
+  CHECK(g.n_edges() == 0);
+
+  CHECK(g.add_edges({{1, 0}, {2, 1}, {2, 3}, {4, 1}}) == 4);
+  CHECK(g.add_edge(5, 6));
+
+  SECTION("Edges") {
+    CHECK(g.n_edges() == 5);
+    CHECK(g.edges() == Edges{{0, 1}, {1, 2}, {1, 4}, {2, 3}, {5, 6}});
+
+    for (const auto& e : g.edges()) {
+      CHECK(g.has_edge(e.first, e.second));
+      CHECK(g.has_edge(e.second, e.first));
+    }
+    CHECK(not g.has_edge(0, 2));
+    CHECK(not g.has_edge(4, 5));
+
+    // Neighbours are sorted by index
+    const auto n1 = g.neighbors(1);
+    CHECK(std::vector<std::size_t>(n1.begin(), n1.end()) ==
+          std::vector<std::size_t>{0, 2, 4});
+    CHECK(g.degree(1) == 3);
+    CHECK(g.degree(6) == 1);
+  }
+
+  SECTION("Repeated edges and self-loops") {
+    CHECK(not g.add_edge(1, 2));
+    CHECK(not g.add_edge(2, 1));
+    CHECK(not g.add_edge(3, 3));
+    CHECK(g.add_edges({{3, 4}, {4, 3}, {0, 1}}) == 1);
+
+    CHECK(g.n_edges() == 6);
+    CHECK(g.has_edge(3, 4));
+
+    CHECK_THROWS_AS(g.add_edge(0, 7), std::out_of_range);
+  }
+
+  SECTION("Connected components") {
+    std::vector<std::size_t> component;
+
+    CHECK(connected_components(g, component) == 2);
+    CHECK(component == std::vector<std::size_t>{0, 0, 0, 0, 0, 1, 1});
+
+    g.add_edge(3, 6);
+    CHECK(connected_components(g, component) == 1);
+
+    CHECK(connected_components(MolecularGraph(3), component) == 3);
+    CHECK(component == std::vector<std::size_t>{0, 1, 2});
+  }
+
+  SECTION("Fragments") {
+    std::vector<std::size_t> component;
+
+    CHECK(g.n_fragments() == 2);
+    CHECK(g.same_fragment(0, 3));
+    CHECK(not g.same_fragment(4, 5));
+    CHECK(g.fragment_labels() == std::vector<std::size_t>{0, 0, 0, 0, 0, 1, 1});
+
+    // Fragments are updated as edges are added
+    g.add_edges({{6, 0}, {0, 1}});
+    CHECK(g.n_fragments() == 1);
+    CHECK(g.same_fragment(4, 5));
+
+    connected_components(g, component);
+    CHECK(g.fragment_labels() == component);
+  }
+
+  SECTION("Breadth-first search") {
+    BreadthFirstSearch bfs(g);
+
+    const auto& visited = bfs(0);
+    CHECK(visited.size() == 5);
+    CHECK(visited.front() == 0);
+    CHECK(bfs.depth(1) == 1);
+    CHECK(bfs.depth(2) == 2);
+    CHECK(bfs.depth(4) == 2);
+    CHECK(bfs.depth(3) == 3);
+    CHECK(bfs.depth(5) == BreadthFirstSearch::unvisited());
+
+    // Bounded search, reusing the work space
+    CHECK(bfs(3, 1).size() == 2);
+    CHECK(bfs.depth(0) == BreadthFirstSearch::unvisited());
+    CHECK(bfs(3, 2).size() == 3);
+    CHECK(bfs(5).size() == 2);
+  }
+}
@@ -8,6 +8,13 @@
 #include "libirc/io.h"
 #include "libirc/molecule.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
 #ifdef HAVE_ARMA
 #include <armadillo>
 using vec3 = arma::vec3;
@@ -284,6 +291,469 @@ TEST_CASE("Internal Redundant Coordinates") {
   }
 }
 
+TEST_CASE("Fragment blocks") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace io;
+
+  const auto molecule =
+      load_xyz<vec3>(config::molecules_dir + "benzene_dimer.xyz");
+  const vec x_c{to_cartesian<vec3, vec>(molecule)};
+
+  // Constrain one bond of every fragment
+  IRC<vec3, vec, mat> dense(molecule, {{0, 1, Constraint::constrained}});
+  IRC<vec3, vec, mat> blocks(molecule, {{0, 1, Constraint::constrained}});
+
+  CHECK(not blocks.fragment_blocks());
+  blocks.use_fragment_blocks();
+  CHECK(blocks.fragment_blocks());
+
+  const std::size_t n_irc{linalg::size(dense.cartesian_to_irc(x_c))};
+
+  const mat H0{dense.projected_initial_hessian()};
+  const mat H0_blocks{blocks.projected_initial_hessian()};
+  for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+    CHECK(H0_blocks(i) == Approx(H0(i)).margin(1e-8));
+  }
+
+  vec grad_c{linalg::zeros<vec>(linalg::size(x_c))};
+  for (std::size_t i{0}; i < linalg::size(x_c); i++) {
+    grad_c(i) = std::sin(i + 1.);
+  }
+
+  const vec g{dense.grad_cartesian_to_projected_irc(grad_c)};
+  const vec g_blocks{blocks.grad_cartesian_to_projected_irc(grad_c)};
+  for (std::size_t i{0}; i < n_irc; i++) {
+    CHECK(g_blocks(i) == Approx(g(i)).margin(1e-8));
+  }
+
+  // Back to a dense projector
+  blocks.use_fragment_blocks(false);
+  CHECK(not blocks.fragment_blocks());
+
+  const mat H0_dense{blocks.projected_initial_hessian()};
+  for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+    CHECK(H0_dense(i) == Approx(H0(i)).margin(1e-12));
+  }
+}
+
+TEST_CASE("Sparse Wilson B matrix") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace io;
+
+  const auto molecule =
+      load_xyz<vec3>(config::molecules_dir + "benzene_dimer.xyz");
+  const vec x_c{to_cartesian<vec3, vec>(molecule)};
+
+  IRC<vec3, vec, mat> dense(molecule, {{0, 1, Constraint::constrained}});
+  IRC<vec3, vec, mat> sparse(molecule, {{0, 1, Constraint::constrained}});
+
+  CHECK(not sparse.sparse_wilson_matrix());
+  sparse.use_sparse_wilson_matrix();
+  CHECK(sparse.sparse_wilson_matrix());
+
+  const vec q{dense.cartesian_to_irc(x_c)};
+  const std::size_t n_irc{linalg::size(q)};
+
+  vec grad_c{linalg::zeros<vec>(linalg::size(x_c))};
+  for (std::size_t i{0}; i < linalg::size(x_c); i++) {
+    grad_c(i) = std::sin(i + 1.);
+  }
+
+  const vec g{dense.grad_cartesian_to_projected_irc(grad_c)};
+  const vec g_sparse{sparse.grad_cartesian_to_projected_irc(grad_c)};
+  for (std::size_t i{0}; i < n_irc; i++) {
+    CHECK(g_sparse(i) == Approx(g(i)).margin(1e-6));
+  }
+
+  // Step along the projected gradient
+  const vec dq{-0.1 * g};
+
+  const auto result = dense.irc_to_cartesian(q, dq, x_c);
+  const auto result_sparse = sparse.irc_to_cartesian(q, dq, x_c);
+  CHECK(result_sparse.converged == result.converged);
+  for (std::size_t i{0}; i < linalg::size(x_c); i++) {
+    CHECK(result_sparse.x_c(i) == Approx(result.x_c(i)).margin(1e-6));
+  }
+
+  // Updated projectors
+  const mat H0{dense.projected_initial_hessian()};
+  const mat H0_sparse{sparse.projected_initial_hessian()};
+  for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+    CHECK(H0_sparse(i) == Approx(H0(i)).margin(1e-8));
+  }
+
+  // Hessian transformations
+  mat H_c{linalg::zeros<mat>(linalg::size(x_c), linalg::size(x_c))};
+  for (std::size_t j{0}; j < linalg::size(x_c); j++) {
+    for (std::size_t i{0}; i < linalg::size(x_c); i++) {
+      H_c(i, j) = std::cos(i + j + 1.);
+    }
+  }
+
+  const mat H_q{dense.hessian_cartesian_to_projected_irc(H_c, grad_c, x_c)};
+  const mat H_q_sparse{
+      sparse.hessian_cartesian_to_projected_irc(H_c, grad_c, x_c)};
+  for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+    CHECK(H_q_sparse(i) == Approx(H_q(i)).margin(1e-6));
+  }
+
+  const vec g_q{dense.grad_cartesian_to_projected_irc(grad_c)};
+  const mat H_x{dense.hessian_irc_to_cartesian(H_q, g_q, x_c)};
+  const mat H_x_sparse{sparse.hessian_irc_to_cartesian(H_q, g_q, x_c)};
+  for (std::size_t i{0}; i < linalg::size(H_x); i++) {
+    CHECK(H_x_sparse(i) == Approx(H_x(i)).margin(1e-8));
+  }
+
+  // Sparse Wilson B matrix from the start
+  const IRC<vec3, vec, mat> built_dense(molecule,
+                                        {{0, 1, Constraint::constrained}});
+  const IRC<vec3, vec, mat> built_sparse(
+      molecule, {{0, 1, Constraint::constrained}}, {}, {}, {}, true);
+  CHECK(not built_dense.sparse_wilson_matrix());
+  CHECK(built_sparse.sparse_wilson_matrix());
+
+  const mat H0_built_dense{built_dense.projected_initial_hessian()};
+  const mat H0_built_sparse{built_sparse.projected_initial_hessian()};
+  for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+    CHECK(H0_built_sparse(i) == Approx(H0_built_dense(i)).margin(1e-8));
+  }
+
+  // Back to a dense Wilson B matrix
+  sparse.use_sparse_wilson_matrix(false);
+  CHECK(not sparse.sparse_wilson_matrix());
+
+  const vec g_new{dense.grad_cartesian_to_projected_irc(grad_c)};
+  const vec g_dense{sparse.grad_cartesian_to_projected_irc(grad_c)};
+  for (std::size_t i{0}; i < n_irc; i++) {
+    CHECK(g_dense(i) == Approx(g_new(i)).margin(1e-6));
+  }
+}
+
+TEST_CASE("Internal coordinates computed with Wilson B matrix") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace io;
+
+  const auto molecule = load_xyz<vec3>(config::molecules_dir + "caffeine.xyz");
+  const vec x_c{to_cartesian<vec3, vec>(molecule)};
+
+  IRC<vec3, vec, mat> irc(molecule);
+
+  // Internal coordinates computed from scratch
+  auto irc_values = [&irc](const vec& x) {
+    return connectivity::cartesian_to_irc<vec3, vec>(
+        x,
+        irc.get_bonds(),
+        irc.get_angles(),
+        irc.get_dihedrals(),
+        irc.get_linear_angles(),
+        irc.get_out_of_plane_bends());
+  };
+
+  auto check = [](const vec& q, const vec& q_ref) {
+    REQUIRE(linalg::size(q) == linalg::size(q_ref));
+    for (std::size_t i{0}; i < linalg::size(q); i++) {
+      CHECK(q(i) == Approx(q_ref(i)).margin(1e-12));
+    }
+  };
+
+  const vec q{irc.cartesian_to_irc(x_c)};
+  check(q, irc_values(x_c));
+
+  vec grad_c{linalg::zeros<vec>(linalg::size(x_c))};
+  for (std::size_t i{0}; i < linalg::size(x_c); i++) {
+    grad_c(i) = std::sin(i + 1.);
+  }
+  const vec dq{-0.05 * irc.grad_cartesian_to_projected_irc(grad_c)};
+
+  SECTION("Dense Wilson B matrix") {
+    const auto result = irc.irc_to_cartesian(q, dq, x_c);
+
+    check(irc.cartesian_to_irc(result.x_c), irc_values(result.x_c));
+    check(irc.cartesian_to_irc(x_c), q);
+  }
+
+  SECTION("Sparse Wilson B matrix") {
+    irc.use_sparse_wilson_matrix();
+
+    const auto result = irc.irc_to_cartesian(q, dq, x_c);
+
+    check(irc.cartesian_to_irc(result.x_c), irc_values(result.x_c));
+    check(irc.cartesian_to_irc(x_c), q);
+  }
+}
+
+TEST_CASE("Hessian transformation") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace io;
+
+  auto molecule = load_xyz<vec3>(config::molecules_dir + "ethanol.xyz");
+  multiply_positions(molecule, tools::conversion::angstrom_to_bohr);
+
+  const vec x_c{to_cartesian<vec3, vec>(molecule)};
+  const std::size_t n_c{linalg::size(x_c)};
+
+  IRC<vec3, vec, mat> irc(molecule);
+
+  // Geometry different from the one of the stored projector
+  vec x_displaced{x_c};
+  for (std::size_t i{0}; i < n_c; i++) {
+    x_displaced(i) += 0.1 * std::sin(3. * i + 1.);
+  }
+
+  // Construction geometry and displaced geometry
+  const std::vector<vec> geometries{x_c, x_displaced};
+  for (std::size_t k{0}; k < geometries.size(); k++) {
+    CAPTURE(k);
+    const vec& x{geometries[k]};
+
+    const mat B{
+        wilson::wilson_matrix<vec3, vec, mat>(x,
+                                              irc.get_bonds(),
+                                              irc.get_angles(),
+                                              irc.get_dihedrals(),
+                                              irc.get_linear_angles(),
+                                              irc.get_out_of_plane_bends())};
+    const std::size_t n_irc{linalg::n_rows(B)};
+
+    // Gradient and Hessian in the range of B (i.e. of the projector)
+    vec y{linalg::zeros<vec>(n_c)};
+    mat M{linalg::zeros<mat>(n_c, n_c)};
+    for (std::size_t i{0}; i < n_c; i++) {
+      y(i) = std::sin(i + 1.);
+      for (std::size_t j{0}; j <= i; j++) {
+        M(i, j) = M(j, i) = std::cos(i + 2. * j);
+      }
+    }
+
+    const vec grad_irc{B * y};
+    const mat H_irc{B * M * linalg::transpose(B)};
+
+    const vec grad_c{linalg::transpose(B) * grad_irc};
+    const mat H_c{irc.hessian_irc_to_cartesian(H_irc, grad_irc, x)};
+
+    REQUIRE(linalg::n_rows(H_c) == n_c);
+    REQUIRE(linalg::n_cols(H_c) == n_c);
+    for (std::size_t i{0}; i < n_c; i++) {
+      for (std::size_t j{0}; j < n_c; j++) {
+        CHECK(H_c(i, j) == Approx(H_c(j, i)).margin(1e-10));
+      }
+    }
+
+    // The gradient term is the only difference with the Hessian of the
+    // quadratic model
+    const mat BHB{linalg::transpose(B) * H_irc * B};
+    double difference{0.};
+    for (std::size_t i{0}; i < n_c * n_c; i++) {
+      difference = std::max(difference, std::abs(H_c(i) - BHB(i)));
+    }
+    CHECK(difference > 1e-3);
+
+    // Back to internal coordinates
+    const mat H{irc.hessian_cartesian_to_projected_irc(H_c, grad_c, x)};
+
+    REQUIRE(linalg::n_rows(H) == n_irc);
+    REQUIRE(linalg::n_cols(H) == n_irc);
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK(H(i) == Approx(H_irc(i)).margin(1e-6));
+    }
+
+    CHECK_THROWS_AS(irc.hessian_cartesian_to_projected_irc(H_irc, grad_c, x),
+                    std::length_error);
+    CHECK_THROWS_AS(irc.hessian_irc_to_cartesian(H_irc, grad_c, x),
+                    std::length_error);
+  }
+}
+
+TEST_CASE("Topology cache") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace io;
+
+  TopologyCache<vec3> topologies;
+
+  for (const auto& filename : {"caffeine.xyz", "glycerol.xyz"}) {
+    CAPTURE(filename);
+
+    auto molecule = load_xyz<vec3>(config::molecules_dir + filename);
+
+    for (std::size_t n{0}; n < 3; n++) {
+      // Conformers with the same covalent bonds
+      for (std::size_t i{0}; i < molecule.size(); i++) {
+        molecule[i].position += vec3{0.01, -0.01 * (i % 2), 0.02 * (i % 3)};
+      }
+
+      const vec x_c{to_cartesian<vec3, vec>(molecule)};
+
+      IRC<vec3, vec, mat> irc(molecule, {{0, 1}});
+      IRC<vec3, vec, mat> cached(molecule, topologies, {{0, 1}});
+
+      CHECK(cached.get_bonds() == irc.get_bonds());
+      CHECK(cached.get_angles() == irc.get_angles());
+      CHECK(cached.get_dihedrals() == irc.get_dihedrals());
+      CHECK(cached.get_linear_angles() == irc.get_linear_angles());
+      CHECK(cached.get_out_of_plane_bends() == irc.get_out_of_plane_bends());
+
+      const vec q{irc.cartesian_to_irc(x_c)};
+      const vec q_cached{cached.cartesian_to_irc(x_c)};
+      REQUIRE(linalg::size(q_cached) == linalg::size(q));
+      for (std::size_t i{0}; i < linalg::size(q); i++) {
+        CHECK(q_cached(i) == Approx(q(i)));
+      }
+    }
+  }
+
+  // Connectivity perceived once per molecule
+  CHECK(topologies.size() == 2);
+  CHECK(topologies.n_misses() == 2);
+  CHECK(topologies.n_hits() == 4);
+}
+
+TEST_CASE("Save and load") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace io;
+
+  const std::string filename{"irc_test.bin"};
+
+  const auto molecule = load_xyz<vec3>(config::molecules_dir + "caffeine.xyz");
+  const vec x_c{to_cartesian<vec3, vec>(molecule)};
+
+  using IRC_t = IRC<vec3, vec, mat>;
+
+  IRC_t irc(molecule, {{0, 1, Constraint::constrained}});
+
+  const std::size_t n_irc{linalg::size(irc.cartesian_to_irc(x_c))};
+
+  const mat H0{irc.projected_initial_hessian()};
+
+  vec grad_c{linalg::zeros<vec>(linalg::size(x_c))};
+  for (std::size_t i{0}; i < linalg::size(x_c); i++) {
+    grad_c(i) = std::cos(i + 1.);
+  }
+  const vec g{irc.grad_cartesian_to_projected_irc(grad_c)};
+
+  auto check = [&](const IRC_t& loaded) {
+    CHECK(loaded.get_bonds() == irc.get_bonds());
+    CHECK(loaded.get_angles() == irc.get_angles());
+    CHECK(loaded.get_dihedrals() == irc.get_dihedrals());
+    CHECK(loaded.get_linear_angles() == irc.get_linear_angles());
+    CHECK(loaded.get_out_of_plane_bends() == irc.get_out_of_plane_bends());
+    CHECK(loaded.get_bonds()[0].constraint == Constraint::constrained);
+
+    const mat H0_loaded{loaded.projected_initial_hessian()};
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK(H0_loaded(i) == Approx(H0(i)).margin(1e-10));
+    }
+
+    const vec g_loaded{loaded.grad_cartesian_to_projected_irc(grad_c)};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      CHECK(g_loaded(i) == Approx(g(i)).margin(1e-10));
+    }
+  };
+
+  SECTION("With matrices and Hessian") {
+    irc.save(filename, H0);
+
+    boost::optional<mat> H;
+    check(IRC_t::load(filename, H));
+
+    REQUIRE(H.is_initialized());
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK((*H)(i) == H0(i));
+    }
+  }
+
+  SECTION("Without matrices") {
+    irc.save(filename, boost::none, false);
+
+    CHECK_THROWS_AS(IRC_t::load(filename), std::runtime_error);
+
+    boost::optional<mat> H;
+    check(IRC_t::load(filename, H, x_c));
+    CHECK(not H.is_initialized());
+  }
+
+  SECTION("Fragment blocks") {
+    irc.use_fragment_blocks();
+    irc.save(filename);
+
+    const auto loaded = IRC_t::load(filename);
+    CHECK(loaded.fragment_blocks());
+    check(loaded);
+  }
+
+  SECTION("Sparse Wilson B matrix") {
+    auto file_size = [&filename]() {
+      std::ifstream in(filename, std::ios::binary | std::ios::ate);
+      return static_cast<std::size_t>(in.tellg());
+    };
+
+    irc.save(filename);
+    const std::size_t dense_size{file_size()};
+
+    irc.use_sparse_wilson_matrix();
+    irc.save(filename);
+
+    // Fixed-width rows instead of n_irc x n_c elements
+    CHECK(file_size() < dense_size);
+
+    const auto loaded = IRC_t::load(filename);
+    CHECK(loaded.sparse_wilson_matrix());
+    check(loaded);
+
+    irc.save(filename, boost::none, false);
+
+    boost::optional<mat> H;
+    const auto loaded_x = IRC_t::load(filename, H, x_c);
+    CHECK(loaded_x.sparse_wilson_matrix());
+    check(loaded_x);
+  }
+
+  std::remove(filename.c_str());
+
+  CHECK_THROWS_AS(IRC_t::load(filename), std::runtime_error);
+}
+
+TEST_CASE("Merge of user-defined primitives") {
+  using namespace connectivity;
+
+  SECTION("Hash functions") {
+    // Equal primitives have equal hashes, regardless of the order of atoms
+    CHECK(std::hash<Bond>{}(Bond{0, 1}) == std::hash<Bond>{}(Bond{1, 0}));
+    CHECK(std::hash<Angle>{}(Angle{0, 1, 2}) ==
+          std::hash<Angle>{}(Angle{2, 1, 0, Constraint::constrained}));
+    CHECK(std::hash<Dihedral>{}(Dihedral{0, 1, 2, 3}) ==
+          std::hash<Dihedral>{}(Dihedral{3, 2, 1, 0}));
+    CHECK(std::hash<OutOfPlaneBend>{}(OutOfPlaneBend{0, 1, 2, 3}) ==
+          std::hash<OutOfPlaneBend>{}(OutOfPlaneBend{0, 3, 1, 2}));
+
+    using LA = LinearAngle<vec3>;
+    CHECK(std::hash<LA>{}(LA{0, 1, 2, {1, 0, 0}, LinearAngleTag::First}) ==
+          std::hash<LA>{}(LA{2, 1, 0, {0, 1, 0}, LinearAngleTag::First}));
+  }
+
+  SECTION("Add without duplicates") {
+    std::vector<Bond> bonds{{0, 1}, {1, 2}, {2, 3}};
+
+    const std::size_t n{add_without_duplicates(
+        bonds,
+        {{4, 3}, {2, 1, Constraint::constrained}, {3, 4}, {5, 0}})};
+
+    CHECK(n == 2);
+    REQUIRE(bonds.size() == 5);
+    CHECK(bonds[3] == Bond{3, 4});
+    CHECK(bonds[4] == Bond{0, 5});
+
+    // Constraint of existing primitives is overridden
+    CHECK(bonds[0].constraint == Constraint::unconstrained);
+    CHECK(bonds[1].constraint == Constraint::constrained);
+  }
+}
+
 TEST_CASE("Issues") {
   using namespace molecule;
   using namespace connectivity;
@@ -2,6 +2,9 @@
 
 #include "libirc/linalg.h"
 
+#include <algorithm>
+#include <cmath>
+
 #ifdef HAVE_ARMA
 #include <armadillo>
 using vec3 = arma::vec3;
@@ -270,3 +273,169 @@ TEST_CASE("Pseudo Inverse", "[pinv]") {
     CHECK(pinv(i) == Approx(p(i)));
   }
 }
+
+namespace {
+
+/// Matrix of size \param n_rows x \param n_cols with deterministic elements
+mat sample(std::size_t n_rows, std::size_t n_cols) {
+  mat m{linalg::zeros<mat>(n_rows, n_cols)};
+  for (std::size_t j{0}; j < n_cols; j++) {
+    for (std::size_t i{0}; i < n_rows; i++) {
+      m(i, j) = std::sin(1. + i + 3. * j) + (i == j ? 2. : 0.);
+    }
+  }
+
+  return m;
+}
+
+/// Matrix of size \param n_rows x 3 and of rank 2
+mat rank_deficient(std::size_t n_rows) {
+  mat m{sample(n_rows, 3)};
+  for (std::size_t i{0}; i < n_rows; i++) {
+    m(i, 2) = m(i, 0) - 2. * m(i, 1);
+  }
+
+  return m;
+}
+
+/// Check that the columns of \param U are orthonormal
+void check_orthonormal(const mat& U) {
+  const mat UtU{linalg::transpose(U) * U};
+  for (std::size_t j{0}; j < linalg::n_cols(U); j++) {
+    for (std::size_t i{0}; i < linalg::n_cols(U); i++) {
+      CHECK(UtU(i, j) == Approx(i == j ? 1. : 0.).margin(1e-12));
+    }
+  }
+}
+
+} // namespace
+
+TEST_CASE("Singular value decomposition", "[svd]") {
+  for (const mat& m : {sample(5, 3), sample(3, 5), rank_deficient(4)}) {
+    const std::size_t n_r{linalg::n_rows(m)};
+    const std::size_t n_c{linalg::n_cols(m)};
+    const std::size_t k{std::min(n_r, n_c)};
+
+    CAPTURE(n_r);
+    CAPTURE(n_c);
+
+    mat U, V;
+    vec s;
+    linalg::svd(m, U, s, V);
+
+    REQUIRE(linalg::n_rows(U) == n_r);
+    REQUIRE(linalg::n_cols(U) == n_r);
+    REQUIRE(linalg::size(s) == k);
+    REQUIRE(linalg::n_rows(V) == n_c);
+    REQUIRE(linalg::n_cols(V) == n_c);
+
+    check_orthonormal(U);
+    check_orthonormal(V);
+
+    for (std::size_t i{1}; i < k; i++) {
+      CHECK(s(i) <= s(i - 1));
+    }
+
+    // Reconstruction U S V^T
+    mat S{linalg::zeros<mat>(n_r, n_c)};
+    for (std::size_t i{0}; i < k; i++) {
+      S(i, i) = s(i);
+    }
+    const mat USVt{U * S * linalg::transpose(V)};
+    for (std::size_t i{0}; i < n_r * n_c; i++) {
+      CHECK(USVt(i) == Approx(m(i)).margin(1e-12));
+    }
+
+    // Thin decomposition
+    mat U_thin;
+    vec s_thin;
+    linalg::svd_thin(m, U_thin, s_thin);
+
+    REQUIRE(linalg::n_rows(U_thin) == n_r);
+    REQUIRE(linalg::n_cols(U_thin) == k);
+    REQUIRE(linalg::size(s_thin) == k);
+
+    check_orthonormal(U_thin);
+
+    for (std::size_t i{0}; i < k; i++) {
+      CHECK(s_thin(i) == Approx(s(i)).margin(1e-12));
+    }
+
+    // The left singular vectors span the range: U U^T m = m
+    const mat UUtm{U_thin * mat{linalg::transpose(U_thin) * m}};
+    for (std::size_t i{0}; i < n_r * n_c; i++) {
+      CHECK(UUtm(i) == Approx(m(i)).margin(1e-12));
+    }
+  }
+
+  SECTION("Rank-deficient matrix") {
+    mat U, V;
+    vec s;
+    linalg::svd(rank_deficient(4), U, s, V);
+
+    REQUIRE(linalg::size(s) == 3);
+    CHECK(s(1) > 1e-3);
+    CHECK(s(2) == Approx(0.).margin(1e-12));
+  }
+}
+
+TEST_CASE("Least squares", "[least_squares]") {
+  // Over-determined, under-determined and rank-deficient systems
+  for (const mat& m : {sample(5, 3), sample(2, 4), rank_deficient(4)}) {
+    const std::size_t n_r{linalg::n_rows(m)};
+    const std::size_t n_c{linalg::n_cols(m)};
+
+    CAPTURE(n_r);
+    CAPTURE(n_c);
+
+    vec b{linalg::zeros<vec>(n_r)};
+    for (std::size_t i{0}; i < n_r; i++) {
+      b(i) = std::cos(2. * i + 1.);
+    }
+
+    const auto result = linalg::least_squares(
+        b,
+        n_c,
+        [&m](const vec& v) { return vec{m * v}; },
+        [&m](const vec& v) { return vec{linalg::transpose(m) * v}; });
+
+    CHECK(result.converged);
+    CHECK(result.n_iterations <= 2 * n_c);
+
+    // Minimum-norm least-squares solution
+    const vec& x{result.x};
+    const vec x_ref{linalg::pseudo_inverse(m) * b};
+
+    REQUIRE(linalg::size(x) == n_c);
+    for (std::size_t i{0}; i < n_c; i++) {
+      CHECK(x(i) == Approx(x_ref(i)).margin(1e-8));
+    }
+  }
+
+  SECTION("Ill-conditioned system") {
+    // Hilbert matrix, with a condition number of about 1e10
+    const std::size_t n{8};
+    mat m{linalg::zeros<mat>(n, n)};
+    for (std::size_t i{0}; i < n; i++) {
+      for (std::size_t j{0}; j < n; j++) {
+        m(i, j) = 1. / (i + j + 1.);
+      }
+    }
+
+    vec b{linalg::zeros<vec>(n)};
+    for (std::size_t i{0}; i < n; i++) {
+      b(i) = std::cos(2. * i + 1.);
+    }
+
+    const auto result = linalg::least_squares(
+        b,
+        n,
+        [&m](const vec& v) { return vec{m * v}; },
+        [&m](const vec& v) { return vec{linalg::transpose(m) * v}; });
+
+    // The tolerance is not reached within the maximum number of iterations
+    CHECK(!result.converged);
+    CHECK(result.n_iterations == 2 * n);
+    REQUIRE(linalg::size(result.x) == n);
+  }
+}
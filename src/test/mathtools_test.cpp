@@ -102,4 +102,44 @@ TEST_CASE("collinear vectors") {
   CHECK(!collinear(v1, v4));
   CHECK(!collinear(v2, v4));
   CHECK(!collinear(v3, v4));
-}
\ No newline at end of file
+}
+TEST_CASE("Second derivatives") {
+  // Function of two variables using every operation
+  auto f = [](const auto& x, const auto& y) {
+    return atan2(y, x) * sqrt(x * y) + acos(x / (x + y)) -
+           asin(0.5 * y / (1. - x * y)) / x;
+  };
+
+  const double x0{0.7};
+  const double y0{0.4};
+
+  // Function with derivatives at (x0 + dx, y0 + dy)
+  auto jet = [&](double dx, double dy) {
+    return f(Jet<2>::variable(0, x0 + dx), Jet<2>::variable(1, y0 + dy));
+  };
+
+  const Jet<2> r{jet(0., 0.)};
+
+  CHECK(r.value ==
+        Approx(std::atan2(y0, x0) * std::sqrt(x0 * y0) +
+               std::acos(x0 / (x0 + y0)) -
+               std::asin(0.5 * y0 / (1. - x0 * y0)) / x0));
+
+  // Central finite differences of the value and of the gradient
+  const double d{1e-5};
+  for (std::size_t i{0}; i < 2; i++) {
+    const double dx{i == 0 ? d : 0.};
+    const double dy{i == 1 ? d : 0.};
+
+    const Jet<2> p{jet(dx, dy)};
+    const Jet<2> m{jet(-dx, -dy)};
+
+    CHECK(r.gradient[i] == Approx((p.value - m.value) / (2. * d)));
+    for (std::size_t j{0}; j < 2; j++) {
+      CHECK(r.hessian[2 * i + j] ==
+            Approx((p.gradient[j] - m.gradient[j]) / (2. * d)));
+    }
+  }
+
+  CHECK(r.hessian[1] == Approx(r.hessian[2]));
+}
@@ -0,0 +1,210 @@
+#include "catch.hpp"
+
+#include "libirc/neighbors.h"
+
+#include "config.h"
+#include "libirc/connectivity.h"
+#include "libirc/io.h"
+#include "libirc/molecule.h"
+
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+#ifdef HAVE_ARMA
+#include <armadillo>
+using vec3 = arma::vec3;
+#elif HAVE_EIGEN3
+#include <eigen3/Eigen/Dense>
+using vec3 = Eigen::Vector3d;
+#else
+#error
+#endif
+
+using namespace irc;
+
+TEST_CASE("Cell list") {
+  using namespace molecule;
+  using namespace neighbors;
+
+  const std::vector<std::string> filenames{
+      "caffeine.xyz", "benzene_dimer.xyz", "octane.xyz", "water_dimer_1.xyz"};
+
+  for (const auto& filename : filenames) {
+    CAPTURE(filename);
+
+    const auto mol = io::load_xyz<vec3>(config::molecules_dir + filename);
+
+    for (const double cutoff : {1.0, 2.5, 4.0, 10.0}) {
+      CAPTURE(cutoff);
+
+      const CellList<vec3> cells(mol, cutoff);
+
+      CHECK(cells.cell_length() >= cutoff);
+      CHECK(cells.n_cells() <= 8 * mol.size());
+
+      // Candidate pairs
+      std::set<std::pair<std::size_t, std::size_t>> candidates;
+      std::size_t n_candidates{0};
+      cells.for_each_pair([&](std::size_t i, std::size_t j) {
+        CHECK(i < j);
+        candidates.insert({i, j});
+        n_candidates++;
+      });
+
+      // Every pair is visited only once
+      CHECK(candidates.size() == n_candidates);
+
+      // Every pair within the cutoff is a candidate
+      for (std::size_t j{0}; j < mol.size(); j++) {
+        for (std::size_t i{0}; i < j; i++) {
+          if (connectivity::distance(mol[i].position, mol[j].position) <
+              cutoff) {
+            CHECK(candidates.count({i, j}) == 1);
+          }
+        }
+      }
+    }
+  }
+
+  SECTION("Atoms near a position") {
+    const auto mol = io::load_xyz<vec3>(config::molecules_dir + "caffeine.xyz");
+
+    const double cutoff{3.0};
+    const CellList<vec3> cells(mol, cutoff);
+
+    // Positions inside and outside the bounding box
+    for (const vec3& position : {vec3{0.0, 0.0, 0.0},
+                                 vec3{mol[3].position},
+                                 vec3{mol[0].position + vec3{4.0, 0.0, 1.0}},
+                                 vec3{50.0, -50.0, 50.0}}) {
+      std::set<std::size_t> candidates;
+      cells.for_each_near(position,
+                          [&](std::size_t i) { candidates.insert(i); });
+
+      // Every atom within the cutoff is a candidate
+      for (std::size_t i{0}; i < mol.size(); i++) {
+        if (connectivity::distance(mol[i].position, position) < cutoff) {
+          CHECK(candidates.count(i) == 1);
+        }
+      }
+    }
+  }
+
+  SECTION("Empty molecule") {
+    const CellList<vec3> cells(Molecule<vec3>{}, 1.0);
+
+    std::size_t n_candidates{0};
+    cells.for_each_pair([&](std::size_t, std::size_t) { n_candidates++; });
+
+    CHECK(n_candidates == 0);
+
+    cells.for_each_near(vec3{0.0, 0.0, 0.0},
+                        [&](std::size_t) { n_candidates++; });
+
+    CHECK(n_candidates == 0);
+  }
+
+  SECTION("Sparse atoms") {
+    // Atoms far apart must not result in a large number of cells
+    const Molecule<vec3> mol{{"H", {0.0, 0.0, 0.0}},
+                             {"H", {1.0e4, 0.0, 0.0}},
+                             {"H", {0.0, 1.0e4, 0.0}},
+                             {"H", {0.0, 0.0, 1.0e4}}};
+
+    const CellList<vec3> cells(mol, 1.0);
+
+    CHECK(cells.n_cells() <= 8 * mol.size());
+  }
+}
+
+TEST_CASE("Neighbor list") {
+  using namespace molecule;
+  using namespace neighbors;
+
+  const std::vector<std::string> filenames{
+      "caffeine.xyz", "benzene_dimer.xyz", "glycerol.xyz", "water_dimer_2.xyz"};
+
+  for (const auto& filename : filenames) {
+    CAPTURE(filename);
+
+    const auto mol = io::load_xyz<vec3>(config::molecules_dir + filename);
+
+    const double cutoff{5.0};
+    const NeighborList nl(mol, cutoff);
+
+    REQUIRE(nl.size() == mol.size());
+    CHECK(nl.cutoff() == Approx(cutoff));
+
+    std::size_t n_pairs{0};
+    for (std::size_t i{0}; i < mol.size(); i++) {
+      // Neighbours are sorted by index
+      const auto range = nl.neighbors(i);
+      for (auto n = range.begin(); n != range.end(); n++) {
+        if (n != range.begin()) {
+          CHECK((n - 1)->index < n->index);
+        }
+      }
+
+      for (std::size_t j{0}; j < mol.size(); j++) {
+        const double d{
+            connectivity::distance(mol[i].position, mol[j].position)};
+
+        if (i != j and d < cutoff) {
+          CHECK(nl(i, j) == Approx(d));
+          CHECK(nl(j, i) == Approx(d));
+          n_pairs++;
+        } else {
+          CHECK(nl(i, j) == std::numeric_limits<double>::infinity());
+        }
+      }
+    }
+
+    CHECK(nl.n_pairs() == n_pairs / 2);
+  }
+
+  SECTION("Update distances") {
+    auto mol = io::load_xyz<vec3>(config::molecules_dir + "caffeine.xyz");
+
+    NeighborList nl(mol, 4.0);
+    const std::size_t n_pairs{nl.n_pairs()};
+
+    for (std::size_t i{0}; i < mol.size(); i++) {
+      mol[i].position = mol[i].position * 1.05;
+    }
+    nl.update(mol);
+
+    // Same pairs, with updated distances
+    CHECK(nl.n_pairs() == n_pairs);
+    for (std::size_t i{0}; i < mol.size(); i++) {
+      for (const auto& n : nl.neighbors(i)) {
+        CHECK(n.distance == Approx(connectivity::distance(
+                                mol[i].position, mol[n.index].position)));
+      }
+    }
+  }
+
+  SECTION("Cutoff longer than half the unit cell") {
+    Molecule<vec3> mol{{"O", {0., 0., 0.}}, {"O", {2., 0., 0.}}};
+
+    // Periodic only along the first lattice vector
+    mol.lattice = periodic::Lattice<vec3>{
+        {6., 0., 0.}, {0., 20., 0.}, {0., 0., 20.}, {{true, false, false}}};
+
+    CHECK_NOTHROW(NeighborList(mol, 2.9));
+    CHECK_THROWS_AS(NeighborList(mol, 3.1), std::invalid_argument);
+
+    // The width along non-periodic directions is irrelevant
+    mol.lattice = periodic::Lattice<vec3>{
+        {20., 0., 0.}, {0., 6., 0.}, {0., 0., 20.}, {{true, false, false}}};
+
+    CHECK_NOTHROW(NeighborList(mol, 5.0));
+  }
+
+  SECTION("Empty neighbor list") {
+    const NeighborList nl;
+
+    CHECK(nl.size() == 0);
+    CHECK(nl.n_pairs() == 0);
+  }
+}
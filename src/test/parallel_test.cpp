@@ -0,0 +1,183 @@
+#include "catch.hpp"
+
+#include "libirc/parallel.h"
+
+#include "libirc/connectivity.h"
+#include "libirc/conversion.h"
+#include "libirc/io.h"
+#include "libirc/molecule.h"
+#include "libirc/wilson.h"
+
+#include "config.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#ifdef HAVE_ARMA
+#include <armadillo>
+using vec3 = arma::vec3;
+using vec = arma::vec;
+using mat = arma::mat;
+#elif HAVE_EIGEN3
+#include <eigen3/Eigen/Dense>
+using vec3 = Eigen::Vector3d;
+using vec = Eigen::VectorXd;
+using mat = Eigen::MatrixXd;
+#else
+#error
+#endif
+
+using namespace irc;
+
+TEST_CASE("Thread pool") {
+  using namespace parallel;
+
+  ThreadPool pool(4);
+  REQUIRE(pool.size() == 4);
+
+  SECTION("Every task runs once") {
+    std::vector<std::atomic<int>> count(1000);
+    for (auto& c : count) {
+      c = 0;
+    }
+
+    pool.run(count.size(), [&count](std::size_t t) { count[t]++; });
+
+    for (const auto& c : count) {
+      CHECK(c == 1);
+    }
+  }
+
+  SECTION("Nested calls") {
+    std::atomic<int> count{0};
+
+    pool.run(8, [&](std::size_t) {
+      pool.run(8, [&](std::size_t) { count++; });
+    });
+
+    CHECK(count == 64);
+  }
+
+  SECTION("Exceptions") {
+    CHECK_THROWS_AS(pool.run(100,
+                             [](std::size_t t) {
+                               if (t == 42) {
+                                 throw std::runtime_error("Task failed.");
+                               }
+                             }),
+                    std::runtime_error);
+
+    // The pool is still usable
+    std::atomic<int> count{0};
+    pool.run(10, [&count](std::size_t) { count++; });
+    CHECK(count == 10);
+  }
+}
+
+TEST_CASE("Parallel ranges") {
+  using namespace parallel;
+
+  set_n_threads(4);
+  set_grain_size(10);
+
+  std::vector<int> count(1003, 0);
+  for_each_range(
+      count.size(),
+      [&count](std::size_t begin, std::size_t end) {
+        CHECK(begin % 4 == 0);
+        for (std::size_t i{begin}; i < end; i++) {
+          count[i]++;
+        }
+      },
+      4);
+
+  for (const auto& c : count) {
+    CHECK(c == 1);
+  }
+
+  // Small problems run serially, in a single range
+  std::size_t n_ranges{0};
+  for_each_range(15, [&n_ranges](std::size_t begin, std::size_t end) {
+    CHECK(begin == 0);
+    CHECK(end == 15);
+    n_ranges++;
+  });
+  CHECK(n_ranges == 1);
+
+  set_n_threads(1);
+  set_grain_size(512);
+}
+
+TEST_CASE("Parallel internal coordinates") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace io;
+
+  const auto mol = load_xyz<vec3>(config::molecules_dir + "caffeine.xyz");
+  const vec x_c{to_cartesian<vec3, vec>(mol)};
+
+  const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+  const Primitives<vec3> p{primitives(bounded_distance_matrix(adj), mol)};
+
+  const vec q{cartesian_to_irc<vec3, vec>(x_c,
+                                          p.bonds,
+                                          p.angles,
+                                          p.dihedrals,
+                                          p.linear_angles,
+                                          p.out_of_plane_bends)};
+  const mat B{wilson::wilson_matrix<vec3, vec, mat>(x_c,
+                                                    p.bonds,
+                                                    p.angles,
+                                                    p.dihedrals,
+                                                    p.linear_angles,
+                                                    p.out_of_plane_bends)};
+  const mat B_numerical{
+      wilson::wilson_matrix_numerical<vec3, vec, mat>(x_c,
+                                                      p.bonds,
+                                                      p.angles,
+                                                      p.dihedrals,
+                                                      p.linear_angles,
+                                                      p.out_of_plane_bends)};
+
+  // Split every type of primitive in several ranges
+  parallel::set_n_threads(4);
+  parallel::set_grain_size(1);
+
+  const vec q_parallel{cartesian_to_irc<vec3, vec>(x_c,
+                                                   p.bonds,
+                                                   p.angles,
+                                                   p.dihedrals,
+                                                   p.linear_angles,
+                                                   p.out_of_plane_bends)};
+  const mat B_parallel{
+      wilson::wilson_matrix<vec3, vec, mat>(x_c,
+                                            p.bonds,
+                                            p.angles,
+                                            p.dihedrals,
+                                            p.linear_angles,
+                                            p.out_of_plane_bends)};
+  const mat B_numerical_parallel{
+      wilson::wilson_matrix_numerical<vec3, vec, mat>(x_c,
+                                                      p.bonds,
+                                                      p.angles,
+                                                      p.dihedrals,
+                                                      p.linear_angles,
+                                                      p.out_of_plane_bends)};
+
+  parallel::set_n_threads(1);
+  parallel::set_grain_size(512);
+
+  // Identical results
+  REQUIRE(linalg::size(q_parallel) == linalg::size(q));
+  for (std::size_t i{0}; i < linalg::size(q); i++) {
+    CHECK(q_parallel(i) == q(i));
+  }
+
+  REQUIRE(linalg::n_rows(B_parallel) == linalg::n_rows(B));
+  REQUIRE(linalg::n_cols(B_parallel) == linalg::n_cols(B));
+  for (std::size_t i{0}; i < linalg::size(B); i++) {
+    CHECK(B_parallel(i) == B(i));
+    CHECK(B_numerical_parallel(i) == B_numerical(i));
+  }
+}
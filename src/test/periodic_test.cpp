@@ -0,0 +1,323 @@
+#include "catch.hpp"
+
+#include "libirc/periodic.h"
+
+#include "config.h"
+#include "libirc/connectivity.h"
+#include "libirc/conversion.h"
+#include "libirc/io.h"
+#include "libirc/irc.h"
+#include "libirc/molecule.h"
+#include "libirc/neighbors.h"
+#include "libirc/wilson.h"
+
+#include <cmath>
+#include <random>
+#include <set>
+#include <sstream>
+#include <utility>
+
+#ifdef HAVE_ARMA
+#include <armadillo>
+using vec3 = arma::vec3;
+using vec = arma::vec;
+using mat = arma::mat;
+#elif HAVE_EIGEN3
+#include <eigen3/Eigen/Dense>
+using vec3 = Eigen::Vector3d;
+using vec = Eigen::VectorXd;
+using mat = Eigen::MatrixXd;
+#else
+#error
+#endif
+
+using namespace irc;
+
+namespace {
+
+/// Shortest image of \p d, by brute force over neighbouring cells
+vec3 brute_force_image(const periodic::Lattice<vec3>& lattice, const vec3& d) {
+  vec3 d_min{d};
+  for (int i{-6}; i <= 6; i++) {
+    for (int j{-6}; j <= 6; j++) {
+      for (int k{-6}; k <= 6; k++) {
+        if ((i != 0 and not lattice.periodic(0)) or
+            (j != 0 and not lattice.periodic(1)) or
+            (k != 0 and not lattice.periodic(2))) {
+          continue;
+        }
+
+        const vec3 di{
+            d + lattice.to_cartesian({double(i), double(j), double(k)})};
+        if (linalg::norm(di) < linalg::norm(d_min)) {
+          d_min = di;
+        }
+      }
+    }
+  }
+
+  return d_min;
+}
+
+/// Molecule translated by \p shift and wrapped into the unit cell
+molecule::Molecule<vec3> wrap(molecule::Molecule<vec3> molecule,
+                              const periodic::Lattice<vec3>& lattice,
+                              const vec3& shift) {
+  for (auto& atom : molecule) {
+    vec3 s{lattice.to_fractional(vec3(atom.position + shift))};
+    for (std::size_t m{0}; m < 3; m++) {
+      s(m) -= std::floor(s(m));
+    }
+    atom.position = lattice.to_cartesian(s);
+  }
+
+  molecule.lattice = lattice;
+
+  return molecule;
+}
+
+} // namespace
+
+TEST_CASE("Lattice") {
+  using namespace periodic;
+
+  const Lattice<vec3> cubic{{10., 0., 0.}, {0., 10., 0.}, {0., 0., 10.}};
+
+  CHECK(cubic.volume() == Approx(1000.));
+  for (std::size_t m{0}; m < 3; m++) {
+    CHECK(cubic.width(m) == Approx(10.));
+    CHECK(cubic.periodic(m));
+  }
+
+  const Lattice<vec3> skewed{{10., 0., 0.}, {5., 8., 0.}, {2., 3., 9.}};
+
+  SECTION("Fractional coordinates") {
+    const vec3 r{1.5, -2.5, 7.25};
+    const vec3 s{skewed.to_fractional(r)};
+    const vec3 rr{skewed.to_cartesian(s)};
+
+    for (std::size_t m{0}; m < 3; m++) {
+      CHECK(rr(m) == Approx(r(m)));
+    }
+
+    CHECK(skewed.to_fractional(skewed.vector(1))(1) == Approx(1.));
+    CHECK(skewed.width(2) == Approx(9.));
+  }
+
+  SECTION("Minimum image") {
+    const vec3 d{cubic.minimum_image({9., -6., 4.})};
+    CHECK(d(0) == Approx(-1.));
+    CHECK(d(1) == Approx(4.));
+    CHECK(d(2) == Approx(4.));
+
+    std::mt19937 gen{42};
+    std::uniform_real_distribution<double> uniform{-25., 25.};
+
+    const Lattice<vec3> slab{
+        {10., 0., 0.}, {5., 8., 0.}, {2., 3., 9.}, {{true, true, false}}};
+
+    for (const Lattice<vec3>& lattice : {skewed, slab}) {
+      for (std::size_t n{0}; n < 100; n++) {
+        const vec3 r{uniform(gen), uniform(gen), uniform(gen)};
+
+        const vec3 mi{lattice.minimum_image(r)};
+        CHECK(linalg::norm(mi) ==
+              Approx(linalg::norm(brute_force_image(lattice, r))));
+      }
+    }
+
+    // No periodicity along the third lattice vector
+    CHECK(slab.minimum_image({0., 0., 20.})(2) == Approx(20.));
+  }
+
+  SECTION("Closest image") {
+    const vec3 r{1., 1., 1.};
+
+    const vec3 p{periodic::closest_image<vec3>(r, {9., 1., 1.}, cubic)};
+    CHECK(p(0) == Approx(-1.));
+
+    const vec3 q{periodic::closest_image<vec3>(r, {9., 1., 1.}, {})};
+    CHECK(q(0) == Approx(9.));
+  }
+
+  SECTION("Degenerate lattice") {
+    CHECK_THROWS_AS(Lattice<vec3>({1., 0., 0.}, {2., 0., 0.}, {0., 0., 1.}),
+                    std::invalid_argument);
+  }
+}
+
+TEST_CASE("Periodic cell list and neighbor list") {
+  using namespace molecule;
+  using namespace neighbors;
+
+  std::mt19937 gen{1};
+  std::uniform_real_distribution<double> uniform{0., 1.};
+
+  const periodic::Lattice<vec3> lattice{
+      {12., 0., 0.}, {4., 11., 0.}, {-2., 3., 13.}, {{true, true, false}}};
+
+  Molecule<vec3> mol;
+  for (std::size_t i{0}; i < 200; i++) {
+    const vec3 s{uniform(gen), uniform(gen), uniform(gen)};
+    mol.push_back({"O", lattice.to_cartesian(s)});
+  }
+  mol.lattice = lattice;
+
+  for (const double cutoff : {1.5, 3.0, 5.0}) {
+    CAPTURE(cutoff);
+
+    const CellList<vec3> cells(mol, cutoff);
+
+    std::set<std::pair<std::size_t, std::size_t>> candidates;
+    std::size_t n_candidates{0};
+    cells.for_each_pair([&](std::size_t i, std::size_t j) {
+      CHECK(i < j);
+      candidates.insert({i, j});
+      n_candidates++;
+    });
+
+    // Every pair is visited only once
+    CHECK(candidates.size() == n_candidates);
+
+    const NeighborList nl(mol, cutoff);
+
+    // Every pair within the cutoff (minimum image) is a candidate
+    std::size_t n_pairs{0};
+    for (std::size_t j{0}; j < mol.size(); j++) {
+      for (std::size_t i{0}; i < j; i++) {
+        const double d{connectivity::distance(mol, i, j)};
+
+        if (d < cutoff) {
+          CHECK(candidates.count({i, j}) == 1);
+          CHECK(nl(i, j) == Approx(d));
+          n_pairs++;
+        }
+      }
+    }
+
+    CHECK(nl.n_pairs() == n_pairs);
+  }
+}
+
+TEST_CASE("Extended XYZ") {
+  using namespace io;
+
+  std::istringstream in{
+      "3\n"
+      "Lattice=\"10.0 0.0 0.0 0.0 11.0 0.0 0.0 0.0 12.0\" pbc=\"T T F\"\n"
+      "O 0.000 0.000 0.000\n"
+      "H 0.757 0.586 0.000\n"
+      "H -0.757 0.586 0.000\n"};
+
+  const auto mol = load_xyz<vec3>(in);
+
+  REQUIRE(mol.size() == 3);
+  REQUIRE(static_cast<bool>(mol.lattice));
+
+  const double a2b{tools::conversion::angstrom_to_bohr};
+  CHECK(mol.lattice->vector(1)(1) == Approx(11. * a2b));
+  CHECK(mol.lattice->width(2) == Approx(12. * a2b));
+  CHECK(mol.lattice->periodic(0));
+  CHECK(mol.lattice->periodic(1));
+  CHECK(not mol.lattice->periodic(2));
+
+  SECTION("Non-periodic molecule") {
+    std::istringstream in_mol{"1\nComment\nH 0.0 0.0 0.0\n"};
+
+    const auto h = load_xyz<vec3>(in_mol);
+
+    CHECK(h.size() == 1);
+    CHECK(not h.lattice);
+  }
+
+  SECTION("Invalid lattice") {
+    std::istringstream in_invalid{"1\nLattice=\"1.0 0.0\"\nH 0.0 0.0 0.0\n"};
+
+    CHECK_THROWS_AS(load_xyz<vec3>(in_invalid), std::runtime_error);
+  }
+}
+
+TEST_CASE("Internal coordinates across periodic boundaries") {
+  using namespace connectivity;
+  using namespace molecule;
+
+  const double a2b{tools::conversion::angstrom_to_bohr};
+
+  const periodic::Lattice<vec3> lattice{
+      periodic::Lattice<vec3>{{15., 0., 0.}, {4., 14., 0.}, {2., -3., 16.}} *
+      a2b};
+
+  for (const auto& filename :
+       {"ethanol.xyz", "glycerol.xyz", "water_dimer_2.xyz"}) {
+    CAPTURE(filename);
+
+    const auto reference = io::load_xyz<vec3>(config::molecules_dir + filename);
+
+    // Straddle the corner of the unit cell
+    const auto mol = wrap(reference, lattice, {-0.3, -0.2, -0.4});
+
+    const IRC<vec3, vec, mat> irc_reference(reference);
+    const IRC<vec3, vec, mat> irc_periodic(mol);
+
+    // Same primitives
+    CHECK(irc_periodic.get_bonds() == irc_reference.get_bonds());
+    CHECK(irc_periodic.get_angles() == irc_reference.get_angles());
+    CHECK(irc_periodic.get_dihedrals() == irc_reference.get_dihedrals());
+    CHECK(irc_periodic.get_linear_angles().size() ==
+          irc_reference.get_linear_angles().size());
+    CHECK(irc_periodic.get_out_of_plane_bends() ==
+          irc_reference.get_out_of_plane_bends());
+
+    // Same values of the internal coordinates
+    const vec x_reference{to_cartesian<vec3, vec>(reference)};
+    const vec x_periodic{to_cartesian<vec3, vec>(mol)};
+
+    const vec q_reference{irc_reference.cartesian_to_irc(x_reference)};
+    const vec q_periodic{irc_periodic.cartesian_to_irc(x_periodic)};
+
+    REQUIRE(linalg::size(q_periodic) == linalg::size(q_reference));
+    for (std::size_t i{0}; i < linalg::size(q_reference); i++) {
+      CHECK(q_periodic(i) == Approx(q_reference(i)).margin(1e-10));
+    }
+
+    // Same Wilson B matrix (analytical and numerical)
+    const auto B_reference = wilson::wilson_matrix<vec3, vec, mat>(
+        x_reference,
+        irc_reference.get_bonds(),
+        irc_reference.get_angles(),
+        irc_reference.get_dihedrals());
+
+    const auto B_periodic =
+        wilson::wilson_matrix<vec3, vec, mat>(x_periodic,
+                                              irc_periodic.get_bonds(),
+                                              irc_periodic.get_angles(),
+                                              irc_periodic.get_dihedrals(),
+                                              {},
+                                              {},
+                                              mol.lattice);
+
+    REQUIRE(linalg::size(B_periodic) == linalg::size(B_reference));
+    for (std::size_t i{0}; i < linalg::size(B_reference); i++) {
+      CHECK(B_periodic(i) == Approx(B_reference(i)).margin(1e-10));
+    }
+
+    // Dihedral angles are discontinuous at pi: compare bonds and angles only
+    const auto B_numerical = wilson::wilson_matrix_numerical<vec3, vec, mat>(
+        x_periodic,
+        irc_periodic.get_bonds(),
+        irc_periodic.get_angles(),
+        {},
+        {},
+        {},
+        1e-6,
+        mol.lattice);
+
+    const std::size_t n_rows{irc_periodic.get_bonds().size() +
+                             irc_periodic.get_angles().size()};
+    for (std::size_t i{0}; i < n_rows; i++) {
+      for (std::size_t j{0}; j < linalg::size(x_periodic); j++) {
+        CHECK(B_numerical(i, j) == Approx(B_periodic(i, j)).margin(1e-6));
+      }
+    }
+  }
+}
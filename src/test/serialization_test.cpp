@@ -0,0 +1,254 @@
+#include "catch.hpp"
+
+#include "libirc/serialization.h"
+
+#include "libirc/io.h"
+#include "libirc/irc.h"
+
+#include "config.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_ARMA
+#include <armadillo>
+using arma::mat;
+using arma::vec;
+using arma::vec3;
+#elif HAVE_EIGEN3
+#include <eigen3/Eigen/Dense>
+using vec3 = Eigen::Vector3d;
+using vec = Eigen::VectorXd;
+using mat = Eigen::MatrixXd;
+
+#else
+#error
+#endif
+
+using namespace irc;
+
+TEST_CASE("Binary serialization") {
+  using namespace connectivity;
+  using namespace serialization;
+
+  std::ostringstream out(std::ios::binary);
+  Writer w(out);
+
+  write_header(w);
+
+  const std::vector<Bond> bonds{{0, 1}, {3, 2, Constraint::constrained}};
+  const std::vector<Angle> angles{{0, 1, 2, Constraint::constrained}};
+  const std::vector<Dihedral> dihedrals{{0, 1, 2, 3}};
+  const std::vector<LinearAngle<vec3>> linear_angles{
+      {0, 1, 2, {0.5, -1., 0.25}, LinearAngleTag::First},
+      {0,
+       1,
+       2,
+       {1., 0.5, 0.},
+       LinearAngleTag::Second,
+       Constraint::constrained}};
+  const std::vector<OutOfPlaneBend> bends{{1, 0, 2, 3}};
+
+  const periodic::Lattice<vec3> lattice{
+      {10., 0., 0.}, {1., 12., 0.}, {0., 0., 14.}, {{true, true, false}}};
+
+  mat m{linalg::zeros<mat>(2, 3)};
+  for (std::size_t i{0}; i < 6; i++) {
+    m(i % 2, i / 2) = 0.5 * i - 1.;
+  }
+
+  write(w, bonds);
+  write(w, angles);
+  write(w, dihedrals);
+  write(w, linear_angles);
+  write(w, bends);
+  write(w, lattice);
+  write_matrix(w, m);
+
+  const std::string data{out.str()};
+
+  SECTION("Round trip") {
+    Reader r(data.data(), data.size());
+
+    REQUIRE_NOTHROW(read_header(r));
+
+    const auto b = read_vector(r, read_bond);
+    REQUIRE(b == bonds);
+    CHECK(b[1].constraint == Constraint::constrained);
+
+    const auto a = read_vector(r, read_angle);
+    REQUIRE(a == angles);
+    CHECK(a[0].constraint == Constraint::constrained);
+
+    CHECK(read_vector(r, read_dihedral) == dihedrals);
+
+    const auto la = read_vector(r, read_linear_angle<vec3>);
+    REQUIRE(la == linear_angles);
+    for (std::size_t i{0}; i < la.size(); i++) {
+      CHECK(la[i].tag == linear_angles[i].tag);
+      CHECK(la[i].constraint == linear_angles[i].constraint);
+      CHECK(linalg::norm(la[i].orthogonal_direction -
+                         linear_angles[i].orthogonal_direction) == Approx(0));
+    }
+
+    CHECK(read_vector(r, read_out_of_plane_bend) == bends);
+
+    const auto l = read_lattice<vec3>(r);
+    for (std::size_t i{0}; i < 3; i++) {
+      CHECK(linalg::norm(l.vector(i) - lattice.vector(i)) == Approx(0));
+      CHECK(l.periodic(i) == lattice.periodic(i));
+    }
+
+    const mat mm{read_matrix<mat>(r)};
+    REQUIRE(linalg::n_rows(mm) == 2);
+    REQUIRE(linalg::n_cols(mm) == 3);
+    for (std::size_t i{0}; i < 6; i++) {
+      CHECK(mm(i) == m(i));
+    }
+
+    CHECK(r.remaining() == 0);
+  }
+
+  SECTION("Truncated data") {
+    Reader r(data.data(), data.size() - 1);
+
+    read_header(r);
+    read_vector(r, read_bond);
+    read_vector(r, read_angle);
+    read_vector(r, read_dihedral);
+    read_vector(r, read_linear_angle<vec3>);
+    read_vector(r, read_out_of_plane_bend);
+    read_lattice<vec3>(r);
+
+    CHECK_THROWS_AS(read_matrix<mat>(r), std::runtime_error);
+  }
+
+  SECTION("Invalid header") {
+    std::string invalid{data};
+    invalid[0] = 'X';
+
+    Reader r(invalid.data(), invalid.size());
+    CHECK_THROWS_AS(read_header(r), std::runtime_error);
+  }
+
+  SECTION("Invalid size") {
+    std::ostringstream o(std::ios::binary);
+    Writer wo(o);
+    wo.write_size(1000);
+    wo.write_index(0);
+
+    const std::string d{o.str()};
+    Reader r(d.data(), d.size());
+    CHECK_THROWS_AS(read_vector(r, read_bond), std::runtime_error);
+  }
+}
+
+TEST_CASE("Corrupt binary IRC files") {
+  using IRC_t = IRC<vec3, vec, mat>;
+
+  const std::string filename{"serialization_test.bin"};
+  const std::string corrupt{"serialization_test_corrupt.bin"};
+
+  // Atoms H (0), O (1) and H (2), with bonds (0, 1) and (1, 2)
+  const auto molecule =
+      io::load_xyz<vec3>(config::molecules_dir + "water.xyz");
+
+  IRC_t irc(molecule);
+  irc.save(filename);
+
+  std::string data;
+  {
+    std::ifstream in(filename, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+  }
+
+  REQUIRE_NOTHROW(IRC_t::load(filename));
+
+  // Header: magic number, version and six flags
+  const std::size_t n_c_offset{2 * sizeof(std::uint32_t) + 6};
+
+  // Number of bonds, then the first atom of the first bond
+  const std::size_t atom_offset{n_c_offset + 2 * sizeof(std::uint64_t)};
+
+  // Save a copy of the file with \param value at \param offset
+  auto save_corrupt = [&](std::size_t offset, auto value) {
+    std::string d{data};
+    std::memcpy(&d[offset], &value, sizeof(value));
+
+    std::ofstream out(corrupt, std::ios::binary);
+    out.write(d.data(), d.size());
+  };
+
+  SECTION("Number of Cartesian coordinates") {
+    save_corrupt(n_c_offset, std::uint64_t{7});
+    CHECK_THROWS_AS(IRC_t::load(corrupt), std::runtime_error);
+  }
+
+  SECTION("Atom index of a bond") {
+    save_corrupt(atom_offset, std::uint32_t{1000});
+    CHECK_THROWS_AS(IRC_t::load(corrupt), std::runtime_error);
+  }
+
+  SECTION("Repeated atom index of a bond") {
+    // Bond (1, 1) instead of (0, 1)
+    save_corrupt(atom_offset, std::uint32_t{1});
+    CHECK_THROWS_AS(IRC_t::load(corrupt), std::runtime_error);
+  }
+
+  SECTION("Atom index beyond the number of atoms") {
+    // Two atoms only, while the second bond involves atom 2
+    save_corrupt(n_c_offset, std::uint64_t{6});
+    CHECK_THROWS_AS(IRC_t::load(corrupt), std::runtime_error);
+  }
+
+  SECTION("Number of fragment labels") {
+    // Four atoms, while three fragment labels are saved
+    save_corrupt(n_c_offset, std::uint64_t{12});
+    CHECK_THROWS_AS(IRC_t::load(corrupt), std::runtime_error);
+  }
+
+  SECTION("Number of atoms in a row of sparse Wilson B matrix") {
+    // Without the basis of the projector, the rows end the file
+    IRC_t sparse(molecule);
+    sparse.use_sparse_wilson_matrix();
+    sparse.use_fragment_blocks();
+    sparse.save(corrupt);
+
+    std::string d;
+    {
+      std::ifstream in(corrupt, std::ios::binary);
+      d.assign(std::istreambuf_iterator<char>(in),
+               std::istreambuf_iterator<char>());
+    }
+    REQUIRE_NOTHROW(IRC_t::load(corrupt));
+
+    // Three rows (two bonds and one angle), the first one with five atoms
+    d[d.size() - 3 * serialization::sparse_row_size] = 5;
+    {
+      std::ofstream out(corrupt, std::ios::binary);
+      out.write(d.data(), d.size());
+    }
+    CHECK_THROWS_AS(IRC_t::load(corrupt), std::runtime_error);
+  }
+
+  SECTION("Size of the Hessian") {
+    irc.save(corrupt, linalg::zeros<mat>(2, 2));
+    CHECK_THROWS_AS(IRC_t::load(corrupt), std::runtime_error);
+  }
+
+  SECTION("Size of the Cartesian coordinates") {
+    irc.save(corrupt, boost::none, false);
+    CHECK_THROWS_AS(IRC_t::load(corrupt, linalg::zeros<vec>(6)),
+                    std::length_error);
+  }
+
+  std::remove(filename.c_str());
+  std::remove(corrupt.c_str());
+}
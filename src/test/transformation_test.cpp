@@ -646,4 +646,169 @@ TEST_CASE("Transformation") {
       REQUIRE(angle(p2, p1, p3) == target);
     }
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Transformation with sparse Wilson B matrix") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace transformation;
+  using namespace io;
+
+  using sparse = wilson::SparseWilsonMatrix<vec>;
+
+  for (const auto& filename : {"caffeine.xyz", "glycerol.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+    const vec x_c{to_cartesian<vec3, vec>(mol)};
+
+    const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+    const Primitives<vec3> p{primitives(bounded_distance_matrix(adj), mol)};
+
+    const mat B{wilson::wilson_matrix<vec3, vec, mat>(x_c,
+                                                      p.bonds,
+                                                      p.angles,
+                                                      p.dihedrals,
+                                                      p.linear_angles,
+                                                      p.out_of_plane_bends)};
+    const sparse B_sparse{wilson::to_sparse<vec>(B)};
+
+    const std::size_t n_irc{linalg::n_rows(B)};
+    const std::size_t n_c{linalg::size(x_c)};
+
+    // Gradient transformations
+    vec grad_c{linalg::zeros<vec>(n_c)};
+    for (std::size_t i{0}; i < n_c; i++) {
+      grad_c(i) = std::sin(i + 1.);
+    }
+
+    const vec g{gradient_cartesian_to_irc<vec, mat>(grad_c, B)};
+    const vec g_sparse{gradient_cartesian_to_irc(grad_c, B_sparse)};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      CHECK(g_sparse(i) == Approx(g(i)).margin(1e-6));
+    }
+
+    const vec gc{gradient_irc_to_cartesian<vec, mat>(g, B)};
+    const vec gc_sparse{gradient_irc_to_cartesian(g, B_sparse)};
+    for (std::size_t i{0}; i < n_c; i++) {
+      CHECK(gc_sparse(i) == Approx(gc(i)).margin(1e-10));
+    }
+
+    // Back-transformation of a small stretch of the first bond
+    const vec q{cartesian_to_irc<vec3, vec>(x_c,
+                                            p.bonds,
+                                            p.angles,
+                                            p.dihedrals,
+                                            p.linear_angles,
+                                            p.out_of_plane_bends)};
+    vec dq{linalg::zeros<vec>(n_irc)};
+    dq(0) = 0.01;
+
+    const auto result = irc_to_cartesian<vec3, vec, mat>(q,
+                                                         dq,
+                                                         x_c,
+                                                         p.bonds,
+                                                         p.angles,
+                                                         p.dihedrals,
+                                                         p.linear_angles,
+                                                         p.out_of_plane_bends);
+    const auto result_sparse =
+        irc_to_cartesian<vec3, vec, sparse>(q,
+                                            dq,
+                                            x_c,
+                                            p.bonds,
+                                            p.angles,
+                                            p.dihedrals,
+                                            p.linear_angles,
+                                            p.out_of_plane_bends);
+
+    CHECK(result_sparse.converged == result.converged);
+    for (std::size_t i{0}; i < n_c; i++) {
+      CHECK(result_sparse.x_c(i) == Approx(result.x_c(i)).margin(1e-6));
+    }
+  }
+}
+
+TEST_CASE("Transformation with matrix-free Wilson B matrix") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace transformation;
+  using namespace io;
+
+  using matrix_free = wilson::WilsonOperator<vec3, vec>;
+
+  const auto mol = load_xyz<vec3>(config::molecules_dir + "glycerol.xyz");
+  const vec x_c{to_cartesian<vec3, vec>(mol)};
+
+  const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+  const Primitives<vec3> p{primitives(bounded_distance_matrix(adj), mol)};
+  const boost::optional<periodic::Lattice<vec3>> lattice{boost::none};
+
+  const mat B{wilson::wilson_matrix<vec3, vec, mat>(x_c,
+                                                    p.bonds,
+                                                    p.angles,
+                                                    p.dihedrals,
+                                                    p.linear_angles,
+                                                    p.out_of_plane_bends)};
+  const matrix_free B_op(x_c,
+                         p.bonds,
+                         p.angles,
+                         p.dihedrals,
+                         p.linear_angles,
+                         p.out_of_plane_bends,
+                         lattice);
+
+  const std::size_t n_irc{linalg::n_rows(B)};
+  const std::size_t n_c{linalg::size(x_c)};
+
+  // Gradient transformations
+  vec grad_c{linalg::zeros<vec>(n_c)};
+  for (std::size_t i{0}; i < n_c; i++) {
+    grad_c(i) = std::sin(i + 1.);
+  }
+
+  const vec g{gradient_cartesian_to_irc<vec, mat>(grad_c, B)};
+  const vec g_op{gradient_cartesian_to_irc(grad_c, B_op)};
+  for (std::size_t i{0}; i < n_irc; i++) {
+    CHECK(g_op(i) == Approx(g(i)).margin(1e-6));
+  }
+
+  const vec gc{gradient_irc_to_cartesian<vec, mat>(g, B)};
+  const vec gc_op{gradient_irc_to_cartesian(g, B_op)};
+  for (std::size_t i{0}; i < n_c; i++) {
+    CHECK(gc_op(i) == Approx(gc(i)).margin(1e-10));
+  }
+
+  // Back-transformation of a small stretch of the first bond
+  const vec q{cartesian_to_irc<vec3, vec>(x_c,
+                                          p.bonds,
+                                          p.angles,
+                                          p.dihedrals,
+                                          p.linear_angles,
+                                          p.out_of_plane_bends)};
+  vec dq{linalg::zeros<vec>(n_irc)};
+  dq(0) = 0.01;
+
+  const auto result = irc_to_cartesian<vec3, vec, mat>(q,
+                                                       dq,
+                                                       x_c,
+                                                       p.bonds,
+                                                       p.angles,
+                                                       p.dihedrals,
+                                                       p.linear_angles,
+                                                       p.out_of_plane_bends);
+  const auto result_op =
+      irc_to_cartesian<vec3, vec, matrix_free>(q,
+                                               dq,
+                                               x_c,
+                                               p.bonds,
+                                               p.angles,
+                                               p.dihedrals,
+                                               p.linear_angles,
+                                               p.out_of_plane_bends);
+
+  CHECK(result_op.converged == result.converged);
+  for (std::size_t i{0}; i < n_c; i++) {
+    CHECK(result_op.x_c(i) == Approx(result.x_c(i)).margin(1e-6));
+  }
+}
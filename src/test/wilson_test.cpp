@@ -11,6 +11,7 @@
 #include "config.h"
 
 #include <cmath>
+#include <stdexcept>
 
 #ifdef HAVE_ARMA
 #include <armadillo>
@@ -406,6 +407,651 @@ TEST_CASE("Wilson B matrix for water dimer", "[wilson]") {
   }
 }
 
+TEST_CASE("Low-rank projector", "[wilson]") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace wilson;
+  using namespace io;
+
+  for (const auto& filename : {"carbon_dioxide.xyz",
+                               "water_dimer_2.xyz",
+                               "caffeine.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+
+    const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+    const Primitives<vec3> p{primitives(bounded_distance_matrix(adj), mol)};
+
+    const mat B{wilson_matrix<vec3, vec, mat>(to_cartesian<vec3, vec>(mol),
+                                              p.bonds,
+                                              p.angles,
+                                              p.dihedrals,
+                                              p.linear_angles,
+                                              p.out_of_plane_bends)};
+    const std::size_t n_irc{linalg::n_rows(B)};
+
+    LowRankProjector<vec, mat> P_low(B);
+    CHECK(P_low.size() == n_irc);
+    CHECK(P_low.rank() <= 3 * mol.size() - 5);
+
+    // Pseudo-inverse of the transpose of B
+    const mat iBt{P_low.transpose_pseudo_inverse(B)};
+    const mat iBt_ref{linalg::pseudo_inverse<mat>(linalg::transpose(B))};
+    REQUIRE(linalg::size(iBt) == linalg::size(iBt_ref));
+    for (std::size_t i{0}; i < linalg::size(iBt); i++) {
+      CHECK(iBt(i) == Approx(iBt_ref(i)).margin(1e-8));
+    }
+
+    // Orthonormal basis
+    const mat UtU{linalg::transpose(P_low.basis()) * P_low.basis()};
+    const mat I{linalg::identity<mat>(P_low.rank())};
+    for (std::size_t i{0}; i < linalg::size(UtU); i++) {
+      CHECK(UtU(i) == Approx(I(i)).margin(1e-10));
+    }
+
+    // Unconstrained projector
+    const mat P{projector(B)};
+    const mat P_dense{P_low.dense()};
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK(P_dense(i) == Approx(P(i)).margin(1e-8));
+    }
+
+    // Projector from the sparse rows (eigendecomposition of B^T B)
+    const SparseWilsonMatrix<vec> B_sparse{to_sparse<vec>(B)};
+    const LowRankProjector<vec, mat> P_sparse(B_sparse);
+    CHECK(P_sparse.rank() == P_low.rank());
+
+    const mat P_sparse_dense{P_sparse.dense()};
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK(P_sparse_dense(i) == Approx(P(i)).margin(1e-8));
+    }
+
+    const mat iBt_sparse{P_sparse.transpose_pseudo_inverse(B_sparse)};
+    REQUIRE(linalg::size(iBt_sparse) == linalg::size(iBt_ref));
+    for (std::size_t i{0}; i < linalg::size(iBt_sparse); i++) {
+      CHECK(iBt_sparse(i) == Approx(iBt_ref(i)).margin(1e-8));
+    }
+
+    // Projection of a vector and of a matrix
+    vec x{linalg::zeros<vec>(n_irc)};
+    mat H{linalg::zeros<mat>(n_irc, n_irc)};
+    for (std::size_t j{0}; j < n_irc; j++) {
+      x(j) = std::sin(j + 1.);
+      for (std::size_t i{0}; i < n_irc; i++) {
+        H(i, j) = std::cos(i * j + 1.);
+      }
+    }
+
+    const vec Px{P_low * x};
+    const vec Px_ref{P * x};
+    const mat PH{P_low * H};
+    const mat PH_ref{P * H};
+    const mat PHP{P_low.project(H)};
+    const mat PHP_ref{P * H * P};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      CHECK(Px(i) == Approx(Px_ref(i)).margin(1e-8));
+    }
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK(PH(i) == Approx(PH_ref(i)).margin(1e-8));
+      CHECK(PHP(i) == Approx(PHP_ref(i)).margin(1e-8));
+    }
+
+    // Constrain the first bond and the first angle
+    mat C{linalg::zeros<mat>(n_irc, n_irc)};
+    C(0, 0) = 1.;
+    C(p.bonds.size(), p.bonds.size()) = 1.;
+
+    P_low.constrain({0, p.bonds.size()});
+
+    const mat PC{projector(B, C)};
+    const mat PC_dense{P_low.dense()};
+    CHECK_THROWS_AS(P_low.transpose_pseudo_inverse(B), std::runtime_error);
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK(PC_dense(i) == Approx(PC(i)).margin(1e-8));
+    }
+
+    // Projector from its basis
+    const auto P_basis = LowRankProjector<vec, mat>::from_basis(P_low.basis());
+    const vec PCx{P_low * x};
+    const vec PCx_basis{P_basis * x};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      CHECK(PCx_basis(i) == PCx(i));
+    }
+  }
+}
+
+TEST_CASE("Projector stored by fragment blocks", "[wilson]") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace wilson;
+  using namespace io;
+
+  for (const auto& filename : {"water_dimer_1.xyz",
+                               "water_dimer_2.xyz",
+                               "benzene_dimer.xyz",
+                               "caffeine.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+
+    const neighbors::NeighborList nl(mol, bonding_cutoff(mol));
+    const UGraph adj{adjacency_matrix(nl, mol)};
+    const BoundedDistanceMatrix bdist{bounded_distance_matrix(adj)};
+    const Primitives<vec3> p{primitives(bdist, mol)};
+
+    const mat B{wilson_matrix<vec3, vec, mat>(to_cartesian<vec3, vec>(mol),
+                                              p.bonds,
+                                              p.angles,
+                                              p.dihedrals,
+                                              p.linear_angles,
+                                              p.out_of_plane_bends)};
+    const std::size_t n_irc{linalg::n_rows(B)};
+
+    // Covalently bonded fragments
+    UGraph covalent(mol.size());
+    add_regular_bonds(covalent, nl, mol);
+
+    FragmentProjector<vec, mat> blocks(B, covalent.fragment_labels());
+    CHECK(blocks.size() == n_irc);
+    CHECK(blocks.n_fragments() == covalent.n_fragments());
+    CHECK(blocks.n_coupling() < n_irc);
+
+    // Unconstrained projector
+    const mat P{projector(B)};
+    const mat P_blocks{blocks.dense()};
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK(P_blocks(i) == Approx(P(i)).margin(1e-8));
+    }
+
+    // Blocks from the sparse rows, assigned to fragments from their atoms
+    const FragmentProjector<vec, mat> blocks_sparse(
+        sparse_wilson_matrix<vec3, vec>(to_cartesian<vec3, vec>(mol),
+                                        p.bonds,
+                                        p.angles,
+                                        p.dihedrals,
+                                        p.linear_angles,
+                                        p.out_of_plane_bends),
+        covalent.fragment_labels());
+    CHECK(blocks_sparse.n_fragments() == blocks.n_fragments());
+    CHECK(blocks_sparse.n_coupling() == blocks.n_coupling());
+
+    const mat P_sparse{blocks_sparse.dense()};
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK(P_sparse(i) == Approx(P(i)).margin(1e-8));
+    }
+
+    // Projection of a vector and of a matrix
+    vec x{linalg::zeros<vec>(n_irc)};
+    mat H{linalg::zeros<mat>(n_irc, n_irc)};
+    for (std::size_t j{0}; j < n_irc; j++) {
+      x(j) = std::sin(j + 1.);
+      for (std::size_t i{0}; i < n_irc; i++) {
+        H(i, j) = std::cos(i * j + 1.);
+      }
+    }
+
+    const vec Px{blocks * x};
+    const vec Px_ref{P * x};
+    const mat PHP{blocks.project(H)};
+    const mat PHP_ref{P * H * P};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      CHECK(Px(i) == Approx(Px_ref(i)).margin(1e-8));
+    }
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK(PHP(i) == Approx(PHP_ref(i)).margin(1e-8));
+    }
+
+    // Constrain the first bond and the first angle
+    mat C{linalg::zeros<mat>(n_irc, n_irc)};
+    C(0, 0) = 1.;
+    C(p.bonds.size(), p.bonds.size()) = 1.;
+
+    blocks.constrain({0, p.bonds.size()});
+
+    const mat PC{projector(B, C)};
+    const mat PC_blocks{blocks.dense()};
+    for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+      CHECK(PC_blocks(i) == Approx(PC(i)).margin(1e-8));
+    }
+  }
+}
+
+TEST_CASE("Projector with redundant constraints", "[wilson]") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace wilson;
+
+  // Planar formaldehyde: the gradients of the three angles around the
+  // carbon atom sum to zero
+  Molecule<vec3> mol{{"C", {0., 0., 0.}},
+                     {"O", {1.21, 0., 0.}},
+                     {"H", {-0.55, 0.94, 0.}},
+                     {"H", {-0.55, -0.94, 0.}}};
+  multiply_positions(mol, tools::conversion::angstrom_to_bohr);
+
+  const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+  const Primitives<vec3> p{primitives(bounded_distance_matrix(adj), mol)};
+  REQUIRE(p.angles.size() == 3);
+
+  const mat B{wilson_matrix<vec3, vec, mat>(to_cartesian<vec3, vec>(mol),
+                                            p.bonds,
+                                            p.angles,
+                                            p.dihedrals,
+                                            p.linear_angles,
+                                            p.out_of_plane_bends)};
+  const std::size_t n_irc{linalg::n_rows(B)};
+
+  std::vector<std::size_t> redundant;
+  mat C{linalg::zeros<mat>(n_irc, n_irc)};
+  for (std::size_t a{0}; a < p.angles.size(); a++) {
+    redundant.push_back(p.bonds.size() + a);
+    C(p.bonds.size() + a, p.bonds.size() + a) = 1.;
+  }
+
+  FragmentProjector<vec, mat> blocks(B, {0, 0, 0, 0});
+  blocks.constrain(redundant);
+
+  const mat PC{projector(B, C)};
+  const mat PC_blocks{blocks.dense()};
+  for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+    CHECK(std::isfinite(PC_blocks(i)));
+    CHECK(PC_blocks(i) == Approx(PC(i)).margin(1e-8));
+  }
+
+  LowRankProjector<vec, mat> P_low(B);
+  P_low.constrain(redundant);
+
+  const mat PC_low{P_low.dense()};
+  for (std::size_t i{0}; i < n_irc * n_irc; i++) {
+    CHECK(PC_low(i) == Approx(PC(i)).margin(1e-8));
+  }
+}
+
+TEST_CASE("Sparse Wilson B matrix", "[wilson]") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace wilson;
+  using namespace io;
+
+  for (const auto& filename : {"carbon_dioxide.xyz",
+                               "water_dimer_2.xyz",
+                               "benzene_dimer.xyz",
+                               "caffeine.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+    const vec x_c{to_cartesian<vec3, vec>(mol)};
+
+    const neighbors::NeighborList nl(mol, bonding_cutoff(mol));
+    const UGraph adj{adjacency_matrix(nl, mol)};
+    const BoundedDistanceMatrix bdist{bounded_distance_matrix(adj)};
+    const Primitives<vec3> p{primitives(bdist, mol)};
+
+    const mat B{wilson_matrix<vec3, vec, mat>(x_c,
+                                              p.bonds,
+                                              p.angles,
+                                              p.dihedrals,
+                                              p.linear_angles,
+                                              p.out_of_plane_bends)};
+    const SparseWilsonMatrix<vec> B_sparse{
+        sparse_wilson_matrix<vec3, vec>(x_c,
+                                        p.bonds,
+                                        p.angles,
+                                        p.dihedrals,
+                                        p.linear_angles,
+                                        p.out_of_plane_bends)};
+
+    const std::size_t n_irc{linalg::n_rows(B)};
+    const std::size_t n_c{linalg::size(x_c)};
+
+    REQUIRE(B_sparse.n_rows() == n_irc);
+    REQUIRE(B_sparse.n_cols() == n_c);
+
+    // Same elements
+    const mat B_dense{B_sparse.dense<mat>()};
+    const mat B_copy{to_sparse<vec>(B).dense<mat>()};
+    for (std::size_t i{0}; i < n_irc * n_c; i++) {
+      CHECK(B_dense(i) == B(i));
+      CHECK(B_copy(i) == B(i));
+    }
+
+    // Products with B and its transpose
+    vec x{linalg::zeros<vec>(n_c)};
+    for (std::size_t i{0}; i < n_c; i++) {
+      x(i) = std::sin(i + 1.);
+    }
+    vec y{linalg::zeros<vec>(n_irc)};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      y(i) = std::cos(i + 1.);
+    }
+
+    const vec Bx{B_sparse * x};
+    const vec Bx_ref{B * x};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      CHECK(Bx(i) == Approx(Bx_ref(i)).margin(1e-12));
+    }
+
+    const vec BTy{B_sparse.transpose_product(y)};
+    const vec BTy_ref{linalg::transpose(B) * y};
+    for (std::size_t i{0}; i < n_c; i++) {
+      CHECK(BTy(i) == Approx(BTy_ref(i)).margin(1e-12));
+    }
+
+    // Products with dense matrices and Gram matrix
+    mat M{linalg::zeros<mat>(n_c, 2)};
+    mat N{linalg::zeros<mat>(n_irc, 2)};
+    for (std::size_t j{0}; j < 2; j++) {
+      for (std::size_t i{0}; i < n_c; i++) {
+        M(i, j) = std::sin(i + j + 1.);
+      }
+      for (std::size_t i{0}; i < n_irc; i++) {
+        N(i, j) = std::cos(i + j + 1.);
+      }
+    }
+
+    const mat BM{B_sparse.matrix_product(M)};
+    const mat BM_ref{B * M};
+    for (std::size_t i{0}; i < linalg::size(BM_ref); i++) {
+      CHECK(BM(i) == Approx(BM_ref(i)).margin(1e-12));
+    }
+
+    const mat BtN{B_sparse.transpose_matrix_product(N)};
+    const mat BtN_ref{linalg::transpose(B) * N};
+    for (std::size_t i{0}; i < linalg::size(BtN_ref); i++) {
+      CHECK(BtN(i) == Approx(BtN_ref(i)).margin(1e-12));
+    }
+
+    const mat G{B_sparse.gram<mat>()};
+    const mat G_ref{linalg::transpose(B) * B};
+    for (std::size_t i{0}; i < n_c * n_c; i++) {
+      CHECK(G(i) == Approx(G_ref(i)).margin(1e-12));
+    }
+
+    // Least-squares solutions (pseudo-inverses)
+    const vec iBy{B_sparse.solve(y)};
+    const vec iBy_ref{linalg::pseudo_inverse(B) * y};
+    for (std::size_t i{0}; i < n_c; i++) {
+      CHECK(iBy(i) == Approx(iBy_ref(i)).margin(1e-6));
+    }
+
+    const vec iBTx{B_sparse.solve_transpose(x)};
+    const vec iBTx_ref{linalg::pseudo_inverse(linalg::transpose(B)) * x};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      CHECK(iBTx(i) == Approx(iBTx_ref(i)).margin(1e-6));
+    }
+  }
+}
+
+TEST_CASE("Matrix-free Wilson B matrix", "[wilson]") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace wilson;
+  using namespace io;
+
+  for (const auto& filename :
+       {"carbon_dioxide.xyz", "benzene_dimer.xyz", "caffeine.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+    const vec x_c{to_cartesian<vec3, vec>(mol)};
+
+    const neighbors::NeighborList nl(mol, bonding_cutoff(mol));
+    const UGraph adj{adjacency_matrix(nl, mol)};
+    const BoundedDistanceMatrix bdist{bounded_distance_matrix(adj)};
+    const Primitives<vec3> p{primitives(bdist, mol)};
+
+    const mat B{wilson_matrix<vec3, vec, mat>(x_c,
+                                              p.bonds,
+                                              p.angles,
+                                              p.dihedrals,
+                                              p.linear_angles,
+                                              p.out_of_plane_bends)};
+    // The lattice is copied: a temporary can be given
+    const WilsonOperator<vec3, vec> B_op(x_c,
+                                         p.bonds,
+                                         p.angles,
+                                         p.dihedrals,
+                                         p.linear_angles,
+                                         p.out_of_plane_bends,
+                                         boost::none);
+
+    const std::size_t n_irc{linalg::n_rows(B)};
+    const std::size_t n_c{linalg::size(x_c)};
+
+    REQUIRE(B_op.n_rows() == n_irc);
+    REQUIRE(B_op.n_cols() == n_c);
+
+    vec x{linalg::zeros<vec>(n_c)};
+    for (std::size_t i{0}; i < n_c; i++) {
+      x(i) = std::sin(i + 1.);
+    }
+    vec y{linalg::zeros<vec>(n_irc)};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      y(i) = std::cos(i + 1.);
+    }
+
+    // Products with B and its transpose
+    const vec Bx{B_op * x};
+    const vec Bx_ref{B * x};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      CHECK(Bx(i) == Approx(Bx_ref(i)).margin(1e-12));
+    }
+
+    const vec BTy{B_op.transpose_product(y)};
+    const vec BTy_ref{linalg::transpose(B) * y};
+    for (std::size_t i{0}; i < n_c; i++) {
+      CHECK(BTy(i) == Approx(BTy_ref(i)).margin(1e-12));
+    }
+
+    // Least-squares solutions (pseudo-inverses)
+    const vec iBy{B_op.solve(y)};
+    const vec iBy_ref{linalg::pseudo_inverse(B) * y};
+    for (std::size_t i{0}; i < n_c; i++) {
+      CHECK(iBy(i) == Approx(iBy_ref(i)).margin(1e-6));
+    }
+
+    const vec iBTx{B_op.solve_transpose(x)};
+    const vec iBTx_ref{linalg::pseudo_inverse(linalg::transpose(B)) * x};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      CHECK(iBTx(i) == Approx(iBTx_ref(i)).margin(1e-6));
+    }
+
+    CHECK_THROWS_AS(B_op * y, std::length_error);
+  }
+}
+
+TEST_CASE("Internal coordinates and Wilson B matrix", "[wilson]") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace wilson;
+  using namespace io;
+
+  for (const auto& filename : {"carbon_dioxide.xyz", "caffeine.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+    const vec x_c{to_cartesian<vec3, vec>(mol)};
+
+    const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+    const Primitives<vec3> p{primitives(bounded_distance_matrix(adj), mol)};
+
+    const vec q{cartesian_to_irc<vec3, vec>(x_c,
+                                            p.bonds,
+                                            p.angles,
+                                            p.dihedrals,
+                                            p.linear_angles,
+                                            p.out_of_plane_bends)};
+    const mat B{wilson_matrix<vec3, vec, mat>(x_c,
+                                              p.bonds,
+                                              p.angles,
+                                              p.dihedrals,
+                                              p.linear_angles,
+                                              p.out_of_plane_bends)};
+
+    const auto e = evaluate<vec3, vec, mat>(x_c,
+                                            p.bonds,
+                                            p.angles,
+                                            p.dihedrals,
+                                            p.linear_angles,
+                                            p.out_of_plane_bends);
+    const auto e_sparse = sparse_evaluate<vec3, vec>(x_c,
+                                                     p.bonds,
+                                                     p.angles,
+                                                     p.dihedrals,
+                                                     p.linear_angles,
+                                                     p.out_of_plane_bends);
+
+    REQUIRE(linalg::size(e.q) == linalg::size(q));
+    REQUIRE(linalg::size(e_sparse.q) == linalg::size(q));
+    for (std::size_t i{0}; i < linalg::size(q); i++) {
+      CHECK(e.q(i) == Approx(q(i)).margin(1e-12));
+      CHECK(e_sparse.q(i) == Approx(q(i)).margin(1e-12));
+    }
+
+    const mat B_sparse{e_sparse.B.dense<mat>()};
+    REQUIRE(linalg::size(e.B) == linalg::size(B));
+    REQUIRE(linalg::size(B_sparse) == linalg::size(B));
+    for (std::size_t i{0}; i < linalg::size(B); i++) {
+      CHECK(e.B(i) == B(i));
+      CHECK(B_sparse(i) == B(i));
+    }
+  }
+}
+
+TEST_CASE("Internal coordinates involving every atom", "[wilson]") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace wilson;
+  using namespace io;
+
+  const auto mol = load_xyz<vec3>(config::molecules_dir + "caffeine.xyz");
+  const vec x_c{to_cartesian<vec3, vec>(mol)};
+
+  const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+  const Primitives<vec3> p{primitives(bounded_distance_matrix(adj), mol)};
+
+  const auto atoms = incidence(mol.size(),
+                               p.bonds,
+                               p.angles,
+                               p.dihedrals,
+                               p.linear_angles,
+                               p.out_of_plane_bends);
+  REQUIRE(atoms.size() == mol.size());
+
+  // Atoms with nonzero gradients
+  const mat B{wilson_matrix<vec3, vec, mat>(x_c,
+                                            p.bonds,
+                                            p.angles,
+                                            p.dihedrals,
+                                            p.linear_angles,
+                                            p.out_of_plane_bends)};
+  for (std::size_t a{0}; a < mol.size(); a++) {
+    CAPTURE(a);
+
+    std::vector<std::size_t> rows;
+    for (std::size_t i{0}; i < linalg::n_rows(B); i++) {
+      if (B(i, 3 * a) != 0. or B(i, 3 * a + 1) != 0. or B(i, 3 * a + 2) != 0.) {
+        rows.push_back(i);
+      }
+    }
+
+    CHECK(atoms[a] == rows);
+  }
+
+  // Numerical B matrix from the internal coordinates of every atom
+  const mat B_numerical{
+      wilson_matrix_numerical<vec3, vec, mat>(x_c,
+                                              p.bonds,
+                                              p.angles,
+                                              p.dihedrals,
+                                              p.linear_angles,
+                                              p.out_of_plane_bends)};
+  for (std::size_t i{0}; i < linalg::size(B); i++) {
+    CHECK(B_numerical(i) == Approx(B(i)).margin(1e-6));
+  }
+}
+
+TEST_CASE("Derivative of the Wilson B matrix", "[wilson]") {
+  using namespace connectivity;
+  using namespace molecule;
+  using namespace wilson;
+  using namespace io;
+
+  for (const auto& filename :
+       {"carbon_dioxide.xyz", "formaldehyde.xyz", "ethanol.xyz"}) {
+    CAPTURE(filename);
+
+    const auto mol = load_xyz<vec3>(config::molecules_dir + filename);
+    const vec x_c{to_cartesian<vec3, vec>(mol)};
+
+    const UGraph adj{adjacency_matrix(distances<vec3, mat>(mol), mol)};
+    const Primitives<vec3> p{primitives(bounded_distance_matrix(adj), mol)};
+
+    auto B = [&p](const vec& x) {
+      return wilson_matrix<vec3, vec, mat>(x,
+                                           p.bonds,
+                                           p.angles,
+                                           p.dihedrals,
+                                           p.linear_angles,
+                                           p.out_of_plane_bends);
+    };
+
+    const WilsonDerivative<vec> dB{
+        wilson_derivative<vec3, vec>(x_c,
+                                     p.bonds,
+                                     p.angles,
+                                     p.dihedrals,
+                                     p.linear_angles,
+                                     p.out_of_plane_bends)};
+
+    const std::size_t n_irc{linalg::n_rows(B(x_c))};
+    const std::size_t n_c{linalg::size(x_c)};
+
+    REQUIRE(dB.n_rows() == n_irc);
+    REQUIRE(dB.n_cols() == n_c);
+
+    // Central finite differences of the analytic gradients
+    const double dx{1e-5};
+    std::vector<mat> dB_numerical(n_c);
+    for (std::size_t j{0}; j < n_c; j++) {
+      vec x_p{x_c}, x_m{x_c};
+      x_p(j) += dx;
+      x_m(j) -= dx;
+
+      dB_numerical[j] = (B(x_p) - B(x_m)) / (2. * dx);
+    }
+
+    for (std::size_t i{0}; i < n_irc; i++) {
+      CAPTURE(i);
+
+      const mat H{dB.hessian<mat>(i)};
+      for (std::size_t j{0}; j < n_c; j++) {
+        for (std::size_t k{0}; k < n_c; k++) {
+          CHECK(H(j, k) == Approx(H(k, j)).margin(1e-10));
+          CHECK(H(j, k) == Approx(dB_numerical[j](i, k)).margin(1e-5));
+        }
+      }
+    }
+
+    // Contraction with the rows
+    vec w{linalg::zeros<vec>(n_irc)};
+    for (std::size_t i{0}; i < n_irc; i++) {
+      w(i) = std::cos(i + 1.);
+    }
+
+    const mat K{dB.contract<mat>(w)};
+    for (std::size_t j{0}; j < n_c; j++) {
+      const vec K_numerical{linalg::transpose(dB_numerical[j]) * w};
+      for (std::size_t k{0}; k < n_c; k++) {
+        CHECK(K(j, k) == Approx(K_numerical(k)).margin(1e-5));
+      }
+    }
+
+    CHECK_THROWS_AS(dB.contract<mat>(x_c), std::length_error);
+  }
+}
+
 TEST_CASE("Linear angle gradient", "[wilson]") {
   using namespace connectivity;
   using namespace molecule;